@@ -0,0 +1,1178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <net/ethernet.h>
+#include <arpa/inet.h>
+#include "net/ip/parser.h"
+#include "net/ip/flow.h"
+#include "net/ip/tcp/connections.h"
+#include "net/ip/tcp/streams.h"
+#include "net/capture/callback.h"
+
+// Stages.
+enum stage {
+  stage_parser = 1 << 0,      // net::ip::parser.
+  stage_connections = 1 << 1, // net::ip::tcp::connections.
+  stage_streams = 1 << 2,     // net::ip::tcp::streams.
+  stage_pipeline = 1 << 3,    // Parser + streams.
+  stage_batch = 1 << 4,       // Batched parser vs scalar parser.
+  stage_all = stage_parser |
+              stage_connections |
+              stage_streams |
+              stage_pipeline |
+              stage_batch
+};
+
+// Maximum number of entries in the packet-size mix.
+static constexpr const size_t max_sizes = 16;
+
+// Minimum frame size.
+static constexpr const size_t min_frame_size = 64;
+
+// Maximum frame size.
+static constexpr const size_t max_frame_size = 9014;
+
+// Maximum size of the headers (ethernet + IPv6 + fragment + TCP).
+static constexpr const size_t max_header_size = 14 + 40 + 8 + 20;
+
+// Options.
+struct options {
+  // Number of frames.
+  size_t npackets;
+
+  // Number of flows.
+  size_t nflows;
+
+  // Packet-size mix (frame sizes and weights).
+  size_t sizes[max_sizes];
+  unsigned weights[max_sizes];
+  size_t nsizes;
+
+  // Percentage of IPv6 flows.
+  double ipv6;
+
+  // Percentage of TCP flows.
+  double tcp;
+
+  // Percentage of UDP datagrams which are fragmented.
+  double fragments;
+
+  // Percentage of TCP segments which are sent out of order.
+  double out_of_order;
+
+  // Seed of the pseudo-random number generator.
+  uint64_t seed;
+
+  // Stages to benchmark.
+  unsigned stages;
+};
+
+// Flow.
+struct flow {
+  // Index of the flow (used to derive the addresses and ports).
+  uint32_t idx;
+
+  // IPv6?
+  bool ipv6;
+
+  // TCP?
+  bool tcp;
+
+  // TCP: number of handshake packets sent (3: established).
+  unsigned handshake;
+
+  // TCP: next sequence number of the client and of the server.
+  uint32_t seq[2];
+
+  // TCP: segment held back (out of order).
+  bool pending;
+  bool pending_from_client;
+  uint32_t pending_seq;
+  size_t pending_len;
+};
+
+// Synthetic traffic generator.
+struct generator {
+  // Options.
+  const options* opts;
+
+  // State of the pseudo-random number generator.
+  uint64_t state;
+
+  // Flows.
+  flow* flows;
+
+  // Frame buffer.
+  uint8_t* buf;
+  size_t used;
+
+  // Frames.
+  net::capture::frame* frames;
+  size_t nframes;
+
+  // Timestamp of the next frame.
+  uint64_t timestamp;
+
+  // IP identifier of the next fragmented datagram.
+  uint32_t id;
+
+  // Sum of the weights of the packet-size mix.
+  unsigned total_weight;
+};
+
+// Totals of the batch stage (to check that both parsers agree).
+struct batch_totals {
+  size_t npackets;
+  uint64_t tcp_bytes;
+  uint32_t hashes;
+  size_t ndeferred;
+};
+
+// TCP segment (parsed in advance for the stages which don't use the parser).
+struct segment {
+  const void* iphdr;
+  const struct tcphdr* tcphdr;
+  const void* payload;
+  uint16_t payloadlen;
+  uint64_t timestamp;
+  bool ipv6;
+};
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static bool parse_sizes(const char* s, options& opts);
+static bool parse_percentage(const char* s, double& n);
+static bool parse_number(const char* s,
+                         uint64_t min,
+                         uint64_t max,
+                         uint64_t& n);
+
+static void usage(const char* program);
+
+static bool generate(generator& gen);
+static void generate_tcp(generator& gen, flow& f);
+static void generate_udp(generator& gen, const flow& f);
+
+static uint8_t* add_frame(generator& gen,
+                          const flow& f,
+                          bool from_client,
+                          uint8_t protocol,
+                          size_t l3len,
+                          bool fragment,
+                          uint16_t offset,
+                          bool more);
+
+static size_t payload_length(generator& gen, const flow& f);
+static bool chance(generator& gen, double percentage);
+static uint64_t next_random(generator& gen);
+
+static size_t parse_segments(const generator& gen, segment* segments);
+
+static void bench_parser(const generator& gen);
+static void bench_connections(const generator& gen,
+                              const segment* segments,
+                              size_t nsegments);
+
+static void bench_streams(const generator& gen,
+                          const segment* segments,
+                          size_t nsegments);
+
+static void bench_pipeline(const generator& gen);
+static void bench_batch(const generator& gen);
+static void parse_scalar(const generator& gen, batch_totals& totals);
+static void parse_batch(const generator& gen, batch_totals& totals);
+
+static bool init_streams(const generator& gen,
+                         net::ip::tcp::streams& streams);
+
+static bool beginstreamfn(const net::ip::tcp::connection* conn,
+                          net::ip::tcp::direction dir,
+                          void*& user);
+
+static void endstreamfn(const net::ip::tcp::connection* conn,
+                        net::ip::tcp::direction dir,
+                        void* user);
+
+static bool payloadfn(const void* payload,
+                      uint16_t payloadlen,
+                      uint64_t offset,
+                      const net::ip::tcp::connection* conn,
+                      net::ip::tcp::direction dir,
+                      void* user);
+
+static bool gapfn(uint32_t gapsize,
+                  uint64_t offset,
+                  const net::ip::tcp::connection* conn,
+                  net::ip::tcp::direction dir,
+                  void* user);
+
+static void show_results(const char* name,
+                         size_t npackets,
+                         uint64_t start,
+                         uint64_t end);
+
+static uint64_t peak_rss();
+static uint64_t now();
+
+// Number of payload bytes delivered by the TCP streams.
+static uint64_t stream_bytes = 0;
+
+int main(int argc, const char** argv)
+{
+  // Parse arguments.
+  options opts;
+  if (parse_arguments(argc, argv, opts)) {
+    generator gen;
+    gen.opts = &opts;
+
+    // Generate synthetic traffic.
+    if (generate(gen)) {
+      printf("%zu frames (%.1f MiB), %zu flows, peak RSS: %.1f MiB.\n",
+             gen.nframes,
+             gen.used / (1024.0 * 1024.0),
+             opts.nflows,
+             peak_rss() / 1024.0);
+
+      int ret = 0;
+
+      if (opts.stages & stage_parser) {
+        bench_parser(gen);
+      }
+
+      if (opts.stages & (stage_connections | stage_streams)) {
+        // Parse the TCP segments in advance.
+        segment* segments = static_cast<segment*>(
+                              malloc(gen.nframes * sizeof(segment))
+                            );
+
+        if (segments) {
+          const size_t nsegments = parse_segments(gen, segments);
+
+          if (opts.stages & stage_connections) {
+            bench_connections(gen, segments, nsegments);
+          }
+
+          if (opts.stages & stage_streams) {
+            bench_streams(gen, segments, nsegments);
+          }
+
+          free(segments);
+        } else {
+          fprintf(stderr, "Error allocating memory.\n");
+          ret = -1;
+        }
+      }
+
+      if (opts.stages & stage_pipeline) {
+        bench_pipeline(gen);
+      }
+
+      if (opts.stages & stage_batch) {
+        bench_batch(gen);
+      }
+
+      free(gen.frames);
+      free(gen.buf);
+      free(gen.flows);
+
+      return ret;
+    } else {
+      fprintf(stderr, "Error allocating memory.\n");
+    }
+  }
+
+  return -1;
+}
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  opts.npackets = 1000000;
+  opts.nflows = 10000;
+  opts.nsizes = 0;
+  opts.ipv6 = 20;
+  opts.tcp = 80;
+  opts.fragments = 1;
+  opts.out_of_order = 1;
+  opts.seed = 1;
+  opts.stages = stage_all;
+
+  // Default packet-size mix (simple IMIX).
+  parse_sizes("64:7,576:4,1500:1", opts);
+
+  int i = 1;
+  while (i < argc) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return false;
+    }
+
+    uint64_t n;
+
+    if (strcasecmp(argv[i], "--packets") == 0) {
+      if (!parse_number(argv[i + 1], 1, 100000000, n)) {
+        fprintf(stderr, "Invalid number of packets '%s'.\n", argv[i + 1]);
+        return false;
+      }
+
+      opts.npackets = n;
+    } else if (strcasecmp(argv[i], "--flows") == 0) {
+      if (!parse_number(argv[i + 1],
+                        1,
+                        net::ip::tcp::connections::max_connections / 2,
+                        n)) {
+        fprintf(stderr, "Invalid number of flows '%s'.\n", argv[i + 1]);
+        return false;
+      }
+
+      opts.nflows = n;
+    } else if (strcasecmp(argv[i], "--sizes") == 0) {
+      if (!parse_sizes(argv[i + 1], opts)) {
+        fprintf(stderr, "Invalid packet-size mix '%s'.\n", argv[i + 1]);
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--ipv6") == 0) {
+      if (!parse_percentage(argv[i + 1], opts.ipv6)) {
+        fprintf(stderr, "Invalid percentage '%s'.\n", argv[i + 1]);
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--tcp") == 0) {
+      if (!parse_percentage(argv[i + 1], opts.tcp)) {
+        fprintf(stderr, "Invalid percentage '%s'.\n", argv[i + 1]);
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--fragments") == 0) {
+      if (!parse_percentage(argv[i + 1], opts.fragments)) {
+        fprintf(stderr, "Invalid percentage '%s'.\n", argv[i + 1]);
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--out-of-order") == 0) {
+      if (!parse_percentage(argv[i + 1], opts.out_of_order)) {
+        fprintf(stderr, "Invalid percentage '%s'.\n", argv[i + 1]);
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--seed") == 0) {
+      if (!parse_number(argv[i + 1], 1, UINT64_MAX, n)) {
+        fprintf(stderr, "Invalid seed '%s'.\n", argv[i + 1]);
+        return false;
+      }
+
+      opts.seed = n;
+    } else if (strcasecmp(argv[i], "--stage") == 0) {
+      if (strcasecmp(argv[i + 1], "parser") == 0) {
+        opts.stages = stage_parser;
+      } else if (strcasecmp(argv[i + 1], "connections") == 0) {
+        opts.stages = stage_connections;
+      } else if (strcasecmp(argv[i + 1], "streams") == 0) {
+        opts.stages = stage_streams;
+      } else if (strcasecmp(argv[i + 1], "pipeline") == 0) {
+        opts.stages = stage_pipeline;
+      } else if (strcasecmp(argv[i + 1], "batch") == 0) {
+        opts.stages = stage_batch;
+      } else if (strcasecmp(argv[i + 1], "all") == 0) {
+        opts.stages = stage_all;
+      } else {
+        fprintf(stderr, "Invalid stage '%s'.\n", argv[i + 1]);
+        return false;
+      }
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+
+    i += 2;
+  }
+
+  return true;
+}
+
+bool parse_sizes(const char* s, options& opts)
+{
+  // Format: <frame-size>:<weight>[,<frame-size>:<weight>]...
+  size_t nsizes = 0;
+  size_t sizes[max_sizes];
+  unsigned weights[max_sizes];
+
+  do {
+    if (nsizes == max_sizes) {
+      return false;
+    }
+
+    char* end;
+    const unsigned long size = strtoul(s, &end, 10);
+    if ((end == s) ||
+        (*end != ':') ||
+        (size < min_frame_size) ||
+        (size > max_frame_size)) {
+      return false;
+    }
+
+    s = end + 1;
+
+    const unsigned long weight = strtoul(s, &end, 10);
+    if ((end == s) || (weight < 1) || (weight > 1000)) {
+      return false;
+    }
+
+    sizes[nsizes] = size;
+    weights[nsizes++] = weight;
+
+    if (*end == 0) {
+      memcpy(opts.sizes, sizes, nsizes * sizeof(size_t));
+      memcpy(opts.weights, weights, nsizes * sizeof(unsigned));
+      opts.nsizes = nsizes;
+
+      return true;
+    } else if (*end != ',') {
+      return false;
+    }
+
+    s = end + 1;
+  } while (true);
+}
+
+bool parse_percentage(const char* s, double& n)
+{
+  char* end;
+  n = strtod(s, &end);
+
+  return ((end != s) && (*end == 0) && (n >= 0) && (n <= 100));
+}
+
+bool parse_number(const char* s, uint64_t min, uint64_t max, uint64_t& n)
+{
+  char* end;
+  n = strtoull(s, &end, 10);
+
+  return ((end != s) && (*end == 0) && (n >= min) && (n <= max));
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--packets <number>] [--flows <number>] "
+          "[--sizes <frame-size>:<weight>[,<frame-size>:<weight>]...] "
+          "[--ipv6 <percentage>] [--tcp <percentage>] "
+          "[--fragments <percentage>] [--out-of-order <percentage>] "
+          "[--seed <number>] "
+          "[--stage parser|connections|streams|pipeline|batch|all]\n",
+          program);
+}
+
+bool generate(generator& gen)
+{
+  const options& opts = *gen.opts;
+
+  gen.state = opts.seed;
+  gen.used = 0;
+  gen.nframes = 0;
+  gen.timestamp = 1500000000ull * 1000000ull;
+  gen.id = 1;
+
+  gen.total_weight = 0;
+  for (size_t i = 0; i < opts.nsizes; i++) {
+    gen.total_weight += opts.weights[i];
+  }
+
+  // A fragmented datagram takes two frames, so the last datagram might
+  // need an extra frame.
+  const size_t maxframes = opts.npackets + 1;
+
+  // Upper bound of the frame size (the headers might not fit in the
+  // smallest frames and the fragments have an extra header).
+  size_t maxsize = 0;
+  for (size_t i = 0; i < opts.nsizes; i++) {
+    if (opts.sizes[i] > maxsize) {
+      maxsize = opts.sizes[i];
+    }
+  }
+
+  maxsize += max_header_size;
+
+  // Only the pages actually used become resident.
+  gen.flows = static_cast<flow*>(malloc(opts.nflows * sizeof(flow)));
+  gen.buf = static_cast<uint8_t*>(malloc(maxframes * maxsize));
+  gen.frames = static_cast<net::capture::frame*>(
+                 malloc(maxframes * sizeof(net::capture::frame))
+               );
+
+  if ((gen.flows) && (gen.buf) && (gen.frames)) {
+    // Create flows.
+    for (size_t i = 0; i < opts.nflows; i++) {
+      flow& f = gen.flows[i];
+
+      f.idx = i;
+      f.ipv6 = chance(gen, opts.ipv6);
+      f.tcp = chance(gen, opts.tcp);
+      f.handshake = 0;
+      f.seq[0] = static_cast<uint32_t>(next_random(gen));
+      f.seq[1] = static_cast<uint32_t>(next_random(gen));
+      f.pending = false;
+    }
+
+    // Generate frames.
+    while (gen.nframes < opts.npackets) {
+      flow& f = gen.flows[next_random(gen) % opts.nflows];
+
+      if (f.tcp) {
+        generate_tcp(gen, f);
+      } else {
+        generate_udp(gen, f);
+      }
+    }
+
+    return true;
+  }
+
+  free(gen.frames);
+  free(gen.buf);
+  free(gen.flows);
+
+  return false;
+}
+
+void generate_tcp(generator& gen, flow& f)
+{
+  bool from_client;
+  uint32_t seq;
+  size_t len;
+  uint8_t flags;
+
+  // If the connection has not been established yet...
+  if (f.handshake < 3) {
+    // SYN, SYN + ACK, ACK.
+    static constexpr const uint8_t handshake_flags[] = {
+      TH_SYN, TH_SYN | TH_ACK, TH_ACK
+    };
+
+    from_client = (f.handshake != 1);
+    flags = handshake_flags[f.handshake];
+    len = 0;
+
+    seq = f.seq[from_client ? 0 : 1];
+
+    // The SYN flag consumes one sequence number.
+    if (flags & TH_SYN) {
+      f.seq[from_client ? 0 : 1]++;
+    }
+
+    f.handshake++;
+  } else if (f.pending) {
+    // Send the segment which was held back.
+    from_client = f.pending_from_client;
+    seq = f.pending_seq;
+    len = f.pending_len;
+    flags = TH_ACK | TH_PUSH;
+
+    f.pending = false;
+  } else {
+    from_client = ((next_random(gen) & 1) == 0);
+    len = payload_length(gen, f);
+    flags = TH_ACK | TH_PUSH;
+
+    uint32_t& next = f.seq[from_client ? 0 : 1];
+
+    // If the segment has to be sent out of order...
+    if ((len > 0) && (chance(gen, gen.opts->out_of_order))) {
+      // Hold back a segment of the same length and send the next one first.
+      f.pending = true;
+      f.pending_from_client = from_client;
+      f.pending_seq = next;
+      f.pending_len = len;
+
+      next += len;
+    }
+
+    seq = next;
+    next += len;
+  }
+
+  uint8_t* const p = add_frame(gen,
+                               f,
+                               from_client,
+                               IPPROTO_TCP,
+                               sizeof(struct tcphdr) + len,
+                               false,
+                               0,
+                               false);
+
+  struct tcphdr* const tcphdr = reinterpret_cast<struct tcphdr*>(p);
+  memset(tcphdr, 0, sizeof(struct tcphdr));
+
+  const uint16_t client_port = htons(1024 + (f.idx % 64000));
+  const uint16_t server_port = htons(80);
+
+  tcphdr->source = from_client ? client_port : server_port;
+  tcphdr->dest = from_client ? server_port : client_port;
+  tcphdr->seq = htonl(seq);
+  tcphdr->ack_seq = (flags & TH_ACK) ? htonl(f.seq[from_client ? 1 : 0]) : 0;
+  tcphdr->doff = sizeof(struct tcphdr) >> 2;
+  tcphdr->th_flags = flags;
+  tcphdr->window = htons(65535);
+
+  memset(p + sizeof(struct tcphdr), 0x5a, len);
+}
+
+void generate_udp(generator& gen, const flow& f)
+{
+  // Build datagram.
+  static uint8_t datagram[max_frame_size];
+
+  const size_t len = sizeof(struct udphdr) + payload_length(gen, f);
+
+  const bool from_client = ((next_random(gen) & 1) == 0);
+
+  const uint16_t client_port = htons(1024 + (f.idx % 64000));
+  const uint16_t server_port = htons(53);
+
+  struct udphdr* const udphdr = reinterpret_cast<struct udphdr*>(datagram);
+  udphdr->source = from_client ? client_port : server_port;
+  udphdr->dest = from_client ? server_port : client_port;
+  udphdr->len = htons(len);
+  udphdr->check = 0;
+
+  memset(datagram + sizeof(struct udphdr), 0xa5, len - sizeof(struct udphdr));
+
+  // If the datagram has to be fragmented (and it is big enough)...
+  if ((len >= 16) && (chance(gen, gen.opts->fragments))) {
+    // Two fragments (the size of the first one must be a multiple of 8).
+    const size_t first = (len / 2) & ~static_cast<size_t>(7);
+
+    memcpy(add_frame(gen, f, from_client, IPPROTO_UDP, first, true, 0, true),
+           datagram,
+           first);
+
+    memcpy(add_frame(gen,
+                     f,
+                     from_client,
+                     IPPROTO_UDP,
+                     len - first,
+                     true,
+                     first,
+                     false),
+           datagram + first,
+           len - first);
+
+    gen.id++;
+  } else {
+    memcpy(add_frame(gen, f, from_client, IPPROTO_UDP, len, false, 0, false),
+           datagram,
+           len);
+  }
+}
+
+uint8_t* add_frame(generator& gen,
+                   const flow& f,
+                   bool from_client,
+                   uint8_t protocol,
+                   size_t l3len,
+                   bool fragment,
+                   uint16_t offset,
+                   bool more)
+{
+  uint8_t* const frame = gen.buf + gen.used;
+  uint8_t* p = frame;
+
+  // Ethernet header.
+  struct ether_header* const eh = reinterpret_cast<struct ether_header*>(p);
+  memset(eh->ether_dhost, from_client ? 0x02 : 0x04, ETH_ALEN);
+  memset(eh->ether_shost, from_client ? 0x04 : 0x02, ETH_ALEN);
+  eh->ether_type = htons(f.ipv6 ? ETHERTYPE_IPV6 : ETHERTYPE_IP);
+
+  p += sizeof(struct ether_header);
+
+  if (!f.ipv6) {
+    // Client: 10.x.x.x, server: 172.16.x.x.
+    const uint32_t client = htonl(0x0a000000u | (f.idx & 0x00ffffffu));
+    const uint32_t server = htonl(0xac100000u | (f.idx & 0x0000ffffu));
+
+    struct iphdr* const iphdr = reinterpret_cast<struct iphdr*>(p);
+    memset(iphdr, 0, sizeof(struct iphdr));
+    iphdr->version = 4;
+    iphdr->ihl = sizeof(struct iphdr) >> 2;
+    iphdr->tot_len = htons(sizeof(struct iphdr) + l3len);
+    iphdr->id = fragment ? htons(static_cast<uint16_t>(gen.id)) : 0;
+    iphdr->frag_off = fragment ? htons((more ? IP_MF : 0) | (offset >> 3)) : 0;
+    iphdr->ttl = 64;
+    iphdr->protocol = protocol;
+    iphdr->saddr = from_client ? client : server;
+    iphdr->daddr = from_client ? server : client;
+
+    p += sizeof(struct iphdr);
+  } else {
+    // Client: fd00::x, server: fd01::x.
+    struct in6_addr client;
+    memset(&client, 0, sizeof(struct in6_addr));
+    client.s6_addr[0] = 0xfd;
+    client.s6_addr32[3] = htonl(f.idx);
+
+    struct in6_addr server = client;
+    server.s6_addr[1] = 0x01;
+
+    struct ip6_hdr* const iphdr = reinterpret_cast<struct ip6_hdr*>(p);
+    iphdr->ip6_flow = htonl(6u << 28);
+    iphdr->ip6_plen = htons((fragment ? sizeof(struct ip6_frag) : 0) + l3len);
+    iphdr->ip6_nxt = fragment ? IPPROTO_FRAGMENT : protocol;
+    iphdr->ip6_hlim = 64;
+    iphdr->ip6_src = from_client ? client : server;
+    iphdr->ip6_dst = from_client ? server : client;
+
+    p += sizeof(struct ip6_hdr);
+
+    if (fragment) {
+      struct ip6_frag* const frag = reinterpret_cast<struct ip6_frag*>(p);
+      frag->ip6f_nxt = protocol;
+      frag->ip6f_reserved = 0;
+      frag->ip6f_offlg = htons(offset) | (more ? IP6F_MORE_FRAG : 0);
+      frag->ip6f_ident = htonl(gen.id);
+
+      p += sizeof(struct ip6_frag);
+    }
+  }
+
+  net::capture::frame* const fr = gen.frames + gen.nframes++;
+  fr->buf = frame;
+  fr->len = (p - frame) + l3len;
+  fr->timestamp = gen.timestamp;
+
+  gen.used += fr->len;
+
+  // Between 1 and 10 microseconds between frames.
+  gen.timestamp += 1 + (next_random(gen) % 10);
+
+  return p;
+}
+
+size_t payload_length(generator& gen, const flow& f)
+{
+  // Pick a frame size from the mix.
+  unsigned w = next_random(gen) % gen.total_weight;
+
+  size_t i = 0;
+  while (w >= gen.opts->weights[i]) {
+    w -= gen.opts->weights[i++];
+  }
+
+  const size_t hdrlen = sizeof(struct ether_header) +
+                        (f.ipv6 ? sizeof(struct ip6_hdr) :
+                                  sizeof(struct iphdr)) +
+                        (f.tcp ? sizeof(struct tcphdr) :
+                                 sizeof(struct udphdr));
+
+  return (gen.opts->sizes[i] > hdrlen) ? gen.opts->sizes[i] - hdrlen : 0;
+}
+
+bool chance(generator& gen, double percentage)
+{
+  return ((next_random(gen) % 1000000) < (percentage * 10000));
+}
+
+uint64_t next_random(generator& gen)
+{
+  // xorshift64*.
+  gen.state ^= gen.state >> 12;
+  gen.state ^= gen.state << 25;
+  gen.state ^= gen.state >> 27;
+
+  return gen.state * 0x2545f4914f6cdd1dull;
+}
+
+size_t parse_segments(const generator& gen, segment* segments)
+{
+  net::ip::parser parser;
+  size_t nsegments = 0;
+
+  for (size_t i = 0; i < gen.nframes; i++) {
+    net::ip::packet pkt;
+
+    // The TCP segments are never fragmented, so they point to the frame
+    // buffer.
+    if ((parser.process_ethernet(gen.frames[i].buf,
+                                 gen.frames[i].len,
+                                 gen.frames[i].timestamp,
+                                 &pkt)) &&
+        (pkt.is_tcp())) {
+      segment* const s = segments + nsegments++;
+
+      s->ipv6 = (pkt.version() == net::ip::version::v6);
+      s->iphdr = s->ipv6 ? static_cast<const void*>(pkt.ipv6()) :
+                           static_cast<const void*>(pkt.ipv4());
+
+      s->tcphdr = pkt.tcp();
+      s->payload = pkt.l4();
+      s->payloadlen = pkt.l4length();
+      s->timestamp = pkt.timestamp();
+    }
+  }
+
+  return nsegments;
+}
+
+void bench_parser(const generator& gen)
+{
+  net::ip::parser parser;
+  size_t npackets = 0;
+
+  const uint64_t start = now();
+
+  for (size_t i = 0; i < gen.nframes; i++) {
+    net::ip::packet pkt;
+    if (parser.process_ethernet(gen.frames[i].buf,
+                                gen.frames[i].len,
+                                gen.frames[i].timestamp,
+                                &pkt)) {
+      npackets++;
+    }
+  }
+
+  const uint64_t end = now();
+
+  show_results("parser", gen.nframes, start, end);
+
+  printf("  %zu IP packets (fragments reassembled).\n", npackets);
+}
+
+void bench_connections(const generator& gen,
+                       const segment* segments,
+                       size_t nsegments)
+{
+  net::ip::tcp::connections connections;
+  if (!connections.init(net::ip::tcp::connections::default_size,
+                        gen.opts->nflows +
+                        net::ip::tcp::connections::min_connections)) {
+    fprintf(stderr, "Error initializing TCP connections.\n");
+    return;
+  }
+
+  size_t nconns = 0;
+
+  const uint64_t start = now();
+
+  for (size_t i = 0; i < nsegments; i++) {
+    const segment& s = segments[i];
+
+    const net::ip::tcp::connection* conn;
+    if (s.ipv6) {
+      conn = connections.process(static_cast<const ip6_hdr*>(s.iphdr),
+                                 s.tcphdr,
+                                 s.timestamp);
+    } else {
+      conn = connections.process(static_cast<const iphdr*>(s.iphdr),
+                                 s.tcphdr,
+                                 s.timestamp);
+    }
+
+    if (conn) {
+      nconns++;
+    }
+  }
+
+  const uint64_t end = now();
+
+  show_results("tcp::connections", nsegments, start, end);
+
+  printf("  %zu segments matched a connection.\n", nconns);
+}
+
+void bench_streams(const generator& gen,
+                   const segment* segments,
+                   size_t nsegments)
+{
+  net::ip::tcp::streams streams;
+  if (!init_streams(gen, streams)) {
+    fprintf(stderr, "Error initializing TCP streams.\n");
+    return;
+  }
+
+  stream_bytes = 0;
+
+  const uint64_t start = now();
+
+  for (size_t i = 0; i < nsegments; i++) {
+    const segment& s = segments[i];
+
+    if (s.ipv6) {
+      streams.process(static_cast<const ip6_hdr*>(s.iphdr),
+                      s.tcphdr,
+                      s.payload,
+                      s.payloadlen,
+                      s.timestamp);
+    } else {
+      streams.process(static_cast<const iphdr*>(s.iphdr),
+                      s.tcphdr,
+                      s.payload,
+                      s.payloadlen,
+                      s.timestamp);
+    }
+  }
+
+  const uint64_t end = now();
+
+  show_results("tcp::streams", nsegments, start, end);
+
+  printf("  %" PRIu64 " bytes of payload delivered.\n", stream_bytes);
+}
+
+void bench_pipeline(const generator& gen)
+{
+  net::ip::parser parser;
+
+  net::ip::tcp::streams streams;
+  if (!init_streams(gen, streams)) {
+    fprintf(stderr, "Error initializing TCP streams.\n");
+    return;
+  }
+
+  stream_bytes = 0;
+
+  const uint64_t start = now();
+
+  for (size_t i = 0; i < gen.nframes; i++) {
+    net::ip::packet pkt;
+    if ((parser.process_ethernet(gen.frames[i].buf,
+                                 gen.frames[i].len,
+                                 gen.frames[i].timestamp,
+                                 &pkt)) &&
+        (pkt.is_tcp())) {
+      if (pkt.version() == net::ip::version::v4) {
+        streams.process(pkt.ipv4(),
+                        pkt.tcp(),
+                        pkt.l4(),
+                        pkt.l4length(),
+                        pkt.timestamp());
+      } else {
+        streams.process(pkt.ipv6(),
+                        pkt.tcp(),
+                        pkt.l4(),
+                        pkt.l4length(),
+                        pkt.timestamp());
+      }
+    }
+  }
+
+  const uint64_t end = now();
+
+  show_results("pipeline (parser + tcp::streams)", gen.nframes, start, end);
+
+  printf("  %" PRIu64 " bytes of payload delivered.\n", stream_bytes);
+}
+
+void bench_batch(const generator& gen)
+{
+  // Both loops are run several times, alternately, and the fastest run of
+  // each one is shown (the first pass over the frames is slower).
+  static constexpr const unsigned runs = 3;
+
+  batch_totals scalar_totals;
+  batch_totals soa_totals;
+  uint64_t scalar_elapsed = UINT64_MAX;
+  uint64_t soa_elapsed = UINT64_MAX;
+
+  for (unsigned i = 0; i < runs; i++) {
+    uint64_t start = now();
+    parse_scalar(gen, scalar_totals);
+    uint64_t elapsed = now() - start;
+
+    if (elapsed < scalar_elapsed) {
+      scalar_elapsed = elapsed;
+    }
+
+    start = now();
+    parse_batch(gen, soa_totals);
+    elapsed = now() - start;
+
+    if (elapsed < soa_elapsed) {
+      soa_elapsed = elapsed;
+    }
+  }
+
+  show_results("parser + flow hash (scalar)", gen.nframes, 0, scalar_elapsed);
+
+  printf("  %zu IP packets, %" PRIu64 " bytes of TCP packets, "
+         "hashes: %08x.\n",
+         scalar_totals.npackets,
+         scalar_totals.tcp_bytes,
+         scalar_totals.hashes);
+
+  show_results("parser (batch, structure of arrays)",
+               gen.nframes,
+               0,
+               soa_elapsed);
+
+  printf("  %zu IP packets, %" PRIu64 " bytes of TCP packets, "
+         "hashes: %08x, %zu deferred frames.\n",
+         soa_totals.npackets,
+         soa_totals.tcp_bytes,
+         soa_totals.hashes,
+         soa_totals.ndeferred);
+}
+
+void parse_scalar(const generator& gen, batch_totals& totals)
+{
+  // One frame at a time, the downstream stage reads the net::ip::packet.
+  net::ip::parser parser;
+
+  totals.npackets = 0;
+  totals.tcp_bytes = 0;
+  totals.hashes = 0;
+  totals.ndeferred = 0;
+
+  for (size_t i = 0; i < gen.nframes; i++) {
+    net::ip::packet pkt;
+    if (parser.process_ethernet(gen.frames[i].buf,
+                                gen.frames[i].len,
+                                gen.frames[i].timestamp,
+                                &pkt)) {
+      totals.npackets++;
+
+      if (pkt.is_tcp()) {
+        totals.tcp_bytes += pkt.length();
+      }
+
+      totals.hashes ^= net::ip::flow_hash(pkt);
+    }
+  }
+}
+
+void parse_batch(const generator& gen, batch_totals& totals)
+{
+  // Blocks of frames, the downstream stage scans the columns of the
+  // descriptors (the deferred frames go through the scalar parser).
+  net::ip::parser parser;
+  net::ip::descriptors desc;
+
+  size_t npackets = 0;
+  uint64_t tcp_bytes = 0;
+  uint32_t hashes = 0;
+  size_t ndeferred = 0;
+
+  for (size_t i = 0; i < gen.nframes; ) {
+    const net::capture::frame* const frames = gen.frames + i;
+
+    i += parser.process_ethernet_batch(frames, gen.nframes - i, desc);
+
+    const size_t count = desc.count();
+    const uint8_t* const protocols = desc.protocols();
+    const uint16_t* const lengths = desc.lengths();
+    const uint32_t* const h = desc.hashes();
+
+    for (size_t j = 0; j < count; j++) {
+      if (protocols[j] == IPPROTO_TCP) {
+        tcp_bytes += lengths[j];
+      }
+
+      hashes ^= h[j];
+    }
+
+    npackets += count;
+
+    // Process the deferred frames.
+    const uint16_t* const deferred = desc.deferred();
+    for (size_t j = 0; j < desc.deferred_count(); j++) {
+      const net::capture::frame& f = frames[deferred[j]];
+
+      net::ip::packet pkt;
+      if (parser.process_ethernet(f.buf, f.len, f.timestamp, &pkt)) {
+        npackets++;
+
+        if (pkt.is_tcp()) {
+          tcp_bytes += pkt.length();
+        }
+
+        hashes ^= net::ip::flow_hash(pkt);
+      }
+    }
+
+    ndeferred += desc.deferred_count();
+  }
+
+  totals.npackets = npackets;
+  totals.tcp_bytes = tcp_bytes;
+  totals.hashes = hashes;
+  totals.ndeferred = ndeferred;
+}
+
+bool init_streams(const generator& gen, net::ip::tcp::streams& streams)
+{
+  return streams.init(beginstreamfn,
+                      endstreamfn,
+                      payloadfn,
+                      gapfn,
+                      net::ip::tcp::connections::default_size,
+                      gen.opts->nflows +
+                      net::ip::tcp::connections::min_connections);
+}
+
+bool beginstreamfn(const net::ip::tcp::connection* conn,
+                   net::ip::tcp::direction dir,
+                   void*& user)
+{
+  return true;
+}
+
+void endstreamfn(const net::ip::tcp::connection* conn,
+                 net::ip::tcp::direction dir,
+                 void* user)
+{
+}
+
+bool payloadfn(const void* payload,
+               uint16_t payloadlen,
+               uint64_t offset,
+               const net::ip::tcp::connection* conn,
+               net::ip::tcp::direction dir,
+               void* user)
+{
+  stream_bytes += payloadlen;
+  return true;
+}
+
+bool gapfn(uint32_t gapsize,
+           uint64_t offset,
+           const net::ip::tcp::connection* conn,
+           net::ip::tcp::direction dir,
+           void* user)
+{
+  return true;
+}
+
+void show_results(const char* name,
+                  size_t npackets,
+                  uint64_t start,
+                  uint64_t end)
+{
+  const uint64_t elapsed = end - start;
+
+  printf("%s:\n", name);
+
+  if ((npackets > 0) && (elapsed > 0)) {
+    printf("  %zu packets, %.1f ns/packet, %.3f Mpps, peak RSS: %.1f MiB.\n",
+           npackets,
+           static_cast<double>(elapsed) / npackets,
+           (npackets * 1000.0) / elapsed,
+           peak_rss() / 1024.0);
+  } else {
+    printf("  %zu packets.\n", npackets);
+  }
+}
+
+uint64_t peak_rss()
+{
+  // Kilobytes.
+  struct rusage usage;
+  return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
@@ -0,0 +1,508 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include "net/capture/ring_buffer.h"
+#include "net/capture/xdp_socket.h"
+#include "net/ip/parser.h"
+#include "util/numa.h"
+
+// Capture backend.
+enum class backend {
+  ring, // Packet ring buffer.
+  xdp,  // AF_XDP socket.
+  all   // Both.
+};
+
+// Options.
+struct options {
+  // Interface name.
+  const char* interface;
+
+  // CPU the consumer thread is pinned to.
+  unsigned cpu;
+
+  // NUMA nodes to benchmark.
+  bool nodes[util::numa::max_nodes];
+
+  // Duration of each run (seconds).
+  unsigned duration;
+
+  // Use huge pages for the frame tables?
+  bool hugepages;
+
+  // Generate traffic (UDP packets to 127.0.0.1)?
+  bool generate;
+
+  // UDP payload size of the generated packets.
+  size_t size;
+
+  // Capture backend.
+  backend b;
+};
+
+// Consumer context.
+struct context {
+  // IP parser.
+  net::ip::parser parser;
+
+  // Number of IP packets.
+  uint64_t npackets;
+};
+
+// Traffic generator.
+struct generator {
+  // Thread.
+  pthread_t thread;
+
+  // UDP payload size.
+  size_t size;
+
+  // Running?
+  std::atomic<bool> running;
+};
+
+// Maximum UDP payload size of the generated packets.
+static constexpr const size_t max_payload_size = 1472;
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static bool parse_nodes(const char* s, bool* nodes);
+static void usage(const char* program);
+
+static bool run_ring(const options& opts, int node);
+static bool run_xdp(const options& opts, int node);
+
+static bool start_generator(const options& opts, generator& gen);
+static void stop_generator(const options& opts, generator& gen);
+
+static void show_results(const char* name,
+                         int node,
+                         uint64_t frames,
+                         uint64_t npackets,
+                         uint64_t drops,
+                         uint64_t callback_time,
+                         uint64_t busy);
+
+static void blockfn(const net::capture::frame* frames,
+                    size_t nframes,
+                    void* user);
+
+static void* generate(void* arg);
+
+static uint64_t now();
+
+int main(int argc, const char** argv)
+{
+  // Parse arguments.
+  options opts;
+  if (parse_arguments(argc, argv, opts)) {
+    // Pin the consumer thread.
+    if (!util::numa::pin(opts.cpu)) {
+      fprintf(stderr, "Error pinning thread to CPU %u.\n", opts.cpu);
+      return -1;
+    }
+
+    printf("Consumer thread pinned to CPU %u (NUMA node %d).\n",
+           opts.cpu,
+           util::numa::node_of_cpu(opts.cpu));
+
+    for (unsigned node = 0; node < util::numa::max_nodes; node++) {
+      if (opts.nodes[node]) {
+        if ((opts.b != backend::xdp) && (!run_ring(opts, node))) {
+          return -1;
+        }
+
+        if ((opts.b != backend::ring) && (!run_xdp(opts, node))) {
+          return -1;
+        }
+      }
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
+bool run_ring(const options& opts, int node)
+{
+  context ctx;
+  ctx.npackets = 0;
+
+  net::capture::ring_buffer ring(blockfn, &ctx);
+
+  // Bind the ring buffer and the frame tables to the NUMA node.
+  ring.numa(node, opts.hugepages);
+
+  if (!ring.create(opts.interface)) {
+    fprintf(stderr,
+            "Error creating ring buffer on NUMA node %d for interface "
+            "'%s'.\n",
+            node,
+            opts.interface);
+
+    return false;
+  }
+
+  generator gen;
+  if (!start_generator(opts, gen)) {
+    return false;
+  }
+
+  const uint64_t start = now();
+  const uint64_t end = start + (opts.duration * 1000000000ull);
+
+  uint64_t t;
+
+  do {
+    ring.read();
+  } while ((t = now()) < end);
+
+  stop_generator(opts, gen);
+
+  net::capture::ring_buffer::statistics stats;
+  if (!ring.get_statistics(stats)) {
+    fprintf(stderr, "Error getting statistics.\n");
+    return false;
+  }
+
+  // Busy time: time not spent sleeping in poll().
+  show_results("Ring buffer",
+               node,
+               stats.frames,
+               ctx.npackets,
+               stats.drops,
+               stats.callback_time,
+               t - start - stats.sleep_time);
+
+  return true;
+}
+
+bool run_xdp(const options& opts, int node)
+{
+  context ctx;
+  ctx.npackets = 0;
+
+  net::capture::xdp_socket sock(blockfn, &ctx);
+
+  // Bind the UMEM to the NUMA node.
+  sock.numa(node, opts.hugepages);
+
+  if (!sock.create(opts.interface)) {
+    fprintf(stderr,
+            "Error creating XDP socket on NUMA node %d for interface "
+            "'%s'.\n",
+            node,
+            opts.interface);
+
+    return false;
+  }
+
+  generator gen;
+  if (!start_generator(opts, gen)) {
+    return false;
+  }
+
+  const uint64_t start = now();
+  const uint64_t end = start + (opts.duration * 1000000000ull);
+
+  uint64_t t;
+
+  do {
+    sock.read();
+  } while ((t = now()) < end);
+
+  stop_generator(opts, gen);
+
+  net::capture::xdp_socket::statistics stats;
+  if (!sock.get_statistics(stats)) {
+    fprintf(stderr, "Error getting statistics.\n");
+    return false;
+  }
+
+  // Busy time: time not spent sleeping in poll().
+  show_results("XDP socket",
+               node,
+               stats.frames,
+               ctx.npackets,
+               stats.drops + stats.ring_full,
+               stats.callback_time,
+               t - start - stats.sleep_time);
+
+  return true;
+}
+
+bool start_generator(const options& opts, generator& gen)
+{
+  gen.size = opts.size;
+  gen.running = false;
+
+  // If traffic has to be generated...
+  if (opts.generate) {
+    gen.running = true;
+
+    if (pthread_create(&gen.thread, nullptr, generate, &gen) != 0) {
+      fprintf(stderr, "Error creating traffic generator.\n");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void stop_generator(const options& opts, generator& gen)
+{
+  if (opts.generate) {
+    gen.running = false;
+    pthread_join(gen.thread, nullptr);
+  }
+}
+
+void show_results(const char* name,
+                  int node,
+                  uint64_t frames,
+                  uint64_t npackets,
+                  uint64_t drops,
+                  uint64_t callback_time,
+                  uint64_t busy)
+{
+  printf("%s, NUMA node %d:\n", name, node);
+  printf("  %" PRIu64 " frames (%" PRIu64 " IP packets), %" PRIu64
+         " dropped by kernel.\n",
+         frames,
+         npackets,
+         drops);
+
+  if (frames > 0) {
+    printf("  %.1f ns per packet in the callback.\n",
+           static_cast<double>(callback_time) / frames);
+
+    printf("  %.1f ns per packet (ring walk + callback).\n",
+           static_cast<double>(busy) / frames);
+  }
+}
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return false;
+  }
+
+  opts.interface = argv[1];
+  opts.cpu = 0;
+  opts.duration = 5;
+  opts.hugepages = true;
+  opts.generate = false;
+  opts.size = 64;
+  opts.b = backend::ring;
+
+  // By default, benchmark all the NUMA nodes.
+  const unsigned nodes = util::numa::nodes();
+  for (unsigned i = 0; i < util::numa::max_nodes; i++) {
+    opts.nodes[i] = (i < nodes);
+  }
+
+  int i = 2;
+  while (i < argc) {
+    if (strcasecmp(argv[i], "--cpu") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        const unsigned long cpu = strtoul(argv[i + 1], &end, 10);
+        if ((end != argv[i + 1]) && (*end == 0) && (cpu < CPU_SETSIZE)) {
+          opts.cpu = cpu;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid CPU '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected CPU after \"--cpu\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--nodes") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse_nodes(argv[i + 1], opts.nodes)) {
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid list of NUMA nodes '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected list of NUMA nodes after \"--nodes\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--duration") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        const unsigned long duration = strtoul(argv[i + 1], &end, 10);
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (duration >= 1) &&
+            (duration <= 3600)) {
+          opts.duration = duration;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid duration '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected number of seconds after \"--duration\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--no-hugepages") == 0) {
+      opts.hugepages = false;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--generate") == 0) {
+      opts.generate = true;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--size") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        const unsigned long size = strtoul(argv[i + 1], &end, 10);
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (size >= 1) &&
+            (size <= max_payload_size)) {
+          opts.size = size;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid payload size '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected number of bytes after \"--size\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--backend") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (strcasecmp(argv[i + 1], "ring") == 0) {
+          opts.b = backend::ring;
+        } else if (strcasecmp(argv[i + 1], "xdp") == 0) {
+          opts.b = backend::xdp;
+        } else if (strcasecmp(argv[i + 1], "all") == 0) {
+          opts.b = backend::all;
+        } else {
+          fprintf(stderr, "Invalid backend '%s'.\n", argv[i + 1]);
+          return false;
+        }
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected backend after \"--backend\".\n");
+        return false;
+      }
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool parse_nodes(const char* s, bool* nodes)
+{
+  for (unsigned i = 0; i < util::numa::max_nodes; i++) {
+    nodes[i] = false;
+  }
+
+  // Format: <node>[,<node>]...
+  do {
+    char* end;
+    const unsigned long node = strtoul(s, &end, 10);
+    if ((end == s) || (node >= util::numa::max_nodes)) {
+      return false;
+    }
+
+    nodes[node] = true;
+
+    if (*end == 0) {
+      return true;
+    } else if (*end != ',') {
+      return false;
+    }
+
+    s = end + 1;
+  } while (true);
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <interface-name> [--cpu <cpu>] [--nodes <node-list>] "
+          "[--duration <seconds>] [--no-hugepages] [--generate] "
+          "[--size <udp-payload-size>] [--backend ring|xdp|all]\n",
+          program);
+}
+
+void blockfn(const net::capture::frame* frames, size_t nframes, void* user)
+{
+  context* ctx = static_cast<context*>(user);
+
+  for (size_t i = 0; i < nframes; i++) {
+    // Process ethernet frame.
+    net::ip::packet pkt;
+    if (ctx->parser.process_ethernet(frames[i].buf,
+                                     frames[i].len,
+                                     frames[i].timestamp,
+                                     &pkt)) {
+      ctx->npackets++;
+    }
+  }
+}
+
+void* generate(void* arg)
+{
+  generator* gen = static_cast<generator*>(arg);
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd != -1) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(9); // Discard.
+
+    uint8_t payload[max_payload_size];
+    memset(payload, 0, sizeof(payload));
+
+    while (gen->running) {
+      sendto(fd,
+             payload,
+             gen->size,
+             0,
+             reinterpret_cast<const struct sockaddr*>(&addr),
+             sizeof(struct sockaddr_in));
+    }
+
+    close(fd);
+  }
+
+  return nullptr;
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+#include "pcap/reader.h"
+#include "pcap/ip/analyzer.h"
+
+// Stages.
+enum stage {
+  stage_reader = 1 << 0,   // pcap::reader.
+  stage_analyzer = 1 << 1, // pcap::ip::analyzer.
+  stage_all = stage_reader | stage_analyzer
+};
+
+// Options.
+struct options {
+  // PCAP file.
+  const char* filename;
+
+  // Number of runs (the fastest one is shown).
+  unsigned runs;
+
+  // Stages.
+  unsigned stages;
+};
+
+// Totals (to check that both dispatch modes see the same packets).
+struct totals {
+  // Number of packets.
+  size_t npackets;
+
+  // Number of bytes.
+  uint64_t nbytes;
+};
+
+// Counts the PCAP packets (pcap::reader::for_each()).
+struct pcap_counter {
+  totals* t;
+
+  bool operator()(const pcap::packet& pkt) const
+  {
+    t->npackets++;
+    t->nbytes += pkt.length();
+
+    return true;
+  }
+};
+
+// Counts the IP packets (pcap::ip::analyzer::for_each_packet()).
+struct ip_counter {
+  totals* t;
+
+  bool operator()(const net::ip::packet& pkt) const
+  {
+    t->npackets++;
+    t->nbytes += pkt.length();
+
+    return true;
+  }
+};
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static void usage(const char* program);
+
+static bool bench_reader(const options& opts);
+static bool bench_analyzer(const options& opts);
+
+static void show_results(const char* name,
+                         const totals& t,
+                         uint64_t elapsed);
+
+static uint64_t peak_rss();
+static uint64_t now();
+
+int main(int argc, const char** argv)
+{
+  // Parse arguments.
+  options opts;
+  if (parse_arguments(argc, argv, opts)) {
+    if ((opts.stages & stage_reader) && (!bench_reader(opts))) {
+      return -1;
+    }
+
+    if ((opts.stages & stage_analyzer) && (!bench_analyzer(opts))) {
+      return -1;
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return false;
+  }
+
+  opts.filename = argv[1];
+  opts.runs = 5;
+  opts.stages = stage_all;
+
+  int i = 2;
+  while (i < argc) {
+    if (strcasecmp(argv[i], "--runs") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        errno = 0;
+        const unsigned long n = strtoul(argv[i + 1], &end, 10);
+
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (errno == 0) &&
+            (n > 0) &&
+            (n <= 1000)) {
+          opts.runs = static_cast<unsigned>(n);
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid number of runs '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected number of runs after \"--runs\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--stage") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (strcasecmp(argv[i + 1], "reader") == 0) {
+          opts.stages = stage_reader;
+        } else if (strcasecmp(argv[i + 1], "analyzer") == 0) {
+          opts.stages = stage_analyzer;
+        } else if (strcasecmp(argv[i + 1], "all") == 0) {
+          opts.stages = stage_all;
+        } else {
+          fprintf(stderr, "Invalid stage '%s'.\n", argv[i + 1]);
+          return false;
+        }
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected stage after \"--stage\".\n");
+        return false;
+      }
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <filename> [--runs <number>] "
+          "[--stage reader|analyzer|all]\n",
+          program);
+}
+
+bool bench_reader(const options& opts)
+{
+  pcap::reader reader;
+  if (!reader.open(opts.filename)) {
+    fprintf(stderr, "Error opening PCAP file '%s'.\n", opts.filename);
+    return false;
+  }
+
+  totals pointer_totals;
+  totals template_totals;
+  uint64_t pointer_elapsed = UINT64_MAX;
+  uint64_t template_elapsed = UINT64_MAX;
+
+  for (unsigned i = 0; i < opts.runs; i++) {
+    // Member function pointers (begin() / next()).
+    totals t = {0, 0};
+
+    uint64_t start = now();
+
+    pcap::packet pkt;
+    if (reader.begin(pkt)) {
+      do {
+        t.npackets++;
+        t.nbytes += pkt.length();
+      } while (reader.next(pkt));
+    }
+
+    uint64_t elapsed = now() - start;
+    if (elapsed < pointer_elapsed) {
+      pointer_elapsed = elapsed;
+    }
+
+    pointer_totals = t;
+
+    // Backend selected once (for_each()).
+    t.npackets = 0;
+    t.nbytes = 0;
+
+    pcap_counter counter;
+    counter.t = &t;
+
+    start = now();
+
+    reader.for_each(counter);
+
+    elapsed = now() - start;
+    if (elapsed < template_elapsed) {
+      template_elapsed = elapsed;
+    }
+
+    template_totals = t;
+  }
+
+  show_results("pcap::reader::next() (pointer dispatch)",
+               pointer_totals,
+               pointer_elapsed);
+
+  show_results("pcap::reader::for_each() (template dispatch)",
+               template_totals,
+               template_elapsed);
+
+  return true;
+}
+
+bool bench_analyzer(const options& opts)
+{
+  pcap::ip::analyzer analyzer;
+  if (!analyzer.open(opts.filename)) {
+    fprintf(stderr, "Error opening PCAP file '%s'.\n", opts.filename);
+    return false;
+  }
+
+  totals pointer_totals;
+  totals template_totals;
+  uint64_t pointer_elapsed = UINT64_MAX;
+  uint64_t template_elapsed = UINT64_MAX;
+
+  for (unsigned i = 0; i < opts.runs; i++) {
+    // Member function pointers (begin() / next()).
+    totals t = {0, 0};
+
+    uint64_t start = now();
+
+    pcap::ip::analyzer::const_iterator it;
+    if (analyzer.begin(it)) {
+      do {
+        t.npackets++;
+        t.nbytes += it->length();
+      } while (analyzer.next(it));
+    }
+
+    uint64_t elapsed = now() - start;
+    if (elapsed < pointer_elapsed) {
+      pointer_elapsed = elapsed;
+    }
+
+    pointer_totals = t;
+
+    // Link-layer header type selected once (for_each_packet()).
+    t.npackets = 0;
+    t.nbytes = 0;
+
+    ip_counter counter;
+    counter.t = &t;
+
+    start = now();
+
+    analyzer.for_each_packet(counter);
+
+    elapsed = now() - start;
+    if (elapsed < template_elapsed) {
+      template_elapsed = elapsed;
+    }
+
+    template_totals = t;
+  }
+
+  show_results("pcap::ip::analyzer::next() (pointer dispatch)",
+               pointer_totals,
+               pointer_elapsed);
+
+  show_results("pcap::ip::analyzer::for_each_packet() (template dispatch)",
+               template_totals,
+               template_elapsed);
+
+  return true;
+}
+
+void show_results(const char* name, const totals& t, uint64_t elapsed)
+{
+  printf("%s:\n", name);
+
+  if ((t.npackets > 0) && (elapsed > 0)) {
+    printf("  %zu packets, %" PRIu64 " bytes, %.1f ns/packet, %.3f Mpps, "
+           "peak RSS: %.1f MiB.\n",
+           t.npackets,
+           t.nbytes,
+           static_cast<double>(elapsed) / t.npackets,
+           (t.npackets * 1000.0) / elapsed,
+           peak_rss() / 1024.0);
+  } else {
+    printf("  %zu packets.\n", t.npackets);
+  }
+}
+
+uint64_t peak_rss()
+{
+  // Kilobytes.
+  struct rusage usage;
+  return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
@@ -1,72 +1,539 @@
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 #include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <new>
 #include "net/ip/parser.h"
 #include "net/ip/address.h"
-#include "net/capture/ring_buffer.h"
+#include "net/capture/fanout_group.h"
+#include "net/capture/writer.h"
+#include "net/capture/filter.h"
+#include "net/capture/xdp_socket.h"
+
+// Options.
+struct options {
+  // Interface name.
+  const char* interface;
+
+  // Number of ring buffers.
+  size_t nrings;
+
+  // Fanout mode.
+  net::capture::ring_buffer::fanout_mode mode;
+
+  // Use the block callback?
+  bool batch;
+
+  // Prefix of the PCAP files (nullptr: don't write to disk).
+  const char* prefix;
+
+  // Maximum file size (bytes).
+  uint64_t max_file_size;
+
+  // Maximum file duration (seconds).
+  uint64_t max_file_duration;
+
+  // Filter expression (nullptr: no filter).
+  const char* filter;
+
+  // Busy-poll mode: idle time before falling back to poll() (microseconds,
+  // 0: disabled).
+  unsigned spin_time;
+
+  // Use an AF_XDP socket instead of the packet ring buffers?
+  bool xdp;
+
+  // Queue of the interface (AF_XDP).
+  unsigned queue;
+};
+
+// Ring buffer context.
+struct context {
+  // IP parser.
+  net::ip::parser parser;
+
+  // Capture writer.
+  net::capture::writer writer;
+
+  // Write to disk?
+  bool write;
+};
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static bool parse_number(const char* s,
+                         uint64_t min,
+                         uint64_t max,
+                         uint64_t& n);
+
+static void usage(const char* program);
+
+static bool setup_contexts(const options& opts, context* contexts);
+
+static int run(net::capture::fanout_group& capture,
+               const options& opts,
+               context* contexts);
+
+static int run(net::capture::xdp_socket& capture,
+               const options& opts,
+               context* ctx);
+
+static void signal_handler(int nsig);
 
 static void ethernetfn(const void* buf,
                        uint32_t len,
                        const struct timeval& timestamp,
                        void* user);
 
-static void signal_handler(int nsig);
+static void blockfn(const net::capture::frame* frames,
+                    size_t nframes,
+                    void* user);
 
-static bool running = false;
+static void process_frame(context* ctx,
+                          const void* buf,
+                          uint32_t len,
+                          uint64_t timestamp);
+
+static volatile sig_atomic_t running = 0;
 
 int main(int argc, const char** argv)
 {
-  if (argc == 2) {
-    // IP parser.
-    net::ip::parser parser;
-
-    // Create capture device.
-    net::capture::ring_buffer capture(ethernetfn, &parser);
-    if (capture.create(argv[1])) {
-      // Install signal handler.
-      struct sigaction act;
-      sigemptyset(&act.sa_mask);
-      act.sa_flags = 0;
-      act.sa_handler = signal_handler;
-      sigaction(SIGTERM, &act, nullptr);
-      sigaction(SIGINT, &act, nullptr);
-
-      running = true;
-
-      do {
-        capture.read();
-      } while (running);
+  // Parse arguments.
+  options opts;
+  if (parse_arguments(argc, argv, opts)) {
+    // Create contexts (one per ring buffer).
+    context* contexts = new (std::nothrow) context[opts.nrings];
+    if (contexts) {
+      int ret;
+
+      // Create capture device.
+      if (opts.xdp) {
+        if (opts.batch) {
+          net::capture::xdp_socket capture(blockfn, contexts);
+          ret = run(capture, opts, contexts);
+        } else {
+          net::capture::xdp_socket capture(ethernetfn, contexts);
+          ret = run(capture, opts, contexts);
+        }
+      } else if (opts.batch) {
+        net::capture::fanout_group capture(blockfn);
+        ret = run(capture, opts, contexts);
+      } else {
+        net::capture::fanout_group capture(ethernetfn);
+        ret = run(capture, opts, contexts);
+      }
+
+      // Close PCAP files.
+      for (size_t i = 0; i < opts.nrings; i++) {
+        if (contexts[i].write) {
+          if (contexts[i].writer.close()) {
+            printf("Ring %zu: %" PRIu64 " packets written to %u file(s).\n",
+                   i,
+                   contexts[i].writer.packets(),
+                   contexts[i].writer.files());
+          } else {
+            fprintf(stderr, "Error writing PCAP files of ring %zu.\n", i);
+            ret = -1;
+          }
+        }
+      }
+
+      delete [] contexts;
+
+      return ret;
+    } else {
+      fprintf(stderr, "Error allocating memory.\n");
+    }
+  }
+
+  return -1;
+}
+
+bool setup_contexts(const options& opts, context* contexts)
+{
+  for (size_t i = 0; i < opts.nrings; i++) {
+    context* ctx = &contexts[i];
+
+    ctx->write = false;
+
+    // If the frames have to be written to disk...
+    if (opts.prefix) {
+      char prefix[PATH_MAX];
+      if (opts.nrings == 1) {
+        snprintf(prefix, sizeof(prefix), "%s", opts.prefix);
+      } else {
+        snprintf(prefix, sizeof(prefix), "%s-%zu", opts.prefix, i);
+      }
+
+      if (!ctx->writer.open(prefix,
+                            opts.max_file_size,
+                            opts.max_file_duration)) {
+        fprintf(stderr, "Error opening capture writer '%s'.\n", prefix);
+        return false;
+      }
+
+      ctx->write = true;
+    }
+  }
+
+  return true;
+}
+
+int run(net::capture::fanout_group& capture,
+        const options& opts,
+        context* contexts)
+{
+  if (!setup_contexts(opts, contexts)) {
+    return -1;
+  }
+
+  void* users[net::capture::fanout_group::max_rings];
+  for (size_t i = 0; i < opts.nrings; i++) {
+    users[i] = &contexts[i];
+  }
+
+  // Compile filter expression (if any).
+  net::capture::filter filter;
+  if ((opts.filter) && (!filter.compile(opts.filter))) {
+    fprintf(stderr, "Error compiling filter expression '%s'.\n", opts.filter);
+    return -1;
+  }
+
+  // If the busy-poll mode has to be enabled...
+  if (opts.spin_time > 0) {
+    capture.busy_poll(opts.spin_time);
+  }
+
+  if (capture.create(opts.interface,
+                     opts.nrings,
+                     users,
+                     opts.mode,
+                     nullptr,
+                     0,
+                     true,
+                     net::capture::ring_buffer::default_block_size,
+                     net::capture::ring_buffer::default_frame_size,
+                     net::capture::ring_buffer::default_frames,
+                     filter.program())) {
+    // Block signals (the threads inherit the signal mask).
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+    // Start threads.
+    if (capture.start()) {
+      // Wait for a signal.
+      int nsig;
+      sigwait(&set, &nsig);
+
+      printf("Received signal %d.\n", nsig);
+
+      // Stop threads.
+      capture.stop();
 
       // Show statistics.
       capture.show_statistics();
 
       return 0;
     } else {
-      fprintf(stderr,
-              "Error creating capture device for interface '%s'.\n",
-              argv[1]);
+      fprintf(stderr, "Error starting capture threads.\n");
     }
   } else {
-    fprintf(stderr, "Usage: %s <interface-name>\n", argv[0]);
+    fprintf(stderr,
+            "Error creating capture device for interface '%s'.\n",
+            opts.interface);
+  }
+
+  return -1;
+}
+
+int run(net::capture::xdp_socket& capture,
+        const options& opts,
+        context* ctx)
+{
+  if (!setup_contexts(opts, ctx)) {
+    return -1;
+  }
+
+  if (capture.create(opts.interface, opts.queue)) {
+    // Install signal handler.
+    struct sigaction act;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = 0;
+    act.sa_handler = signal_handler;
+    sigaction(SIGTERM, &act, nullptr);
+    sigaction(SIGINT, &act, nullptr);
+
+    running = 1;
+
+    do {
+      if ((capture.read() < 0) && (errno != EINTR)) {
+        fprintf(stderr, "Error reading from XDP socket.\n");
+        return -1;
+      }
+    } while (running);
+
+    // Show statistics.
+    capture.show_statistics();
+
+    return 0;
+  } else {
+    fprintf(stderr,
+            "Error creating XDP socket for queue %u of interface '%s'.\n",
+            opts.queue,
+            opts.interface);
   }
 
   return -1;
 }
 
+void signal_handler(int nsig)
+{
+  printf("Received signal %d.\n", nsig);
+
+  running = 0;
+}
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return false;
+  }
+
+  opts.interface = argv[1];
+  opts.nrings = 1;
+  opts.mode = net::capture::ring_buffer::fanout_mode::hash;
+  opts.batch = false;
+  opts.prefix = nullptr;
+  opts.max_file_size = 0;
+  opts.max_file_duration = 0;
+  opts.filter = nullptr;
+  opts.spin_time = 0;
+  opts.xdp = false;
+  opts.queue = 0;
+
+  int i = 2;
+  while (i < argc) {
+    if (strcasecmp(argv[i], "--rings") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse_number(argv[i + 1],
+                         1,
+                         net::capture::fanout_group::max_rings,
+                         n)) {
+          opts.nrings = n;
+
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid number of rings '%s' (valid range: 1 .. %zu).\n",
+                  argv[i + 1],
+                  net::capture::fanout_group::max_rings);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected number after \"--rings\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--fanout") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (strcasecmp(argv[i + 1], "hash") == 0) {
+          opts.mode = net::capture::ring_buffer::fanout_mode::hash;
+        } else if (strcasecmp(argv[i + 1], "lb") == 0) {
+          opts.mode = net::capture::ring_buffer::fanout_mode::lb;
+        } else if (strcasecmp(argv[i + 1], "cpu") == 0) {
+          opts.mode = net::capture::ring_buffer::fanout_mode::cpu;
+        } else if (strcasecmp(argv[i + 1], "rollover") == 0) {
+          opts.mode = net::capture::ring_buffer::fanout_mode::rollover;
+        } else {
+          fprintf(stderr, "Invalid fanout mode '%s'.\n", argv[i + 1]);
+          return false;
+        }
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected fanout mode after \"--fanout\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--batch") == 0) {
+      opts.batch = true;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--write") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        opts.prefix = argv[i + 1];
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected prefix after \"--write\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--max-file-size") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse_number(argv[i + 1], 1, 1024 * 1024, n)) {
+          // Convert MiB to bytes.
+          opts.max_file_size = n * 1024 * 1024;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid maximum file size '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected size after \"--max-file-size\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--max-file-duration") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse_number(argv[i + 1], 1, 365 * 24 * 3600, n)) {
+          opts.max_file_duration = n;
+
+          i += 2;
+        } else {
+          fprintf(stderr,
+                  "Invalid maximum file duration '%s'.\n",
+                  argv[i + 1]);
+
+          return false;
+        }
+      } else {
+        fprintf(stderr,
+                "Expected number of seconds after "
+                "\"--max-file-duration\".\n");
+
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--filter") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        opts.filter = argv[i + 1];
+
+        i += 2;
+      } else {
+        fprintf(stderr, "Expected expression after \"--filter\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--busy-poll") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        uint64_t n;
+        if (parse_number(argv[i + 1], 1, 1000000, n)) {
+          opts.spin_time = n;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid spin time '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr,
+                "Expected number of microseconds after \"--busy-poll\".\n");
+
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--xdp") == 0) {
+      opts.xdp = true;
+
+      // If the queue has been specified...
+      uint64_t n;
+      if ((i + 1 < argc) && (parse_number(argv[i + 1], 0, UINT32_MAX, n))) {
+        opts.queue = n;
+
+        i += 2;
+      } else {
+        i++;
+      }
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+  }
+
+  // The AF_XDP socket reads from a single queue, in the main thread.
+  if ((opts.xdp) &&
+      ((opts.nrings > 1) || (opts.filter) || (opts.spin_time > 0))) {
+    fprintf(stderr,
+            "\"--xdp\" can't be combined with \"--rings\", \"--filter\" "
+            "or \"--busy-poll\".\n");
+
+    return false;
+  }
+
+  return true;
+}
+
+bool parse_number(const char* s, uint64_t min, uint64_t max, uint64_t& n)
+{
+  char* end;
+  n = strtoull(s, &end, 10);
+
+  return ((end != s) && (*end == 0) && (n >= min) && (n <= max));
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <interface-name> [--rings <number>] "
+          "[--fanout hash|lb|cpu|rollover] [--batch] "
+          "[--write <prefix> [--max-file-size <MiB>] "
+          "[--max-file-duration <seconds>]] [--filter <expression>] "
+          "[--busy-poll <microseconds>] [--xdp [<queue>]]\n",
+          program);
+}
+
 void ethernetfn(const void* buf,
                 uint32_t len,
                 const struct timeval& timestamp,
                 void* user)
 {
-  net::ip::parser* parser = static_cast<net::ip::parser*>(user);
+  process_frame(static_cast<context*>(user),
+                buf,
+                len,
+                (timestamp.tv_sec * 1000000ull) +
+                static_cast<uint64_t>(timestamp.tv_usec));
+}
+
+void blockfn(const net::capture::frame* frames, size_t nframes, void* user)
+{
+  context* ctx = static_cast<context*>(user);
+
+  // If the frames are being written to disk...
+  if (ctx->write) {
+    ctx->writer.write(frames, nframes);
+  } else {
+    for (size_t i = 0; i < nframes; i++) {
+      process_frame(ctx, frames[i].buf, frames[i].len, frames[i].timestamp);
+    }
+  }
+}
+
+void process_frame(context* ctx,
+                   const void* buf,
+                   uint32_t len,
+                   uint64_t timestamp)
+{
+  // If the frames are being written to disk...
+  if (ctx->write) {
+    ctx->writer.write(buf, len, timestamp);
+    return;
+  }
 
   // Process ethernet frame.
   net::ip::packet pkt;
-  if (parser->process_ethernet(buf,
-                               len,
-                               (timestamp.tv_sec * 1000000ull) +
-                               static_cast<uint64_t>(timestamp.tv_usec),
-                               &pkt)) {
+  if (ctx->parser.process_ethernet(buf, len, timestamp, &pkt)) {
     char from[INET6_ADDRSTRLEN];
     char to[INET6_ADDRSTRLEN];
 
@@ -108,10 +575,3 @@ void ethernetfn(const void* buf,
     }
   }
 }
-
-void signal_handler(int nsig)
-{
-  printf("Received signal %d.\n", nsig);
-
-  running = false;
-}
@@ -42,14 +42,22 @@ static const char* directory = nullptr;
 
 int main(int argc, const char** argv)
 {
-  if (argc == 3) {
+  if (argc >= 3) {
+    // The last argument is the directory, the previous ones are the PCAP
+    // files (their packets are merged by timestamp).
+    const char* const* filenames = argv + 1;
+    const size_t nfiles = argc - 2;
+
     struct stat sbuf;
-    if ((stat(argv[2], &sbuf) == 0) && (S_ISDIR(sbuf.st_mode))) {
-      // Open PCAP file.
+    if ((stat(argv[argc - 1], &sbuf) == 0) && (S_ISDIR(sbuf.st_mode))) {
+      // Open PCAP file(s).
       pcap::ip::analyzer analyzer;
-      if (analyzer.open(argv[1])) {
+      if (analyzer.open(filenames, nfiles)) {
         // Save directory.
-        directory = argv[2];
+        directory = argv[argc - 1];
+
+        // Compute the flow hashes while parsing the packets.
+        analyzer.flow_hashes(true);
 
         // Initialize streams.
         net::ip::tcp::streams streams;
@@ -61,13 +69,15 @@ int main(int argc, const char** argv)
             do {
               // IPv4?
               if (it->version() == net::ip::version::v4) {
-                streams.process(it->ipv4(),
+                streams.process(it->hash(),
+                                it->ipv4(),
                                 it->tcp(),
                                 it->l4(),
                                 it->l4length(),
                                 it->timestamp());
               } else {
-                streams.process(it->ipv6(),
+                streams.process(it->hash(),
+                                it->ipv6(),
                                 it->tcp(),
                                 it->l4(),
                                 it->l4length(),
@@ -83,13 +93,21 @@ int main(int argc, const char** argv)
           fprintf(stderr, "Error initializing TCP streams.\n");
         }
       } else {
-        fprintf(stderr, "Error opening PCAP file '%s'.\n", argv[1]);
+        if (nfiles == 1) {
+          fprintf(stderr, "Error opening PCAP file '%s'.\n", argv[1]);
+        } else {
+          fprintf(stderr, "Error opening PCAP files.\n");
+        }
       }
     } else {
-      fprintf(stderr, "'%s' doesn't exist or is not a directory.\n", argv[2]);
+      fprintf(stderr,
+              "'%s' doesn't exist or is not a directory.\n",
+              argv[argc - 1]);
     }
   } else {
-    fprintf(stderr, "Usage: %s <filename> <directory>\n", argv[0]);
+    fprintf(stderr,
+            "Usage: %s <filename> [<filename> ...] <directory>\n",
+            argv[0]);
   }
 
   return -1;
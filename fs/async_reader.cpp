@@ -0,0 +1,406 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include "fs/async_reader.h"
+
+bool fs::async_reader::open(int fd, size_t queue_depth, size_t buffer_size)
+{
+  close();
+
+  // Sanity check.
+  if (queue_depth == 0) {
+    queue_depth = 1;
+  } else if (queue_depth > max_queue_depth) {
+    queue_depth = max_queue_depth;
+  }
+
+  if (buffer_size < min_buffer_size) {
+    buffer_size = min_buffer_size;
+  }
+
+  struct stat sbuf;
+  if (fstat(fd, &sbuf) < 0) {
+    return false;
+  }
+
+  // Set up io_uring.
+  io_uring_params params;
+  memset(&params, 0, sizeof(io_uring_params));
+
+  _M_ringfd = syscall(__NR_io_uring_setup, queue_depth, &params);
+  if (_M_ringfd < 0) {
+    _M_ringfd = -1;
+    return false;
+  }
+
+  _M_sqring_size = params.sq_off.array +
+                   (params.sq_entries * sizeof(uint32_t));
+
+  _M_cqring_size = params.cq_off.cqes +
+                   (params.cq_entries * sizeof(io_uring_cqe));
+
+  // If both rings can be mapped with a single mmap()...
+  const bool single_mmap = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+  if (single_mmap) {
+    if (_M_cqring_size > _M_sqring_size) {
+      _M_sqring_size = _M_cqring_size;
+    }
+  }
+
+  // Map submission queue ring.
+  if ((_M_sqring = mmap(nullptr,
+                        _M_sqring_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        _M_ringfd,
+                        IORING_OFF_SQ_RING)) != MAP_FAILED) {
+    // Map completion queue ring.
+    if (single_mmap) {
+      _M_cqring = _M_sqring;
+    } else {
+      _M_cqring = mmap(nullptr,
+                       _M_cqring_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       _M_ringfd,
+                       IORING_OFF_CQ_RING);
+    }
+
+    if (_M_cqring != MAP_FAILED) {
+      // Map submission queue entries.
+      _M_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+      if ((_M_sqes = static_cast<io_uring_sqe*>(
+                       mmap(nullptr,
+                            _M_sqes_size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE,
+                            _M_ringfd,
+                            IORING_OFF_SQES)
+                     )) != MAP_FAILED) {
+        uint8_t* const sq = static_cast<uint8_t*>(_M_sqring);
+        uint8_t* const cq = static_cast<uint8_t*>(_M_cqring);
+
+        _M_sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        _M_sq_mask = *reinterpret_cast<uint32_t*>(sq +
+                                                  params.sq_off.ring_mask);
+        _M_sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+        _M_cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        _M_cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        _M_cq_mask = *reinterpret_cast<uint32_t*>(cq +
+                                                  params.cq_off.ring_mask);
+        _M_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        _M_to_submit = 0;
+
+        // Allocate buffers.
+        if ((_M_mem = static_cast<uint8_t*>(
+                        malloc(queue_depth * buffer_size)
+                      )) != nullptr) {
+          struct iovec iov[max_queue_depth];
+
+          for (size_t i = 0; i < queue_depth; i++) {
+            _M_buffers[i].data = _M_mem + (i * buffer_size);
+            _M_buffers[i].st = state::free;
+
+            iov[i].iov_base = _M_buffers[i].data;
+            iov[i].iov_len = buffer_size;
+          }
+
+          _M_nbuffers = queue_depth;
+          _M_buffer_size = buffer_size;
+
+          // Register buffers (if it fails, e.g. because of RLIMIT_MEMLOCK,
+          // the buffers are used as normal buffers).
+          _M_fixed = (syscall(__NR_io_uring_register,
+                              _M_ringfd,
+                              IORING_REGISTER_BUFFERS,
+                              iov,
+                              queue_depth) == 0);
+
+          // Positioned reads?
+          off_t off;
+          if (((S_ISREG(sbuf.st_mode)) || (S_ISBLK(sbuf.st_mode))) &&
+              ((off = lseek(fd, 0, SEEK_CUR)) != -1)) {
+            _M_seekable = true;
+            _M_offset = off;
+          } else {
+            _M_seekable = false;
+            _M_offset = 0;
+          }
+
+          _M_fd = fd;
+
+          _M_current = 0;
+          _M_pos = 0;
+
+          _M_next = 0;
+
+          _M_in_flight = 0;
+
+          _M_eof = false;
+
+          // Submit the first reads.
+          submit();
+
+          return true;
+        }
+      }
+    }
+  }
+
+  close();
+
+  return false;
+}
+
+void fs::async_reader::close()
+{
+  if (_M_ringfd != -1) {
+    // The kernel might still write into the buffers.
+    cancel();
+
+    if (_M_sqes != MAP_FAILED) {
+      munmap(_M_sqes, _M_sqes_size);
+      _M_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    }
+
+    if (_M_cqring != MAP_FAILED) {
+      if (_M_cqring != _M_sqring) {
+        munmap(_M_cqring, _M_cqring_size);
+      }
+
+      _M_cqring = MAP_FAILED;
+    }
+
+    if (_M_sqring != MAP_FAILED) {
+      munmap(_M_sqring, _M_sqring_size);
+      _M_sqring = MAP_FAILED;
+    }
+
+    // Close the ring (unregisters the buffers).
+    ::close(_M_ringfd);
+    _M_ringfd = -1;
+  }
+
+  if (_M_mem) {
+    free(_M_mem);
+    _M_mem = nullptr;
+  }
+}
+
+ssize_t fs::async_reader::read(void* buf, size_t count)
+{
+  buffer& b = _M_buffers[_M_current];
+
+  // Wait for the buffer to be read.
+  while (b.st != state::done) {
+    // If the read of the buffer has not been submitted (end of file)...
+    if (b.st == state::free) {
+      return 0;
+    }
+
+    if (!enter(1)) {
+      return -1;
+    }
+
+    complete();
+    submit();
+  }
+
+  if (b.error) {
+    errno = EIO;
+    return -1;
+  }
+
+  // End of file?
+  if (b.len == 0) {
+    return 0;
+  }
+
+  const size_t left = b.len - _M_pos;
+  if (count > left) {
+    count = left;
+  }
+
+  memcpy(buf, b.data + _M_pos, count);
+
+  // If the buffer has been completely read...
+  if ((_M_pos += count) == b.len) {
+    b.st = state::free;
+
+    _M_current = (_M_current + 1) % _M_nbuffers;
+    _M_pos = 0;
+
+    // Process the reads which have completed in the meantime and reuse the
+    // buffer.
+    complete();
+    submit();
+  }
+
+  return count;
+}
+
+void fs::async_reader::submit()
+{
+  // Prepare the reads of the free buffers (in order).
+  while ((!_M_eof) &&
+         (_M_buffers[_M_next].st == state::free) &&
+         ((_M_seekable) || (_M_in_flight == 0))) {
+    buffer& b = _M_buffers[_M_next];
+
+    b.len = 0;
+    b.offset = _M_offset;
+    b.st = state::in_flight;
+    b.error = false;
+
+    if (_M_seekable) {
+      _M_offset += _M_buffer_size;
+    }
+
+    prepare(_M_next);
+
+    _M_next = (_M_next + 1) % _M_nbuffers;
+  }
+
+  if (_M_to_submit > 0) {
+    enter(0);
+  }
+}
+
+void fs::async_reader::cancel()
+{
+  if (_M_mem) {
+    // Cancel the reads in flight.
+    for (size_t i = 0; i < _M_nbuffers; i++) {
+      if (_M_buffers[i].st == state::in_flight) {
+        io_uring_sqe* const sqe = next_sqe();
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = i;
+        sqe->user_data = cancel_user_data;
+
+        _M_to_submit++;
+      }
+    }
+
+    // Wait for the reads.
+    while (_M_in_flight > 0) {
+      if (!enter(1)) {
+        break;
+      }
+
+      uint32_t head = *_M_cq_head;
+      const uint32_t tail = __atomic_load_n(_M_cq_tail, __ATOMIC_ACQUIRE);
+
+      for (; head != tail; head++) {
+        if (_M_cqes[head & _M_cq_mask].user_data != cancel_user_data) {
+          _M_in_flight--;
+        }
+      }
+
+      __atomic_store_n(_M_cq_head, head, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+io_uring_sqe* fs::async_reader::next_sqe()
+{
+  // Only this thread writes the tail.
+  const uint32_t tail = *_M_sq_tail;
+  const uint32_t i = tail & _M_sq_mask;
+
+  io_uring_sqe* const sqe = &_M_sqes[i];
+  memset(sqe, 0, sizeof(io_uring_sqe));
+
+  _M_sq_array[i] = i;
+
+  __atomic_store_n(_M_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  return sqe;
+}
+
+void fs::async_reader::prepare(size_t idx)
+{
+  const buffer& b = _M_buffers[idx];
+
+  io_uring_sqe* const sqe = next_sqe();
+
+  sqe->opcode = _M_fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd = _M_fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(b.data + b.len);
+  sqe->len = _M_buffer_size - b.len;
+
+  // Pipes and sockets read from the current position.
+  sqe->off = _M_seekable ? b.offset + b.len : static_cast<uint64_t>(-1);
+
+  sqe->buf_index = idx;
+  sqe->user_data = idx;
+
+  _M_to_submit++;
+  _M_in_flight++;
+}
+
+bool fs::async_reader::enter(uint32_t min_complete)
+{
+  do {
+    const long ret = syscall(__NR_io_uring_enter,
+                             _M_ringfd,
+                             _M_to_submit,
+                             min_complete,
+                             (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0,
+                             nullptr,
+                             0);
+
+    if (ret >= 0) {
+      _M_to_submit -= ret;
+      return true;
+    } else if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+      return false;
+    }
+  } while (true);
+}
+
+void fs::async_reader::complete()
+{
+  uint32_t head = *_M_cq_head;
+  const uint32_t tail = __atomic_load_n(_M_cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    const io_uring_cqe* const cqe = &_M_cqes[head & _M_cq_mask];
+    const size_t idx = cqe->user_data;
+    buffer& b = _M_buffers[idx];
+
+    _M_in_flight--;
+
+    if (cqe->res > 0) {
+      b.len += cqe->res;
+
+      // If a positioned read has returned less than requested, read the
+      // rest (the following buffers have been requested at the following
+      // offsets).
+      if ((_M_seekable) && (b.len < _M_buffer_size)) {
+        prepare(idx);
+      } else {
+        b.st = state::done;
+      }
+    } else if (cqe->res == 0) {
+      // End of file.
+      b.st = state::done;
+      _M_eof = true;
+    } else if ((cqe->res == -EINTR) || (cqe->res == -EAGAIN)) {
+      // Retry.
+      prepare(idx);
+    } else {
+      b.st = state::done;
+      b.error = true;
+      _M_eof = true;
+    }
+  }
+
+  __atomic_store_n(_M_cq_head, head, __ATOMIC_RELEASE);
+}
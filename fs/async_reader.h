@@ -0,0 +1,179 @@
+#ifndef FS_ASYNC_READER_H
+#define FS_ASYNC_READER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+
+namespace fs {
+  // Asynchronous reader (io_uring, raw system calls).
+  // Keeps up to 'queue depth' reads in flight into fixed (registered)
+  // buffers, so that reading the file descriptor overlaps with processing
+  // the data already read. The data is returned in order.
+  // Files which support positioned reads (regular files and block devices)
+  // have all the buffers in flight, at consecutive offsets; pipes and sockets
+  // have a single read in flight (the order of concurrent reads wouldn't be
+  // guaranteed).
+  class async_reader {
+    public:
+      // Default queue depth.
+      static constexpr const size_t default_queue_depth = 4;
+
+      // Maximum queue depth.
+      static constexpr const size_t max_queue_depth = 64;
+
+      // Default buffer size (256 KiB).
+      static constexpr const size_t default_buffer_size = 256 * 1024;
+
+      // Minimum buffer size (4 KiB).
+      static constexpr const size_t min_buffer_size = 4 * 1024;
+
+      // Constructor.
+      async_reader() = default;
+
+      // Destructor.
+      ~async_reader();
+
+      // Open reader (the file descriptor is not closed by close()).
+      // Fails if io_uring is not available.
+      bool open(int fd,
+                size_t queue_depth = default_queue_depth,
+                size_t buffer_size = default_buffer_size);
+
+      // Is the reader open?
+      bool open() const;
+
+      // Close reader.
+      void close();
+
+      // Read.
+      // Returns the number of bytes read, 0 at the end of the file or -1 on
+      // error.
+      ssize_t read(void* buf, size_t count);
+
+    private:
+      // User data of the cancel requests.
+      static constexpr const uint64_t cancel_user_data = UINT64_MAX;
+
+      // Buffer state.
+      enum class state {
+        free,
+        in_flight,
+        done
+      };
+
+      // Buffer.
+      struct buffer {
+        // Data.
+        uint8_t* data;
+
+        // Number of bytes read.
+        size_t len;
+
+        // Offset of the first byte of the buffer in the file.
+        uint64_t offset;
+
+        // State.
+        state st;
+
+        // Error?
+        bool error;
+      };
+
+      // io_uring file descriptor.
+      int _M_ringfd = -1;
+
+      // File descriptor.
+      int _M_fd;
+
+      // Does the file descriptor support positioned reads?
+      bool _M_seekable;
+
+      // Offset of the next read (positioned reads).
+      uint64_t _M_offset;
+
+      // Submission queue ring and entries.
+      void* _M_sqring = MAP_FAILED;
+      size_t _M_sqring_size;
+      io_uring_sqe* _M_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+      size_t _M_sqes_size;
+
+      uint32_t* _M_sq_tail;
+      uint32_t _M_sq_mask;
+      uint32_t* _M_sq_array;
+
+      // Completion queue ring (it might share the mapping with the
+      // submission queue ring).
+      void* _M_cqring = MAP_FAILED;
+      size_t _M_cqring_size;
+
+      uint32_t* _M_cq_head;
+      uint32_t* _M_cq_tail;
+      uint32_t _M_cq_mask;
+      io_uring_cqe* _M_cqes;
+
+      // Number of submission queue entries to be submitted.
+      uint32_t _M_to_submit;
+
+      // Memory of the buffers.
+      uint8_t* _M_mem = nullptr;
+
+      // Have the buffers been registered?
+      bool _M_fixed;
+
+      // Buffers.
+      buffer _M_buffers[max_queue_depth];
+      size_t _M_nbuffers;
+      size_t _M_buffer_size;
+
+      // Buffer being read and position in it.
+      size_t _M_current;
+      size_t _M_pos;
+
+      // Next buffer to be submitted.
+      size_t _M_next;
+
+      // Number of reads in flight.
+      size_t _M_in_flight;
+
+      // Has the end of the file (or an error) been reached?
+      bool _M_eof;
+
+      // Submit the reads of the free buffers.
+      void submit();
+
+      // Get next submission queue entry.
+      io_uring_sqe* next_sqe();
+
+      // Prepare read of (the rest of) a buffer.
+      void prepare(size_t idx);
+
+      // Cancel the reads in flight and wait for them.
+      void cancel();
+
+      // Enter the kernel: submit the prepared reads and wait for at least
+      // 'min_complete' completions.
+      bool enter(uint32_t min_complete);
+
+      // Process completions.
+      void complete();
+
+      // Disable copy constructor and assignment operator.
+      async_reader(const async_reader&) = delete;
+      async_reader& operator=(const async_reader&) = delete;
+  };
+
+  inline async_reader::~async_reader()
+  {
+    close();
+  }
+
+  inline bool async_reader::open() const
+  {
+    return (_M_ringfd != -1);
+  }
+}
+
+#endif // FS_ASYNC_READER_H
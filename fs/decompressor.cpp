@@ -0,0 +1,495 @@
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <new>
+
+#if HAVE_ZLIB
+  #include <zlib.h>
+#endif
+
+#if HAVE_ZSTD
+  #include <zstd.h>
+#endif
+
+#if HAVE_LZ4
+  #include <lz4frame.h>
+#endif
+
+#include "fs/decompressor.h"
+
+fs::decompressor::format fs::decompressor::detect(const void* buf, size_t len)
+{
+  const uint8_t* const b = static_cast<const uint8_t*>(buf);
+
+  // gzip (RFC 1952).
+  if ((len >= 2) && (b[0] == 0x1f) && (b[1] == 0x8b)) {
+    return format::gzip;
+  }
+
+  if (len >= 4) {
+    // zstd frame (0xfd2fb528).
+    if ((b[0] == 0x28) && (b[1] == 0xb5) && (b[2] == 0x2f) && (b[3] == 0xfd)) {
+      return format::zstd;
+    }
+
+    // lz4 frame (0x184d2204).
+    if ((b[0] == 0x04) && (b[1] == 0x22) && (b[2] == 0x4d) && (b[3] == 0x18)) {
+      return format::lz4;
+    }
+  }
+
+  return format::none;
+}
+
+bool fs::decompressor::open(const char* filename)
+{
+  close();
+
+  // Open file for reading.
+  if ((_M_fd = ::open(filename, O_RDONLY)) != -1) {
+    struct stat sbuf;
+    uint8_t magic[4];
+
+    // If the file is compressed in a supported format...
+    if ((fstat(_M_fd, &sbuf) == 0) &&
+        (S_ISREG(sbuf.st_mode)) &&
+        (pread(_M_fd, magic, sizeof(magic), 0) ==
+         static_cast<ssize_t>(sizeof(magic))) &&
+        ((_M_format = detect(magic, sizeof(magic))) != format::none) &&
+        (create_decoder())) {
+      _M_filesize = sbuf.st_size;
+
+      // The file is read sequentially.
+      posix_fadvise(_M_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+      // Allocate buffers (compressed data followed by the buffers of
+      // decompressed data).
+      if ((_M_in = static_cast<uint8_t*>(
+                     malloc(input_buffer_size + (nbuffers * buffer_size))
+                   )) != nullptr) {
+        _M_inptr = _M_in;
+        _M_inend = _M_in;
+        _M_inputeof = false;
+
+        for (size_t i = 0; i < nbuffers; i++) {
+          _M_buffers[i].data = _M_in + input_buffer_size + (i * buffer_size);
+          _M_buffers[i].len = 0;
+        }
+
+        _M_boundary = false;
+
+        _M_producer = 0;
+        _M_consumer = 0;
+
+        _M_current = nullptr;
+        _M_offset = 0;
+
+        _M_full = 0;
+
+        _M_eof = false;
+        _M_error = false;
+        _M_stop = false;
+
+        pthread_mutex_init(&_M_mutex, nullptr);
+        pthread_cond_init(&_M_not_empty, nullptr);
+        pthread_cond_init(&_M_not_full, nullptr);
+
+        // Start decompression thread.
+        if (pthread_create(&_M_thread, nullptr, run, this) == 0) {
+          _M_running = true;
+          return true;
+        }
+
+        pthread_cond_destroy(&_M_not_full);
+        pthread_cond_destroy(&_M_not_empty);
+        pthread_mutex_destroy(&_M_mutex);
+      }
+    }
+
+    close();
+  }
+
+  return false;
+}
+
+void fs::decompressor::close()
+{
+  // Stop decompression thread.
+  if (_M_running) {
+    pthread_mutex_lock(&_M_mutex);
+
+    _M_stop = true;
+    pthread_cond_signal(&_M_not_full);
+
+    pthread_mutex_unlock(&_M_mutex);
+
+    pthread_join(_M_thread, nullptr);
+
+    pthread_cond_destroy(&_M_not_full);
+    pthread_cond_destroy(&_M_not_empty);
+    pthread_mutex_destroy(&_M_mutex);
+
+    _M_running = false;
+  }
+
+  destroy_decoder();
+
+  if (_M_in) {
+    free(_M_in);
+    _M_in = nullptr;
+  }
+
+  if (_M_fd != -1) {
+    ::close(_M_fd);
+    _M_fd = -1;
+  }
+
+  _M_filesize = 0;
+  _M_format = format::none;
+}
+
+ssize_t fs::decompressor::read(void* buf, size_t count)
+{
+  // If there is no buffer being read...
+  if (!_M_current) {
+    pthread_mutex_lock(&_M_mutex);
+
+    // Wait for the next buffer.
+    while ((_M_full == 0) && (!_M_eof)) {
+      pthread_cond_wait(&_M_not_empty, &_M_mutex);
+    }
+
+    const bool empty = (_M_full == 0);
+    const bool error = _M_error;
+
+    pthread_mutex_unlock(&_M_mutex);
+
+    // No more data?
+    if (empty) {
+      if (error) {
+        errno = EIO;
+        return -1;
+      }
+
+      return 0;
+    }
+
+    _M_current = &_M_buffers[_M_consumer];
+    _M_offset = 0;
+  }
+
+  const size_t left = _M_current->len - _M_offset;
+  if (count > left) {
+    count = left;
+  }
+
+  memcpy(buf, _M_current->data + _M_offset, count);
+
+  // If the buffer has been completely read...
+  if ((_M_offset += count) == _M_current->len) {
+    _M_current = nullptr;
+
+    _M_consumer = (_M_consumer + 1) % nbuffers;
+
+    // Hand the buffer back to the decompression thread.
+    pthread_mutex_lock(&_M_mutex);
+
+    _M_full--;
+    pthread_cond_signal(&_M_not_full);
+
+    pthread_mutex_unlock(&_M_mutex);
+  }
+
+  return count;
+}
+
+bool fs::decompressor::create_decoder()
+{
+  switch (_M_format) {
+    case format::gzip:
+      {
+#if HAVE_ZLIB
+        z_stream* const z = new (std::nothrow) z_stream;
+        if (z) {
+          memset(z, 0, sizeof(z_stream));
+
+          // gzip header and trailer.
+          if (inflateInit2(z, 16 + MAX_WBITS) == Z_OK) {
+            _M_state = z;
+            _M_decode = &decompressor::decode_gzip;
+
+            return true;
+          }
+
+          delete z;
+        }
+#endif // HAVE_ZLIB
+
+        return false;
+      }
+    case format::zstd:
+      {
+#if HAVE_ZSTD
+        ZSTD_DStream* const ds = ZSTD_createDStream();
+        if (ds) {
+          if (!ZSTD_isError(ZSTD_initDStream(ds))) {
+            _M_state = ds;
+            _M_decode = &decompressor::decode_zstd;
+
+            return true;
+          }
+
+          ZSTD_freeDStream(ds);
+        }
+#endif // HAVE_ZSTD
+
+        return false;
+      }
+    case format::lz4:
+      {
+#if HAVE_LZ4
+        LZ4F_dctx* ctx;
+        if (!LZ4F_isError(LZ4F_createDecompressionContext(&ctx,
+                                                          LZ4F_VERSION))) {
+          _M_state = ctx;
+          _M_decode = &decompressor::decode_lz4;
+
+          return true;
+        }
+#endif // HAVE_LZ4
+
+        return false;
+      }
+    default:
+      return false;
+  }
+}
+
+void fs::decompressor::destroy_decoder()
+{
+  if (_M_state) {
+    switch (_M_format) {
+      case format::gzip:
+#if HAVE_ZLIB
+        inflateEnd(static_cast<z_stream*>(_M_state));
+        delete static_cast<z_stream*>(_M_state);
+#endif // HAVE_ZLIB
+
+        break;
+      case format::zstd:
+#if HAVE_ZSTD
+        ZSTD_freeDStream(static_cast<ZSTD_DStream*>(_M_state));
+#endif // HAVE_ZSTD
+
+        break;
+      case format::lz4:
+#if HAVE_LZ4
+        LZ4F_freeDecompressionContext(static_cast<LZ4F_dctx*>(_M_state));
+#endif // HAVE_LZ4
+
+        break;
+      default:
+        break;
+    }
+
+    _M_state = nullptr;
+  }
+}
+
+bool fs::decompressor::decode_gzip(const uint8_t* in,
+                                   size_t& inlen,
+                                   uint8_t* out,
+                                   size_t& outlen)
+{
+#if HAVE_ZLIB
+  z_stream* const z = static_cast<z_stream*>(_M_state);
+
+  z->next_in = const_cast<Bytef*>(in);
+  z->avail_in = inlen;
+  z->next_out = out;
+  z->avail_out = outlen;
+
+  const int ret = inflate(z, Z_NO_FLUSH);
+
+  inlen -= z->avail_in;
+  outlen -= z->avail_out;
+
+  switch (ret) {
+    case Z_OK:
+      if ((inlen > 0) || (outlen > 0)) {
+        _M_boundary = false;
+      }
+
+      return true;
+    case Z_BUF_ERROR:
+      // No progress possible (no more input).
+      return true;
+    case Z_STREAM_END:
+      // End of the gzip member (there might be more members).
+      _M_boundary = true;
+      return (inflateReset(z) == Z_OK);
+    default:
+      return false;
+  }
+#else
+  return false;
+#endif // HAVE_ZLIB
+}
+
+bool fs::decompressor::decode_zstd(const uint8_t* in,
+                                   size_t& inlen,
+                                   uint8_t* out,
+                                   size_t& outlen)
+{
+#if HAVE_ZSTD
+  ZSTD_inBuffer input = {in, inlen, 0};
+  ZSTD_outBuffer output = {out, outlen, 0};
+
+  const size_t ret = ZSTD_decompressStream(static_cast<ZSTD_DStream*>(_M_state),
+                                           &output,
+                                           &input);
+
+  if (!ZSTD_isError(ret)) {
+    inlen = input.pos;
+    outlen = output.pos;
+
+    // End of frame?
+    if (ret == 0) {
+      _M_boundary = true;
+    } else if ((inlen > 0) || (outlen > 0)) {
+      _M_boundary = false;
+    }
+
+    return true;
+  }
+#endif // HAVE_ZSTD
+
+  return false;
+}
+
+bool fs::decompressor::decode_lz4(const uint8_t* in,
+                                  size_t& inlen,
+                                  uint8_t* out,
+                                  size_t& outlen)
+{
+#if HAVE_LZ4
+  const size_t ret = LZ4F_decompress(static_cast<LZ4F_dctx*>(_M_state),
+                                     out,
+                                     &outlen,
+                                     in,
+                                     &inlen,
+                                     nullptr);
+
+  if (!LZ4F_isError(ret)) {
+    // End of frame?
+    if (ret == 0) {
+      _M_boundary = true;
+    } else if ((inlen > 0) || (outlen > 0)) {
+      _M_boundary = false;
+    }
+
+    return true;
+  }
+#endif // HAVE_LZ4
+
+  return false;
+}
+
+bool fs::decompressor::fill(buffer& buf, bool& eof)
+{
+  buf.len = 0;
+
+  do {
+    // If the buffer of compressed data is empty...
+    if ((_M_inptr == _M_inend) && (!_M_inputeof)) {
+      ssize_t ret;
+      while (((ret = ::read(_M_fd, _M_in, input_buffer_size)) < 0) &&
+             (errno == EINTR));
+
+      if (ret > 0) {
+        _M_inptr = _M_in;
+        _M_inend = _M_in + ret;
+      } else if (ret == 0) {
+        _M_inputeof = true;
+      } else {
+        return false;
+      }
+    }
+
+    // Decode (at the end of the file, the decoder might still have data to
+    // flush).
+    size_t inlen = _M_inend - _M_inptr;
+    size_t outlen = buffer_size - buf.len;
+    if (!(this->*_M_decode)(_M_inptr, inlen, buf.data + buf.len, outlen)) {
+      return false;
+    }
+
+    // If no progress has been made...
+    if ((inlen == 0) && (outlen == 0)) {
+      // If the whole file has been decoded...
+      if (_M_inputeof) {
+        eof = true;
+
+        // The file has to end at the end of a frame (otherwise it is
+        // truncated).
+        return _M_boundary;
+      }
+
+      return false;
+    }
+
+    _M_inptr += inlen;
+    buf.len += outlen;
+  } while (buf.len < buffer_size);
+
+  return true;
+}
+
+void* fs::decompressor::run(void* arg)
+{
+  decompressor* const d = static_cast<decompressor*>(arg);
+
+  bool eof = false;
+
+  do {
+    pthread_mutex_lock(&d->_M_mutex);
+
+    // Wait for a free buffer.
+    while ((d->_M_full == nbuffers) && (!d->_M_stop)) {
+      pthread_cond_wait(&d->_M_not_full, &d->_M_mutex);
+    }
+
+    const bool stop = d->_M_stop;
+
+    pthread_mutex_unlock(&d->_M_mutex);
+
+    if (stop) {
+      break;
+    }
+
+    // The reader doesn't access the buffer until it is counted as full.
+    buffer& buf = d->_M_buffers[d->_M_producer];
+    const bool ret = d->fill(buf, eof);
+
+    pthread_mutex_lock(&d->_M_mutex);
+
+    if (buf.len > 0) {
+      d->_M_producer = (d->_M_producer + 1) % nbuffers;
+      d->_M_full++;
+    }
+
+    if (!ret) {
+      d->_M_error = true;
+      eof = true;
+    }
+
+    d->_M_eof = eof;
+
+    pthread_cond_signal(&d->_M_not_empty);
+
+    pthread_mutex_unlock(&d->_M_mutex);
+  } while (!eof);
+
+  return nullptr;
+}
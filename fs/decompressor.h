@@ -0,0 +1,195 @@
+#ifndef FS_DECOMPRESSOR_H
+#define FS_DECOMPRESSOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+namespace fs {
+  // Decompressor of gzip, zstd and lz4 (frame format) files.
+  // The format is detected by the magic bytes. The file is decompressed by a
+  // background thread into a ring of buffers, so that the reader only copies
+  // already decompressed data (it only waits when the decompressor is slower
+  // than the reader).
+  // gzip requires HAVE_ZLIB, zstd HAVE_ZSTD and lz4 HAVE_LZ4.
+  class decompressor {
+    public:
+      // Compression format.
+      enum class format {
+        none,
+        gzip,
+        zstd,
+        lz4
+      };
+
+      // Number of buffers of decompressed data.
+      static constexpr const size_t nbuffers = 2;
+
+      // Size of the buffers of decompressed data (1 MiB).
+      static constexpr const size_t
+             buffer_size = static_cast<size_t>(1) << 20;
+
+      // Size of the buffer of compressed data (256 KiB).
+      static constexpr const size_t input_buffer_size = 256 * 1024;
+
+      // Constructor.
+      decompressor() = default;
+
+      // Destructor.
+      ~decompressor();
+
+      // Detect compression format from the first bytes of a file.
+      static format detect(const void* buf, size_t len);
+
+      // Open compressed file and start the decompression thread.
+      // Fails if the file is not compressed or the format is not supported.
+      bool open(const char* filename);
+
+      // Is the file open?
+      bool open() const;
+
+      // Close file.
+      void close();
+
+      // Get compression format.
+      format compression() const;
+
+      // Get size of the compressed file.
+      size_t filesize() const;
+
+      // Read decompressed data.
+      // Returns the number of bytes read, 0 at the end of the data or -1 on
+      // error (corrupted or truncated file).
+      ssize_t read(void* buf, size_t count);
+
+    private:
+      // Buffer of decompressed data.
+      struct buffer {
+        uint8_t* data;
+        size_t len;
+      };
+
+      // Decode data.
+      // On input, 'inlen' is the number of bytes available in 'in' and
+      // 'outlen' the free space in 'out'; on output, the number of bytes
+      // consumed and produced.
+      typedef bool (decompressor::*fndecode)(const uint8_t* in,
+                                             size_t& inlen,
+                                             uint8_t* out,
+                                             size_t& outlen);
+
+      // File descriptor.
+      int _M_fd = -1;
+
+      // Size of the compressed file.
+      size_t _M_filesize = 0;
+
+      // Compression format.
+      format _M_format = format::none;
+
+      // Decoder state (z_stream, ZSTD_DStream or LZ4F_dctx).
+      void* _M_state = nullptr;
+
+      // Decode function.
+      fndecode _M_decode;
+
+      // Is the decoder at the end of a frame (gzip member)?
+      bool _M_boundary;
+
+      // Buffer of compressed data (used by the decompression thread).
+      uint8_t* _M_in = nullptr;
+      const uint8_t* _M_inptr;
+      const uint8_t* _M_inend;
+
+      // Has the whole compressed file been read?
+      bool _M_inputeof;
+
+      // Buffers of decompressed data.
+      buffer _M_buffers[nbuffers];
+
+      // Next buffer to be filled (decompression thread).
+      size_t _M_producer;
+
+      // Next buffer to be read (reader).
+      size_t _M_consumer;
+
+      // Buffer being read (nullptr: none) and offset in it.
+      const buffer* _M_current;
+      size_t _M_offset;
+
+      // Number of filled buffers.
+      size_t _M_full;
+
+      // Has the decompression thread finished? Has it failed?
+      bool _M_eof;
+      bool _M_error;
+
+      // Has the decompression thread to stop?
+      bool _M_stop;
+
+      // Decompression thread.
+      pthread_t _M_thread;
+      bool _M_running = false;
+
+      // Mutex and condition variables protecting '_M_full', '_M_eof',
+      // '_M_error' and '_M_stop'.
+      pthread_mutex_t _M_mutex;
+      pthread_cond_t _M_not_empty;
+      pthread_cond_t _M_not_full;
+
+      // Create decoder.
+      bool create_decoder();
+
+      // Destroy decoder.
+      void destroy_decoder();
+
+      // Decoders.
+      bool decode_gzip(const uint8_t* in,
+                       size_t& inlen,
+                       uint8_t* out,
+                       size_t& outlen);
+
+      bool decode_zstd(const uint8_t* in,
+                       size_t& inlen,
+                       uint8_t* out,
+                       size_t& outlen);
+
+      bool decode_lz4(const uint8_t* in,
+                      size_t& inlen,
+                      uint8_t* out,
+                      size_t& outlen);
+
+      // Fill buffer (decompression thread).
+      bool fill(buffer& buf, bool& eof);
+
+      // Decompression thread.
+      static void* run(void* arg);
+
+      // Disable copy constructor and assignment operator.
+      decompressor(const decompressor&) = delete;
+      decompressor& operator=(const decompressor&) = delete;
+  };
+
+  inline decompressor::~decompressor()
+  {
+    close();
+  }
+
+  inline bool decompressor::open() const
+  {
+    return (_M_fd != -1);
+  }
+
+  inline decompressor::format decompressor::compression() const
+  {
+    return _M_format;
+  }
+
+  inline size_t decompressor::filesize() const
+  {
+    return _M_filesize;
+  }
+}
+
+#endif // FS_DECOMPRESSOR_H
@@ -17,6 +17,9 @@ namespace fs {
       // Open file for writing.
       bool open(const char* filename);
 
+      // Open file with the given flags.
+      bool open(const char* filename, int flags, mode_t mode = 0644);
+
       // Is the file open?
       bool open() const;
 
@@ -64,6 +67,11 @@ namespace fs {
             -1);
   }
 
+  inline bool file::open(const char* filename, int flags, mode_t mode)
+  {
+    return ((_M_fd = ::open(filename, flags, mode)) != -1);
+  }
+
   inline bool file::open() const
   {
     return (_M_fd != -1);
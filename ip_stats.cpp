@@ -1,75 +1,99 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include "pcap/ip/analyzer.h"
+#include "pcap/ip/parallel_analyzer.h"
+
+// Counters (one per thread).
+struct counters {
+  size_t ipv4;
+  size_t ipv6;
+
+  size_t tcp;
+  size_t udp;
+  size_t icmp;
+  size_t icmpv6;
+
+  size_t count;
+};
+
+static bool count_packet(const net::ip::packet& pkt, void* user);
 
 int main(int argc, const char** argv)
 {
-  if (argc == 2) {
-    pcap::ip::analyzer analyzer;
+  if ((argc == 2) || (argc == 3)) {
+    // Number of threads (0: one per online CPU).
+    size_t nthreads = 0;
+
+    if (argc == 3) {
+      char* end;
+      nthreads = strtoul(argv[2], &end, 10);
+
+      if ((end == argv[2]) ||
+          (*end) ||
+          (nthreads > pcap::ip::parallel_analyzer::max_workers)) {
+        fprintf(stderr, "Invalid number of threads '%s'.\n", argv[2]);
+        return -1;
+      }
+    }
+
+    pcap::ip::parallel_analyzer analyzer;
 
     // Open PCAP file.
-    if (analyzer.open(argv[1])) {
+    if (analyzer.open(argv[1], nthreads)) {
       // Read all packets.
       if (!analyzer.read_all()) {
         fprintf(stderr, "Error reading packets.\n");
         return -1;
       }
 
-      pcap::ip::analyzer::const_iterator it;
-      if (analyzer.begin(it)) {
-        size_t ipv4 = 0;
-        size_t ipv6 = 0;
-
-        size_t tcp = 0;
-        size_t udp = 0;
-        size_t icmp = 0;
-        size_t icmpv6 = 0;
-
-        size_t count = 0;
-
-        do {
-          count++;
-
-          if (it->version() == net::ip::version::v4) {
-            ipv4++;
-          } else {
-            ipv6++;
-          }
-
-          if (it->is_tcp()) {
-            tcp++;
-          } else if (it->is_udp()) {
-            udp++;
-          } else if (it->is_icmp()) {
-            icmp++;
-          } else if (it->is_icmpv6()) {
-            icmpv6++;
-          }
-        } while (analyzer.next(it));
+      // Count packets (one thread per worker).
+      counters c[pcap::ip::parallel_analyzer::max_workers] = {};
+      void* users[pcap::ip::parallel_analyzer::max_workers];
+
+      for (size_t i = 0; i < analyzer.workers(); i++) {
+        users[i] = &c[i];
+      }
+
+      if (!analyzer.for_each_flow(count_packet, users)) {
+        fprintf(stderr, "Error processing packets.\n");
+        return -1;
+      }
+
+      for (size_t i = 1; i < analyzer.workers(); i++) {
+        c[0].ipv4 += c[i].ipv4;
+        c[0].ipv6 += c[i].ipv6;
+        c[0].tcp += c[i].tcp;
+        c[0].udp += c[i].udp;
+        c[0].icmp += c[i].icmp;
+        c[0].icmpv6 += c[i].icmpv6;
+        c[0].count += c[i].count;
+      }
+
+      const size_t count = c[0].count;
 
+      if (count > 0) {
         printf("# IPv4 packets: %zu (%.2f %%)\n",
-               ipv4,
-               (static_cast<float>(ipv4) / count) * 100.0);
+               c[0].ipv4,
+               (static_cast<float>(c[0].ipv4) / count) * 100.0);
 
         printf("# IPv6 packets: %zu (%.2f %%)\n",
-               ipv6,
-               (static_cast<float>(ipv6) / count) * 100.0);
+               c[0].ipv6,
+               (static_cast<float>(c[0].ipv6) / count) * 100.0);
 
         printf("# TCP segments: %zu (%.2f %%)\n",
-               tcp,
-               (static_cast<float>(tcp) / count) * 100.0);
+               c[0].tcp,
+               (static_cast<float>(c[0].tcp) / count) * 100.0);
 
         printf("# UDP datagrams: %zu (%.2f %%)\n",
-               udp,
-               (static_cast<float>(udp) / count) * 100.0);
+               c[0].udp,
+               (static_cast<float>(c[0].udp) / count) * 100.0);
 
         printf("# ICMP datagrams: %zu (%.2f %%)\n",
-               icmp,
-               (static_cast<float>(icmp) / count) * 100.0);
+               c[0].icmp,
+               (static_cast<float>(c[0].icmp) / count) * 100.0);
 
         printf("# ICMPv6 datagrams: %zu (%.2f %%)\n",
-               icmpv6,
-               (static_cast<float>(icmpv6) / count) * 100.0);
+               c[0].icmpv6,
+               (static_cast<float>(c[0].icmpv6) / count) * 100.0);
       } else {
         printf("No packets.\n");
       }
@@ -79,8 +103,35 @@ int main(int argc, const char** argv)
       fprintf(stderr, "Error opening PCAP file '%s'.\n", argv[1]);
     }
   } else {
-    fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+    fprintf(stderr,
+            "Usage: %s <filename> [<number-of-threads> (0: one per CPU)]\n",
+            argv[0]);
   }
 
   return -1;
 }
+
+bool count_packet(const net::ip::packet& pkt, void* user)
+{
+  counters* c = static_cast<counters*>(user);
+
+  c->count++;
+
+  if (pkt.version() == net::ip::version::v4) {
+    c->ipv4++;
+  } else {
+    c->ipv6++;
+  }
+
+  if (pkt.is_tcp()) {
+    c->tcp++;
+  } else if (pkt.is_udp()) {
+    c->udp++;
+  } else if (pkt.is_icmp()) {
+    c->icmp++;
+  } else if (pkt.is_icmpv6()) {
+    c->icmpv6++;
+  }
+
+  return true;
+}
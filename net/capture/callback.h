@@ -2,6 +2,7 @@
 #define NET_CAPTURE_CALLBACK_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <time.h>
 
 namespace net {
@@ -11,6 +12,24 @@ namespace net {
                                  uint32_t len,
                                  const struct timeval& timestamp,
                                  void* user);
+
+    // Frame descriptor.
+    struct frame {
+      // Pointer to the ethernet frame.
+      const void* buf;
+
+      // Length of the ethernet frame.
+      uint32_t len;
+
+      // Frame timestamp, as the number of microseconds since the Epoch,
+      // 1970-01-01 00:00:00 +0000 (UTC).
+      uint64_t timestamp;
+    };
+
+    // Block callback.
+    // The frames stay valid until the callback returns, then the block is
+    // handed back to the kernel.
+    typedef void (*blockfn_t)(const frame* frames, size_t nframes, void* user);
   }
 }
 
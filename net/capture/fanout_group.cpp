@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <new>
+#include "net/capture/fanout_group.h"
+#include "util/numa.h"
+
+void net::capture::fanout_group::clear()
+{
+  // Stop threads.
+  stop();
+
+  for (; _M_nrings > 0; _M_nrings--) {
+    delete _M_workers[_M_nrings - 1].ring;
+  }
+}
+
+bool net::capture::fanout_group::create(unsigned ifindex,
+                                        size_t nrings,
+                                        void* const* users,
+                                        ring_buffer::fanout_mode mode,
+                                        const int* cpus,
+                                        int rcvbuf_size,
+                                        bool promiscuous_mode,
+                                        size_t block_size,
+                                        size_t frame_size,
+                                        size_t frame_count,
+                                        const struct sock_fprog* fprog)
+{
+  // Sanity checks.
+  if ((_M_nrings == 0) && (nrings > 0) && (nrings <= max_rings)) {
+    // Get number of online CPUs.
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus <= 0) {
+      ncpus = 1;
+    }
+
+    // The fanout group identifier is derived from the process id and the
+    // interface index, all the ring buffers join the same group.
+    const int group_id = (getpid() ^ ifindex) & 0xffff;
+
+    for (size_t i = 0; i < nrings; i++) {
+      worker& w = _M_workers[i];
+
+      // Create ring buffer.
+      w.ring = _M_blockfn ?
+                 new (std::nothrow) ring_buffer(_M_blockfn, users[i]) :
+                 new (std::nothrow) ring_buffer(_M_ethernetfn, users[i]);
+
+      if (!w.ring) {
+        clear();
+        return false;
+      }
+
+      w.group = this;
+      w.cpu = cpus ? cpus[i] : static_cast<int>(i % ncpus);
+      w.running = false;
+
+      _M_nrings++;
+
+      // Set fanout mode.
+      w.ring->fanout(mode, group_id);
+
+      // Set busy-poll mode.
+      w.ring->busy_poll(_M_spin_time, _M_busy_poll);
+
+      // If the ring buffer has to be placed on the NUMA node of its
+      // thread...
+      if ((_M_numa_local) && (w.cpu >= 0)) {
+        w.ring->numa(util::numa::node_of_cpu(w.cpu), _M_hugepages);
+      }
+
+      if (!w.ring->create(ifindex,
+                          rcvbuf_size,
+                          promiscuous_mode,
+                          block_size,
+                          frame_size,
+                          frame_count,
+                          fprog)) {
+        clear();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+bool net::capture::fanout_group::start(int timeout)
+{
+  if ((_M_nrings > 0) && (!_M_running)) {
+    _M_timeout = timeout;
+
+    _M_running = true;
+
+    for (size_t i = 0; i < _M_nrings; i++) {
+      worker& w = _M_workers[i];
+
+      // Start thread.
+      if (pthread_create(&w.thread, nullptr, run, &w) == 0) {
+        w.running = true;
+      } else {
+        stop();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void net::capture::fanout_group::stop()
+{
+  _M_running = false;
+
+  for (size_t i = 0; i < _M_nrings; i++) {
+    worker& w = _M_workers[i];
+
+    if (w.running) {
+      pthread_join(w.thread, nullptr);
+      w.running = false;
+    }
+  }
+}
+
+bool
+net::capture::fanout_group::get_statistics(ring_buffer::statistics& stats)
+{
+  if (_M_nrings > 0) {
+    memset(&stats, 0, sizeof(ring_buffer::statistics));
+
+    for (size_t i = 0; i < _M_nrings; i++) {
+      ring_buffer::statistics s;
+      if (!_M_workers[i].ring->get_statistics(s)) {
+        return false;
+      }
+
+      stats.packets += s.packets;
+      stats.drops += s.drops;
+      stats.queue_freezes += s.queue_freezes;
+      stats.blocks += s.blocks;
+      stats.frames += s.frames;
+      stats.block_bytes += s.block_bytes;
+      stats.block_size = s.block_size;
+      stats.polls += s.polls;
+      stats.poll_wakeups += s.poll_wakeups;
+      stats.callback_time += s.callback_time;
+      stats.latency += s.latency;
+      stats.spin_time += s.spin_time;
+      stats.sleep_time += s.sleep_time;
+
+      if (s.max_latency > stats.max_latency) {
+        stats.max_latency = s.max_latency;
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+bool net::capture::fanout_group::show_statistics()
+{
+  for (size_t i = 0; i < _M_nrings; i++) {
+    printf("Ring %zu:\n", i);
+
+    if (!_M_workers[i].ring->show_statistics()) {
+      return false;
+    }
+  }
+
+  ring_buffer::statistics stats;
+  if (get_statistics(stats)) {
+    printf("Total: %" PRIu64 " packets received, %" PRIu64 " dropped, "
+           "%" PRIu64 " blocks processed.\n",
+           stats.packets,
+           stats.drops,
+           stats.blocks);
+
+    return true;
+  }
+
+  return false;
+}
+
+void* net::capture::fanout_group::run(void* arg)
+{
+  worker* w = static_cast<worker*>(arg);
+
+  // If the thread has to be pinned to a CPU...
+  if (w->cpu >= 0) {
+    util::numa::pin(w->cpu);
+  }
+
+  const int timeout = w->group->_M_timeout;
+
+  do {
+    if ((w->ring->read(timeout) < 0) && (errno != EINTR)) {
+      break;
+    }
+  } while (w->group->_M_running);
+
+  return nullptr;
+}
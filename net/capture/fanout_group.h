@@ -0,0 +1,216 @@
+#ifndef NET_CAPTURE_FANOUT_GROUP_H
+#define NET_CAPTURE_FANOUT_GROUP_H
+
+#include <pthread.h>
+#include <atomic>
+#include "net/capture/ring_buffer.h"
+
+namespace net {
+  namespace capture {
+    // Group of ring buffers joined with PACKET_FANOUT.
+    // Each ring buffer is drained by its own thread.
+    class fanout_group {
+      public:
+        // Maximum number of ring buffers.
+        static constexpr const size_t max_rings = 64;
+
+        // Constructor.
+        fanout_group(ethernetfn_t ethernetfn);
+        fanout_group(blockfn_t blockfn);
+
+        // Destructor.
+        ~fanout_group();
+
+        // Clear.
+        void clear();
+
+        // Create.
+        // 'users' contains one user pointer per ring buffer (it is passed to
+        // the callback of the corresponding ring buffer).
+        // 'cpus' contains the CPU to which each thread is pinned (-1: don't
+        // pin the thread). If 'cpus' is nullptr, the thread 'i' is pinned to
+        // the CPU 'i' (modulo the number of online CPUs).
+        bool create(const char* interface,
+                    size_t nrings,
+                    void* const* users,
+                    ring_buffer::fanout_mode
+                      mode = ring_buffer::fanout_mode::hash,
+                    const int* cpus = nullptr,
+                    int rcvbuf_size = 0,
+                    bool promiscuous_mode = true,
+                    size_t block_size = ring_buffer::default_block_size,
+                    size_t frame_size = ring_buffer::default_frame_size,
+                    size_t frame_count = ring_buffer::default_frames,
+                    const struct sock_fprog* fprog = nullptr);
+
+        bool create(unsigned ifindex,
+                    size_t nrings,
+                    void* const* users,
+                    ring_buffer::fanout_mode
+                      mode = ring_buffer::fanout_mode::hash,
+                    const int* cpus = nullptr,
+                    int rcvbuf_size = 0,
+                    bool promiscuous_mode = true,
+                    size_t block_size = ring_buffer::default_block_size,
+                    size_t frame_size = ring_buffer::default_frame_size,
+                    size_t frame_count = ring_buffer::default_frames,
+                    const struct sock_fprog* fprog = nullptr);
+
+        // Enable busy-poll mode in all the ring buffers (must be called before
+        // create(), see ring_buffer::busy_poll()).
+        void busy_poll(unsigned spin_time = ring_buffer::default_spin_time,
+                       unsigned busy_poll = ring_buffer::default_busy_poll);
+
+        // Place each ring buffer on the NUMA node of the CPU its thread is
+        // pinned to (must be called before create(), see
+        // ring_buffer::numa()).
+        void numa(bool local = true, bool hugepages = true);
+
+        // Start threads.
+        bool start(int timeout = ring_buffer::default_read_timeout);
+
+        // Stop threads.
+        void stop();
+
+        // Get number of ring buffers.
+        size_t count() const;
+
+        // Get ring buffer.
+        ring_buffer* get(size_t idx);
+
+        // Get statistics of a ring buffer.
+        bool get_statistics(size_t idx, ring_buffer::statistics& stats);
+
+        // Get aggregated statistics of all the ring buffers.
+        bool get_statistics(ring_buffer::statistics& stats);
+
+        // Show statistics.
+        bool show_statistics();
+
+      private:
+        // Worker.
+        struct worker {
+          // Fanout group.
+          fanout_group* group;
+
+          // Ring buffer.
+          ring_buffer* ring;
+
+          // CPU (-1: don't pin the thread).
+          int cpu;
+
+          // Thread.
+          pthread_t thread;
+
+          // Has the thread been started?
+          bool running;
+        };
+
+        // Workers.
+        worker _M_workers[max_rings];
+
+        // Number of ring buffers.
+        size_t _M_nrings = 0;
+
+        // Ethernet frame callback.
+        ethernetfn_t _M_ethernetfn = nullptr;
+
+        // Block callback.
+        blockfn_t _M_blockfn = nullptr;
+
+        // Read timeout.
+        int _M_timeout;
+
+        // Busy-poll mode (see ring_buffer::busy_poll()).
+        unsigned _M_spin_time = 0;
+        unsigned _M_busy_poll = 0;
+
+        // NUMA placement (see numa()).
+        bool _M_numa_local = false;
+        bool _M_hugepages = false;
+
+        // Running?
+        std::atomic<bool> _M_running;
+
+        // Thread function.
+        static void* run(void* arg);
+
+        // Disable copy constructor and assignment operator.
+        fanout_group(const fanout_group&) = delete;
+        fanout_group& operator=(const fanout_group&) = delete;
+    };
+
+    inline fanout_group::fanout_group(ethernetfn_t ethernetfn)
+      : _M_ethernetfn(ethernetfn),
+        _M_running(false)
+    {
+    }
+
+    inline fanout_group::fanout_group(blockfn_t blockfn)
+      : _M_blockfn(blockfn),
+        _M_running(false)
+    {
+    }
+
+    inline fanout_group::~fanout_group()
+    {
+      clear();
+    }
+
+    inline bool fanout_group::create(const char* interface,
+                                     size_t nrings,
+                                     void* const* users,
+                                     ring_buffer::fanout_mode mode,
+                                     const int* cpus,
+                                     int rcvbuf_size,
+                                     bool promiscuous_mode,
+                                     size_t block_size,
+                                     size_t frame_size,
+                                     size_t frame_count,
+                                     const struct sock_fprog* fprog)
+    {
+      return create(if_nametoindex(interface),
+                    nrings,
+                    users,
+                    mode,
+                    cpus,
+                    rcvbuf_size,
+                    promiscuous_mode,
+                    block_size,
+                    frame_size,
+                    frame_count,
+                    fprog);
+    }
+
+    inline void fanout_group::busy_poll(unsigned spin_time, unsigned busy_poll)
+    {
+      _M_spin_time = spin_time;
+      _M_busy_poll = busy_poll;
+    }
+
+    inline void fanout_group::numa(bool local, bool hugepages)
+    {
+      _M_numa_local = local;
+      _M_hugepages = hugepages;
+    }
+
+    inline size_t fanout_group::count() const
+    {
+      return _M_nrings;
+    }
+
+    inline ring_buffer* fanout_group::get(size_t idx)
+    {
+      return (idx < _M_nrings) ? _M_workers[idx].ring : nullptr;
+    }
+
+    inline bool fanout_group::get_statistics(size_t idx,
+                                             ring_buffer::statistics& stats)
+    {
+      return (idx < _M_nrings) &&
+             (_M_workers[idx].ring->get_statistics(stats));
+    }
+  }
+}
+
+#endif // NET_CAPTURE_FANOUT_GROUP_H
@@ -0,0 +1,1046 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <arpa/inet.h>
+#include "net/capture/filter.h"
+#include "net/ip/ports.h"
+
+void net::capture::filter::clear()
+{
+  free_code();
+
+  if (_M_insns) {
+    free(_M_insns);
+    _M_insns = nullptr;
+  }
+}
+
+bool net::capture::filter::compile(const char* expression, uint32_t snaplen)
+{
+  clear();
+
+  if (expression) {
+    _M_ptr = expression;
+
+    // Get first token.
+    next_token();
+
+    // If the expression is empty...
+    if (_M_token == token_type::end) {
+      // Accept all the packets.
+      if ((stmt(BPF_RET | BPF_K, snaplen)) && (link())) {
+        free_code();
+        return true;
+      }
+    } else {
+      size_t t, f;
+      if ((new_label(t)) &&
+          (new_label(f)) &&
+          (prologue()) &&
+          (parse_expression(t, f)) &&
+          (_M_token == token_type::end)) {
+        // Accept packet.
+        place(t);
+
+        if (stmt(BPF_RET | BPF_K, snaplen)) {
+          // Drop packet.
+          place(f);
+
+          if ((stmt(BPF_RET | BPF_K, 0)) && (link())) {
+            free_code();
+            return true;
+          }
+        }
+      }
+    }
+
+    clear();
+  }
+
+  return false;
+}
+
+void net::capture::filter::print() const
+{
+  for (size_t i = 0; i < count(); i++) {
+    printf("{ 0x%02x, %u, %u, 0x%08x },\n",
+           _M_insns[i].code,
+           _M_insns[i].jt,
+           _M_insns[i].jf,
+           _M_insns[i].k);
+  }
+}
+
+void net::capture::filter::next_token()
+{
+  // Skip whitespaces.
+  while ((*_M_ptr == ' ') ||
+         (*_M_ptr == '\t') ||
+         (*_M_ptr == '\r') ||
+         (*_M_ptr == '\n')) {
+    _M_ptr++;
+  }
+
+  switch (*_M_ptr) {
+    case 0:
+      _M_token = token_type::end;
+      return;
+    case '(':
+      _M_token = token_type::left_parenthesis;
+      _M_ptr++;
+
+      return;
+    case ')':
+      _M_token = token_type::right_parenthesis;
+      _M_ptr++;
+
+      return;
+    case '!':
+      _M_token = token_type::op_not;
+      _M_ptr++;
+
+      return;
+    case '&':
+      if (_M_ptr[1] == '&') {
+        _M_token = token_type::op_and;
+        _M_ptr += 2;
+
+        return;
+      }
+
+      break;
+    case '|':
+      if (_M_ptr[1] == '|') {
+        _M_token = token_type::op_or;
+        _M_ptr += 2;
+
+        return;
+      }
+
+      break;
+  }
+
+  // Word.
+  _M_word = _M_ptr;
+
+  do {
+    _M_ptr++;
+  } while ((*_M_ptr) && (!strchr(" \t\r\n()!&|", *_M_ptr)));
+
+  _M_wordlen = _M_ptr - _M_word;
+
+  _M_token = token_type::word;
+
+  if (is_word("and")) {
+    _M_token = token_type::op_and;
+  } else if (is_word("or")) {
+    _M_token = token_type::op_or;
+  } else if (is_word("not")) {
+    _M_token = token_type::op_not;
+  }
+}
+
+bool net::capture::filter::parse_expression(size_t t, size_t f)
+{
+  do {
+    // Label of the next alternative.
+    size_t next;
+    if ((!new_label(next)) || (!parse_and_expression(t, next))) {
+      return false;
+    }
+
+    if (_M_token != token_type::op_or) {
+      // There are no more alternatives.
+      alias(next, f);
+
+      return true;
+    }
+
+    place(next);
+
+    next_token();
+  } while (true);
+}
+
+bool net::capture::filter::parse_and_expression(size_t t, size_t f)
+{
+  do {
+    // Label of the next term.
+    size_t next;
+    if ((!new_label(next)) || (!parse_unary(next, f))) {
+      return false;
+    }
+
+    if (_M_token != token_type::op_and) {
+      // There are no more terms.
+      alias(next, t);
+
+      return true;
+    }
+
+    place(next);
+
+    next_token();
+  } while (true);
+}
+
+bool net::capture::filter::parse_unary(size_t t, size_t f)
+{
+  switch (_M_token) {
+    case token_type::op_not:
+      next_token();
+
+      // Swap targets.
+      return parse_unary(f, t);
+    case token_type::left_parenthesis:
+      next_token();
+
+      if ((parse_expression(t, f)) &&
+          (_M_token == token_type::right_parenthesis)) {
+        next_token();
+        return true;
+      }
+
+      return false;
+    case token_type::word:
+      return parse_primitive(t, f);
+    default:
+      return false;
+  }
+}
+
+bool net::capture::filter::parse_primitive(size_t t, size_t f)
+{
+  if (is_word("ip")) {
+    next_token();
+    return ethertype(ethertype_ipv4, t, f);
+  } else if (is_word("ip6")) {
+    next_token();
+    return ethertype(ethertype_ipv6, t, f);
+  } else if (is_word("tcp")) {
+    next_token();
+    return protocol(IPPROTO_TCP, true, true, t, f);
+  } else if (is_word("udp")) {
+    next_token();
+    return protocol(IPPROTO_UDP, true, true, t, f);
+  } else if (is_word("icmp")) {
+    next_token();
+    return protocol(IPPROTO_ICMP, true, false, t, f);
+  } else if (is_word("icmp6")) {
+    next_token();
+    return protocol(IPPROTO_ICMPV6, false, true, t, f);
+  } else if (is_word("vlan")) {
+    next_token();
+    return parse_vlan(t, f);
+  }
+
+  direction dir = direction::src_or_dst;
+
+  if (is_word("src")) {
+    dir = direction::src;
+    next_token();
+  } else if (is_word("dst")) {
+    dir = direction::dst;
+    next_token();
+  }
+
+  if (is_word("host")) {
+    next_token();
+    return parse_address(dir, false, t, f);
+  } else if (is_word("net")) {
+    next_token();
+    return parse_address(dir, true, t, f);
+  } else if ((is_word("port")) || (is_word("portrange"))) {
+    // The port list is parsed directly from the expression.
+    return parse_ports(dir, t, f);
+  }
+
+  return false;
+}
+
+bool net::capture::filter::parse_vlan(size_t t, size_t f)
+{
+  bool has_id = false;
+  unsigned id = 0;
+
+  // If a VLAN identifier has been specified...
+  if ((_M_token == token_type::word) &&
+      (*_M_word >= '0') &&
+      (*_M_word <= '9')) {
+    for (size_t i = 0; i < _M_wordlen; i++) {
+      if ((_M_word[i] >= '0') && (_M_word[i] <= '9')) {
+        if ((id = (id * 10) + (_M_word[i] - '0')) > 4095) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+
+    has_id = true;
+
+    next_token();
+  }
+
+  size_t in_packet;
+  if (!new_label(in_packet)) {
+    return false;
+  }
+
+  // Has the tag been stripped by the kernel?
+  if (!stmt(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_VLAN_TAG_PRESENT)) {
+    return false;
+  }
+
+  if (has_id) {
+    if ((!jump(BPF_JMP | BPF_JEQ | BPF_K, 0, in_packet, no_label)) ||
+        (!stmt(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_VLAN_TAG)) ||
+        (!stmt(BPF_ALU | BPF_AND | BPF_K, 0x0fff)) ||
+        (!jump(BPF_JMP | BPF_JEQ | BPF_K, id, t, f))) {
+      return false;
+    }
+  } else {
+    if (!jump(BPF_JMP | BPF_JEQ | BPF_K, 0, in_packet, t)) {
+      return false;
+    }
+  }
+
+  // Is the tag in the packet?
+  place(in_packet);
+
+  if (!stmt(BPF_LD | BPF_MEM, link_length_slot)) {
+    return false;
+  }
+
+  if (has_id) {
+    return ((jump(BPF_JMP | BPF_JGT | BPF_K,
+                  ethernet_header_length,
+                  no_label,
+                  f)) &&
+            (stmt(BPF_LD | BPF_H | BPF_ABS, ethernet_header_length)) &&
+            (stmt(BPF_ALU | BPF_AND | BPF_K, 0x0fff)) &&
+            (jump(BPF_JMP | BPF_JEQ | BPF_K, id, t, f)));
+  } else {
+    return jump(BPF_JMP | BPF_JGT | BPF_K, ethernet_header_length, t, f);
+  }
+}
+
+bool net::capture::filter::parse_address(direction dir,
+                                         bool is_net,
+                                         size_t t,
+                                         size_t f)
+{
+  char addr[INET6_ADDRSTRLEN + 8];
+
+  if ((_M_token != token_type::word) || (_M_wordlen >= sizeof(addr))) {
+    return false;
+  }
+
+  memcpy(addr, _M_word, _M_wordlen);
+  addr[_M_wordlen] = 0;
+
+  next_token();
+
+  // Parse prefix length (if present).
+  int prefixlen = -1;
+
+  char* slash = strchr(addr, '/');
+  if (slash) {
+    // Only networks have prefix length.
+    if (!is_net) {
+      return false;
+    }
+
+    char* end;
+    prefixlen = static_cast<int>(strtol(slash + 1, &end, 10));
+    if ((end == slash + 1) || (*end) || (prefixlen < 0)) {
+      return false;
+    }
+
+    *slash = 0;
+  }
+
+  struct in_addr ipv4;
+  struct in6_addr ipv6;
+
+  if (inet_pton(AF_INET, addr, &ipv4) == 1) {
+    if (prefixlen < 0) {
+      prefixlen = 32;
+    } else if (prefixlen > 32) {
+      return false;
+    }
+
+    const uint32_t mask = (prefixlen > 0) ?
+                            0xffffffffu << (32 - prefixlen) :
+                            0;
+
+    return ipv4_address(dir, ntohl(ipv4.s_addr) & mask, mask, t, f);
+  } else if (inet_pton(AF_INET6, addr, &ipv6) == 1) {
+    if (prefixlen < 0) {
+      prefixlen = 128;
+    } else if (prefixlen > 128) {
+      return false;
+    }
+
+    uint32_t words[4];
+    uint32_t mask[4];
+
+    for (size_t i = 0; i < 4; i++) {
+      if (prefixlen >= 32) {
+        mask[i] = 0xffffffffu;
+        prefixlen -= 32;
+      } else if (prefixlen > 0) {
+        mask[i] = 0xffffffffu << (32 - prefixlen);
+        prefixlen = 0;
+      } else {
+        mask[i] = 0;
+      }
+
+      uint32_t w;
+      memcpy(&w, ipv6.s6_addr + (i * 4), 4);
+
+      words[i] = ntohl(w) & mask[i];
+    }
+
+    return ipv6_address(dir, words, mask, t, f);
+  }
+
+  return false;
+}
+
+bool net::capture::filter::parse_ports(direction dir, size_t t, size_t f)
+{
+  // Skip whitespaces.
+  while ((*_M_ptr == ' ') || (*_M_ptr == '\t')) {
+    _M_ptr++;
+  }
+
+  const char* begin = _M_ptr;
+
+  // The port list contains digits, separators, dashes and whitespaces.
+  while (((*_M_ptr >= '0') && (*_M_ptr <= '9')) ||
+         (*_M_ptr == ',') ||
+         (*_M_ptr == '-') ||
+         (*_M_ptr == ' ') ||
+         (*_M_ptr == '\t')) {
+    _M_ptr++;
+  }
+
+  // Skip trailing whitespaces.
+  const char* end = _M_ptr;
+  while ((end > begin) && ((end[-1] == ' ') || (end[-1] == '\t'))) {
+    end--;
+  }
+
+  const size_t len = end - begin;
+  if ((len == 0) || (len >= max_port_list)) {
+    return false;
+  }
+
+  char list[max_port_list];
+  memcpy(list, begin, len);
+  list[len] = 0;
+
+  next_token();
+
+  // Build port list.
+  net::ip::ports portlist;
+  if (!portlist.build(list)) {
+    return false;
+  }
+
+  // Convert port list to ranges.
+  uint16_t ranges[2 * max_port_ranges];
+  size_t nranges = 0;
+
+  for (unsigned port = 0; port <= 65535; port++) {
+    if (portlist.get(port)) {
+      // If the port is not contiguous to the last range...
+      if ((nranges == 0) || (ranges[(2 * nranges) - 1] + 1u != port)) {
+        if (nranges == max_port_ranges) {
+          return false;
+        }
+
+        ranges[2 * nranges] = port;
+        nranges++;
+      }
+
+      ranges[(2 * nranges) - 1] = port;
+    }
+  }
+
+  return ((nranges > 0) && (ports(dir, ranges, nranges, t, f)));
+}
+
+bool net::capture::filter::prologue()
+{
+  size_t vlan, done;
+  if ((!new_label(vlan)) || (!new_label(done))) {
+    return false;
+  }
+
+  // M[link_length_slot] = length of the link layer header.
+  if ((!stmt(BPF_LD | BPF_IMM, ethernet_header_length)) ||
+      (!stmt(BPF_ST, link_length_slot)) ||
+      (!stmt(BPF_LD | BPF_H | BPF_ABS, ethernet_header_length - 2)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_vlan, vlan, no_label)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_qinq, vlan, done))) {
+    return false;
+  }
+
+  // Outer VLAN tag.
+  place(vlan);
+
+  if ((!stmt(BPF_LD | BPF_IMM, ethernet_header_length + vlan_tag_length)) ||
+      (!stmt(BPF_ST, link_length_slot)) ||
+      (!stmt(BPF_LD | BPF_H | BPF_ABS,
+             ethernet_header_length + vlan_tag_length - 2)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_vlan, no_label, done))) {
+    return false;
+  }
+
+  // Inner VLAN tag.
+  if ((!stmt(BPF_LD | BPF_IMM,
+             ethernet_header_length + (2 * vlan_tag_length))) ||
+      (!stmt(BPF_ST, link_length_slot)) ||
+      (!stmt(BPF_LD | BPF_H | BPF_ABS,
+             ethernet_header_length + (2 * vlan_tag_length) - 2))) {
+    return false;
+  }
+
+  // M[ethertype_slot] = ethertype (after the VLAN tags).
+  place(done);
+
+  size_t not_ipv4, ipv6, ports_offset, not_ip, no_ports, end;
+  if ((!new_label(not_ipv4)) ||
+      (!new_label(ipv6)) ||
+      (!new_label(ports_offset)) ||
+      (!new_label(not_ip)) ||
+      (!new_label(no_ports)) ||
+      (!new_label(end))) {
+    return false;
+  }
+
+  if ((!stmt(BPF_ST, ethertype_slot)) ||
+      (!stmt(BPF_LDX | BPF_MEM, link_length_slot)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_ipv4, no_label, not_ipv4))) {
+    return false;
+  }
+
+  // IPv4: M[protocol_slot] = protocol.
+  if ((!stmt(BPF_LD | BPF_B | BPF_IND, offsetof(struct iphdr, protocol))) ||
+      (!stmt(BPF_ST, protocol_slot))) {
+    return false;
+  }
+
+  // Only the first fragment contains the ports.
+  if ((!stmt(BPF_LD | BPF_H | BPF_IND, offsetof(struct iphdr, frag_off))) ||
+      (!jump(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, no_ports, no_label))) {
+    return false;
+  }
+
+  // A = length of the link layer header + length of the IPv4 header.
+  if ((!stmt(BPF_LD | BPF_B | BPF_IND, 0)) ||
+      (!stmt(BPF_ALU | BPF_AND | BPF_K, 0x0f)) ||
+      (!stmt(BPF_ALU | BPF_LSH | BPF_K, 2)) ||
+      (!stmt(BPF_ALU | BPF_ADD | BPF_X, 0)) ||
+      (!jump(BPF_JMP | BPF_JA, 0, ports_offset, no_label))) {
+    return false;
+  }
+
+  // The accumulator still contains the ethertype.
+  place(not_ipv4);
+
+  if (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_ipv6, ipv6, not_ip)) {
+    return false;
+  }
+
+  // IPv6: M[protocol_slot] = next header (the extension headers are not
+  // followed).
+  place(ipv6);
+
+  if ((!stmt(BPF_LD | BPF_B | BPF_IND, offsetof(struct ip6_hdr, ip6_nxt))) ||
+      (!stmt(BPF_ST, protocol_slot))) {
+    return false;
+  }
+
+  // A = length of the link layer header + length of the IPv6 header.
+  if ((!stmt(BPF_LD | BPF_IMM, sizeof(struct ip6_hdr))) ||
+      (!stmt(BPF_ALU | BPF_ADD | BPF_X, 0))) {
+    return false;
+  }
+
+  // M[ports_offset_slot] = offset of the ports (the source and destination
+  // ports are the first two fields of the TCP, UDP and SCTP headers).
+  place(ports_offset);
+
+  if ((!stmt(BPF_ST, ports_offset_slot)) ||
+      (!stmt(BPF_LD | BPF_MEM, protocol_slot)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, end, no_label)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, end, no_label)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_SCTP, end, no_ports))) {
+    return false;
+  }
+
+  // Not an IP packet: M[protocol_slot] = 0.
+  place(not_ip);
+
+  if ((!stmt(BPF_LD | BPF_IMM, 0)) || (!stmt(BPF_ST, protocol_slot))) {
+    return false;
+  }
+
+  // No ports: M[ports_offset_slot] = 0.
+  place(no_ports);
+
+  if ((!stmt(BPF_LD | BPF_IMM, 0)) || (!stmt(BPF_ST, ports_offset_slot))) {
+    return false;
+  }
+
+  place(end);
+
+  return true;
+}
+
+bool net::capture::filter::ethertype(uint32_t type, size_t t, size_t f)
+{
+  return ((stmt(BPF_LD | BPF_MEM, ethertype_slot)) &&
+          (jump(BPF_JMP | BPF_JEQ | BPF_K, type, t, f)));
+}
+
+bool net::capture::filter::protocol(uint8_t proto,
+                                    bool ipv4,
+                                    bool ipv6,
+                                    size_t t,
+                                    size_t f)
+{
+  // If only one IP version has to be checked...
+  if ((!ipv4) || (!ipv6)) {
+    if ((!stmt(BPF_LD | BPF_MEM, ethertype_slot)) ||
+        (!jump(BPF_JMP | BPF_JEQ | BPF_K,
+               ipv4 ? ethertype_ipv4 : ethertype_ipv6,
+               no_label,
+               f))) {
+      return false;
+    }
+  }
+
+  // The protocol is 0 for packets which are not IP packets.
+  return ((stmt(BPF_LD | BPF_MEM, protocol_slot)) &&
+          (jump(BPF_JMP | BPF_JEQ | BPF_K, proto, t, f)));
+}
+
+bool net::capture::filter::ipv4_address(direction dir,
+                                        uint32_t addr,
+                                        uint32_t mask,
+                                        size_t t,
+                                        size_t f)
+{
+  if ((!stmt(BPF_LD | BPF_MEM, ethertype_slot)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_ipv4, no_label, f)) ||
+      (!stmt(BPF_LDX | BPF_MEM, link_length_slot))) {
+    return false;
+  }
+
+  static constexpr const uint32_t offsets[] = {
+    offsetof(struct iphdr, saddr),
+    offsetof(struct iphdr, daddr)
+  };
+
+  for (size_t i = 0; i < 2; i++) {
+    if (((i == 0) && (dir == direction::dst)) ||
+        ((i == 1) && (dir == direction::src))) {
+      continue;
+    }
+
+    // If the destination address has to be checked afterwards...
+    size_t next = f;
+    if ((i == 0) && (dir == direction::src_or_dst) && (!new_label(next))) {
+      return false;
+    }
+
+    if ((!stmt(BPF_LD | BPF_W | BPF_IND, offsets[i])) ||
+        ((mask != 0xffffffffu) && (!stmt(BPF_ALU | BPF_AND | BPF_K, mask))) ||
+        (!jump(BPF_JMP | BPF_JEQ | BPF_K, addr, t, next))) {
+      return false;
+    }
+
+    if (next != f) {
+      place(next);
+    }
+  }
+
+  return true;
+}
+
+bool net::capture::filter::ipv6_address(direction dir,
+                                        const uint32_t* addr,
+                                        const uint32_t* mask,
+                                        size_t t,
+                                        size_t f)
+{
+  if ((!stmt(BPF_LD | BPF_MEM, ethertype_slot)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, ethertype_ipv6, no_label, f)) ||
+      (!stmt(BPF_LDX | BPF_MEM, link_length_slot))) {
+    return false;
+  }
+
+  // Number of words to check (at least one).
+  size_t nwords = 1;
+  for (size_t i = 1; i < 4; i++) {
+    if (mask[i] != 0) {
+      nwords = i + 1;
+    }
+  }
+
+  static constexpr const uint32_t offsets[] = {
+    offsetof(struct ip6_hdr, ip6_src),
+    offsetof(struct ip6_hdr, ip6_dst)
+  };
+
+  for (size_t i = 0; i < 2; i++) {
+    if (((i == 0) && (dir == direction::dst)) ||
+        ((i == 1) && (dir == direction::src))) {
+      continue;
+    }
+
+    // If the destination address has to be checked afterwards...
+    size_t next = f;
+    if ((i == 0) && (dir == direction::src_or_dst) && (!new_label(next))) {
+      return false;
+    }
+
+    for (size_t j = 0; j < nwords; j++) {
+      if ((!stmt(BPF_LD | BPF_W | BPF_IND, offsets[i] + (j * 4))) ||
+          ((mask[j] != 0xffffffffu) &&
+           (!stmt(BPF_ALU | BPF_AND | BPF_K, mask[j]))) ||
+          (!jump(BPF_JMP | BPF_JEQ | BPF_K,
+                 addr[j],
+                 (j + 1 < nwords) ? no_label : t,
+                 next))) {
+        return false;
+      }
+    }
+
+    if (next != f) {
+      place(next);
+    }
+  }
+
+  return true;
+}
+
+bool net::capture::filter::ports(direction dir,
+                                 const uint16_t* ranges,
+                                 size_t nranges,
+                                 size_t t,
+                                 size_t f)
+{
+  static constexpr const uint32_t offsets[] = {0, 2};
+
+  // X = offset of the ports (0 if the packet has no ports).
+  if ((!stmt(BPF_LD | BPF_MEM, ports_offset_slot)) ||
+      (!jump(BPF_JMP | BPF_JEQ | BPF_K, 0, f, no_label)) ||
+      (!stmt(BPF_MISC | BPF_TAX, 0))) {
+    return false;
+  }
+
+  for (size_t i = 0; i < 2; i++) {
+    if (((i == 0) && (dir == direction::dst)) ||
+        ((i == 1) && (dir == direction::src))) {
+      continue;
+    }
+
+    // If the destination port has to be checked afterwards...
+    size_t next = f;
+    if ((i == 0) && (dir == direction::src_or_dst) && (!new_label(next))) {
+      return false;
+    }
+
+    if ((!stmt(BPF_LD | BPF_H | BPF_IND, offsets[i])) ||
+        (!port_ranges(ranges, nranges, t, next))) {
+      return false;
+    }
+
+    if (next != f) {
+      place(next);
+    }
+  }
+
+  return true;
+}
+
+bool net::capture::filter::port_ranges(const uint16_t* ranges,
+                                       size_t nranges,
+                                       size_t t,
+                                       size_t f)
+{
+  for (size_t i = 0; i < nranges; i++) {
+    const uint32_t first = ranges[2 * i];
+    const uint32_t last = ranges[(2 * i) + 1];
+
+    // If this is not the last range...
+    size_t next = f;
+    if ((i + 1 < nranges) && (!new_label(next))) {
+      return false;
+    }
+
+    bool ret;
+
+    if (first == last) {
+      ret = jump(BPF_JMP | BPF_JEQ | BPF_K, first, t, next);
+    } else if (first == 0) {
+      ret = jump(BPF_JMP | BPF_JGT | BPF_K, last, next, t);
+    } else if (last == 65535) {
+      ret = jump(BPF_JMP | BPF_JGE | BPF_K, first, t, next);
+    } else {
+      ret = ((jump(BPF_JMP | BPF_JGE | BPF_K, first, no_label, next)) &&
+             (jump(BPF_JMP | BPF_JGT | BPF_K, last, next, t)));
+    }
+
+    if (!ret) {
+      return false;
+    }
+
+    if (next != f) {
+      place(next);
+    }
+  }
+
+  return true;
+}
+
+bool net::capture::filter::stmt(uint16_t code, uint32_t k)
+{
+  return jump(code, k, no_label, no_label);
+}
+
+bool net::capture::filter::jump(uint16_t code,
+                                uint32_t k,
+                                size_t t,
+                                size_t f)
+{
+  if (_M_used == _M_size) {
+    if (_M_size == max_instructions) {
+      return false;
+    }
+
+    const size_t size = (_M_size > 0) ? _M_size * 2 : 64;
+
+    instruction* instructions = static_cast<instruction*>(
+                                  realloc(_M_instructions,
+                                          size * sizeof(instruction))
+                                );
+
+    if (!instructions) {
+      return false;
+    }
+
+    _M_instructions = instructions;
+    _M_size = size;
+  }
+
+  instruction* const i = &_M_instructions[_M_used++];
+
+  i->insn.code = code;
+  i->insn.jt = 0;
+  i->insn.jf = 0;
+  i->insn.k = k;
+
+  i->jt = t;
+  i->jf = f;
+
+  return true;
+}
+
+bool net::capture::filter::new_label(size_t& l)
+{
+  if (_M_nlabels == _M_label_size) {
+    const size_t size = (_M_label_size > 0) ? _M_label_size * 2 : 64;
+
+    label* labels = static_cast<label*>(
+                      realloc(_M_labels, size * sizeof(label))
+                    );
+
+    if (!labels) {
+      return false;
+    }
+
+    _M_labels = labels;
+    _M_label_size = size;
+  }
+
+  l = _M_nlabels++;
+
+  _M_labels[l].pos = no_label;
+  _M_labels[l].alias = no_label;
+
+  return true;
+}
+
+size_t net::capture::filter::resolve(size_t l) const
+{
+  while (_M_labels[l].pos == no_label) {
+    if ((l = _M_labels[l].alias) == no_label) {
+      return no_label;
+    }
+  }
+
+  return _M_labels[l].pos;
+}
+
+bool net::capture::filter::link()
+{
+  if ((_M_used == 0) || (_M_used > max_instructions)) {
+    return false;
+  }
+
+  // Position of each instruction in the program and targets of the
+  // conditional jumps which need a trampoline (bit 0: 'jt', bit 1: 'jf').
+  size_t* const positions = static_cast<size_t*>(
+                              malloc((_M_used + 1) * sizeof(size_t))
+                            );
+
+  uint8_t* const far = static_cast<uint8_t*>(calloc(_M_used, 1));
+
+  bool ret = ((positions) && (far));
+
+  // The trampolines make the jumps longer, so more trampolines might be
+  // needed (there are no backward jumps, so the loop ends).
+  bool changed = true;
+  while ((ret) && (changed)) {
+    size_t pos = 0;
+    for (size_t i = 0; i < _M_used; i++) {
+      positions[i] = pos;
+      pos += 1 + (far[i] & 0x01) + ((far[i] >> 1) & 0x01);
+    }
+
+    positions[_M_used] = pos;
+
+    changed = false;
+
+    for (size_t i = 0; (ret) && (i < _M_used); i++) {
+      const instruction& insn = _M_instructions[i];
+
+      if (BPF_CLASS(insn.insn.code) == BPF_JMP) {
+        const size_t targets[] = {insn.jt, insn.jf};
+
+        for (size_t j = 0; j < 2; j++) {
+          if (targets[j] != no_label) {
+            const size_t target = resolve(targets[j]);
+
+            // Only forward jumps are allowed.
+            if ((target == no_label) || (target <= i) || (target > _M_used)) {
+              ret = false;
+              break;
+            }
+
+            // Unconditional jumps have 32-bit offsets.
+            if ((BPF_OP(insn.insn.code) != BPF_JA) &&
+                ((far[i] & (1 << j)) == 0) &&
+                (positions[target] - positions[i] - 1 > 255)) {
+              far[i] |= (1 << j);
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if ((ret) &&
+      ((positions[_M_used] > max_instructions) ||
+       ((_M_insns = static_cast<struct sock_filter*>(
+                      malloc(positions[_M_used] * sizeof(struct sock_filter))
+                    )) == nullptr))) {
+    ret = false;
+  }
+
+  if (ret) {
+    for (size_t i = 0; i < _M_used; i++) {
+      const instruction& insn = _M_instructions[i];
+      struct sock_filter* const out = &_M_insns[positions[i]];
+
+      *out = insn.insn;
+
+      // If the instruction is a jump...
+      if (BPF_CLASS(insn.insn.code) == BPF_JMP) {
+        if (BPF_OP(insn.insn.code) == BPF_JA) {
+          out->k = static_cast<uint32_t>(
+                     positions[resolve(insn.jt)] - positions[i] - 1
+                   );
+        } else {
+          const size_t targets[] = {insn.jt, insn.jf};
+          uint8_t offsets[2];
+          size_t ntrampolines = 0;
+
+          for (size_t j = 0; j < 2; j++) {
+            if (far[i] & (1 << j)) {
+              // Jump to the trampoline, which jumps to the target.
+              struct sock_filter* const
+                trampoline = out + 1 + ntrampolines;
+
+              trampoline->code = BPF_JMP | BPF_JA;
+              trampoline->jt = 0;
+              trampoline->jf = 0;
+              trampoline->k = static_cast<uint32_t>(
+                                positions[resolve(targets[j])] -
+                                (positions[i] + 1 + ntrampolines) -
+                                1
+                              );
+
+              offsets[j] = static_cast<uint8_t>(ntrampolines++);
+            } else {
+              // No label: next instruction (after the trampolines).
+              const size_t target = (targets[j] != no_label) ?
+                                      resolve(targets[j]) :
+                                      i + 1;
+
+              offsets[j] = static_cast<uint8_t>(
+                             positions[target] - positions[i] - 1
+                           );
+            }
+          }
+
+          out->jt = offsets[0];
+          out->jf = offsets[1];
+        }
+      }
+    }
+
+    _M_fprog.len = static_cast<unsigned short>(positions[_M_used]);
+    _M_fprog.filter = _M_insns;
+  }
+
+  if (positions) {
+    free(positions);
+  }
+
+  if (far) {
+    free(far);
+  }
+
+  return ret;
+}
+
+void net::capture::filter::free_code()
+{
+  if (_M_instructions) {
+    free(_M_instructions);
+    _M_instructions = nullptr;
+  }
+
+  _M_size = 0;
+  _M_used = 0;
+
+  if (_M_labels) {
+    free(_M_labels);
+    _M_labels = nullptr;
+  }
+
+  _M_label_size = 0;
+  _M_nlabels = 0;
+}
@@ -0,0 +1,283 @@
+#ifndef NET_CAPTURE_FILTER_H
+#define NET_CAPTURE_FILTER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <strings.h>
+#include <linux/filter.h>
+
+namespace net {
+  namespace capture {
+    // Compiler of filter expressions into classic BPF programs (to be
+    // attached to the capture socket, so the unwanted packets never reach
+    // the ring buffer).
+    //
+    // Grammar:
+    //   expression := and-expression [("or" | "||") and-expression]...
+    //   and-expression := unary [("and" | "&&") unary]...
+    //   unary := ("not" | "!") unary | "(" expression ")" | primitive
+    //   primitive := "ip" | "ip6" | "tcp" | "udp" | "icmp" | "icmp6" |
+    //                "vlan" [<vlan-id>] |
+    //                ["src" | "dst"] "host" <address> |
+    //                ["src" | "dst"] "net" <address>[/<prefix-length>] |
+    //                ["src" | "dst"] ("port" | "portrange") <port-list>
+    //
+    // The addresses can be either IPv4 or IPv6 addresses.
+    // The port lists use the syntax of 'net::ip::ports' (e.g.:
+    // "80,443,8000-8080") and match TCP, UDP and SCTP packets (only the
+    // first fragment for IPv4).
+    // Up to two VLAN tags (802.1Q / 802.1ad) are skipped before checking the
+    // IP header, whether they have been stripped by the kernel or not.
+    // The IPv6 extension headers are not followed.
+    class filter {
+      public:
+        // Default snapshot length (number of bytes of the accepted packets).
+        static constexpr const uint32_t default_snaplen = 262144;
+
+        // Constructor.
+        filter() = default;
+
+        // Destructor.
+        ~filter();
+
+        // Clear.
+        void clear();
+
+        // Compile expression (an empty expression accepts all the packets).
+        bool compile(const char* expression,
+                     uint32_t snaplen = default_snaplen);
+
+        // Get program (nullptr if no expression has been compiled).
+        const struct sock_fprog* program() const;
+
+        // Get number of instructions.
+        size_t count() const;
+
+        // Print program (one instruction per line: { code, jt, jf, k }).
+        void print() const;
+
+      private:
+        // Maximum number of instructions.
+        static constexpr const size_t max_instructions = BPF_MAXINSNS;
+
+        // Maximum number of port ranges per primitive.
+        static constexpr const size_t max_port_ranges = 256;
+
+        // Maximum length of a port list (enough for 'max_port_ranges' ranges
+        // like "65534-65535,").
+        static constexpr const size_t max_port_list = 12 * max_port_ranges;
+
+        // No label.
+        static constexpr const size_t no_label = static_cast<size_t>(-1);
+
+        // Scratch memory slots (filled in by the prologue).
+        static constexpr const uint32_t link_length_slot = 0;
+        static constexpr const uint32_t ethertype_slot = 1;
+        static constexpr const uint32_t protocol_slot = 2;
+        static constexpr const uint32_t ports_offset_slot = 3;
+
+        // Length of the ethernet header (without VLAN tags).
+        static constexpr const uint32_t ethernet_header_length = 14;
+
+        // Length of a VLAN tag.
+        static constexpr const uint32_t vlan_tag_length = 4;
+
+        // Ethertypes.
+        static constexpr const uint32_t ethertype_ipv4 = 0x0800;
+        static constexpr const uint32_t ethertype_ipv6 = 0x86dd;
+        static constexpr const uint32_t ethertype_vlan = 0x8100;
+        static constexpr const uint32_t ethertype_qinq = 0x88a8;
+
+        // Token type.
+        enum class token_type {
+          end,
+          left_parenthesis,
+          right_parenthesis,
+          op_not,
+          op_and,
+          op_or,
+          word
+        };
+
+        // Direction.
+        enum class direction {
+          src_or_dst,
+          src,
+          dst
+        };
+
+        // Instruction.
+        struct instruction {
+          // Instruction (the jump offsets are filled in when linking).
+          struct sock_filter insn;
+
+          // Labels of the jump targets of conditional jumps (no_label: next
+          // instruction).
+          size_t jt;
+          size_t jf;
+        };
+
+        // Label.
+        struct label {
+          // Position (index of the instruction) or no_label if the label
+          // has not been placed.
+          size_t pos;
+
+          // Label this label is an alias of (no_label: none).
+          size_t alias;
+        };
+
+        // Instructions being generated.
+        instruction* _M_instructions = nullptr;
+        size_t _M_size = 0;
+        size_t _M_used = 0;
+
+        // Labels.
+        label* _M_labels = nullptr;
+        size_t _M_label_size = 0;
+        size_t _M_nlabels = 0;
+
+        // Program.
+        struct sock_filter* _M_insns = nullptr;
+        struct sock_fprog _M_fprog;
+
+        // Current position in the expression.
+        const char* _M_ptr;
+
+        // Current token.
+        token_type _M_token;
+        const char* _M_word;
+        size_t _M_wordlen;
+
+        // Get next token.
+        void next_token();
+
+        // Is the current token the word 'w'?
+        bool is_word(const char* w) const;
+
+        // Parse expression.
+        bool parse_expression(size_t t, size_t f);
+
+        // Parse and-expression.
+        bool parse_and_expression(size_t t, size_t f);
+
+        // Parse unary.
+        bool parse_unary(size_t t, size_t f);
+
+        // Parse primitive.
+        bool parse_primitive(size_t t, size_t f);
+
+        // Parse VLAN primitive.
+        bool parse_vlan(size_t t, size_t f);
+
+        // Parse host or net primitive.
+        bool parse_address(direction dir, bool is_net, size_t t, size_t f);
+
+        // Parse port list.
+        bool parse_ports(direction dir, size_t t, size_t f);
+
+        // Generate code for the prologue (computes the length of the link
+        // layer header, the ethertype, the IP protocol and the offset of the
+        // ports, 0 if the packet has no ports).
+        bool prologue();
+
+        // Generate code for checking the ethertype.
+        bool ethertype(uint32_t type, size_t t, size_t f);
+
+        // Generate code for checking the IP protocol.
+        bool protocol(uint8_t proto, bool ipv4, bool ipv6, size_t t, size_t f);
+
+        // Generate code for checking an IPv4 address.
+        bool ipv4_address(direction dir,
+                          uint32_t addr,
+                          uint32_t mask,
+                          size_t t,
+                          size_t f);
+
+        // Generate code for checking an IPv6 address.
+        bool ipv6_address(direction dir,
+                          const uint32_t* addr,
+                          const uint32_t* mask,
+                          size_t t,
+                          size_t f);
+
+        // Generate code for checking the ports.
+        bool ports(direction dir,
+                   const uint16_t* ranges,
+                   size_t nranges,
+                   size_t t,
+                   size_t f);
+
+        // Generate code for checking the port loaded in the accumulator
+        // against the port ranges.
+        bool port_ranges(const uint16_t* ranges,
+                         size_t nranges,
+                         size_t t,
+                         size_t f);
+
+        // Emit statement.
+        bool stmt(uint16_t code, uint32_t k);
+
+        // Emit jump.
+        bool jump(uint16_t code, uint32_t k, size_t t, size_t f);
+
+        // Create label.
+        bool new_label(size_t& l);
+
+        // Place label at the current position.
+        void place(size_t l);
+
+        // Make label 'l' an alias of label 'target'.
+        void alias(size_t l, size_t target);
+
+        // Resolve label.
+        size_t resolve(size_t l) const;
+
+        // Resolve jumps and build program (the conditional jumps which
+        // don't fit in 8 bits go through an unconditional jump placed just
+        // after them).
+        bool link();
+
+        // Free instructions and labels.
+        void free_code();
+
+        // Disable copy constructor and assignment operator.
+        filter(const filter&) = delete;
+        filter& operator=(const filter&) = delete;
+    };
+
+    inline filter::~filter()
+    {
+      clear();
+    }
+
+    inline const struct sock_fprog* filter::program() const
+    {
+      return _M_insns ? &_M_fprog : nullptr;
+    }
+
+    inline size_t filter::count() const
+    {
+      return _M_insns ? _M_fprog.len : 0;
+    }
+
+    inline bool filter::is_word(const char* w) const
+    {
+      return ((_M_token == token_type::word) &&
+              (strncasecmp(_M_word, w, _M_wordlen) == 0) &&
+              (w[_M_wordlen] == 0));
+    }
+
+    inline void filter::place(size_t l)
+    {
+      _M_labels[l].pos = _M_used;
+    }
+
+    inline void filter::alias(size_t l, size_t target)
+    {
+      _M_labels[l].alias = target;
+    }
+  }
+}
+
+#endif // NET_CAPTURE_FILTER_H
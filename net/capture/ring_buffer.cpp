@@ -1,11 +1,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <net/ethernet.h>
 #include <linux/net_tstamp.h>
 #include "net/capture/ring_buffer.h"
+#include "util/numa.h"
 #include "net/capture/limits.h"
 
 void net::capture::ring_buffer::clear()
@@ -21,11 +23,32 @@ void net::capture::ring_buffer::clear()
   }
 
   if (_M_frames) {
-    free(_M_frames);
+    util::numa::free(_M_frames, _M_count * sizeof(struct iovec));
     _M_frames = nullptr;
   }
 
+  if (_M_batch) {
+    util::numa::free(_M_batch, _M_batch_size * sizeof(frame));
+    _M_batch = nullptr;
+  }
+
   _M_idx = 0;
+
+  // Reset counters.
+  _M_counters.blocks = 0;
+  _M_counters.frames = 0;
+  _M_counters.block_bytes = 0;
+  _M_counters.polls = 0;
+  _M_counters.poll_wakeups = 0;
+  _M_counters.callback_time = 0;
+  _M_counters.latency = 0;
+  _M_counters.max_latency = 0;
+  _M_counters.spin_time = 0;
+  _M_counters.sleep_time = 0;
+
+  _M_packets = 0;
+  _M_drops = 0;
+  _M_queue_freezes = 0;
 }
 
 bool net::capture::ring_buffer::create(unsigned ifindex,
@@ -49,25 +72,13 @@ bool net::capture::ring_buffer::create(unsigned ifindex,
       (frame_count <= max_frames) &&
       (frame_size <= block_size)) {
     if ((setup_socket(rcvbuf_size, promiscuous_mode, ifindex, fprog)) &&
-        (setup_ring(block_size, frame_size, frame_count)) &&
+        (setup_numa_ring(block_size, frame_size, frame_count)) &&
         (mmap_ring()) &&
         (bind_ring(ifindex))) {
-#if defined(PACKET_FANOUT)
-      // Must be done after bind().
-
-      // Create fanout group.
-      const int
-        optval = ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16) |
-                 ((getpid() ^ ifindex) & 0xffff);
-
-      if (setsockopt(_M_fd,
-                     SOL_PACKET,
-                     PACKET_FANOUT,
-                     &optval,
-                     sizeof(int)) < 0) {
+      // Join fanout group (must be done after bind()).
+      if (!join_fanout(ifindex)) {
         return false;
       }
-#endif // defined(PACKET_FANOUT)
 
       _M_pollfd.fd = _M_fd;
       _M_pollfd.events = POLLIN;
@@ -81,25 +92,28 @@ bool net::capture::ring_buffer::create(unsigned ifindex,
 
 int net::capture::ring_buffer::read(int timeout)
 {
-#if HAVE_TPACKET_V3
-  if (recv_v3()) {
+  if (recv()) {
     return 1;
   }
-#else
-  if (recv_v2()) {
+
+  // If the busy-poll mode is enabled...
+  if ((_M_spin_time > 0) && (spin())) {
     return 1;
   }
-#endif
 
-  switch (poll(&_M_pollfd, 1, timeout)) {
+  increment(_M_counters.polls);
+
+  const uint64_t start = now();
+
+  const int ret = poll(&_M_pollfd, 1, timeout);
+
+  increment(_M_counters.sleep_time, now() - start);
+
+  switch (ret) {
     case 1:
-#if HAVE_TPACKET_V3
-      return recv_v3() ? 1 : 0;
-#else
-      return recv_v2() ? 1 : 0;
-#endif
+      increment(_M_counters.poll_wakeups);
 
-      break;
+      return recv() ? 1 : 0;
     case 0: // Timeout.
       return 0;
     default:
@@ -107,19 +121,83 @@ int net::capture::ring_buffer::read(int timeout)
   }
 }
 
-bool net::capture::ring_buffer::show_statistics()
+bool net::capture::ring_buffer::spin()
+{
+  const uint64_t start = now();
+  uint64_t t;
+
+  do {
+    cpu_relax();
+
+    if (recv()) {
+      increment(_M_counters.spin_time, now() - start);
+      return true;
+    }
+  } while ((t = now()) - start < _M_spin_time);
+
+  increment(_M_counters.spin_time, t - start);
+
+  return false;
+}
+
+bool net::capture::ring_buffer::get_statistics(statistics& stats)
 {
 #if HAVE_TPACKET_V3
-  struct tpacket_stats_v3 stats;
+  struct tpacket_stats_v3 kstats;
 #else
-  struct tpacket_stats stats;
+  struct tpacket_stats kstats;
 #endif
 
-  socklen_t optlen = sizeof(stats);
+  socklen_t optlen = sizeof(kstats);
+
+  // Get kernel counters (they are reset after being read).
+  if (getsockopt(_M_fd,
+                 SOL_PACKET,
+                 PACKET_STATISTICS,
+                 &kstats,
+                 &optlen) == 0) {
+    // The kernel counters are reset after being read, so concurrent
+    // callers have to add them atomically.
+    stats.packets = _M_packets.fetch_add(kstats.tp_packets,
+                                         std::memory_order_relaxed) +
+                    kstats.tp_packets;
+
+    stats.drops = _M_drops.fetch_add(kstats.tp_drops,
+                                     std::memory_order_relaxed) +
+                  kstats.tp_drops;
 
-  if (getsockopt(_M_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &optlen) == 0) {
-    printf("  %u packets received.\n", stats.tp_packets);
-    printf("  %u packets dropped by kernel.\n", stats.tp_drops);
+#if HAVE_TPACKET_V3
+    stats.queue_freezes = _M_queue_freezes.fetch_add(
+                            kstats.tp_freeze_q_cnt,
+                            std::memory_order_relaxed
+                          ) +
+                          kstats.tp_freeze_q_cnt;
+#else
+    stats.queue_freezes = _M_queue_freezes.load(std::memory_order_relaxed);
+#endif
+
+    stats.blocks = _M_counters.blocks.load(std::memory_order_relaxed);
+    stats.frames = _M_counters.frames.load(std::memory_order_relaxed);
+    stats.block_bytes =
+      _M_counters.block_bytes.load(std::memory_order_relaxed);
+
+#if HAVE_TPACKET_V3
+    stats.block_size = _M_size;
+#else
+    stats.block_size = 0;
+#endif
+
+    stats.polls = _M_counters.polls.load(std::memory_order_relaxed);
+    stats.poll_wakeups =
+      _M_counters.poll_wakeups.load(std::memory_order_relaxed);
+    stats.callback_time =
+      _M_counters.callback_time.load(std::memory_order_relaxed);
+    stats.latency = _M_counters.latency.load(std::memory_order_relaxed);
+    stats.max_latency =
+      _M_counters.max_latency.load(std::memory_order_relaxed);
+    stats.spin_time = _M_counters.spin_time.load(std::memory_order_relaxed);
+    stats.sleep_time =
+      _M_counters.sleep_time.load(std::memory_order_relaxed);
 
     return true;
   }
@@ -127,6 +205,80 @@ bool net::capture::ring_buffer::show_statistics()
   return false;
 }
 
+bool net::capture::ring_buffer::show_statistics()
+{
+  statistics stats;
+  if (get_statistics(stats)) {
+    printf("  %" PRIu64 " packets received.\n", stats.packets);
+    printf("  %" PRIu64 " packets dropped by kernel.\n", stats.drops);
+
+#if HAVE_TPACKET_V3
+    printf("  %" PRIu64 " queue freezes.\n", stats.queue_freezes);
+#endif
+
+    printf("  %" PRIu64 " blocks processed (%" PRIu64 " frames).\n",
+           stats.blocks,
+           stats.frames);
+
+    if (stats.blocks > 0) {
+#if HAVE_TPACKET_V3
+      printf("  Average block fill: %.2f%%.\n",
+             (100.0 * stats.block_bytes) /
+             (static_cast<double>(stats.blocks) * stats.block_size));
+#endif
+
+      printf("  Average time in callbacks: %" PRIu64 " ns per block.\n",
+             stats.callback_time / stats.blocks);
+
+      printf("  Average latency: %" PRIu64 " ns (maximum: %" PRIu64 " ns).\n",
+             stats.latency / stats.blocks,
+             stats.max_latency);
+    }
+
+    printf("  %" PRIu64 " calls to poll() (%" PRIu64 " wakeups).\n",
+           stats.polls,
+           stats.poll_wakeups);
+
+    if (_M_spin_time > 0) {
+      printf("  Time spinning: %.3f ms, time sleeping in poll(): %.3f ms.\n",
+             stats.spin_time / 1000000.0,
+             stats.sleep_time / 1000000.0);
+    } else {
+      printf("  Time sleeping in poll(): %.3f ms.\n",
+             stats.sleep_time / 1000000.0);
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void net::capture::ring_buffer::update_counters(uint64_t nframes,
+                                                uint64_t nbytes,
+                                                uint64_t timestamp,
+                                                uint64_t received,
+                                                uint64_t start,
+                                                uint64_t end)
+{
+  increment(_M_counters.blocks);
+  increment(_M_counters.frames, nframes);
+  increment(_M_counters.block_bytes, nbytes);
+  increment(_M_counters.callback_time, end - start);
+
+  // If the packet timestamp is comparable with the current time (it might
+  // come from the clock of the network card)...
+  if (timestamp <= received) {
+    const uint64_t latency = received - timestamp;
+
+    increment(_M_counters.latency, latency);
+
+    if (latency > _M_counters.max_latency.load(std::memory_order_relaxed)) {
+      _M_counters.max_latency.store(latency, std::memory_order_relaxed);
+    }
+  }
+}
+
 bool net::capture::ring_buffer::setup_socket(int rcvbuf_size,
                                              bool promiscuous_mode,
                                              unsigned ifindex,
@@ -159,6 +311,15 @@ bool net::capture::ring_buffer::setup_socket(int rcvbuf_size,
       }
     }
 
+#if defined(SO_BUSY_POLL)
+    if (_M_busy_poll > 0) {
+      // Busy-wait on the device queue before sleeping in poll() (requires
+      // CAP_NET_ADMIN to exceed net.core.busy_read).
+      const int optval = static_cast<int>(_M_busy_poll);
+      setsockopt(_M_fd, SOL_SOCKET, SO_BUSY_POLL, &optval, sizeof(int));
+    }
+#endif // defined(SO_BUSY_POLL)
+
     if (fprog) {
       // Attach filter.
       if (setsockopt(_M_fd,
@@ -220,6 +381,29 @@ bool net::capture::ring_buffer::setup_ring(size_t block_size,
                      sizeof(req)) == 0);
 }
 
+bool net::capture::ring_buffer::setup_numa_ring(size_t block_size,
+                                                size_t frame_size,
+                                                size_t frame_count)
+{
+  // If the ring buffer doesn't have to be bound to a NUMA node...
+  if (_M_numa_node < 0) {
+    return setup_ring(block_size, frame_size, frame_count);
+  }
+
+  // The kernel allocates the ring buffer when the ring is set up, following
+  // the memory policy of the calling thread.
+  util::numa::policy policy;
+  if (util::numa::bind_thread(_M_numa_node, policy)) {
+    const bool ret = setup_ring(block_size, frame_size, frame_count);
+
+    util::numa::restore(policy);
+
+    return ret;
+  }
+
+  return false;
+}
+
 bool net::capture::ring_buffer::mmap_ring()
 {
   // Map ring into memory.
@@ -231,7 +415,9 @@ bool net::capture::ring_buffer::mmap_ring()
                      0)) != MAP_FAILED) {
     // Allocate frames.
     if ((_M_frames = static_cast<struct iovec*>(
-                       malloc(_M_count * sizeof(struct iovec))
+                       util::numa::alloc(_M_count * sizeof(struct iovec),
+                                         _M_numa_node,
+                                         _M_hugepages)
                      )) != nullptr) {
       uint8_t* buf = static_cast<uint8_t*>(_M_buf);
 
@@ -242,6 +428,16 @@ bool net::capture::ring_buffer::mmap_ring()
         buf += _M_size;
       }
 
+      // If the block callback is used...
+      if (_M_blockfn) {
+        // Allocate frame descriptors.
+        return ((_M_batch = static_cast<frame*>(
+                              util::numa::alloc(_M_batch_size * sizeof(frame),
+                                                _M_numa_node,
+                                                _M_hugepages)
+                            )) != nullptr);
+      }
+
       return true;
     }
   }
@@ -262,6 +458,28 @@ bool net::capture::ring_buffer::bind_ring(unsigned ifindex)
                sizeof(struct sockaddr_ll)) == 0);
 }
 
+bool net::capture::ring_buffer::join_fanout(unsigned ifindex)
+{
+#if defined(PACKET_FANOUT)
+  // Compute fanout group identifier.
+  const int id = (_M_fanout_group != -1) ? _M_fanout_group :
+                                           (getpid() ^ ifindex);
+
+  // Create or join fanout group.
+  const int optval = ((static_cast<int>(_M_fanout_mode) |
+                       PACKET_FANOUT_FLAG_DEFRAG) << 16) |
+                     (id & 0xffff);
+
+  return (setsockopt(_M_fd,
+                     SOL_PACKET,
+                     PACKET_FANOUT,
+                     &optval,
+                     sizeof(int)) == 0);
+#else
+  return true;
+#endif // defined(PACKET_FANOUT)
+}
+
 #if HAVE_TPACKET_V3
   void net::capture::ring_buffer::config_v3(size_t block_size,
                                             size_t frame_size,
@@ -286,6 +504,11 @@ bool net::capture::ring_buffer::bind_ring(unsigned ifindex)
 
     _M_count = block_count;
     _M_size = block_size;
+
+    // A block holds up to one packet per minimum TPACKET_V3 record (header
+    // and ethernet header), so the frame descriptors of a whole block fit
+    // and the block callback is called once per block.
+    _M_batch_size = block_size / TPACKET_ALIGN(TPACKET3_HDRLEN + ETH_HLEN);
   }
 
   bool net::capture::ring_buffer::recv_v3()
@@ -312,6 +535,9 @@ bool net::capture::ring_buffer::bind_ring(unsigned ifindex)
 
       const uint32_t num_pkts = block_desc->hdr.bh1.num_pkts;
 
+      const uint64_t received = wall_clock();
+      const uint64_t start = now();
+
       // Process packets in the block.
       for (uint32_t i = num_pkts; i > 0; i--) {
 #if defined(PACKET_TIMESTAMP)
@@ -329,6 +555,97 @@ bool net::capture::ring_buffer::bind_ring(unsigned ifindex)
               );
       }
 
+      if (num_pkts > 0) {
+        update_counters(num_pkts,
+                        block_desc->hdr.bh1.blk_len,
+                        last_packet_timestamp(block_desc),
+                        received,
+                        start,
+                        now());
+      }
+
+      // Mark block as free.
+      block_desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+      _M_idx = (_M_idx + 1) % _M_count;
+
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  bool net::capture::ring_buffer::recv_block_v3()
+  {
+    struct tpacket_block_desc* const
+      block_desc = static_cast<struct tpacket_block_desc*>(
+                     _M_frames[_M_idx].iov_base
+                   );
+
+    // If there is a new block...
+    if ((block_desc->hdr.bh1.block_status & TP_STATUS_USER) != 0) {
+      const struct tpacket3_hdr*
+        hdr = reinterpret_cast<const struct tpacket3_hdr*>(
+                reinterpret_cast<const uint8_t*>(block_desc) +
+                block_desc->hdr.bh1.offset_to_first_pkt
+              );
+
+#if !defined(PACKET_TIMESTAMP)
+      // Get current time.
+      struct timeval tv;
+      gettimeofday(&tv, nullptr);
+
+      const uint64_t timestamp = (tv.tv_sec * 1000000ull) + tv.tv_usec;
+#endif // !defined(PACKET_TIMESTAMP)
+
+      const uint32_t num_pkts = block_desc->hdr.bh1.num_pkts;
+
+      size_t nframes = 0;
+
+      const uint64_t received = wall_clock();
+      const uint64_t start = now();
+
+      // Fill frame descriptors.
+      for (uint32_t i = num_pkts; i > 0; i--) {
+        frame* const f = _M_batch + nframes;
+
+        f->buf = reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_mac;
+        f->len = hdr->tp_snaplen;
+
+#if defined(PACKET_TIMESTAMP)
+        f->timestamp = (hdr->tp_sec * 1000000ull) + (hdr->tp_nsec / 1000);
+#else
+        f->timestamp = timestamp;
+#endif // defined(PACKET_TIMESTAMP)
+
+        // If all the frame descriptors are in use (shouldn't happen, a block
+        // can't hold more packets)...
+        if (++nframes == _M_batch_size) {
+          // Process frames.
+          _M_blockfn(_M_batch, nframes, _M_user);
+
+          nframes = 0;
+        }
+
+        hdr = reinterpret_cast<const struct tpacket3_hdr*>(
+                reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_next_offset
+              );
+      }
+
+      // Process remaining frames.
+      if (nframes > 0) {
+        _M_blockfn(_M_batch, nframes, _M_user);
+      }
+
+      if (num_pkts > 0) {
+        update_counters(num_pkts,
+                        block_desc->hdr.bh1.blk_len,
+                        last_packet_timestamp(block_desc),
+                        received,
+                        start,
+                        now());
+      }
+
       // Mark block as free.
       block_desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
 
@@ -360,15 +677,30 @@ bool net::capture::ring_buffer::bind_ring(unsigned ifindex)
 
     _M_count = frame_count;
     _M_size = frame_size;
+
+    _M_batch_size = frames_per_block;
   }
 
   bool net::capture::ring_buffer::recv_v2()
   {
-    struct tpacket2_hdr* const
+    struct tpacket2_hdr*
       hdr = static_cast<struct tpacket2_hdr*>(_M_frames[_M_idx].iov_base);
 
-    // If there is a new packet...
-    if ((hdr->tp_status & TP_STATUS_USER) != 0) {
+    // If there are no new packets...
+    if ((hdr->tp_status & TP_STATUS_USER) == 0) {
+      return false;
+    }
+
+    // The counters are updated once per batch of consecutive frames (as in
+    // recv_batch_v2()), not once per frame.
+    const uint64_t received = wall_clock();
+    const uint64_t start = now();
+
+    uint64_t timestamp = 0;
+    uint64_t nbytes = 0;
+    size_t nframes = 0;
+
+    do {
       struct timeval tv;
 
 #if defined(PACKET_TIMESTAMP)
@@ -379,17 +711,95 @@ bool net::capture::ring_buffer::bind_ring(unsigned ifindex)
       gettimeofday(&tv, nullptr);
 #endif
 
+      // Save timestamp of the first packet of the batch.
+      if (nframes == 0) {
+        timestamp = (tv.tv_sec * 1000000000ull) + (tv.tv_usec * 1000ull);
+      }
+
       // Process packet.
       _M_ethernetfn(reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_mac,
                     hdr->tp_snaplen,
                     tv,
                     _M_user);
 
+      nbytes += hdr->tp_snaplen;
+
       // Mark frame as free.
       hdr->tp_status = TP_STATUS_KERNEL;
 
       _M_idx = (_M_idx + 1) % _M_count;
 
+      hdr = static_cast<struct tpacket2_hdr*>(_M_frames[_M_idx].iov_base);
+    } while ((++nframes < _M_batch_size) &&
+             ((hdr->tp_status & TP_STATUS_USER) != 0));
+
+    update_counters(nframes, nbytes, timestamp, received, start, now());
+
+    return true;
+  }
+
+  bool net::capture::ring_buffer::recv_batch_v2()
+  {
+    size_t nframes = 0;
+
+    // Fill frame descriptors with consecutive frames.
+    for (size_t idx = _M_idx; nframes < _M_batch_size; nframes++) {
+      const struct tpacket2_hdr* const
+        hdr = static_cast<const struct tpacket2_hdr*>(
+                _M_frames[idx].iov_base
+              );
+
+      // If there are no more packets...
+      if ((hdr->tp_status & TP_STATUS_USER) == 0) {
+        break;
+      }
+
+      frame* const f = _M_batch + nframes;
+
+      f->buf = reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_mac;
+      f->len = hdr->tp_snaplen;
+
+#if defined(PACKET_TIMESTAMP)
+      f->timestamp = (hdr->tp_sec * 1000000ull) + (hdr->tp_nsec / 1000);
+#else
+      // Get current time.
+      struct timeval tv;
+      gettimeofday(&tv, nullptr);
+
+      f->timestamp = (tv.tv_sec * 1000000ull) + tv.tv_usec;
+#endif
+
+      idx = (idx + 1) % _M_count;
+    }
+
+    if (nframes > 0) {
+      const uint64_t received = wall_clock();
+      const uint64_t start = now();
+
+      // Process frames.
+      _M_blockfn(_M_batch, nframes, _M_user);
+
+      uint64_t nbytes = 0;
+      for (size_t i = 0; i < nframes; i++) {
+        nbytes += _M_batch[i].len;
+      }
+
+      update_counters(nframes,
+                      nbytes,
+                      _M_batch[0].timestamp * 1000ull,
+                      received,
+                      start,
+                      now());
+
+      // Mark frames as free.
+      for (; nframes > 0; nframes--) {
+        static_cast<struct tpacket2_hdr*>(
+          _M_frames[_M_idx].iov_base
+        )->tp_status = TP_STATUS_KERNEL;
+
+        _M_idx = (_M_idx + 1) % _M_count;
+      }
+
       return true;
     } else {
       return false;
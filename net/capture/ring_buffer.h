@@ -6,8 +6,10 @@
 #include <poll.h>
 #include <net/if.h>
 #include <limits.h>
+#include <time.h>
 #include <linux/if_packet.h>
 #include <linux/filter.h>
+#include <atomic>
 #include "net/capture/callback.h"
 
 namespace net {
@@ -49,9 +51,83 @@ namespace net {
         // Default read timeout (in milliseconds).
         static constexpr const int default_read_timeout = 100;
 
+        // Default idle time after which the busy-poll mode falls back to
+        // poll() (in microseconds).
+        static constexpr const unsigned default_spin_time = 1000;
+
+        // Default value for SO_BUSY_POLL (in microseconds).
+        static constexpr const unsigned default_busy_poll = 50;
+
+        // Fanout mode.
+        enum class fanout_mode {
+          hash = 0,    // PACKET_FANOUT_HASH.
+          lb = 1,      // PACKET_FANOUT_LB.
+          cpu = 2,     // PACKET_FANOUT_CPU.
+          rollover = 3 // PACKET_FANOUT_ROLLOVER.
+        };
+
+        // Statistics.
+        struct statistics {
+          // Number of packets received (kernel).
+          uint64_t packets;
+
+          // Number of packets dropped (kernel).
+          uint64_t drops;
+
+          // Number of times the queue was frozen because there were no free
+          // blocks (kernel, TPACKET_V3).
+          uint64_t queue_freezes;
+
+          // Number of blocks (TPACKET_V3) or batches of frames (TPACKET_V2)
+          // processed.
+          uint64_t blocks;
+
+          // Number of frames processed.
+          uint64_t frames;
+
+          // Number of bytes used in the processed blocks (TPACKET_V3).
+          // Average block fill: block_bytes / (blocks * block_size).
+          uint64_t block_bytes;
+
+          // Block size.
+          uint64_t block_size;
+
+          // Number of calls to poll().
+          uint64_t polls;
+
+          // Number of calls to poll() which returned because there were new
+          // packets.
+          uint64_t poll_wakeups;
+
+          // Time spent in the callbacks (nanoseconds).
+          uint64_t callback_time;
+
+          // Accumulated latency from the last packet of a block (first
+          // packet of a batch for TPACKET_V2) until the block is consumed
+          // (nanoseconds).
+          // Average latency: latency / blocks.
+          uint64_t latency;
+
+          // Maximum latency (nanoseconds).
+          uint64_t max_latency;
+
+          // Time spent spinning on the ring buffer (busy-poll mode,
+          // nanoseconds).
+          uint64_t spin_time;
+
+          // Time spent sleeping in poll() (nanoseconds).
+          uint64_t sleep_time;
+        };
+
         // Constructor.
+        // The ethernet frame callback is called once per frame.
         ring_buffer(ethernetfn_t ethernetfn, void* user);
 
+        // Constructor.
+        // The block callback is called once per block (TPACKET_V3) or once per
+        // batch of consecutive frames (TPACKET_V2).
+        ring_buffer(blockfn_t blockfn, void* user);
+
         // Destructor.
         ~ring_buffer();
 
@@ -75,6 +151,31 @@ namespace net {
                     size_t frame_count = default_frames,
                     const struct sock_fprog* fprog = nullptr);
 
+        // Set fanout mode and fanout group identifier (must be called before
+        // create()).
+        // By default, the ring buffer joins a PACKET_FANOUT_HASH group whose
+        // identifier is derived from the process id and the interface index.
+        void fanout(fanout_mode mode, int group_id = -1);
+
+        // Enable busy-poll mode (must be called before create()).
+        // read() checks the ring buffer in a tight loop and only falls back
+        // to poll() when no packets have been received for 'spin_time'
+        // microseconds (0: disable busy-poll mode).
+        // If 'busy_poll' is not 0, SO_BUSY_POLL is set to 'busy_poll'
+        // microseconds (if available), so poll() busy-waits on the device
+        // queue before sleeping.
+        // Meant for threads running on a dedicated core.
+        void busy_poll(unsigned spin_time = default_spin_time,
+                       unsigned busy_poll = default_busy_poll);
+
+        // Set NUMA placement (must be called before create()).
+        // The ring buffer (allocated by the kernel when the ring is set up)
+        // and the frame tables are bound to the NUMA node 'node' (-1:
+        // default placement).
+        // If 'hugepages' is true, the frame tables use huge pages where the
+        // kernel allows it.
+        void numa(int node, bool hugepages = true);
+
         // Read next packet(s).
         // Returns:
         //   -1: Error.
@@ -82,6 +183,13 @@ namespace net {
         //    1: Packet was read.
         int read(int timeout = default_read_timeout);
 
+        // Get statistics.
+        // The kernel counters are reset every time they are read, so they are
+        // accumulated; this method must not be called from several threads
+        // at the same time. The user-side counters can be read while another
+        // thread is reading from the ring buffer.
+        bool get_statistics(statistics& stats);
+
         // Show statistics.
         bool show_statistics();
 
@@ -116,9 +224,101 @@ namespace net {
         struct pollfd _M_pollfd;
 
         // Ethernet frame callback.
-        ethernetfn_t _M_ethernetfn;
+        ethernetfn_t _M_ethernetfn = nullptr;
+
+        // Block callback.
+        blockfn_t _M_blockfn = nullptr;
+
+        // User pointer.
         void* _M_user;
 
+        // Counters updated by the thread reading from the ring buffer.
+        struct counters {
+          std::atomic<uint64_t> blocks{0};
+          std::atomic<uint64_t> frames{0};
+          std::atomic<uint64_t> block_bytes{0};
+          std::atomic<uint64_t> polls{0};
+          std::atomic<uint64_t> poll_wakeups{0};
+          std::atomic<uint64_t> callback_time{0};
+          std::atomic<uint64_t> latency{0};
+          std::atomic<uint64_t> max_latency{0};
+          std::atomic<uint64_t> spin_time{0};
+          std::atomic<uint64_t> sleep_time{0};
+        };
+
+        counters _M_counters;
+
+        // Accumulated kernel counters (updated by get_statistics(), which
+        // might be called from several threads).
+        std::atomic<uint64_t> _M_packets{0};
+        std::atomic<uint64_t> _M_drops{0};
+        std::atomic<uint64_t> _M_queue_freezes{0};
+
+        // Update block counters.
+        // 'timestamp' (packet timestamp) and 'received' are wall-clock times
+        // (for the latency), 'start' and 'end' monotonic times (for the time
+        // spent in the callbacks).
+        void update_counters(uint64_t nframes,
+                             uint64_t nbytes,
+                             uint64_t timestamp,
+                             uint64_t received,
+                             uint64_t start,
+                             uint64_t end);
+
+        // Increment counter (there is only one writer).
+        static void increment(std::atomic<uint64_t>& counter, uint64_t n = 1);
+
+        // Get monotonic time (nanoseconds, for measuring intervals: it
+        // doesn't go backwards when the wall clock is set).
+        static uint64_t now();
+
+        // Get current time (nanoseconds since the Epoch, comparable with the
+        // packet timestamps).
+        static uint64_t wall_clock();
+
+        // Hint the CPU that we are spinning.
+        static void cpu_relax();
+
+        // Busy-poll mode: idle time before falling back to poll()
+        // (nanoseconds, 0: disabled).
+        uint64_t _M_spin_time = 0;
+
+        // Value for SO_BUSY_POLL (microseconds, 0: don't set).
+        unsigned _M_busy_poll = 0;
+
+        // NUMA node (-1: default placement).
+        int _M_numa_node = -1;
+
+        // Use huge pages for the frame tables?
+        bool _M_hugepages = false;
+
+        // Spin on the ring buffer until a packet is read or the ring buffer
+        // has been idle for '_M_spin_time'.
+        bool spin();
+
+#if HAVE_TPACKET_V3
+        // Get timestamp of the last packet of the block (nanoseconds since
+        // the Epoch).
+        static uint64_t
+        last_packet_timestamp(const struct tpacket_block_desc* block_desc);
+#endif
+
+        // Frame descriptors (used by the block callback).
+        frame* _M_batch = nullptr;
+
+        // Number of frame descriptors.
+        size_t _M_batch_size;
+
+        // Fanout mode.
+        fanout_mode _M_fanout_mode = fanout_mode::hash;
+
+        // Fanout group identifier (-1: derive from the process id and the
+        // interface index).
+        int _M_fanout_group = -1;
+
+        // Join fanout group.
+        bool join_fanout(unsigned ifindex);
+
         // Set up socket.
         bool setup_socket(int rcvbuf_size,
                           bool promiscuous_mode,
@@ -130,12 +330,20 @@ namespace net {
                         size_t frame_size,
                         size_t frame_count);
 
+        // Set up packet ring on the NUMA node (if any).
+        bool setup_numa_ring(size_t block_size,
+                             size_t frame_size,
+                             size_t frame_count);
+
         // Set up mmap packet ring.
         bool mmap_ring();
 
         // Bind packet ring.
         bool bind_ring(unsigned ifindex);
 
+        // Receive packet(s).
+        bool recv();
+
 #if HAVE_TPACKET_V3
         // Configure for TPACKET_V3.
         void config_v3(size_t block_size,
@@ -145,6 +353,9 @@ namespace net {
 
         // Receive packet for TPACKET_V3.
         bool recv_v3();
+
+        // Receive block for TPACKET_V3.
+        bool recv_block_v3();
 #else
         // Configure for TPACKET_V2.
         void config_v2(size_t block_size,
@@ -154,6 +365,9 @@ namespace net {
 
         // Receive packet for TPACKET_V2.
         bool recv_v2();
+
+        // Receive batch of packets for TPACKET_V2.
+        bool recv_batch_v2();
 #endif
 
         // Disable copy constructor and assignment operator.
@@ -167,11 +381,89 @@ namespace net {
     {
     }
 
+    inline ring_buffer::ring_buffer(blockfn_t blockfn, void* user)
+      : _M_blockfn(blockfn),
+        _M_user(user)
+    {
+    }
+
     inline ring_buffer::~ring_buffer()
     {
       clear();
     }
 
+    inline void ring_buffer::fanout(fanout_mode mode, int group_id)
+    {
+      _M_fanout_mode = mode;
+      _M_fanout_group = group_id;
+    }
+
+    inline void ring_buffer::busy_poll(unsigned spin_time, unsigned busy_poll)
+    {
+      _M_spin_time = spin_time * 1000ull;
+      _M_busy_poll = busy_poll;
+    }
+
+    inline void ring_buffer::numa(int node, bool hugepages)
+    {
+      _M_numa_node = node;
+      _M_hugepages = hugepages;
+    }
+
+    inline void ring_buffer::increment(std::atomic<uint64_t>& counter,
+                                       uint64_t n)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+
+    inline uint64_t ring_buffer::now()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+
+      return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+    }
+
+    inline uint64_t ring_buffer::wall_clock()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+
+      return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+    }
+
+    inline void ring_buffer::cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__)
+      __asm__ __volatile__("yield" ::: "memory");
+#else
+      __asm__ __volatile__("" ::: "memory");
+#endif
+    }
+
+#if HAVE_TPACKET_V3
+    inline uint64_t
+    ring_buffer::last_packet_timestamp(
+      const struct tpacket_block_desc* block_desc
+    )
+    {
+      return (block_desc->hdr.bh1.ts_last_pkt.ts_sec * 1000000000ull) +
+             block_desc->hdr.bh1.ts_last_pkt.ts_nsec;
+    }
+#endif
+
+    inline bool ring_buffer::recv()
+    {
+#if HAVE_TPACKET_V3
+      return _M_blockfn ? recv_block_v3() : recv_v3();
+#else
+      return _M_blockfn ? recv_batch_v2() : recv_v2();
+#endif
+    }
+
     inline bool ring_buffer::create(const char* interface,
                                     int rcvbuf_size,
                                     bool promiscuous_mode,
@@ -0,0 +1,201 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include "net/capture/tx_ring.h"
+
+void net::capture::tx_ring::clear()
+{
+  if (_M_buf != MAP_FAILED) {
+    munmap(_M_buf, _M_ring_size);
+    _M_buf = MAP_FAILED;
+  }
+
+  if (_M_fd != -1) {
+    close(_M_fd);
+    _M_fd = -1;
+  }
+
+  _M_idx = 0;
+  _M_pending = 0;
+
+  _M_packets = 0;
+  _M_bytes = 0;
+}
+
+bool net::capture::tx_ring::create(unsigned ifindex,
+                                   size_t frame_size,
+                                   size_t frame_count,
+                                   bool qdisc_bypass)
+{
+  // Sanity checks.
+  if ((_M_fd == -1) &&
+      (ifindex > 0) &&
+      (frame_size >= min_frame_size) &&
+      (frame_size <= max_frame_size) &&
+      ((frame_size & (frame_size - 1)) == 0) &&
+      (frame_count >= min_frames) &&
+      (frame_count <= max_frames)) {
+    // Create socket (protocol 0: the socket doesn't receive packets).
+    if ((_M_fd = socket(AF_PACKET, SOCK_RAW, 0)) != -1) {
+      const int version = TPACKET_V2;
+
+      // Discard malformed frames instead of stopping the transmission.
+      const int loss = 1;
+
+      // Calculate number of frames per block.
+      const size_t frames_per_block = block_size / frame_size;
+
+      // Calculate number of blocks.
+      const size_t block_count = (frame_count + frames_per_block - 1) /
+                                 frames_per_block;
+
+      struct tpacket_req req;
+      req.tp_block_size = block_size;
+      req.tp_block_nr = block_count;
+      req.tp_frame_size = frame_size;
+      req.tp_frame_nr = block_count * frames_per_block;
+
+      if ((setsockopt(_M_fd,
+                      SOL_PACKET,
+                      PACKET_VERSION,
+                      &version,
+                      sizeof(int)) == 0) &&
+          (setsockopt(_M_fd,
+                      SOL_PACKET,
+                      PACKET_LOSS,
+                      &loss,
+                      sizeof(int)) == 0) &&
+          (setsockopt(_M_fd,
+                      SOL_PACKET,
+                      PACKET_TX_RING,
+                      &req,
+                      sizeof(struct tpacket_req)) == 0)) {
+#if defined(PACKET_QDISC_BYPASS)
+        if (qdisc_bypass) {
+          const int optval = 1;
+          if (setsockopt(_M_fd,
+                         SOL_PACKET,
+                         PACKET_QDISC_BYPASS,
+                         &optval,
+                         sizeof(int)) < 0) {
+            clear();
+            return false;
+          }
+        }
+#endif // defined(PACKET_QDISC_BYPASS)
+
+        _M_ring_size = block_count * block_size;
+
+        // Map ring into memory.
+        if ((_M_buf = mmap(nullptr,
+                           _M_ring_size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_LOCKED,
+                           _M_fd,
+                           0)) != MAP_FAILED) {
+          // Bind.
+          struct sockaddr_ll addr;
+          memset(&addr, 0, sizeof(struct sockaddr_ll));
+          addr.sll_family = AF_PACKET;
+          addr.sll_protocol = htons(ETH_P_ALL);
+          addr.sll_ifindex = ifindex;
+
+          if (bind(_M_fd,
+                   reinterpret_cast<const struct sockaddr*>(&addr),
+                   sizeof(struct sockaddr_ll)) == 0) {
+            _M_frame_size = frame_size;
+            _M_count = req.tp_frame_nr;
+            _M_batch_size = frames_per_block;
+
+            _M_pollfd.fd = _M_fd;
+            _M_pollfd.events = POLLOUT;
+
+            return true;
+          }
+        }
+      }
+
+      clear();
+    }
+  }
+
+  return false;
+}
+
+int net::capture::tx_ring::write(const void* buf, size_t len, int timeout)
+{
+  if (len > mtu()) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  struct tpacket2_hdr* hdr = get_frame(_M_idx);
+
+  // If the frame is still in use by the kernel (the ring is full)...
+  while (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) !=
+         TP_STATUS_AVAILABLE) {
+    // Send queued frames.
+    if (!flush()) {
+      return -1;
+    }
+
+    // Wait for a free frame.
+    switch (poll(&_M_pollfd, 1, timeout)) {
+      case 0: // Timeout.
+        return 0;
+      case -1:
+        if (errno != EINTR) {
+          return -1;
+        }
+
+        break;
+    }
+  }
+
+  // Copy frame.
+  memcpy(reinterpret_cast<uint8_t*>(hdr) + data_offset, buf, len);
+  hdr->tp_len = len;
+
+  // Hand the frame to the kernel.
+  __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+  _M_idx = (_M_idx + 1) % _M_count;
+
+  _M_packets++;
+  _M_bytes += len;
+
+  // If the batch is full...
+  if ((++_M_pending == _M_batch_size) && (!flush())) {
+    return -1;
+  }
+
+  return 1;
+}
+
+bool net::capture::tx_ring::flush(bool wait)
+{
+  // If there are no queued frames and we don't have to wait...
+  if ((_M_pending == 0) && (!wait)) {
+    return true;
+  }
+
+  _M_pending = 0;
+
+  // Without MSG_DONTWAIT, send() returns after the kernel has sent all the
+  // frames.
+  if (send(_M_fd, nullptr, 0, wait ? 0 : MSG_DONTWAIT) < 0) {
+    switch (errno) {
+      case EAGAIN:
+      case ENOBUFS:
+      case EINTR:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
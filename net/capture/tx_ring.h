@@ -0,0 +1,175 @@
+#ifndef NET_CAPTURE_TX_RING_H
+#define NET_CAPTURE_TX_RING_H
+
+#include <sys/mman.h>
+#include <poll.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <stdint.h>
+
+namespace net {
+  namespace capture {
+    // Transmission ring (PACKET_TX_RING, TPACKET_V2).
+    // The frames are copied into the ring and handed to the kernel in
+    // batches (one send() call per batch).
+    class tx_ring {
+      public:
+        // Minimum frame size.
+        static constexpr const size_t min_frame_size = 128;
+
+        // Maximum frame size (64 KiB).
+        static constexpr const size_t
+               max_frame_size = static_cast<size_t>(1) << 16;
+
+        // Default frame size (2 KiB).
+        static constexpr const size_t
+               default_frame_size = static_cast<size_t>(1) << 11;
+
+        // Minimum number of frames.
+        static constexpr const size_t min_frames = 8;
+
+        // Maximum number of frames.
+        static constexpr const size_t
+               max_frames = static_cast<size_t>(1) << 20;
+
+        // Default number of frames (4096).
+        static constexpr const size_t
+               default_frames = static_cast<size_t>(1) << 12;
+
+        // Default write timeout (in milliseconds).
+        static constexpr const int default_write_timeout = 100;
+
+        // Constructor.
+        tx_ring() = default;
+
+        // Destructor.
+        ~tx_ring();
+
+        // Clear.
+        void clear();
+
+        // Create.
+        // 'frame_size' must be a power of two.
+        // If 'qdisc_bypass' is true, the frames are handed directly to the
+        // driver (PACKET_QDISC_BYPASS), skipping the traffic control layer.
+        bool create(const char* interface,
+                    size_t frame_size = default_frame_size,
+                    size_t frame_count = default_frames,
+                    bool qdisc_bypass = false);
+
+        bool create(unsigned ifindex,
+                    size_t frame_size = default_frame_size,
+                    size_t frame_count = default_frames,
+                    bool qdisc_bypass = false);
+
+        // Get maximum length of a frame.
+        size_t mtu() const;
+
+        // Queue frame (the frames are sent when the batch is full or when
+        // flush() is called).
+        // Returns:
+        //   -1: Error.
+        //    0: Timeout (the ring is full).
+        //    1: Frame was queued.
+        int write(const void* buf,
+                  size_t len,
+                  int timeout = default_write_timeout);
+
+        // Send queued frames.
+        // If 'wait' is true, waits until the kernel has sent all the frames.
+        bool flush(bool wait = false);
+
+        // Get number of frames queued.
+        uint64_t packets() const;
+
+        // Get number of bytes queued.
+        uint64_t bytes() const;
+
+      private:
+        // Socket.
+        int _M_fd = -1;
+
+        // Buffer for the ring.
+        void* _M_buf = MAP_FAILED;
+        size_t _M_ring_size;
+
+        // Frame size.
+        size_t _M_frame_size;
+
+        // Number of frames.
+        size_t _M_count;
+
+        // Index of the next frame.
+        size_t _M_idx = 0;
+
+        // Number of frames queued since the last send().
+        size_t _M_pending = 0;
+
+        // Number of frames per batch.
+        size_t _M_batch_size;
+
+        // Poll file descriptor.
+        struct pollfd _M_pollfd;
+
+        // Number of frames queued.
+        uint64_t _M_packets = 0;
+
+        // Number of bytes queued.
+        uint64_t _M_bytes = 0;
+
+        // Block size (multiple of the page size and of the frame size).
+        static constexpr const size_t block_size = max_frame_size;
+
+        // Offset of the data in the frame.
+        static constexpr const size_t
+               data_offset = TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+
+        // Get frame.
+        struct tpacket2_hdr* get_frame(size_t idx) const;
+
+        // Disable copy constructor and assignment operator.
+        tx_ring(const tx_ring&) = delete;
+        tx_ring& operator=(const tx_ring&) = delete;
+    };
+
+    inline tx_ring::~tx_ring()
+    {
+      clear();
+    }
+
+    inline bool tx_ring::create(const char* interface,
+                                size_t frame_size,
+                                size_t frame_count,
+                                bool qdisc_bypass)
+    {
+      return create(if_nametoindex(interface),
+                    frame_size,
+                    frame_count,
+                    qdisc_bypass);
+    }
+
+    inline size_t tx_ring::mtu() const
+    {
+      return _M_frame_size - data_offset;
+    }
+
+    inline uint64_t tx_ring::packets() const
+    {
+      return _M_packets;
+    }
+
+    inline uint64_t tx_ring::bytes() const
+    {
+      return _M_bytes;
+    }
+
+    inline struct tpacket2_hdr* tx_ring::get_frame(size_t idx) const
+    {
+      return reinterpret_cast<struct tpacket2_hdr*>(
+               static_cast<uint8_t*>(_M_buf) + (idx * _M_frame_size)
+             );
+    }
+  }
+}
+
+#endif // NET_CAPTURE_TX_RING_H
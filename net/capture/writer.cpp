@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/param.h>
+#include "net/capture/writer.h"
+#include "pcap/pcap.h"
+
+bool net::capture::writer::open(const char* prefix,
+                                uint64_t max_file_size,
+                                uint64_t max_file_duration,
+                                size_t buffer_size,
+                                size_t nbuffers,
+                                uint32_t snaplen,
+                                bool direct_io)
+{
+  // Sanity checks.
+  if ((!_M_buffers) &&
+      (prefix) &&
+      (*prefix) &&
+      (strlen(prefix) < sizeof(_M_prefix) - 32) &&
+      (buffer_size >= min_buffer_size) &&
+      (buffer_size <= max_buffer_size) &&
+      ((buffer_size & (alignment - 1)) == 0) &&
+      (nbuffers >= min_buffers) &&
+      (nbuffers <= max_buffers) &&
+      (snaplen > 0)) {
+    // Allocate buffers.
+    if ((_M_buffers = static_cast<buffer*>(
+                        calloc(nbuffers, sizeof(buffer))
+                      )) != nullptr) {
+      _M_nbuffers = nbuffers;
+
+      for (size_t i = 0; i < nbuffers; i++) {
+        void* data;
+        if (posix_memalign(&data, alignment, buffer_size) == 0) {
+          _M_buffers[i].data = static_cast<uint8_t*>(data);
+        } else {
+          free_buffers();
+          return false;
+        }
+      }
+
+      strcpy(_M_prefix, prefix);
+
+      _M_buffer_size = buffer_size;
+      _M_max_file_size = max_file_size;
+      _M_max_file_duration = max_file_duration * 1000000ull;
+      _M_snaplen = snaplen;
+      _M_direct_io = direct_io;
+
+      _M_fill = 0;
+      _M_flush = 0;
+      _M_ready = 0;
+      _M_done = false;
+      _M_error = false;
+
+      _M_nfiles = 0;
+      _M_packets = 0;
+      _M_bytes = 0;
+
+      pthread_mutex_init(&_M_mutex, nullptr);
+      pthread_cond_init(&_M_not_empty, nullptr);
+      pthread_cond_init(&_M_not_full, nullptr);
+
+      // Start first file.
+      rotate();
+
+      // Start writer thread.
+      if (pthread_create(&_M_thread, nullptr, run, this) == 0) {
+        return true;
+      }
+
+      pthread_cond_destroy(&_M_not_full);
+      pthread_cond_destroy(&_M_not_empty);
+      pthread_mutex_destroy(&_M_mutex);
+
+      free_buffers();
+    }
+  }
+
+  return false;
+}
+
+bool net::capture::writer::close()
+{
+  if (_M_buffers) {
+    // Hand the last buffer to the writer thread.
+    seal(true);
+
+    pthread_mutex_lock(&_M_mutex);
+    _M_done = true;
+    pthread_cond_signal(&_M_not_empty);
+    pthread_mutex_unlock(&_M_mutex);
+
+    // Wait for the writer thread.
+    pthread_join(_M_thread, nullptr);
+
+    pthread_cond_destroy(&_M_not_full);
+    pthread_cond_destroy(&_M_not_empty);
+    pthread_mutex_destroy(&_M_mutex);
+
+    free_buffers();
+
+    return !_M_error;
+  }
+
+  return true;
+}
+
+bool net::capture::writer::write(const void* buf,
+                                 uint32_t len,
+                                 uint64_t timestamp)
+{
+  // Compute length of the PCAP record.
+  const uint32_t caplen = MIN(len, _M_snaplen);
+  const uint32_t reclen = sizeof(pcap::pkthdr) + caplen;
+
+  // If the current file is not empty...
+  if (!_M_file_empty) {
+    // If the file has to be rotated...
+    if (((_M_max_file_size != 0) &&
+         (_M_file_size + reclen > _M_max_file_size)) ||
+        ((_M_max_file_duration != 0) &&
+         (timestamp >= _M_file_timestamp + _M_max_file_duration))) {
+      // Start a new file.
+      if (!rotate()) {
+        return false;
+      }
+
+      _M_file_timestamp = timestamp;
+      _M_file_empty = false;
+    }
+  } else {
+    _M_file_timestamp = timestamp;
+    _M_file_empty = false;
+  }
+
+  // Build PCAP packet header.
+  pcap::pkthdr hdr;
+  hdr.ts.tv_sec = static_cast<uint32_t>(timestamp / 1000000ull);
+  hdr.ts.tv_usec = static_cast<uint32_t>(timestamp % 1000000ull);
+  hdr.caplen = caplen;
+  hdr.len = len;
+
+  // Add PCAP record.
+  if ((append(&hdr, sizeof(pcap::pkthdr))) && (append(buf, caplen))) {
+    _M_file_size += reclen;
+
+    _M_packets++;
+    _M_bytes += reclen;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool net::capture::writer::append(const void* data, size_t len)
+{
+  const uint8_t* d = static_cast<const uint8_t*>(data);
+
+  do {
+    buffer& buf = _M_buffers[_M_fill];
+
+    // Copy as much data as fits in the current buffer.
+    const size_t n = MIN(len, _M_buffer_size - buf.len);
+    memcpy(buf.data + buf.len, d, n);
+
+    buf.len += n;
+
+    // If the buffer is full...
+    if (buf.len == _M_buffer_size) {
+      // Hand the buffer to the writer thread.
+      if (!seal(false)) {
+        return false;
+      }
+    }
+
+    d += n;
+    len -= n;
+  } while (len > 0);
+
+  return true;
+}
+
+bool net::capture::writer::rotate()
+{
+  // If there is a current file...
+  if (_M_nfiles > 0) {
+    // Close the current file after writing the current buffer.
+    if (!seal(true)) {
+      return false;
+    }
+  }
+
+  // Open a new file before writing the current buffer.
+  buffer& buf = _M_buffers[_M_fill];
+  buf.new_file = true;
+  buf.file_number = _M_nfiles++;
+
+  // Build PCAP file header.
+  pcap::file_header hdr;
+  hdr.magic = static_cast<uint32_t>(pcap::magic::microseconds);
+  hdr.version_major = pcap::version_major;
+  hdr.version_minor = pcap::version_minor;
+  hdr.thiszone = 0;
+  hdr.sigfigs = 0;
+  hdr.snaplen = _M_snaplen;
+  hdr.linktype = static_cast<uint32_t>(pcap::linklayer_header::ethernet);
+
+  _M_file_size = sizeof(pcap::file_header);
+  _M_file_empty = true;
+
+  _M_bytes += sizeof(pcap::file_header);
+
+  // Add PCAP file header (the buffer is empty, so it fits).
+  return append(&hdr, sizeof(pcap::file_header));
+}
+
+bool net::capture::writer::seal(bool last)
+{
+  _M_buffers[_M_fill].last = last;
+
+  pthread_mutex_lock(&_M_mutex);
+
+  // Hand the buffer to the writer thread.
+  _M_ready++;
+  pthread_cond_signal(&_M_not_empty);
+
+  _M_fill = (_M_fill + 1) % _M_nbuffers;
+
+  // Wait for a free buffer.
+  while ((_M_ready == _M_nbuffers) && (!_M_error)) {
+    pthread_cond_wait(&_M_not_full, &_M_mutex);
+  }
+
+  const bool error = _M_error;
+
+  pthread_mutex_unlock(&_M_mutex);
+
+  // Reset next buffer.
+  buffer& buf = _M_buffers[_M_fill];
+  buf.len = 0;
+  buf.new_file = false;
+  buf.last = false;
+
+  return !error;
+}
+
+bool net::capture::writer::flush(const buffer& buf)
+{
+  // If a new file has to be opened...
+  if (buf.new_file) {
+    if (!open_file(buf.file_number)) {
+      return false;
+    }
+  }
+
+  if (buf.len > 0) {
+    // Compute length of the aligned part of the buffer.
+    const size_t len = buf.len & ~(alignment - 1);
+
+    if ((len > 0) && (!_M_file.write(buf.data, len))) {
+      return false;
+    }
+
+    // If there is a tail (only the last buffer of a file can have a
+    // tail)...
+    if (len < buf.len) {
+      // The tail cannot be written with O_DIRECT.
+      const int flags = fcntl(_M_file.fd(), F_GETFL);
+      if ((flags & O_DIRECT) != 0) {
+        if (fcntl(_M_file.fd(), F_SETFL, flags & ~O_DIRECT) < 0) {
+          return false;
+        }
+      }
+
+      if (!_M_file.write(buf.data + len, buf.len - len)) {
+        return false;
+      }
+    }
+  }
+
+  // If this was the last buffer of the file...
+  if (buf.last) {
+    _M_file.close();
+  }
+
+  return true;
+}
+
+bool net::capture::writer::open_file(unsigned file_number)
+{
+  // Close previous file (if open).
+  _M_file.close();
+
+  // Build filename.
+  char filename[sizeof(_M_prefix) + 32];
+  snprintf(filename,
+           sizeof(filename),
+           "%s-%06u.pcap",
+           _M_prefix,
+           file_number);
+
+  static constexpr const int flags = O_CREAT | O_TRUNC | O_WRONLY;
+
+  // Open file (fall back to buffered I/O if the file system doesn't support
+  // O_DIRECT).
+  return (((_M_direct_io) && (_M_file.open(filename, flags | O_DIRECT))) ||
+          (_M_file.open(filename, flags)));
+}
+
+void* net::capture::writer::run(void* arg)
+{
+  writer* w = static_cast<writer*>(arg);
+
+  pthread_mutex_lock(&w->_M_mutex);
+
+  do {
+    // Wait for a buffer.
+    while ((w->_M_ready == 0) && (!w->_M_done)) {
+      pthread_cond_wait(&w->_M_not_empty, &w->_M_mutex);
+    }
+
+    // If there are no more buffers...
+    if (w->_M_ready == 0) {
+      break;
+    }
+
+    const buffer& buf = w->_M_buffers[w->_M_flush];
+
+    pthread_mutex_unlock(&w->_M_mutex);
+
+    // Write buffer to disk.
+    const bool ret = w->flush(buf);
+
+    pthread_mutex_lock(&w->_M_mutex);
+
+    if (!ret) {
+      w->_M_error = true;
+      pthread_cond_signal(&w->_M_not_full);
+
+      break;
+    }
+
+    w->_M_flush = (w->_M_flush + 1) % w->_M_nbuffers;
+
+    // Release buffer.
+    w->_M_ready--;
+    pthread_cond_signal(&w->_M_not_full);
+  } while (true);
+
+  pthread_mutex_unlock(&w->_M_mutex);
+
+  w->_M_file.close();
+
+  return nullptr;
+}
+
+void net::capture::writer::free_buffers()
+{
+  for (size_t i = 0; i < _M_nbuffers; i++) {
+    free(_M_buffers[i].data);
+  }
+
+  free(_M_buffers);
+  _M_buffers = nullptr;
+
+  _M_nbuffers = 0;
+}
@@ -0,0 +1,230 @@
+#ifndef NET_CAPTURE_WRITER_H
+#define NET_CAPTURE_WRITER_H
+
+#include <pthread.h>
+#include <limits.h>
+#include "net/capture/callback.h"
+#include "fs/file.h"
+
+namespace net {
+  namespace capture {
+    // Capture writer.
+    // Copies the captured frames (as PCAP records) into large aligned
+    // buffers, which are written to disk by a dedicated thread (using
+    // O_DIRECT when the file system supports it).
+    // The files are rotated by size and/or by time and are named:
+    //   <prefix>-<sequence-number>.pcap
+    class writer {
+      public:
+        // Alignment of the buffers (and of the O_DIRECT writes).
+        static constexpr const size_t alignment = 4096;
+
+        // Minimum buffer size (64 KiB).
+        static constexpr const size_t
+               min_buffer_size = static_cast<size_t>(1) << 16;
+
+        // Maximum buffer size (1 GiB).
+        static constexpr const size_t
+               max_buffer_size = static_cast<size_t>(1) << 30;
+
+        // Default buffer size (8 MiB).
+        static constexpr const size_t
+               default_buffer_size = static_cast<size_t>(1) << 23;
+
+        // Minimum number of buffers.
+        static constexpr const size_t min_buffers = 2;
+
+        // Maximum number of buffers.
+        static constexpr const size_t max_buffers = 1024;
+
+        // Default number of buffers.
+        static constexpr const size_t default_buffers = 8;
+
+        // Default snapshot length.
+        static constexpr const uint32_t default_snaplen = 65535;
+
+        // Constructor.
+        writer() = default;
+
+        // Destructor.
+        ~writer();
+
+        // Open.
+        // 'max_file_size': rotate when the file reaches this size in bytes
+        //                  (0: no size limit).
+        // 'max_file_duration': rotate when the file contains packets spanning
+        //                      this number of seconds (0: no time limit).
+        bool open(const char* prefix,
+                  uint64_t max_file_size = 0,
+                  uint64_t max_file_duration = 0,
+                  size_t buffer_size = default_buffer_size,
+                  size_t nbuffers = default_buffers,
+                  uint32_t snaplen = default_snaplen,
+                  bool direct_io = true);
+
+        // Close (flushes the buffered data and waits for the writer thread).
+        bool close();
+
+        // Write frames.
+        bool write(const frame* frames, size_t nframes);
+
+        // Write frame.
+        bool write(const void* buf, uint32_t len, uint64_t timestamp);
+
+        // Get number of packets written.
+        uint64_t packets() const;
+
+        // Get number of bytes written.
+        uint64_t bytes() const;
+
+        // Get number of files created.
+        unsigned files() const;
+
+      private:
+        // Buffer.
+        struct buffer {
+          // Data (aligned to 'alignment').
+          uint8_t* data;
+
+          // Length of the data.
+          size_t len;
+
+          // Open a new file before writing this buffer?
+          bool new_file;
+
+          // Sequence number of the new file.
+          unsigned file_number;
+
+          // Close the file after writing this buffer?
+          bool last;
+        };
+
+        // Buffers.
+        buffer* _M_buffers = nullptr;
+
+        // Number of buffers.
+        size_t _M_nbuffers = 0;
+
+        // Buffer size.
+        size_t _M_buffer_size;
+
+        // Index of the buffer being filled (producer).
+        size_t _M_fill;
+
+        // Index of the next buffer to be written (writer thread).
+        size_t _M_flush;
+
+        // Number of buffers ready to be written.
+        size_t _M_ready;
+
+        // Mutex and condition variables protecting '_M_ready', '_M_done' and
+        // '_M_error'.
+        pthread_mutex_t _M_mutex;
+        pthread_cond_t _M_not_empty;
+        pthread_cond_t _M_not_full;
+
+        // Writer thread.
+        pthread_t _M_thread;
+
+        // Has the producer finished?
+        bool _M_done;
+
+        // Error in the writer thread?
+        bool _M_error;
+
+        // Prefix of the filenames.
+        char _M_prefix[PATH_MAX];
+
+        // Maximum file size.
+        uint64_t _M_max_file_size;
+
+        // Maximum file duration (microseconds).
+        uint64_t _M_max_file_duration;
+
+        // Snapshot length.
+        uint32_t _M_snaplen;
+
+        // Use O_DIRECT?
+        bool _M_direct_io;
+
+        // Size of the current file (producer side).
+        uint64_t _M_file_size;
+
+        // Timestamp of the first packet of the current file.
+        uint64_t _M_file_timestamp;
+
+        // Is the current file empty?
+        bool _M_file_empty;
+
+        // Number of packets written.
+        uint64_t _M_packets;
+
+        // Number of bytes written.
+        uint64_t _M_bytes;
+
+        // Number of files.
+        unsigned _M_nfiles;
+
+        // Current file (writer thread).
+        fs::file _M_file;
+
+        // Append data to the current buffer.
+        bool append(const void* data, size_t len);
+
+        // Start a new file.
+        bool rotate();
+
+        // Hand the current buffer to the writer thread and get the next one.
+        bool seal(bool last);
+
+        // Write buffer to disk (writer thread).
+        bool flush(const buffer& buf);
+
+        // Open file (writer thread).
+        bool open_file(unsigned file_number);
+
+        // Thread function.
+        static void* run(void* arg);
+
+        // Free buffers.
+        void free_buffers();
+
+        // Disable copy constructor and assignment operator.
+        writer(const writer&) = delete;
+        writer& operator=(const writer&) = delete;
+    };
+
+    inline writer::~writer()
+    {
+      close();
+    }
+
+    inline bool writer::write(const frame* frames, size_t nframes)
+    {
+      for (size_t i = 0; i < nframes; i++) {
+        if (!write(frames[i].buf, frames[i].len, frames[i].timestamp)) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    inline uint64_t writer::packets() const
+    {
+      return _M_packets;
+    }
+
+    inline uint64_t writer::bytes() const
+    {
+      return _M_bytes;
+    }
+
+    inline unsigned writer::files() const
+    {
+      return _M_nfiles;
+    }
+  }
+}
+
+#endif // NET_CAPTURE_WRITER_H
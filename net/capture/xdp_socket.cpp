@@ -0,0 +1,489 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/if_link.h>
+#include "net/capture/xdp_socket.h"
+#include "util/numa.h"
+
+#if !defined(AF_XDP)
+  #define AF_XDP 44
+#endif
+
+#if !defined(SOL_XDP)
+  #define SOL_XDP 283
+#endif
+
+void net::capture::xdp_socket::clear()
+{
+  // Closing the link detaches the program from the interface.
+  if (_M_link_fd != -1) {
+    close(_M_link_fd);
+    _M_link_fd = -1;
+  }
+
+  if (_M_prog_fd != -1) {
+    close(_M_prog_fd);
+    _M_prog_fd = -1;
+  }
+
+  if (_M_map_fd != -1) {
+    close(_M_map_fd);
+    _M_map_fd = -1;
+  }
+
+  munmap_ring(_M_rx);
+  munmap_ring(_M_fill);
+  munmap_ring(_M_completion);
+
+  if (_M_fd != -1) {
+    close(_M_fd);
+    _M_fd = -1;
+  }
+
+  if (_M_umem) {
+    util::numa::free(_M_umem, _M_umem_size);
+    _M_umem = nullptr;
+  }
+
+  if (_M_batch) {
+    free(_M_batch);
+    _M_batch = nullptr;
+  }
+
+  // Reset counters.
+  _M_batches = 0;
+  _M_frames = 0;
+  _M_polls = 0;
+  _M_poll_wakeups = 0;
+  _M_callback_time = 0;
+  _M_sleep_time = 0;
+}
+
+bool net::capture::xdp_socket::create(unsigned ifindex,
+                                      unsigned queue,
+                                      size_t frame_size,
+                                      size_t frame_count)
+{
+  // Sanity checks.
+  if ((_M_fd == -1) &&
+      (ifindex > 0) &&
+      (frame_size >= min_frame_size) &&
+      (frame_size <= max_frame_size) &&
+      ((frame_size & (frame_size - 1)) == 0) &&
+      (frame_count >= min_frames) &&
+      (frame_count <= max_frames) &&
+      ((frame_count & (frame_count - 1)) == 0)) {
+    _M_frame_size = frame_size;
+    _M_nframes = frame_count;
+
+    // Create socket.
+    if ((_M_fd = socket(AF_XDP, SOCK_RAW, 0)) != -1) {
+      if ((setup_umem()) &&
+          ((_M_blockfn == nullptr) ||
+           ((_M_batch = static_cast<frame*>(
+                          malloc(max_batch * sizeof(frame))
+                        )) != nullptr))) {
+        // Bind socket to the queue (copy mode).
+        struct sockaddr_xdp addr;
+        memset(&addr, 0, sizeof(struct sockaddr_xdp));
+        addr.sxdp_family = AF_XDP;
+        addr.sxdp_flags = XDP_COPY;
+        addr.sxdp_ifindex = ifindex;
+        addr.sxdp_queue_id = queue;
+
+        if ((bind(_M_fd,
+                  reinterpret_cast<const struct sockaddr*>(&addr),
+                  sizeof(struct sockaddr_xdp)) == 0) &&
+            (load_program(queue)) &&
+            (attach_program(ifindex))) {
+          _M_pollfd.fd = _M_fd;
+          _M_pollfd.events = POLLIN;
+          _M_pollfd.revents = 0;
+
+          return true;
+        }
+      }
+    }
+
+    clear();
+  }
+
+  return false;
+}
+
+int net::capture::xdp_socket::read(int timeout)
+{
+  if (recv()) {
+    return 1;
+  }
+
+  _M_polls++;
+
+  const uint64_t start = now();
+
+  const int ret = poll(&_M_pollfd, 1, timeout);
+
+  _M_sleep_time += (now() - start);
+
+  switch (ret) {
+    case 1:
+      _M_poll_wakeups++;
+
+      return recv() ? 1 : 0;
+    case 0: // Timeout.
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+bool net::capture::xdp_socket::get_statistics(statistics& stats)
+{
+  struct xdp_statistics kstats;
+  socklen_t optlen = sizeof(struct xdp_statistics);
+
+  // Get kernel counters (they are not reset after being read).
+  if (getsockopt(_M_fd, SOL_XDP, XDP_STATISTICS, &kstats, &optlen) == 0) {
+    stats.drops = kstats.rx_dropped;
+    stats.ring_full = kstats.rx_ring_full;
+    stats.fill_ring_empty = kstats.rx_fill_ring_empty_descs;
+    stats.invalid_descs = kstats.rx_invalid_descs;
+
+    stats.batches = _M_batches;
+    stats.frames = _M_frames;
+    stats.polls = _M_polls;
+    stats.poll_wakeups = _M_poll_wakeups;
+    stats.callback_time = _M_callback_time;
+    stats.sleep_time = _M_sleep_time;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool net::capture::xdp_socket::show_statistics()
+{
+  statistics stats;
+  if (get_statistics(stats)) {
+    printf("  %" PRIu64 " packets dropped by kernel (%" PRIu64 " RX ring "
+           "full, %" PRIu64 " invalid descriptors).\n",
+           stats.drops + stats.ring_full + stats.invalid_descs,
+           stats.ring_full,
+           stats.invalid_descs);
+
+    printf("  %" PRIu64 " times the fill ring was empty.\n",
+           stats.fill_ring_empty);
+
+    printf("  %" PRIu64 " batches processed (%" PRIu64 " frames).\n",
+           stats.batches,
+           stats.frames);
+
+    if (stats.batches > 0) {
+      printf("  Average time in callbacks: %" PRIu64 " ns per batch.\n",
+             stats.callback_time / stats.batches);
+    }
+
+    printf("  %" PRIu64 " calls to poll() (%" PRIu64 " wakeups).\n",
+           stats.polls,
+           stats.poll_wakeups);
+
+    printf("  Time sleeping in poll(): %.3f ms.\n",
+           stats.sleep_time / 1000000.0);
+
+    return true;
+  }
+
+  return false;
+}
+
+bool net::capture::xdp_socket::setup_umem()
+{
+  _M_umem_size = _M_nframes * _M_frame_size;
+
+  // Allocate UMEM.
+  if ((_M_umem = util::numa::alloc(_M_umem_size,
+                                   _M_numa_node,
+                                   _M_hugepages)) != nullptr) {
+    // Register UMEM.
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(struct xdp_umem_reg));
+    reg.addr = reinterpret_cast<uintptr_t>(_M_umem);
+    reg.len = _M_umem_size;
+    reg.chunk_size = _M_frame_size;
+    reg.headroom = 0;
+
+    // The fill ring and the RX ring can hold all the frames; the
+    // completion ring is only used for transmission.
+    const int nframes = static_cast<int>(_M_nframes);
+    const int ncompletions = static_cast<int>(min_frames);
+
+    if ((setsockopt(_M_fd,
+                    SOL_XDP,
+                    XDP_UMEM_REG,
+                    &reg,
+                    sizeof(struct xdp_umem_reg)) == 0) &&
+        (setsockopt(_M_fd,
+                    SOL_XDP,
+                    XDP_UMEM_FILL_RING,
+                    &nframes,
+                    sizeof(int)) == 0) &&
+        (setsockopt(_M_fd,
+                    SOL_XDP,
+                    XDP_UMEM_COMPLETION_RING,
+                    &ncompletions,
+                    sizeof(int)) == 0) &&
+        (setsockopt(_M_fd,
+                    SOL_XDP,
+                    XDP_RX_RING,
+                    &nframes,
+                    sizeof(int)) == 0)) {
+      // Get offsets of the rings.
+      struct xdp_mmap_offsets off;
+      socklen_t optlen = sizeof(struct xdp_mmap_offsets);
+
+      if ((getsockopt(_M_fd,
+                      SOL_XDP,
+                      XDP_MMAP_OFFSETS,
+                      &off,
+                      &optlen) == 0) &&
+          (mmap_ring(off.rx,
+                     sizeof(struct xdp_desc),
+                     _M_nframes,
+                     XDP_PGOFF_RX_RING,
+                     _M_rx)) &&
+          (mmap_ring(off.fr,
+                     sizeof(uint64_t),
+                     _M_nframes,
+                     XDP_UMEM_PGOFF_FILL_RING,
+                     _M_fill)) &&
+          (mmap_ring(off.cr,
+                     sizeof(uint64_t),
+                     min_frames,
+                     XDP_UMEM_PGOFF_COMPLETION_RING,
+                     _M_completion))) {
+        // Hand all the frames to the kernel.
+        uint64_t* const addrs = static_cast<uint64_t*>(_M_fill.descs);
+        for (size_t i = 0; i < _M_nframes; i++) {
+          addrs[i] = i * _M_frame_size;
+        }
+
+        __atomic_store_n(_M_fill.producer,
+                         static_cast<uint32_t>(_M_nframes),
+                         __ATOMIC_RELEASE);
+
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool net::capture::xdp_socket::mmap_ring(const struct xdp_ring_offset& off,
+                                         size_t desc_size,
+                                         size_t count,
+                                         off_t pgoff,
+                                         ring& r)
+{
+  r.map_len = off.desc + (count * desc_size);
+
+  if ((r.map = mmap(nullptr,
+                    r.map_len,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE,
+                    _M_fd,
+                    pgoff)) != MAP_FAILED) {
+    uint8_t* const base = static_cast<uint8_t*>(r.map);
+
+    r.producer = reinterpret_cast<uint32_t*>(base + off.producer);
+    r.consumer = reinterpret_cast<uint32_t*>(base + off.consumer);
+    r.descs = base + off.desc;
+    r.mask = count - 1;
+
+    return true;
+  }
+
+  return false;
+}
+
+void net::capture::xdp_socket::munmap_ring(ring& r)
+{
+  if (r.map != MAP_FAILED) {
+    munmap(r.map, r.map_len);
+    r.map = MAP_FAILED;
+  }
+}
+
+bool net::capture::xdp_socket::load_program(unsigned queue)
+{
+  // Create XSKMAP.
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(union bpf_attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint32_t);
+  attr.max_entries = queue + 1;
+
+  if ((_M_map_fd = bpf(BPF_MAP_CREATE, attr)) != -1) {
+    // Add the socket at index 'queue'.
+    const uint32_t key = queue;
+    const uint32_t value = static_cast<uint32_t>(_M_fd);
+
+    memset(&attr, 0, sizeof(union bpf_attr));
+    attr.map_fd = _M_map_fd;
+    attr.key = reinterpret_cast<uintptr_t>(&key);
+    attr.value = reinterpret_cast<uintptr_t>(&value);
+    attr.flags = BPF_ANY;
+
+    if (bpf(BPF_MAP_UPDATE_ELEM, attr) == 0) {
+      // XDP program:
+      //   r2 = ctx->rx_queue_index
+      //   r1 = xskmap
+      //   r3 = XDP_PASS (action if there is no socket for the queue)
+      //   return bpf_redirect_map(r1, r2, r3)
+      struct bpf_insn insns[6];
+      memset(insns, 0, sizeof(insns));
+
+      insns[0].code = BPF_LDX | BPF_MEM | BPF_W;
+      insns[0].dst_reg = BPF_REG_2;
+      insns[0].src_reg = BPF_REG_1;
+      insns[0].off = offsetof(struct xdp_md, rx_queue_index);
+
+      // 64-bit immediate (two instructions).
+      insns[1].code = BPF_LD | BPF_DW | BPF_IMM;
+      insns[1].dst_reg = BPF_REG_1;
+      insns[1].src_reg = BPF_PSEUDO_MAP_FD;
+      insns[1].imm = _M_map_fd;
+
+      insns[3].code = BPF_ALU64 | BPF_MOV | BPF_K;
+      insns[3].dst_reg = BPF_REG_3;
+      insns[3].imm = XDP_PASS;
+
+      insns[4].code = BPF_JMP | BPF_CALL;
+      insns[4].imm = BPF_FUNC_redirect_map;
+
+      insns[5].code = BPF_JMP | BPF_EXIT;
+
+      static const char license[] = "Dual BSD/GPL";
+
+      memset(&attr, 0, sizeof(union bpf_attr));
+      attr.prog_type = BPF_PROG_TYPE_XDP;
+      attr.insn_cnt = sizeof(insns) / sizeof(struct bpf_insn);
+      attr.insns = reinterpret_cast<uintptr_t>(insns);
+      attr.license = reinterpret_cast<uintptr_t>(license);
+
+      return ((_M_prog_fd = bpf(BPF_PROG_LOAD, attr)) != -1);
+    }
+  }
+
+  return false;
+}
+
+bool net::capture::xdp_socket::attach_program(unsigned ifindex)
+{
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(union bpf_attr));
+  attr.link_create.prog_fd = _M_prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+
+  return ((_M_link_fd = bpf(BPF_LINK_CREATE, attr)) != -1);
+}
+
+bool net::capture::xdp_socket::recv()
+{
+  const uint32_t cons = *_M_rx.consumer;
+  const uint32_t prod = __atomic_load_n(_M_rx.producer, __ATOMIC_ACQUIRE);
+
+  // If there are no new frames...
+  if (prod == cons) {
+    return false;
+  }
+
+  const uint32_t n = prod - cons;
+
+  const struct xdp_desc* const
+    descs = static_cast<const struct xdp_desc*>(_M_rx.descs);
+
+  const uint8_t* const umem = static_cast<const uint8_t*>(_M_umem);
+
+  // The frames have no timestamp.
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+
+  const uint64_t start = now();
+
+  if (_M_blockfn) {
+    const uint64_t timestamp = (tv.tv_sec * 1000000ull) + tv.tv_usec;
+
+    size_t nframes = 0;
+
+    // Fill frame descriptors.
+    for (uint32_t i = 0; i < n; i++) {
+      const struct xdp_desc* const desc = descs + ((cons + i) & _M_rx.mask);
+
+      frame* const f = _M_batch + nframes;
+
+      f->buf = umem + desc->addr;
+      f->len = desc->len;
+      f->timestamp = timestamp;
+
+      // If all the frame descriptors are in use...
+      if (++nframes == max_batch) {
+        // Process frames.
+        _M_blockfn(_M_batch, nframes, _M_user);
+        _M_batches++;
+
+        nframes = 0;
+      }
+    }
+
+    // Process remaining frames.
+    if (nframes > 0) {
+      _M_blockfn(_M_batch, nframes, _M_user);
+      _M_batches++;
+    }
+  } else {
+    for (uint32_t i = 0; i < n; i++) {
+      const struct xdp_desc* const desc = descs + ((cons + i) & _M_rx.mask);
+
+      _M_ethernetfn(umem + desc->addr, desc->len, tv, _M_user);
+    }
+
+    _M_batches++;
+  }
+
+  _M_callback_time += (now() - start);
+  _M_frames += n;
+
+  // Give the frames back to the kernel (the fill ring can hold all the
+  // frames, so there is always room for them).
+  const uint32_t fill_prod = *_M_fill.producer;
+  uint64_t* const addrs = static_cast<uint64_t*>(_M_fill.descs);
+
+  for (uint32_t i = 0; i < n; i++) {
+    addrs[(fill_prod + i) & _M_fill.mask] =
+      descs[(cons + i) & _M_rx.mask].addr & ~(_M_frame_size - 1);
+  }
+
+  __atomic_store_n(_M_fill.producer, fill_prod + n, __ATOMIC_RELEASE);
+  __atomic_store_n(_M_rx.consumer, prod, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+int net::capture::xdp_socket::bpf(int cmd, union bpf_attr& attr)
+{
+  return static_cast<int>(syscall(SYS_bpf,
+                                  cmd,
+                                  &attr,
+                                  sizeof(union bpf_attr)));
+}
@@ -0,0 +1,281 @@
+#ifndef NET_CAPTURE_XDP_SOCKET_H
+#define NET_CAPTURE_XDP_SOCKET_H
+
+#include <sys/mman.h>
+#include <poll.h>
+#include <net/if.h>
+#include <time.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+#include "net/capture/callback.h"
+
+namespace net {
+  namespace capture {
+    // AF_XDP socket (copy mode).
+    // An XDP program, attached in generic (SKB) mode, redirects the frames
+    // received on one queue of the interface to the socket, so it works on
+    // any interface (veth, loopback, ...) without driver support.
+    // The redirected frames don't reach the network stack, and there can be
+    // only one XDP socket per interface.
+    class xdp_socket {
+      public:
+        // Minimum frame size (2 KiB).
+        static constexpr const size_t
+               min_frame_size = static_cast<size_t>(1) << 11;
+
+        // Maximum frame size (4 KiB).
+        static constexpr const size_t
+               max_frame_size = static_cast<size_t>(1) << 12;
+
+        // Default frame size (2 KiB).
+        static constexpr const size_t default_frame_size = min_frame_size;
+
+        // Minimum number of frames.
+        static constexpr const size_t min_frames = 64;
+
+        // Maximum number of frames.
+        static constexpr const size_t
+               max_frames = static_cast<size_t>(1) << 20;
+
+        // Default number of frames (4096).
+        static constexpr const size_t
+               default_frames = static_cast<size_t>(1) << 12;
+
+        // Default read timeout (in milliseconds).
+        static constexpr const int default_read_timeout = 100;
+
+        // Statistics.
+        struct statistics {
+          // Number of packets dropped (kernel).
+          uint64_t drops;
+
+          // Number of packets dropped because the RX ring was full (kernel).
+          uint64_t ring_full;
+
+          // Number of times the fill ring was empty (kernel).
+          uint64_t fill_ring_empty;
+
+          // Number of invalid descriptors (kernel).
+          uint64_t invalid_descs;
+
+          // Number of batches of frames processed.
+          uint64_t batches;
+
+          // Number of frames processed.
+          uint64_t frames;
+
+          // Number of calls to poll().
+          uint64_t polls;
+
+          // Number of calls to poll() which returned because there were new
+          // packets.
+          uint64_t poll_wakeups;
+
+          // Time spent in the callbacks (nanoseconds).
+          uint64_t callback_time;
+
+          // Time spent sleeping in poll() (nanoseconds).
+          uint64_t sleep_time;
+        };
+
+        // Constructor.
+        // The ethernet frame callback is called once per frame.
+        xdp_socket(ethernetfn_t ethernetfn, void* user);
+
+        // Constructor.
+        // The block callback is called once per batch of frames.
+        xdp_socket(blockfn_t blockfn, void* user);
+
+        // Destructor.
+        ~xdp_socket();
+
+        // Clear.
+        void clear();
+
+        // Create.
+        // 'frame_size' must be a power of two and 'frame_count' a power of
+        // two.
+        bool create(const char* interface,
+                    unsigned queue = 0,
+                    size_t frame_size = default_frame_size,
+                    size_t frame_count = default_frames);
+
+        bool create(unsigned ifindex,
+                    unsigned queue = 0,
+                    size_t frame_size = default_frame_size,
+                    size_t frame_count = default_frames);
+
+        // Set NUMA placement of the UMEM (must be called before create()).
+        void numa(int node, bool hugepages = true);
+
+        // Read next packet(s).
+        // Returns:
+        //   -1: Error.
+        //    0: Timeout.
+        //    1: Packet was read.
+        int read(int timeout = default_read_timeout);
+
+        // Get statistics (must be called from the thread reading from the
+        // socket).
+        bool get_statistics(statistics& stats);
+
+        // Show statistics.
+        bool show_statistics();
+
+      private:
+        // Ring shared with the kernel.
+        struct ring {
+          // Producer and consumer indices.
+          uint32_t* producer;
+          uint32_t* consumer;
+
+          // Descriptors.
+          void* descs;
+
+          // Number of descriptors - 1.
+          uint32_t mask;
+
+          // Mapping.
+          void* map = MAP_FAILED;
+          size_t map_len;
+        };
+
+        // Socket.
+        int _M_fd = -1;
+
+        // UMEM (packet buffers).
+        void* _M_umem = nullptr;
+        size_t _M_umem_size;
+
+        // Frame size.
+        size_t _M_frame_size;
+
+        // Number of frames.
+        size_t _M_nframes;
+
+        // RX ring.
+        ring _M_rx;
+
+        // Fill ring.
+        ring _M_fill;
+
+        // Completion ring (required by the kernel, unused).
+        ring _M_completion;
+
+        // XSKMAP.
+        int _M_map_fd = -1;
+
+        // XDP program.
+        int _M_prog_fd = -1;
+
+        // BPF link attaching the program to the interface.
+        int _M_link_fd = -1;
+
+        // Poll file descriptor.
+        struct pollfd _M_pollfd;
+
+        // Ethernet frame callback.
+        ethernetfn_t _M_ethernetfn = nullptr;
+
+        // Block callback.
+        blockfn_t _M_blockfn = nullptr;
+
+        // User pointer.
+        void* _M_user;
+
+        // Frame descriptors (used by the block callback).
+        frame* _M_batch = nullptr;
+
+        // Maximum number of frames per batch.
+        static constexpr const size_t max_batch = 256;
+
+        // Counters.
+        uint64_t _M_batches = 0;
+        uint64_t _M_frames = 0;
+        uint64_t _M_polls = 0;
+        uint64_t _M_poll_wakeups = 0;
+        uint64_t _M_callback_time = 0;
+        uint64_t _M_sleep_time = 0;
+
+        // NUMA node (-1: default placement).
+        int _M_numa_node = -1;
+
+        // Use huge pages for the UMEM?
+        bool _M_hugepages = false;
+
+        // Set up UMEM and rings.
+        bool setup_umem();
+
+        // Map ring of 'count' descriptors.
+        bool mmap_ring(const struct xdp_ring_offset& off,
+                       size_t desc_size,
+                       size_t count,
+                       off_t pgoff,
+                       ring& r);
+
+        // Unmap ring.
+        static void munmap_ring(ring& r);
+
+        // Create XSKMAP (with the socket at index 'queue') and load XDP
+        // program redirecting the frames to it.
+        bool load_program(unsigned queue);
+
+        // Attach XDP program to the interface (generic mode).
+        bool attach_program(unsigned ifindex);
+
+        // Receive batch of packets.
+        bool recv();
+
+        // bpf() system call.
+        static int bpf(int cmd, union bpf_attr& attr);
+
+        // Get monotonic time (nanoseconds, for measuring intervals).
+        static uint64_t now();
+
+        // Disable copy constructor and assignment operator.
+        xdp_socket(const xdp_socket&) = delete;
+        xdp_socket& operator=(const xdp_socket&) = delete;
+    };
+
+    inline xdp_socket::xdp_socket(ethernetfn_t ethernetfn, void* user)
+      : _M_ethernetfn(ethernetfn),
+        _M_user(user)
+    {
+    }
+
+    inline xdp_socket::xdp_socket(blockfn_t blockfn, void* user)
+      : _M_blockfn(blockfn),
+        _M_user(user)
+    {
+    }
+
+    inline xdp_socket::~xdp_socket()
+    {
+      clear();
+    }
+
+    inline bool xdp_socket::create(const char* interface,
+                                   unsigned queue,
+                                   size_t frame_size,
+                                   size_t frame_count)
+    {
+      return create(if_nametoindex(interface), queue, frame_size, frame_count);
+    }
+
+    inline void xdp_socket::numa(int node, bool hugepages)
+    {
+      _M_numa_node = node;
+      _M_hugepages = hugepages;
+    }
+
+    inline uint64_t xdp_socket::now()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+
+      return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+    }
+  }
+}
+
+#endif // NET_CAPTURE_XDP_SOCKET_H
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include "net/ip/compact_packets.h"
+
+void net::ip::compact_packets::clear()
+{
+  if (_M_records) {
+    free(_M_records);
+    _M_records = nullptr;
+  }
+
+  _M_size = 0;
+  _M_used = 0;
+}
+
+bool net::ip::compact_packets::add(const packet& pkt)
+{
+  // If the array is full...
+  if (_M_used == _M_size) {
+    // Big arrays are mapped, so realloc() doesn't copy them (mremap()).
+    const size_t size = (_M_size > 0) ? _M_size * 2 : record_allocation;
+
+    record* records;
+    if ((records = static_cast<record*>(
+                     realloc(_M_records, size * sizeof(record))
+                   )) == nullptr) {
+      return false;
+    }
+
+    _M_records = records;
+    _M_size = size;
+  }
+
+  const uint8_t* const l2 = static_cast<const uint8_t*>(pkt.l2());
+
+  record& r = _M_records[_M_used++];
+
+  r.l2 = l2;
+  r.timestamp = pkt.timestamp();
+  r.length = pkt.length();
+  r.l3 = static_cast<uint16_t>(static_cast<const uint8_t*>(pkt.l3()) - l2);
+  r.l4 = static_cast<uint16_t>(static_cast<const uint8_t*>(pkt.l4()) - l2);
+  r.protocol = pkt.protocol();
+  r.version = static_cast<uint8_t>(pkt.version());
+
+  return true;
+}
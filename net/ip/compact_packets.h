@@ -0,0 +1,112 @@
+#ifndef NET_IP_COMPACT_PACKETS_H
+#define NET_IP_COMPACT_PACKETS_H
+
+#include "net/ip/packet.h"
+
+namespace net {
+  namespace ip {
+    // IP packets, stored as compact records (24 bytes per packet) in a
+    // contiguous array.
+    // A record doesn't own the packet: it points to the IP header (in the
+    // mapped PCAP file or in the buffer of a reassembled packet), which has
+    // to stay valid. The net::ip::packet is built on demand by get().
+    class compact_packets {
+      public:
+        // Constructor.
+        compact_packets() = default;
+
+        // Destructor.
+        ~compact_packets();
+
+        // Clear.
+        void clear();
+
+        // Add packet.
+        bool add(const packet& pkt);
+
+        // Remove last packet.
+        void remove_last();
+
+        // Get number of packets.
+        size_t count() const;
+
+        // Get packet at position.
+        bool get(size_t idx, packet& pkt) const;
+
+      private:
+        // Record allocation (number of records).
+        static constexpr const size_t record_allocation = 32 * 1024;
+
+        // Record (24 bytes).
+        struct record {
+          // Pointer to the IP header.
+          const void* l2;
+
+          // Packet timestamp.
+          uint64_t timestamp;
+
+          // Length of the IP packet.
+          uint16_t length;
+
+          // Offsets of the layer 3 and of the layer 4 (from the IP header).
+          uint16_t l3;
+          uint16_t l4;
+
+          // Layer 3 protocol.
+          uint8_t protocol;
+
+          // IP version.
+          uint8_t version;
+        };
+
+        // Records.
+        record* _M_records = nullptr;
+        size_t _M_size = 0;
+        size_t _M_used = 0;
+
+        // Disable copy constructor and assignment operator.
+        compact_packets(const compact_packets&) = delete;
+        compact_packets& operator=(const compact_packets&) = delete;
+    };
+
+    inline compact_packets::~compact_packets()
+    {
+      clear();
+    }
+
+    inline void compact_packets::remove_last()
+    {
+      if (_M_used > 0) {
+        _M_used--;
+      }
+    }
+
+    inline size_t compact_packets::count() const
+    {
+      return _M_used;
+    }
+
+    inline bool compact_packets::get(size_t idx, packet& pkt) const
+    {
+      if (idx < _M_used) {
+        const record& r = _M_records[idx];
+        const uint8_t* const l2 = static_cast<const uint8_t*>(r.l2);
+
+        pkt._M_timestamp = r.timestamp;
+        pkt._M_length = r.length;
+        pkt._M_version = static_cast<ip::version>(r.version);
+        pkt._M_l2.buf = l2;
+        pkt._M_protocol = r.protocol;
+        pkt._M_l3.buf = l2 + r.l3;
+        pkt._M_l4 = l2 + r.l4;
+        pkt._M_has_hash = false;
+
+        return true;
+      }
+
+      return false;
+    }
+  }
+}
+
+#endif // NET_IP_COMPACT_PACKETS_H
@@ -0,0 +1,171 @@
+#ifndef NET_IP_DESCRIPTORS_H
+#define NET_IP_DESCRIPTORS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace net {
+  namespace ip {
+    // Block of IP packet descriptors, stored as a structure of arrays (one
+    // tightly packed column per field), filled by
+    // net::ip::parser::process_ethernet_batch().
+    // The offsets are relative to the beginning of the ethernet frame; as in
+    // net::ip::packet, layer 2 is the IP header, layer 3 the TCP / UDP /
+    // ICMP header and layer 4 its payload.
+    class descriptors {
+      friend class parser;
+
+      public:
+        // Maximum number of packets per block.
+        static constexpr const size_t max_packets = 256;
+
+        // Constructor.
+        descriptors() = default;
+
+        // Destructor.
+        ~descriptors() = default;
+
+        // Get number of packets.
+        size_t count() const;
+
+        // Get indices of the frames (in the batch).
+        const uint16_t* frames() const;
+
+        // Get packet timestamps.
+        const uint64_t* timestamps() const;
+
+        // Get lengths of the IP packets.
+        const uint16_t* lengths() const;
+
+        // Get IP versions (4 or 6).
+        const uint8_t* versions() const;
+
+        // Get protocols (IPPROTO_TCP, IPPROTO_UDP, IPPROTO_ICMP or
+        // IPPROTO_ICMPV6).
+        const uint8_t* protocols() const;
+
+        // Get offsets of the layer 2 (IP header).
+        const uint16_t* l2_offsets() const;
+
+        // Get offsets of the layer 3 (TCP / UDP / ICMP header).
+        const uint16_t* l3_offsets() const;
+
+        // Get offsets of the layer 4 (payload).
+        const uint16_t* l4_offsets() const;
+
+        // Get source ports (host byte order, 0 for ICMP).
+        const uint16_t* sports() const;
+
+        // Get destination ports (host byte order, 0 for ICMP).
+        const uint16_t* dports() const;
+
+        // Get flow hashes (see net::ip::flow_hash()).
+        const uint32_t* hashes() const;
+
+        // Get number of deferred frames.
+        size_t deferred_count() const;
+
+        // Get indices of the frames (in the batch) which have to be processed
+        // with net::ip::parser::process_ethernet() (fragments, tunnels and
+        // packets with MPLS labels or IPv6 extension headers).
+        const uint16_t* deferred() const;
+
+      private:
+        // Columns.
+        uint16_t _M_frames[max_packets];
+        uint64_t _M_timestamps[max_packets];
+        uint16_t _M_lengths[max_packets];
+        uint8_t _M_versions[max_packets];
+        uint8_t _M_protocols[max_packets];
+        uint16_t _M_l2_offsets[max_packets];
+        uint16_t _M_l3_offsets[max_packets];
+        uint16_t _M_l4_offsets[max_packets];
+        uint16_t _M_sports[max_packets];
+        uint16_t _M_dports[max_packets];
+        uint32_t _M_hashes[max_packets];
+
+        // Number of packets.
+        size_t _M_count = 0;
+
+        // Deferred frames.
+        uint16_t _M_deferred[max_packets];
+        size_t _M_ndeferred = 0;
+
+        // Disable copy constructor and assignment operator.
+        descriptors(const descriptors&) = delete;
+        descriptors& operator=(const descriptors&) = delete;
+    };
+
+    inline size_t descriptors::count() const
+    {
+      return _M_count;
+    }
+
+    inline const uint16_t* descriptors::frames() const
+    {
+      return _M_frames;
+    }
+
+    inline const uint64_t* descriptors::timestamps() const
+    {
+      return _M_timestamps;
+    }
+
+    inline const uint16_t* descriptors::lengths() const
+    {
+      return _M_lengths;
+    }
+
+    inline const uint8_t* descriptors::versions() const
+    {
+      return _M_versions;
+    }
+
+    inline const uint8_t* descriptors::protocols() const
+    {
+      return _M_protocols;
+    }
+
+    inline const uint16_t* descriptors::l2_offsets() const
+    {
+      return _M_l2_offsets;
+    }
+
+    inline const uint16_t* descriptors::l3_offsets() const
+    {
+      return _M_l3_offsets;
+    }
+
+    inline const uint16_t* descriptors::l4_offsets() const
+    {
+      return _M_l4_offsets;
+    }
+
+    inline const uint16_t* descriptors::sports() const
+    {
+      return _M_sports;
+    }
+
+    inline const uint16_t* descriptors::dports() const
+    {
+      return _M_dports;
+    }
+
+    inline const uint32_t* descriptors::hashes() const
+    {
+      return _M_hashes;
+    }
+
+    inline size_t descriptors::deferred_count() const
+    {
+      return _M_ndeferred;
+    }
+
+    inline const uint16_t* descriptors::deferred() const
+    {
+      return _M_deferred;
+    }
+  }
+}
+
+#endif // NET_IP_DESCRIPTORS_H
@@ -0,0 +1,69 @@
+#ifndef NET_IP_FLOW_H
+#define NET_IP_FLOW_H
+
+#include "net/ip/packet.h"
+#include "net/ip/address.h"
+
+namespace net {
+  namespace ip {
+    // Compute flow hash from the hashes of the addresses (see
+    // net::ip::address::hash()) and the ports (network byte order).
+    static inline uint32_t flow_hash(uint32_t saddr,
+                                     uint32_t daddr,
+                                     uint16_t sport,
+                                     uint16_t dport)
+    {
+      static constexpr const uint32_t initval = 0;
+
+      // Order the endpoints.
+      if ((saddr < daddr) || ((saddr == daddr) && (sport <= dport))) {
+        return util::hash::hash_3words(saddr,
+                                       daddr,
+                                       (static_cast<uint32_t>(sport) << 16) |
+                                         dport,
+                                       initval);
+      } else {
+        return util::hash::hash_3words(daddr,
+                                       saddr,
+                                       (static_cast<uint32_t>(dport) << 16) |
+                                         sport,
+                                       initval);
+      }
+    }
+
+    // Compute flow hash (both directions of the flow have the same hash).
+    // Returns the hash computed by the parser, if any.
+    static inline uint32_t flow_hash(const packet& pkt)
+    {
+      if (pkt.has_hash()) {
+        return pkt.hash();
+      }
+
+      uint32_t saddr;
+      uint32_t daddr;
+
+      if (pkt.version() == version::v4) {
+        saddr = address::hash(pkt.ipv4()->saddr);
+        daddr = address::hash(pkt.ipv4()->daddr);
+      } else {
+        saddr = address::hash(pkt.ipv6()->ip6_src);
+        daddr = address::hash(pkt.ipv6()->ip6_dst);
+      }
+
+      uint16_t sport = 0;
+      uint16_t dport = 0;
+
+      if (pkt.is_tcp()) {
+        sport = pkt.tcp()->source;
+        dport = pkt.tcp()->dest;
+      } else if (pkt.is_udp()) {
+        sport = pkt.udp()->source;
+        dport = pkt.udp()->dest;
+      }
+
+      return flow_hash(saddr, daddr, sport, dport);
+    }
+  }
+}
+
+#endif // NET_IP_FLOW_H
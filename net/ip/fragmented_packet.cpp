@@ -1,8 +1,5 @@
 #include <string.h>
-#include <sys/param.h>
-#include <new>
 #include "net/ip/fragmented_packet.h"
-#include "net/ip/limits.h"
 
 net::ip::fragmented_packet::result
 net::ip::fragmented_packet::add(const void* iphdr,
@@ -14,119 +11,190 @@ net::ip::fragmented_packet::add(const void* iphdr,
                                 uint16_t len,
                                 bool last)
 {
-  // Start from the end.
-  size_t idx = _M_used;
-  while (idx > 0) {
-    const fragment* cur = _M_fragments[idx - 1];
-
-    // If the offset of the new fragment is bigger than the offset of the
-    // current fragment...
-    if (offset > cur->offset()) {
-      // If the current fragment is not the last fragment and it doesn't overlap
-      // with the new fragment...
-      if ((!cur->last()) && (cur->offset() + cur->length() <= offset)) {
-        break;
-      } else {
-        return result::invalid_fragment;
-      }
-    } else if (offset < cur->offset()) {
-      // If the new fragment is not the last fragment and it doesn't overlap
-      // with the current fragment...
-      if ((!last) && (offset + len <= cur->offset())) {
-        idx--;
-      } else {
-        return result::invalid_fragment;
-      }
-    } else {
-      // Return 'duplicated fragment' if the fragments are identical.
-      return ((len == cur->length()) && (last == cur->last())) ?
-               result::duplicated_fragment :
-               result::invalid_fragment;
+  // Compute end of the fragment.
+  const size_t end = static_cast<size_t>(offset) + len;
+
+  // Sanity checks (the length of all the fragments but the last one must be
+  // a multiple of 8 and the IP header and the data must fit in 'max_length'
+  // bytes).
+  if ((end > max_length) ||
+      ((!last) && ((len & 0x07) != 0)) ||
+      ((offset == 0) && (iphdrlen + end > max_length))) {
+    return result::invalid_fragment;
+  }
+
+  // If the last fragment has already been received...
+  if (_M_last) {
+    // If the fragment ends after the last fragment...
+    if ((end > _M_length) || ((last) && (end != _M_length))) {
+      return result::invalid_fragment;
     }
+  } else if ((last) && (end < _M_end)) {
+    // A fragment ends after the last fragment.
+    return result::invalid_fragment;
   }
 
-  // If the packet is not too big...
-  if (static_cast<size_t>(
-        ((_M_iphdrlen != 0) ? _M_iphdrlen : iphdrlen) + _M_length + len
-      ) <= packet_max_len) {
-    // Allocate fragment.
-    if (allocate()) {
-      // Get first free fragment.
-      fragment* frag = _M_fragments[_M_used];
-
-      // Fill fragment.
-      if (frag->assign(offset, data, len, last)) {
-        // If it is the first fragment...
-        if (offset == 0) {
-          // Save IP header.
-          _M_iphdr = iphdr;
-
-          // Save length of the IP header.
-          _M_iphdrlen = iphdrlen;
-
-          // Save identifier.
-          _M_id = id;
-
-          // Save timestamp.
-          _M_timestamp = timestamp;
-        } else if (_M_used == 0) {
-          // Save identifier.
-          _M_id = id;
-
-          // Save timestamp.
-          _M_timestamp = timestamp;
-        }
+  // Allocate buffer (if not allocated yet).
+  if ((!_M_buf) &&
+      ((_M_buf = static_cast<uint8_t*>(
+                   malloc(_M_header_room + max_length)
+                 )) == nullptr)) {
+    return result::no_memory;
+  }
 
-        // If not the last fragment...
-        if (idx < _M_used) {
-          // Make space for the new fragment (move fragments to the right).
-          memmove(_M_fragments + idx + 1,
-                  _M_fragments + idx,
-                  (_M_used - idx) * sizeof(fragment*));
-        }
+  // If the IP header of the first fragment doesn't fit in front of the
+  // data...
+  if ((offset == 0) &&
+      (iphdrlen > _M_header_room) &&
+      (!reserve_header_room(iphdrlen))) {
+    return result::no_memory;
+  }
+
+  // If it is the first fragment received...
+  if (_M_end == 0) {
+    // A single hole: the whole data.
+    hole* const h = get_hole(0);
+    h->last = max_length - 1;
+    h->next = no_hole;
 
-        _M_fragments[idx] = frag;
+    _M_hole = 0;
+  }
 
-        // Increment number of fragments.
-        _M_used++;
+  const uint16_t first = offset;
+  const uint16_t final = static_cast<uint16_t>(end - 1);
+
+  // Search the hole which contains the fragment.
+  uint16_t prev = no_hole;
+  uint16_t cur = _M_hole;
+  while (cur != no_hole) {
+    const hole* const h = get_hole(cur);
+
+    // If the fragment is inside the hole...
+    if ((first >= cur) && (final <= h->last)) {
+      break;
+    } else if ((first <= h->last) && (final >= cur)) {
+      // The fragment overlaps with data already received.
+      return result::invalid_fragment;
+    }
 
-        // Increment total length of the fragmented packet.
-        _M_length += len;
+    prev = cur;
+    cur = h->next;
+  }
 
-        // Get a pointer to the last fragment.
-        const fragment* last = _M_fragments[_M_used - 1];
+  // If the fragment doesn't fill any hole...
+  if (cur == no_hole) {
+    // All its data has already been received.
+    return result::duplicated_fragment;
+  }
 
-        return ((!last->last()) ||
-                (_M_length < last->offset() + last->length())) ?
-                 result::success :
-                 result::complete;
+  // Replace the hole with the parts of it before and after the fragment
+  // (nothing follows the last fragment). The descriptor of the hole might be
+  // overwritten by the fragment.
+  hole* const h = get_hole(cur);
+  const uint16_t last_byte = h->last;
+  uint16_t next = h->next;
+
+  // If there is a hole after the fragment...
+  if ((!last) && (final < last_byte)) {
+    hole* const after = get_hole(final + 1);
+    after->last = last_byte;
+    after->next = next;
+
+    next = final + 1;
+  }
+
+  // If there is a hole before the fragment...
+  if (first > cur) {
+    h->last = first - 1;
+    h->next = next;
+  } else if (prev != no_hole) {
+    get_hole(prev)->next = next;
+  } else {
+    _M_hole = next;
+  }
+
+  // If it is the last fragment...
+  if (last) {
+    // Remove the holes after the end of the data.
+    prev = no_hole;
+    cur = _M_hole;
+    while (cur != no_hole) {
+      const uint16_t n = get_hole(cur)->next;
+
+      if (cur >= end) {
+        if (prev != no_hole) {
+          get_hole(prev)->next = n;
+        } else {
+          _M_hole = n;
+        }
       } else {
-        return result::no_memory;
+        prev = cur;
       }
-    } else {
-      return result::no_memory;
+
+      cur = n;
     }
-  } else {
-    return result::invalid_fragment;
+
+    _M_length = static_cast<uint16_t>(end);
+    _M_last = true;
   }
+
+  // Copy data.
+  memcpy(_M_buf + _M_header_room + offset, data, len);
+
+  // If it is the first fragment...
+  if (offset == 0) {
+    // Save IP header (just before the data).
+    memcpy(_M_buf + _M_header_room - iphdrlen, iphdr, iphdrlen);
+
+    // Save length of the IP header.
+    _M_iphdrlen = iphdrlen;
+
+    // Save identifier.
+    _M_id = id;
+
+    // Save timestamp.
+    _M_timestamp = timestamp;
+  } else if (_M_end == 0) {
+    // Save identifier.
+    _M_id = id;
+
+    // Save timestamp.
+    _M_timestamp = timestamp;
+  }
+
+  if (end > _M_end) {
+    _M_end = end;
+  }
+
+  // If there are no holes...
+  if ((_M_last) && (_M_hole == no_hole)) {
+    // If the packet is not too big...
+    return (static_cast<size_t>(_M_iphdrlen) + _M_length <= max_length) ?
+             result::complete :
+             result::invalid_fragment;
+  }
+
+  return result::success;
 }
 
-bool net::ip::fragmented_packet::allocate()
+bool net::ip::fragmented_packet::reserve_header_room(uint16_t iphdrlen)
 {
-  // If there are available fragments...
-  if (_M_used < _M_size) {
-    return true;
-  } else {
-    for (size_t count = MIN(fragment_allocation, max_fragments - _M_used);
-         count > 0;
-         count--) {
-      if ((_M_fragments[_M_size] = new (std::nothrow) fragment()) != nullptr) {
-        _M_size++;
-      } else {
-        break;
-      }
-    }
+  // Round up to a multiple of 8 (so the hole descriptors stay aligned).
+  const size_t room = (static_cast<size_t>(iphdrlen) + 7) &
+                      ~static_cast<size_t>(7);
+
+  uint8_t* const buf = static_cast<uint8_t*>(realloc(_M_buf,
+                                                     room + max_length));
+
+  if (buf) {
+    // Move the data (and the hole descriptors) received so far.
+    memmove(buf + room, buf + _M_header_room, max_length);
 
-    return (_M_used < _M_size);
+    _M_buf = buf;
+    _M_header_room = room;
+
+    return true;
   }
+
+  return false;
 }
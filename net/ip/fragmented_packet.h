@@ -1,16 +1,29 @@
 #ifndef NET_IP_FRAGMENTED_PACKET_H
 #define NET_IP_FRAGMENTED_PACKET_H
 
-#include "net/ip/fragment.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include "net/ip/address.h"
 
 namespace net {
   namespace ip {
     // IP fragmented packet.
+    // The fragments are copied, as they arrive, to their place in a single
+    // buffer (the IP header of the first fragment followed by the data),
+    // and the parts of the data not received yet are tracked with a hole
+    // list (RFC 815), whose descriptors are stored in the holes themselves
+    // (all the fragments but the last one are multiples of 8 bytes, so the
+    // holes are big enough).
     class fragmented_packet {
+      friend class fragmented_packets;
+
       public:
         // Maximum age of a fragmented packet (in microseconds).
         static constexpr const uint64_t max_age = 30 * 1000000ull;
 
+        // Maximum length of the data of a fragmented packet.
+        static constexpr const size_t max_length = 0xffff;
+
         // Constructor.
         fragmented_packet() = default;
 
@@ -38,7 +51,7 @@ namespace net {
                    uint16_t len,
                    bool last);
 
-        // Get IP header of the first fragment.
+        // Get IP header of the first fragment (followed by the data).
         const void* ip_header() const;
 
         // Get length of the IP header of the first fragment.
@@ -50,21 +63,33 @@ namespace net {
         // Get timestamp.
         uint64_t timestamp() const;
 
-        // Get fragment.
-        const fragment* get(size_t idx) const;
-
         // Get total length of the fragmented packet.
         uint16_t total_length() const;
 
       private:
-        // Maximum number of fragments.
-        static constexpr const size_t max_fragments = 8 * 1024;
+        // Initial space reserved for the IP header in front of the data
+        // (enough for any IPv4 header, it grows for longer headers).
+        static constexpr const size_t default_header_room = 64;
 
-        // Fragment allocation.
-        static constexpr const size_t fragment_allocation = 8;
+        // No hole.
+        static constexpr const uint16_t no_hole = 0xffff;
 
-        // IP header of the first fragment.
-        const void* _M_iphdr;
+        // Hole descriptor, stored at the first byte of the hole.
+        struct hole {
+          // Last byte of the hole.
+          uint16_t last;
+
+          // First byte of the next hole.
+          uint16_t next;
+        };
+
+        // Buffer (allocated when the first fragment is added and kept when the
+        // fragmented packet is reused).
+        uint8_t* _M_buf = nullptr;
+
+        // Space reserved for the IP header in front of the data (a multiple
+        // of 8, kept with the buffer).
+        size_t _M_header_room = default_header_room;
 
         // Length of the IP header of the first fragment.
         uint16_t _M_iphdrlen = 0;
@@ -75,20 +100,45 @@ namespace net {
         // Timestamp of the first fragment.
         uint64_t _M_timestamp;
 
-        // Fragments.
-        fragment* _M_fragments[max_fragments];
+        // First byte of the first hole.
+        uint16_t _M_hole = no_hole;
 
-        // Number of allocated fragments.
-        size_t _M_size = 0;
+        // Data length (known when the last fragment has been received).
+        uint16_t _M_length = 0;
 
-        // Number of fragments in use.
-        size_t _M_used = 0;
+        // Has the last fragment been received?
+        bool _M_last = false;
 
-        // Data length.
-        uint16_t _M_length = 0;
+        // End of the fragment which ends further.
+        size_t _M_end = 0;
 
-        // Allocate fragments.
-        bool allocate();
+        // Key (source and destination addresses, protocol [IPv4 only] and
+        // identifier) and its hash (set by net::ip::fragmented_packets).
+        address _M_saddr;
+        address _M_daddr;
+        uint8_t _M_protocol;
+        uint32_t _M_hash;
+
+        // Time at which the first fragment was received (the fragmented
+        // packet expires 'max_age' microseconds later).
+        uint64_t _M_created;
+
+        // Previous and next fragmented packets in the bucket of the hash
+        // table.
+        fragmented_packet* _M_prev;
+        fragmented_packet* _M_next;
+
+        // Slot of the timer wheel and previous and next fragmented packets in
+        // the slot.
+        size_t _M_slot;
+        fragmented_packet* _M_prev_timer;
+        fragmented_packet* _M_next_timer;
+
+        // Make room for an IP header of 'iphdrlen' bytes in front of the data.
+        bool reserve_header_room(uint16_t iphdrlen);
+
+        // Get hole descriptor.
+        hole* get_hole(uint16_t first);
 
         // Disable copy constructor and assignment operator.
         fragmented_packet(const fragmented_packet&) = delete;
@@ -97,21 +147,23 @@ namespace net {
 
     inline fragmented_packet::~fragmented_packet()
     {
-      for (size_t i = _M_size; i > 0; i--) {
-        delete _M_fragments[i - 1];
+      if (_M_buf) {
+        free(_M_buf);
       }
     }
 
     inline void fragmented_packet::clear()
     {
       _M_iphdrlen = 0;
-      _M_used = 0;
+      _M_hole = no_hole;
       _M_length = 0;
+      _M_last = false;
+      _M_end = 0;
     }
 
     inline const void* fragmented_packet::ip_header() const
     {
-      return _M_iphdr;
+      return _M_buf + _M_header_room - _M_iphdrlen;
     }
 
     inline uint16_t fragmented_packet::ip_header_length() const
@@ -129,14 +181,15 @@ namespace net {
       return _M_timestamp;
     }
 
-    inline const fragment* fragmented_packet::get(size_t idx) const
+    inline uint16_t fragmented_packet::total_length() const
     {
-      return (idx < _M_used) ? _M_fragments[idx] : nullptr;
+      return _M_iphdrlen + _M_length;
     }
 
-    inline uint16_t fragmented_packet::total_length() const
+    inline fragmented_packet::hole*
+    fragmented_packet::get_hole(uint16_t first)
     {
-      return _M_iphdrlen + _M_length;
+      return reinterpret_cast<hole*>(_M_buf + _M_header_room + first);
     }
   }
 }
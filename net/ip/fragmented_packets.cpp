@@ -1,15 +1,79 @@
-#include <new>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include "net/ip/fragmented_packets.h"
 
 void net::ip::fragmented_packets::clear()
 {
-  for (; _M_npackets > 0; _M_npackets--) {
-    delete _M_packets[_M_npackets - 1];
+  // Delete fragmented packets in use.
+  if (_M_npackets > 0) {
+    for (size_t i = 0; i < slots; i++) {
+      fragmented_packet* pkt = _M_wheel[i];
+      while (pkt) {
+        fragmented_packet* next = pkt->_M_next_timer;
+        delete pkt;
+        pkt = next;
+      }
+    }
+
+    _M_npackets = 0;
   }
 
+  // Delete free fragmented packets.
   for (; _M_nfree > 0; _M_nfree--) {
     delete _M_free[_M_nfree - 1];
   }
+
+  _M_nallocated = 0;
+
+  if (_M_free) {
+    ::free(_M_free);
+    _M_free = nullptr;
+  }
+
+  if (_M_buckets) {
+    ::free(_M_buckets);
+    _M_buckets = nullptr;
+  }
+
+  _M_max_packets = 0;
+}
+
+bool net::ip::fragmented_packets::init(size_t maxpackets)
+{
+  clear();
+
+  // Sanity check.
+  if ((maxpackets >= min_packets) && (maxpackets <= max_packets)) {
+    // The size of the hash table is the first power of two which is not
+    // smaller than the maximum number of fragmented packets.
+    size_t size = 1;
+    while (size < maxpackets) {
+      size <<= 1;
+    }
+
+    if (((_M_buckets = static_cast<fragmented_packet**>(
+                         calloc(size, sizeof(fragmented_packet*))
+                       )) != nullptr) &&
+        ((_M_free = static_cast<fragmented_packet**>(
+                      malloc(maxpackets * sizeof(fragmented_packet*))
+                    )) != nullptr)) {
+      _M_mask = size - 1;
+
+      for (size_t i = 0; i < slots; i++) {
+        _M_wheel[i] = nullptr;
+      }
+
+      _M_tick = 0;
+
+      _M_max_packets = maxpackets;
+
+      return true;
+    }
+
+    clear();
+  }
+
+  return false;
 }
 
 const net::ip::fragmented_packet*
@@ -22,20 +86,24 @@ net::ip::fragmented_packets::add(const void* iphdr,
                                  uint16_t len,
                                  bool last)
 {
+  // Initialize with the default values (if not done yet).
+  if ((!_M_buckets) && (!init())) {
+    return nullptr;
+  }
+
   // Get fragmented packet.
-  ssize_t idx;
-  if ((len > 0) && ((idx = get(id, timestamp)) != -1)) {
-    fragmented_packet* pkt = _M_packets[idx];
+  fragmented_packet* pkt;
+  if ((len > 0) && ((pkt = get(iphdr, id, timestamp)) != nullptr)) {
     switch (pkt->add(iphdr, iphdrlen, id, timestamp, offset, data, len, last)) {
       case fragmented_packet::result::complete:
-        free(idx, pkt);
+        free(pkt);
         return pkt;
       case fragmented_packet::result::success:
       case fragmented_packet::result::duplicated_fragment:
         return nullptr;
       case fragmented_packet::result::invalid_fragment:
       case fragmented_packet::result::no_memory:
-        free(idx, pkt);
+        free(pkt);
         return nullptr;
     }
   }
@@ -43,61 +111,160 @@ net::ip::fragmented_packets::add(const void* iphdr,
   return nullptr;
 }
 
-ssize_t net::ip::fragmented_packets::get(uint32_t id, uint64_t timestamp)
+void net::ip::fragmented_packets::remove_expired(uint64_t now)
 {
-  // Find fragmented packet.
-  size_t i = 0;
-  while (i < _M_npackets) {
-    // If it is the fragmented packet we are searching for...
-    if (id == _M_packets[i]->id()) {
-      // If the fragmented packet is not too old...
-      if (_M_packets[i]->timestamp() + fragmented_packet::max_age >=
-          timestamp) {
-        return i;
-      } else {
-        free(i, _M_packets[i]);
+  // If some fragmented packet might have expired...
+  if (now > fragmented_packet::max_age) {
+    // Ticks whose fragmented packets have all expired.
+    const uint64_t tick = (now - fragmented_packet::max_age) >> slot_shift;
 
-        break;
+    if (_M_tick < tick) {
+      if (_M_npackets > 0) {
+        // Remove the fragmented packets of the expired slots (each slot
+        // once).
+        const uint64_t end = (tick - _M_tick < slots) ? tick : _M_tick + slots;
+        for (uint64_t t = _M_tick; t < end; t++) {
+          remove_slot(t & (slots - 1));
+        }
       }
-    } else {
+
+      _M_tick = tick;
+    }
+  }
+}
+
+net::ip::fragmented_packet*
+net::ip::fragmented_packets::get(const void* iphdr,
+                                 uint32_t id,
+                                 uint64_t timestamp)
+{
+  // Remove expired fragmented packets.
+  remove_expired(timestamp);
+
+  // Build key.
+  address saddr;
+  address daddr;
+  uint8_t protocol;
+
+  // IPv4?
+  if ((*static_cast<const uint8_t*>(iphdr) >> 4) == 4) {
+    const struct iphdr* const hdr = static_cast<const struct iphdr*>(iphdr);
+
+    saddr = hdr->saddr;
+    daddr = hdr->daddr;
+    protocol = hdr->protocol;
+  } else {
+    const struct ip6_hdr* const hdr = static_cast<const struct ip6_hdr*>(iphdr);
+
+    saddr = hdr->ip6_src;
+    daddr = hdr->ip6_dst;
+
+    // The protocol is not part of the key of the IPv6 fragments.
+    protocol = 0;
+  }
+
+  static constexpr const uint32_t initval = 0;
+
+  const uint32_t hash = util::hash::hash_3words(
+                          saddr.hash(),
+                          daddr.hash(),
+                          id ^ (static_cast<uint32_t>(protocol) << 16),
+                          initval
+                        );
+
+  // Search fragmented packet in the bucket.
+  for (fragmented_packet* pkt = _M_buckets[hash & _M_mask];
+       pkt;
+       pkt = pkt->_M_next) {
+    // If it is the fragmented packet we are searching for...
+    if ((pkt->_M_hash == hash) &&
+        (pkt->_M_id == id) &&
+        (pkt->_M_protocol == protocol) &&
+        (pkt->_M_saddr == saddr) &&
+        (pkt->_M_daddr == daddr)) {
       // If the fragmented packet is not too old...
-      if (_M_packets[i]->timestamp() + fragmented_packet::max_age >=
-          timestamp) {
-        i++;
-      } else {
-        free(i, _M_packets[i]);
+      if (pkt->_M_created + fragmented_packet::max_age >= timestamp) {
+        return pkt;
       }
+
+      free(pkt);
+
+      break;
     }
   }
 
   // Fragmented packet not found.
 
-  // If there are free fragmented packets...
-  if ((_M_nfree > 0) || ((_M_npackets == 0) && (allocate()))) {
-    // Get last free fragmented packet.
-    fragmented_packet* pkt = _M_free[--_M_nfree];
+  // If the maximum number of fragmented packets has been reached...
+  if (_M_npackets == _M_max_packets) {
+    remove_oldest();
+  }
 
+  fragmented_packet* pkt = get_free_packet();
+  if (pkt) {
     // Clear fragmented packet.
     pkt->clear();
 
-    // Add fragmented packet.
-    _M_packets[_M_npackets++] = pkt;
+    // Save key.
+    pkt->_M_saddr = saddr;
+    pkt->_M_daddr = daddr;
+    pkt->_M_protocol = protocol;
+    pkt->_M_id = id;
+    pkt->_M_hash = hash;
 
-    return _M_npackets - 1;
-  } else {
-    return -1;
+    pkt->_M_created = timestamp;
+
+    // Add to the bucket.
+    fragmented_packet** const bucket = &_M_buckets[hash & _M_mask];
+
+    pkt->_M_prev = nullptr;
+    pkt->_M_next = *bucket;
+
+    if (*bucket) {
+      (*bucket)->_M_prev = pkt;
+    }
+
+    *bucket = pkt;
+
+    // Add to the slot of the timer wheel (the fragmented packets older than
+    // the slots not expired yet go to the next slot to be expired).
+    uint64_t tick = timestamp >> slot_shift;
+    if (tick < _M_tick) {
+      tick = _M_tick;
+    }
+
+    pkt->_M_slot = tick & (slots - 1);
+    pkt->_M_prev_timer = nullptr;
+    pkt->_M_next_timer = _M_wheel[pkt->_M_slot];
+
+    if (_M_wheel[pkt->_M_slot]) {
+      _M_wheel[pkt->_M_slot]->_M_prev_timer = pkt;
+    }
+
+    _M_wheel[pkt->_M_slot] = pkt;
+
+    _M_npackets++;
   }
+
+  return pkt;
 }
 
-bool net::ip::fragmented_packets::allocate()
+void net::ip::fragmented_packets::remove_oldest()
 {
-  // Allocate fragmented packets.
-  for (; _M_nfree < max_packets; _M_nfree++) {
-    if ((_M_free[_M_nfree] = new (std::nothrow) fragmented_packet()) ==
-        nullptr) {
-      return (_M_nfree > 0);
+  // Search the first non-empty slot, starting from the next slot to be
+  // expired.
+  for (uint64_t t = _M_tick; t < _M_tick + slots; t++) {
+    fragmented_packet* const pkt = _M_wheel[t & (slots - 1)];
+    if (pkt) {
+      free(pkt);
+      return;
     }
   }
+}
 
-  return true;
+void net::ip::fragmented_packets::remove_slot(size_t slot)
+{
+  while (_M_wheel[slot]) {
+    free(_M_wheel[slot]);
+  }
 }
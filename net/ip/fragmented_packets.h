@@ -1,14 +1,32 @@
 #ifndef NET_IP_FRAGMENTED_PACKETS_H
 #define NET_IP_FRAGMENTED_PACKETS_H
 
-#include <string.h>
+#include <stdlib.h>
+#include <new>
 #include "net/ip/fragmented_packet.h"
 
 namespace net {
   namespace ip {
     // IP fragmented packets.
+    // The fragmented packets being reassembled are kept in a hash table,
+    // keyed on the source and destination addresses, the protocol (IPv4
+    // only, RFC 791) and the identifier (RFC 791 / RFC 8200), and in a timer
+    // wheel, which expires them 'fragmented_packet::max_age' microseconds
+    // after their first fragment has been received.
     class fragmented_packets {
       public:
+        // Minimum number of fragmented packets being reassembled.
+        static constexpr const size_t min_packets = 1;
+
+        // Maximum number of fragmented packets being reassembled (65536).
+        static constexpr const size_t
+               max_packets = static_cast<size_t>(1) << 16;
+
+        // Maximum number of fragmented packets being reassembled (default)
+        // (1024).
+        static constexpr const size_t
+               default_max_packets = static_cast<size_t>(1) << 10;
+
         // Constructor.
         fragmented_packets() = default;
 
@@ -18,6 +36,13 @@ namespace net {
         // Clear.
         void clear();
 
+        // Initialize.
+        // When the maximum number of fragmented packets is reached, the
+        // oldest fragmented packet is dropped to make room for the new one.
+        // If it is not called, add() initializes the fragmented packets with
+        // the default values.
+        bool init(size_t maxpackets = default_max_packets);
+
         // Add fragment.
         // Return a fragmented packet when it is complete.
         const fragmented_packet* add(const void* iphdr,
@@ -29,30 +54,66 @@ namespace net {
                                      uint16_t len,
                                      bool last);
 
+        // Remove expired fragmented packets.
+        void remove_expired(uint64_t now);
+
+        // Get number of fragmented packets being reassembled.
+        size_t count() const;
+
+        // Get maximum number of fragmented packets.
+        size_t maximum_number_packets() const;
+
       private:
-        // Maximum number of fragmented packets.
-        static constexpr const size_t max_packets = 1024;
+        // Number of slots of the timer wheel.
+        static constexpr const size_t slots = 64;
+
+        // Width of a slot of the timer wheel (2 ^ 19 microseconds, ~0.5
+        // seconds: the 64 slots span more than fragmented_packet::max_age).
+        static constexpr const unsigned slot_shift = 19;
 
-        // Fragmented packets in use.
-        fragmented_packet* _M_packets[max_packets];
+        // Hash table.
+        fragmented_packet** _M_buckets = nullptr;
+
+        // Mask (for performing modulo).
+        size_t _M_mask;
+
+        // Timer wheel.
+        fragmented_packet* _M_wheel[slots];
+
+        // Next tick to be expired (timestamp >> slot_shift).
+        uint64_t _M_tick;
+
+        // Maximum number of fragmented packets.
+        size_t _M_max_packets = 0;
 
         // Number of fragmented packets in use.
         size_t _M_npackets = 0;
 
         // Free fragmented packets.
-        fragmented_packet* _M_free[max_packets];
+        fragmented_packet** _M_free = nullptr;
 
         // Number of free fragmented packets.
         size_t _M_nfree = 0;
 
+        // Number of allocated fragmented packets.
+        size_t _M_nallocated = 0;
+
         // Get fragmented packet.
-        ssize_t get(uint32_t id, uint64_t timestamp);
+        fragmented_packet* get(const void* iphdr,
+                               uint32_t id,
+                               uint64_t timestamp);
 
         // Free fragmented packet.
-        void free(size_t idx, fragmented_packet* pkt);
+        void free(fragmented_packet* pkt);
+
+        // Remove (one of) the oldest fragmented packets.
+        void remove_oldest();
+
+        // Remove the fragmented packets of a slot of the timer wheel.
+        void remove_slot(size_t slot);
 
-        // Allocate fragments.
-        bool allocate();
+        // Get free fragmented packet.
+        fragmented_packet* get_free_packet();
 
         // Disable copy constructor and assignment operator.
         fragmented_packets(const fragmented_packets&) = delete;
@@ -64,16 +125,59 @@ namespace net {
       clear();
     }
 
-    inline void fragmented_packets::free(size_t idx, fragmented_packet* pkt)
+    inline size_t fragmented_packets::count() const
     {
-      // If not the last fragmented packet...
-      if (idx < --_M_npackets) {
-        memmove(_M_packets + idx,
-                _M_packets + idx + 1,
-                (_M_npackets - idx) * sizeof(fragmented_packet*));
+      return _M_npackets;
+    }
+
+    inline size_t fragmented_packets::maximum_number_packets() const
+    {
+      return _M_max_packets;
+    }
+
+    inline void fragmented_packets::free(fragmented_packet* pkt)
+    {
+      // Remove from the bucket.
+      if (pkt->_M_prev) {
+        pkt->_M_prev->_M_next = pkt->_M_next;
+      } else {
+        _M_buckets[pkt->_M_hash & _M_mask] = pkt->_M_next;
+      }
+
+      if (pkt->_M_next) {
+        pkt->_M_next->_M_prev = pkt->_M_prev;
+      }
+
+      // Remove from the slot of the timer wheel.
+      if (pkt->_M_prev_timer) {
+        pkt->_M_prev_timer->_M_next_timer = pkt->_M_next_timer;
+      } else {
+        _M_wheel[pkt->_M_slot] = pkt->_M_next_timer;
+      }
+
+      if (pkt->_M_next_timer) {
+        pkt->_M_next_timer->_M_prev_timer = pkt->_M_prev_timer;
       }
 
       _M_free[_M_nfree++] = pkt;
+
+      _M_npackets--;
+    }
+
+    inline fragmented_packet* fragmented_packets::get_free_packet()
+    {
+      if (_M_nfree > 0) {
+        return _M_free[--_M_nfree];
+      } else if (_M_nallocated < _M_max_packets) {
+        fragmented_packet* pkt = new (std::nothrow) fragmented_packet();
+        if (pkt) {
+          _M_nallocated++;
+        }
+
+        return pkt;
+      } else {
+        return nullptr;
+      }
     }
   }
 }
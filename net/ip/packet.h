@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
@@ -17,6 +18,7 @@ namespace net {
     // IP packet.
     class packet {
       friend class parser;
+      friend class compact_packets;
 
       public:
         // Constructor.
@@ -82,6 +84,18 @@ namespace net {
         // Is the packet an ICMPv6 datagram?
         bool is_icmpv6() const;
 
+        // Has the flow hash been computed by the parser (see
+        // net::ip::parser::flow_hashes())?
+        bool has_hash() const;
+
+        // Get flow hash (the same for both directions of the flow, see
+        // net::ip::flow_hash()).
+        uint32_t hash() const;
+
+        // Copy the IP packet to the packet's own buffer (when it points to
+        // data which doesn't stay valid, like the buffer of a PCAP stream).
+        bool copy();
+
       private:
         // Packet timestamp, as the number of microseconds since the Epoch,
         // 1970-01-01 00:00:00 +0000 (UTC).
@@ -103,6 +117,12 @@ namespace net {
         // Layer 3 protocol.
         uint8_t _M_protocol;
 
+        // Has the flow hash been computed?
+        bool _M_has_hash = false;
+
+        // Flow hash.
+        uint32_t _M_hash;
+
         // Pointer to the layer 3 protocol.
         union {
           const struct tcphdr* tcp;
@@ -226,6 +246,44 @@ namespace net {
     {
       return (_M_protocol == IPPROTO_ICMPV6);
     }
+
+    inline bool packet::has_hash() const
+    {
+      return _M_has_hash;
+    }
+
+    inline uint32_t packet::hash() const
+    {
+      return _M_hash;
+    }
+
+    inline bool packet::copy()
+    {
+      // If the IP packet is not in its own buffer yet...
+      if (_M_l2.buf != _M_buf) {
+        const uint8_t* const l2 = static_cast<const uint8_t*>(_M_l2.buf);
+
+        void* buf;
+        if ((buf = realloc(_M_buf, _M_length)) != nullptr) {
+          memcpy(buf, l2, _M_length);
+
+          // Make the pointers point to the buffer.
+          _M_l3.buf = static_cast<const uint8_t*>(buf) +
+                      (static_cast<const uint8_t*>(_M_l3.buf) - l2);
+
+          _M_l4 = static_cast<const uint8_t*>(buf) +
+                  (static_cast<const uint8_t*>(_M_l4) - l2);
+
+          _M_l2.buf = buf;
+
+          _M_buf = buf;
+        } else {
+          return false;
+        }
+      }
+
+      return true;
+    }
   }
 }
 
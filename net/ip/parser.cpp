@@ -31,6 +31,17 @@ static inline bool last_fragment(const struct ip6_frag* frag)
   return (ntohs(frag->ip6f_offlg & IP6F_MORE_FRAG) == 0);
 }
 
+static inline void prefetch_headers(const net::capture::frame& frame)
+{
+  // The headers (ethernet, VLAN tags, IP and TCP) might span two cache
+  // lines.
+  __builtin_prefetch(frame.buf);
+
+  if (frame.len > 64) {
+    __builtin_prefetch(static_cast<const uint8_t*>(frame.buf) + 64);
+  }
+}
+
 bool net::ip::parser::process_ethernet(const void* buf,
                                        uint32_t len,
                                        uint64_t timestamp,
@@ -105,6 +116,47 @@ bool net::ip::parser::process_ethernet(const void* buf,
   return false;
 }
 
+size_t net::ip::parser::process_ethernet_batch(const capture::frame* frames,
+                                               size_t nframes,
+                                               descriptors& desc)
+{
+  if (nframes > descriptors::max_packets) {
+    nframes = descriptors::max_packets;
+  }
+
+  desc._M_count = 0;
+  desc._M_ndeferred = 0;
+
+  // Prefetch the headers of the first frames.
+  for (size_t i = 0; (i < prefetch_distance) && (i < nframes); i++) {
+    prefetch_headers(frames[i]);
+  }
+
+  for (size_t i = 0; i < nframes; i++) {
+    // Prefetch the headers of a frame ahead.
+    if (i + prefetch_distance < nframes) {
+      prefetch_headers(frames[i + prefetch_distance]);
+    }
+
+    switch (describe_ethernet(static_cast<const uint8_t*>(frames[i].buf),
+                              frames[i].len,
+                              desc,
+                              desc._M_count)) {
+      case description::described:
+        desc._M_frames[desc._M_count] = static_cast<uint16_t>(i);
+        desc._M_timestamps[desc._M_count++] = frames[i].timestamp;
+        break;
+      case description::deferred:
+        desc._M_deferred[desc._M_ndeferred++] = static_cast<uint16_t>(i);
+        break;
+      case description::ignored:
+        break;
+    }
+  }
+
+  return nframes;
+}
+
 bool net::ip::parser::process_ipv4(const void* buf,
                                    uint16_t len,
                                    uint64_t timestamp,
@@ -398,6 +450,9 @@ bool net::ip::parser::process_tcp(packet* pkt, uint16_t iphdrlen)
       // Save pointer to the layer 4 protocol.
       pkt->_M_l4 = reinterpret_cast<const uint8_t*>(tcphdr) + tcphdrlen;
 
+      // Save flow hash.
+      save_flow_hash(pkt, tcphdr->source, tcphdr->dest);
+
       return true;
     }
   }
@@ -427,6 +482,9 @@ bool net::ip::parser::process_udp(packet* pkt, uint16_t iphdrlen)
       pkt->_M_l4 = reinterpret_cast<const uint8_t*>(udphdr) +
                    sizeof(struct udphdr);
 
+      // Save flow hash.
+      save_flow_hash(pkt, udphdr->source, udphdr->dest);
+
       return true;
     }
   }
@@ -451,6 +509,9 @@ bool net::ip::parser::process_icmp(packet* pkt, uint16_t iphdrlen)
     pkt->_M_l4 = static_cast<const uint8_t*>(pkt->_M_l3.buf) +
                  sizeof(struct icmphdr);
 
+    // Save flow hash.
+    save_flow_hash(pkt, 0, 0);
+
     return true;
   }
 
@@ -474,31 +535,259 @@ bool net::ip::parser::process_icmpv6(packet* pkt, uint16_t iphdrlen)
     pkt->_M_l4 = static_cast<const uint8_t*>(pkt->_M_l3.buf) +
                  sizeof(struct icmp6_hdr);
 
+    // Save flow hash.
+    save_flow_hash(pkt, 0, 0);
+
     return true;
   }
 
   return false;
 }
 
-bool net::ip::parser::build(const fragmented_packet* fp, packet* pkt)
+net::ip::parser::description
+net::ip::parser::describe_ethernet(const uint8_t* frame,
+                                   uint32_t len,
+                                   descriptors& desc,
+                                   size_t idx)
 {
-  uint8_t* buf;
-  if ((buf = static_cast<uint8_t*>(
-               realloc(pkt->_M_buf, fp->total_length())
-             )) != nullptr) {
-    pkt->_M_buf = buf;
+  // If the frame is big enough...
+  if (len > sizeof(struct ether_header)) {
+    // Offset of the ether_type.
+    uint16_t off = sizeof(struct ether_addr) << 1;
+
+    // Subtract length of the ethernet header.
+    len -= sizeof(struct ether_header);
+
+    do {
+      // Check ether_type.
+      switch ((static_cast<uint16_t>(frame[off]) << 8) | frame[off + 1]) {
+        case ETH_P_IP:
+          return describe_ipv4(frame, off + 2, len, desc, idx);
+        case ETH_P_IPV6:
+          return describe_ipv6(frame, off + 2, len, desc, idx);
+        case ETH_P_8021Q:
+        case ETH_P_8021AD:
+          // If the frame is big enough...
+          if (len > 4) {
+            // Skip VLAN tag.
+            off += 4;
+
+            len -= 4;
+          } else {
+            return description::ignored;
+          }
+
+          break;
+        case ETH_P_MPLS_UC:
+        case ETH_P_MPLS_MC:
+          return description::deferred;
+        default:
+          return description::ignored;
+      }
+    } while (true);
+  }
+
+  return description::ignored;
+}
+
+net::ip::parser::description
+net::ip::parser::describe_ipv4(const uint8_t* frame,
+                               uint16_t off,
+                               uint16_t len,
+                               descriptors& desc,
+                               size_t idx)
+{
+  // If the packet is big enough...
+  if (len > sizeof(struct iphdr)) {
+    const struct iphdr* const
+      iphdr = reinterpret_cast<const struct iphdr*>(frame + off);
+
+    // Compute IP header length.
+    const uint16_t iphdrlen = static_cast<uint16_t>(iphdr->ihl) << 2;
 
-    // Copy IP header.
-    memcpy(buf, fp->ip_header(), fp->ip_header_length());
+    // Compute length of the IP packet.
+    const uint16_t iplen = ntohs(iphdr->tot_len);
+
+    // Sanity check.
+    if ((iphdrlen >= sizeof(struct iphdr)) &&
+        (iphdrlen < iplen) &&
+        (iplen <= len)) {
+      // Fragment?
+      if ((ntohs(iphdr->frag_off) & (IP_MF | IP_OFFMASK)) != 0) {
+        return description::deferred;
+      }
+
+      switch (iphdr->protocol) {
+        case IPPROTO_TCP:
+        case IPPROTO_UDP:
+        case IPPROTO_ICMP:
+          desc._M_versions[idx] = 4;
+
+          return describe_transport(frame,
+                                    off,
+                                    iphdrlen,
+                                    iplen,
+                                    iphdr->protocol,
+                                    address::hash(iphdr->saddr),
+                                    address::hash(iphdr->daddr),
+                                    desc,
+                                    idx);
+        case IPPROTO_IPIP:
+        case IPPROTO_IPV6:
+          return description::deferred;
+      }
+    }
+  }
+
+  return description::ignored;
+}
+
+net::ip::parser::description
+net::ip::parser::describe_ipv6(const uint8_t* frame,
+                               uint16_t off,
+                               uint16_t len,
+                               descriptors& desc,
+                               size_t idx)
+{
+  // If the packet is big enough...
+  if (len > sizeof(struct ip6_hdr)) {
+    const struct ip6_hdr* const
+      iphdr = reinterpret_cast<const struct ip6_hdr*>(frame + off);
 
-    uint16_t len = fp->ip_header_length();
+    // Compute length of the IP packet.
+    const uint16_t iplen = sizeof(struct ip6_hdr) + ntohs(iphdr->ip6_plen);
 
-    // For each fragment...
-    const fragment* frag;
-    for (size_t i = 0; (frag = fp->get(i)) != nullptr; i++) {
-      memcpy(buf + len, frag->data(), frag->length());
-      len += frag->length();
+    // Sanity check.
+    if (iplen <= len) {
+      const uint8_t nxt = iphdr->ip6_nxt;
+
+      switch (nxt) {
+        case IPPROTO_TCP:
+        case IPPROTO_UDP:
+        case IPPROTO_ICMPV6:
+          desc._M_versions[idx] = 6;
+
+          return describe_transport(frame,
+                                    off,
+                                    sizeof(struct ip6_hdr),
+                                    iplen,
+                                    nxt,
+                                    address::hash(iphdr->ip6_src),
+                                    address::hash(iphdr->ip6_dst),
+                                    desc,
+                                    idx);
+        case IPPROTO_IPIP:
+          return description::deferred;
+        default:
+          if (is_extension_header(nxt)) {
+            return description::deferred;
+          }
+      }
     }
+  }
+
+  return description::ignored;
+}
+
+net::ip::parser::description
+net::ip::parser::describe_transport(const uint8_t* frame,
+                                    uint16_t off,
+                                    uint16_t iphdrlen,
+                                    uint16_t iplen,
+                                    uint8_t protocol,
+                                    uint32_t saddr,
+                                    uint32_t daddr,
+                                    descriptors& desc,
+                                    size_t idx)
+{
+  // Offset and length of the layer 3 protocol.
+  const uint16_t l3off = off + iphdrlen;
+  const uint16_t l3len = iplen - iphdrlen;
+
+  // Offset of the layer 4 protocol.
+  uint16_t l4off;
+
+  // Ports (network byte order).
+  uint16_t sport;
+  uint16_t dport;
+
+  switch (protocol) {
+    case IPPROTO_TCP:
+      // If the TCP segment is big enough...
+      if (l3len >= sizeof(struct tcphdr)) {
+        const struct tcphdr* const
+          tcphdr = reinterpret_cast<const struct tcphdr*>(frame + l3off);
+
+        // Compute TCP header length.
+        const uint16_t tcphdrlen = static_cast<uint16_t>(tcphdr->doff) << 2;
+
+        // Sanity check.
+        if ((tcphdrlen >= sizeof(struct tcphdr)) && (tcphdrlen <= l3len)) {
+          l4off = l3off + tcphdrlen;
+
+          sport = tcphdr->source;
+          dport = tcphdr->dest;
+
+          break;
+        }
+      }
+
+      return description::ignored;
+    case IPPROTO_UDP:
+      // If the UDP datagram is big enough...
+      if (l3len >= sizeof(struct udphdr)) {
+        const struct udphdr* const
+          udphdr = reinterpret_cast<const struct udphdr*>(frame + l3off);
+
+        // Sanity check.
+        if (l3len == ntohs(udphdr->len)) {
+          l4off = l3off + sizeof(struct udphdr);
+
+          sport = udphdr->source;
+          dport = udphdr->dest;
+
+          break;
+        }
+      }
+
+      return description::ignored;
+    default:
+      // ICMP / ICMPv6 (both headers have the same length).
+      if (l3len >= sizeof(struct icmphdr)) {
+        l4off = l3off + sizeof(struct icmphdr);
+
+        sport = 0;
+        dport = 0;
+
+        break;
+      }
+
+      return description::ignored;
+  }
+
+  desc._M_lengths[idx] = iplen;
+  desc._M_protocols[idx] = protocol;
+  desc._M_l2_offsets[idx] = off;
+  desc._M_l3_offsets[idx] = l3off;
+  desc._M_l4_offsets[idx] = l4off;
+  desc._M_sports[idx] = ntohs(sport);
+  desc._M_dports[idx] = ntohs(dport);
+  desc._M_hashes[idx] = flow_hash(saddr, daddr, sport, dport);
+
+  return description::described;
+}
+
+bool net::ip::parser::build(const fragmented_packet* fp, packet* pkt)
+{
+  const uint16_t len = fp->total_length();
+
+  uint8_t* buf;
+  if ((buf = static_cast<uint8_t*>(realloc(pkt->_M_buf, len))) != nullptr) {
+    pkt->_M_buf = buf;
+
+    // Copy IP packet (the fragments have been reassembled just after the IP
+    // header).
+    memcpy(buf, fp->ip_header(), len);
 
     pkt->_M_length = len;
 
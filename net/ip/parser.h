@@ -2,13 +2,20 @@
 #define NET_IP_PARSER_H
 
 #include "net/ip/packet.h"
+#include "net/ip/flow.h"
+#include "net/ip/descriptors.h"
 #include "net/ip/fragmented_packets.h"
+#include "net/capture/callback.h"
 
 namespace net {
   namespace ip {
     // IP parser.
     class parser {
       public:
+        // Number of frames ahead whose headers are prefetched by
+        // process_ethernet_batch().
+        static constexpr const size_t prefetch_distance = 4;
+
         // Constructor.
         parser() = default;
 
@@ -33,15 +40,48 @@ namespace net {
                           uint64_t timestamp,
                           packet* pkt);
 
+        // Set maximum number of fragmented packets being reassembled
+        // (fragmented_packets::default_max_packets by default).
+        bool max_fragmented_packets(size_t n);
+
+        // Compute the flow hash of the packets (net::ip::flow_hash()) and
+        // store it in the packet, so it doesn't have to be computed again
+        // by the connection tables, the sharding, ... (disabled by
+        // default).
+        void flow_hashes(bool enable);
+
+        // Process a batch of ethernet frames (up to descriptors::max_packets)
+        // and fill the block of descriptors.
+        // The frames which are not IP packets (or are malformed) are skipped;
+        // the ones which need the scalar parser (fragments, tunnels, MPLS
+        // labels and IPv6 extension headers) are returned as deferred.
+        // Returns the number of frames processed.
+        size_t process_ethernet_batch(const capture::frame* frames,
+                                      size_t nframes,
+                                      descriptors& desc);
+
       private:
+        // Result of describing a frame.
+        enum class description {
+          described,
+          ignored,
+          deferred
+        };
+
         // Fragmented packets.
         fragmented_packets _M_fragmented_packets;
 
+        // Compute the flow hash of the packets?
+        bool _M_flow_hashes = false;
+
         // Process non-fragmented IPv4 packet.
         bool process_non_fragmented_ipv4(const struct iphdr* iphdr,
                                          uint16_t iplen,
                                          packet* pkt);
 
+        // Save flow hash (ports in network byte order).
+        void save_flow_hash(packet* pkt, uint16_t sport, uint16_t dport) const;
+
         // Process TCP segment.
         bool process_tcp(packet* pkt, uint16_t iphdrlen);
 
@@ -54,6 +94,38 @@ namespace net {
         // Process ICMPv6 datagram.
         bool process_icmpv6(packet* pkt, uint16_t iphdrlen);
 
+        // Describe ethernet frame (entry 'idx' of 'desc').
+        static description describe_ethernet(const uint8_t* frame,
+                                             uint32_t len,
+                                             descriptors& desc,
+                                             size_t idx);
+
+        // Describe IPv4 packet at offset 'off' of the frame.
+        static description describe_ipv4(const uint8_t* frame,
+                                         uint16_t off,
+                                         uint16_t len,
+                                         descriptors& desc,
+                                         size_t idx);
+
+        // Describe IPv6 packet at offset 'off' of the frame.
+        static description describe_ipv6(const uint8_t* frame,
+                                         uint16_t off,
+                                         uint16_t len,
+                                         descriptors& desc,
+                                         size_t idx);
+
+        // Describe TCP / UDP / ICMP / ICMPv6 header following the IP header
+        // at offset 'off' of the frame.
+        static description describe_transport(const uint8_t* frame,
+                                              uint16_t off,
+                                              uint16_t iphdrlen,
+                                              uint16_t iplen,
+                                              uint8_t protocol,
+                                              uint32_t saddr,
+                                              uint32_t daddr,
+                                              descriptors& desc,
+                                              size_t idx);
+
         // Build packet from fragmented packet.
         static bool build(const fragmented_packet* fp, packet* pkt);
 
@@ -65,6 +137,39 @@ namespace net {
         parser& operator=(const parser&) = delete;
     };
 
+    inline bool parser::max_fragmented_packets(size_t n)
+    {
+      return _M_fragmented_packets.init(n);
+    }
+
+    inline void parser::flow_hashes(bool enable)
+    {
+      _M_flow_hashes = enable;
+    }
+
+    inline void parser::save_flow_hash(packet* pkt,
+                                       uint16_t sport,
+                                       uint16_t dport) const
+    {
+      if (_M_flow_hashes) {
+        if (pkt->_M_version == version::v4) {
+          pkt->_M_hash = flow_hash(address::hash(pkt->_M_l2.ipv4->saddr),
+                                   address::hash(pkt->_M_l2.ipv4->daddr),
+                                   sport,
+                                   dport);
+        } else {
+          pkt->_M_hash = flow_hash(address::hash(pkt->_M_l2.ipv6->ip6_src),
+                                   address::hash(pkt->_M_l2.ipv6->ip6_dst),
+                                   sport,
+                                   dport);
+        }
+
+        pkt->_M_has_hash = true;
+      } else {
+        pkt->_M_has_hash = false;
+      }
+    }
+
     inline bool parser::is_extension_header(uint8_t nxt)
     {
       switch (nxt) {
@@ -1,28 +1,59 @@
-#include <net/ethernet.h>
-#include <net/if_arp.h>
 #include "pcap/ip/analyzer.h"
 
 bool pcap::ip::analyzer::open(const char* filename)
 {
   // Open PCAP file.
-  if (_M_reader.open(filename)) {
-    _M_begin = &analyzer::begin_iterator;
-    _M_next = &analyzer::next_iterator;
-    _M_end = &analyzer::end_iterator;
-    _M_prev = &analyzer::prev_iterator;
-
-    // Check link-layer header type.
-    switch (static_cast<linklayer_header>(_M_reader.linktype())) {
-      case linklayer_header::ethernet:
-        _M_process = &analyzer::process_ethernet;
-        return true;
-      case linklayer_header::raw:
-        _M_process = &analyzer::process_raw;
-        return true;
-      case linklayer_header::linux_sll:
-        _M_process = &analyzer::process_linux_sll;
-        return true;
+  return ((_M_reader.open(filename)) && (init()));
+}
+
+bool pcap::ip::analyzer::open(const char* const* filenames, size_t nfiles)
+{
+  // Open PCAP files.
+  return ((_M_reader.open(filenames, nfiles)) && (init()));
+}
+
+bool pcap::ip::analyzer::open(const char* filename,
+                              bool use_index,
+                              uint32_t interval)
+{
+  if (open(filename)) {
+    if ((!use_index) ||
+        ((_M_reader.file_format() == reader::format::pcap) &&
+         ((_M_index.open(filename)) || (_M_index.build(filename, interval))))) {
+      return true;
     }
+
+    close();
+  }
+
+  return false;
+}
+
+bool pcap::ip::analyzer::init()
+{
+  _M_begin = &analyzer::begin_iterator;
+  _M_next = &analyzer::next_iterator;
+  _M_end = &analyzer::end_iterator;
+  _M_prev = &analyzer::prev_iterator;
+
+  // pcapng file or merged files? (each interface or file has its own
+  // link-layer header type)
+  if (_M_reader.file_format() != reader::format::pcap) {
+    _M_process = &analyzer::process_linktype;
+    return true;
+  }
+
+  // Check link-layer header type.
+  switch (static_cast<linklayer_header>(_M_reader.linktype())) {
+    case linklayer_header::ethernet:
+      _M_process = &analyzer::process_ethernet;
+      return true;
+    case linklayer_header::raw:
+      _M_process = &analyzer::process_raw;
+      return true;
+    case linklayer_header::linux_sll:
+      _M_process = &analyzer::process_linux_sll;
+      return true;
   }
 
   return false;
@@ -32,95 +63,106 @@ bool pcap::ip::analyzer::read_all()
 {
   // Get first packet of the PCAP file.
   packet pcappkt;
-  if (_M_reader.begin(pcappkt)) {
-    net::ip::packet* ippkt = nullptr;
+  return ((_M_reader.begin(pcappkt)) && (read(pcappkt, SIZE_MAX)));
+}
+
+bool pcap::ip::analyzer::read_all(size_t begin, size_t end)
+{
+  // Get first packet of the chunk.
+  packet pcappkt;
+  return ((_M_reader.begin(pcappkt, begin)) && (read(pcappkt, end)));
+}
 
-    do {
-      // Get a new packet (if needed).
-      if ((ippkt) || ((ippkt = _M_packets.get()) != nullptr)) {
-        // Process packet.
-        if ((this->*_M_process)(pcappkt, ippkt)) {
-          // Add packet.
-          if (_M_packets.add(ippkt)) {
-            ippkt = nullptr;
-          } else {
+bool pcap::ip::analyzer::read(packet& pcappkt, size_t end)
+{
+  net::ip::packet* ippkt = nullptr;
+
+  // If the PCAP packets are not mapped, they are only valid until the next
+  // one is read: the IP packets have to be copied.
+  const bool copy = !_M_reader.mapped();
+
+  // The compact packets can't be copied.
+  if ((_M_compact) && (copy)) {
+    return false;
+  }
+
+  do {
+    // Get a new packet (if needed).
+    if ((ippkt) || ((ippkt = _M_packets.get()) != nullptr)) {
+      // Process packet.
+      if ((this->*_M_process)(pcappkt, ippkt)) {
+        // Compact mode?
+        if (_M_compact) {
+          const uint8_t* const data =
+            static_cast<const uint8_t*>(pcappkt.data());
+
+          const uint8_t* const l2 = static_cast<const uint8_t*>(ippkt->l2());
+
+          // Add compact packet.
+          if (!_M_compact_packets.add(*ippkt)) {
             delete ippkt;
 
             return false;
           }
-        }
-      } else {
-        return false;
-      }
-    } while (_M_reader.next(pcappkt));
-
-    if (ippkt) {
-      delete ippkt;
-    }
 
-    _M_begin = &analyzer::begin_index;
-    _M_next = &analyzer::next_index;
-    _M_end = &analyzer::end_index;
-    _M_prev = &analyzer::prev_index;
+          // If the packet has been reassembled (its data is not in the PCAP
+          // file), keep it.
+          if ((l2 < data) || (l2 >= data + pcappkt.length())) {
+            if (_M_packets.add(ippkt)) {
+              ippkt = nullptr;
+            } else {
+              delete ippkt;
 
-    return true;
-  }
+              _M_compact_packets.remove_last();
 
-  return false;
-}
+              return false;
+            }
+          }
+        } else if (((!copy) || (ippkt->copy())) && (_M_packets.add(ippkt))) {
+          // The packet has been added.
+          ippkt = nullptr;
+        } else {
+          delete ippkt;
 
-bool pcap::ip::analyzer::process_raw(const packet& pcappkt,
-                                     net::ip::packet* ippkt)
-{
-  // If the packet is not too big...
-  if (pcappkt.length() <= net::ip::packet_max_len) {
-    // Check IP version.
-    switch (*static_cast<const uint8_t*>(pcappkt.data()) & 0xf0) {
-      case 0x40: // IPv4.
-        // Process IPv4 packet.
-        return _M_parser.process_ipv4(pcappkt.data(),
-                                      pcappkt.length(),
-                                      pcappkt.timestamp(),
-                                      ippkt);
-      case 0x60: // IPv6.
-        // Process IPv6 packet.
-        return _M_parser.process_ipv6(pcappkt.data(),
-                                      pcappkt.length(),
-                                      pcappkt.timestamp(),
-                                      ippkt);
+          return false;
+        }
+      }
+    } else {
+      return false;
     }
+  } while (((end == SIZE_MAX) || (_M_reader.offset(pcappkt) < end)) &&
+           (_M_reader.next(pcappkt)));
+
+  if (ippkt) {
+    delete ippkt;
   }
 
-  return false;
-}
+  // If the chunk has not been read up to its end...
+  if ((end != SIZE_MAX) && (_M_reader.offset(pcappkt) != end)) {
+    return false;
+  }
 
-bool pcap::ip::analyzer::process_linux_sll(const packet& pcappkt,
-                                           net::ip::packet* ippkt)
-{
-  // If the packet is neither too small nor too big...
-  if ((pcappkt.length() > 16) &&
-      (pcappkt.length() <= net::ip::packet_max_len)) {
-    const uint8_t* const b = static_cast<const uint8_t*>(pcappkt.data());
-
-    if ((((static_cast<uint16_t>(b[2]) << 8) | b[3]) == ARPHRD_ETHER) &&
-        (((static_cast<uint16_t>(b[4]) << 8) | b[5]) == ETH_ALEN)) {
-      // The Linux SLL header is two bytes longer than the ethernet header.
-
-      // Process ethernet frame.
-      return _M_parser.process_ethernet(b + 2,
-                                        pcappkt.length() - 2,
-                                        pcappkt.timestamp(),
-                                        ippkt);
-    }
+  if (_M_compact) {
+    _M_begin = &analyzer::begin_compact;
+    _M_next = &analyzer::next_compact;
+    _M_end = &analyzer::end_compact;
+    _M_prev = &analyzer::prev_compact;
+  } else {
+    _M_begin = &analyzer::begin_index;
+    _M_next = &analyzer::next_index;
+    _M_end = &analyzer::end_index;
+    _M_prev = &analyzer::prev_index;
   }
 
-  return false;
+  return true;
 }
 
 bool pcap::ip::analyzer::begin_iterator(const_iterator& it)
 {
   // Get first packet of the PCAP file.
   if (_M_reader.begin(it._M_pcap_packet)) {
+    it._M_pktidx = 0;
+
     // If the packet can be processed...
     if ((this->*_M_process)(it._M_pcap_packet, &it._M_ip_packet)) {
       // Save a pointer to the IP packet.
@@ -139,6 +181,8 @@ bool pcap::ip::analyzer::next_iterator(const_iterator& it)
 {
   // Get next packet of the PCAP file.
   while (_M_reader.next(it._M_pcap_packet)) {
+    it._M_pktidx++;
+
     // If the packet can be processed...
     if ((this->*_M_process)(it._M_pcap_packet, &it._M_ip_packet)) {
       // Save a pointer to the IP packet.
@@ -150,3 +194,63 @@ bool pcap::ip::analyzer::next_iterator(const_iterator& it)
 
   return false;
 }
+
+bool pcap::ip::analyzer::seek(uint64_t timestamp, const_iterator& it)
+{
+  // Find the indexed packet from which the packet has to be searched.
+  uint64_t idx;
+  uint64_t offset;
+  if ((_M_begin == &analyzer::begin_iterator) &&
+      (_M_index.open()) &&
+      (_M_index.find(timestamp, idx, offset)) &&
+      (_M_reader.begin(it._M_pcap_packet, offset))) {
+    it._M_pktidx = idx;
+
+    do {
+      // If the packet is not older and it can be processed...
+      if ((it._M_pcap_packet.timestamp() >= timestamp) &&
+          ((this->*_M_process)(it._M_pcap_packet, &it._M_ip_packet))) {
+        // Save a pointer to the IP packet.
+        it._M_ippkt = &it._M_ip_packet;
+
+        return true;
+      }
+
+      it._M_pktidx++;
+    } while (_M_reader.next(it._M_pcap_packet));
+  }
+
+  return false;
+}
+
+bool pcap::ip::analyzer::search_backward(uint64_t idx, const_iterator& it)
+{
+  do {
+    // Locate packet.
+    uint64_t offset;
+    uint64_t skip;
+    if ((!_M_index.locate(idx, offset, skip)) ||
+        (!_M_reader.begin(it._M_pcap_packet, offset))) {
+      return false;
+    }
+
+    // Skip packets.
+    for (; skip > 0; skip--) {
+      if (!_M_reader.next(it._M_pcap_packet)) {
+        return false;
+      }
+    }
+
+    // If the packet can be processed...
+    if ((this->*_M_process)(it._M_pcap_packet, &it._M_ip_packet)) {
+      // Save a pointer to the IP packet.
+      it._M_ippkt = &it._M_ip_packet;
+
+      it._M_pktidx = idx;
+
+      return true;
+    }
+  } while (idx-- > 0);
+
+  return false;
+}
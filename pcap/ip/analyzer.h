@@ -1,9 +1,13 @@
 #ifndef PCAP_IP_ANALYZER_H
 #define PCAP_IP_ANALYZER_H
 
+#include <net/ethernet.h>
+#include <net/if_arp.h>
 #include "pcap/reader.h"
+#include "pcap/ip/index.h"
 #include "net/ip/parser.h"
 #include "net/ip/packets.h"
+#include "net/ip/compact_packets.h"
 #include "net/ip/protocol.h"
 #include "net/ip/limits.h"
 
@@ -11,6 +15,8 @@ namespace pcap {
   namespace ip {
     // IP analyzer.
     class analyzer {
+      friend class index;
+
       public:
         // Constructor.
         analyzer() = default;
@@ -18,18 +24,58 @@ namespace pcap {
         // Destructor.
         ~analyzer() = default;
 
+        // Enable asynchronous mode (see pcap::reader::asynchronous(), must
+        // be called before open()).
+        void asynchronous(size_t queue_depth = fs::async_reader::
+                                               default_queue_depth,
+                          size_t buffer_size = fs::async_reader::
+                                               default_buffer_size);
+
         // Open PCAP file.
         bool open(const char* filename);
 
+        // Open several PCAP files whose packets are merged by timestamp
+        // (see pcap::merged_reader).
+        bool open(const char* const* filenames, size_t nfiles);
+
+        // Open PCAP file and its index (<filename>.idx), which is built if
+        // it doesn't exist or is stale (PCAP files only).
+        // The index makes possible to seek in the PCAP file and to get the
+        // last and the previous packets without calling read_all().
+        bool open(const char* filename,
+                  bool use_index,
+                  uint32_t interval = index::default_interval);
+
         // Close PCAP file.
         void close();
 
+        // Store the packets read by read_all() as compact records
+        // (net::ip::compact_packets, 24 bytes per packet) instead of as
+        // net::ip::packet objects (must be called before read_all()).
+        // The packets are then built on demand: get(idx) returns nullptr
+        // and get(idx, pkt) has to be used instead.
+        // The records point to the PCAP file, so it has to be mapped (see
+        // pcap::reader::mapped()): otherwise read_all() fails.
+        void compact();
+
+        // Compute the flow hash of the packets while parsing them (see
+        // net::ip::parser::flow_hashes()).
+        void flow_hashes(bool enable);
+
         // Read all packets.
         // Parses all the packets in the PCAP file and builds a list of
         // IP packets.
+        // The IP packets point to the PCAP file if it is mapped, otherwise
+        // (compressed PCAP files, streams) they are copied.
         // It is not mandatory to call this method.
         bool read_all();
 
+        // Read all the packets of a chunk of the PCAP file.
+        // Parses the packets starting at the offset 'begin' up to the offset
+        // 'end' (see pcap::reader::split()). Fails if the last packet of the
+        // chunk doesn't end at 'end' (PCAP files only).
+        bool read_all(size_t begin, size_t end);
+
         // Get number of packets (available when the method read_all() has been
         // called).
         size_t count() const;
@@ -38,6 +84,10 @@ namespace pcap {
         // called).
         const net::ip::packet* get(size_t idx) const;
 
+        // Get packet at position (available when the methods compact() and
+        // read_all() have been called).
+        bool get(size_t idx, net::ip::packet& pkt) const;
+
         // Constant iterator.
         class const_iterator {
           friend class analyzer;
@@ -67,7 +117,8 @@ namespace pcap {
             packet _M_pcap_packet;
 
             // Packet index (used to iterate the packets when the method
-            // read_all() has been called).
+            // read_all() has been called, otherwise number of the packet in
+            // the PCAP file).
             size_t _M_pktidx = 0;
 
             // IP packet (set when the method read_all() has not been called).
@@ -90,13 +141,30 @@ namespace pcap {
         bool next(net::ip::protocol protocol, const_iterator& it);
 
         // Get last packet (available when the method read_all() has been
-        // called).
+        // called or the index has been loaded).
         bool end(const_iterator& it);
 
         // Get previous packet (available when the method read_all() has been
-        // called).
+        // called or the index has been loaded).
         bool prev(const_iterator& it);
 
+        // Get first packet whose timestamp is equal or greater than
+        // 'timestamp' (available when the index has been loaded and the
+        // method read_all() has not been called).
+        bool seek(uint64_t timestamp, const_iterator& it);
+
+        // Get index.
+        const index& get_index() const;
+
+        // Call 'fn' for every IP packet (bool fn(const net::ip::packet& pkt),
+        // returns false to stop).
+        // The link-layer header type and the reader's backend are resolved
+        // once, so the per-packet loop has no indirect calls. If read_all()
+        // has been called, the list of IP packets is iterated.
+        // Returns false if 'fn' has stopped the iteration.
+        template<typename Function>
+        bool for_each_packet(Function fn);
+
       private:
         // PCAP reader.
         reader _M_reader;
@@ -104,15 +172,49 @@ namespace pcap {
         // IP parser.
         net::ip::parser _M_parser;
 
-        // IP packets (filled when the method read_all() has been called).
+        // IP packets (filled when the method read_all() has been called;
+        // in compact mode, only the reassembled packets, whose data is not
+        // in the PCAP file).
         net::ip::packets _M_packets;
 
+        // Compact packets (filled when the methods compact() and read_all()
+        // have been called).
+        net::ip::compact_packets _M_compact_packets;
+
+        // Compact mode?
+        bool _M_compact = false;
+
+        // Index.
+        index _M_index;
+
         // Process function.
         typedef bool (analyzer::*fnprocess)(const packet& pcappkt,
                                             net::ip::packet* ippkt);
 
         fnprocess _M_process;
 
+        // Processes the PCAP packets with 'process' and calls 'fn' (passed
+        // to reader::for_each()).
+        template<fnprocess process, typename Function>
+        struct visitor {
+          // Analyzer.
+          analyzer* a;
+
+          // Function to be called for every IP packet.
+          Function* fn;
+
+          // IP packet.
+          net::ip::packet* ippkt;
+
+          // Process PCAP packet.
+          bool operator()(const packet& pcappkt) const;
+        };
+
+        // Call 'fn' for every IP packet, processing the PCAP packets with
+        // 'process'.
+        template<fnprocess process, typename Function>
+        bool for_each_packet(Function& fn);
+
         // Iterate function.
         typedef bool (analyzer::*fniterate)(const_iterator& it);
         fniterate _M_begin;
@@ -120,6 +222,14 @@ namespace pcap {
         fniterate _M_end;
         fniterate _M_prev;
 
+        // Set the iterator and packet processing functions once the PCAP
+        // file has been opened.
+        bool init();
+
+        // Read packets up to the offset 'end' (SIZE_MAX: end of the file),
+        // starting at 'pcappkt'.
+        bool read(packet& pcappkt, size_t end);
+
         // Process ethernet packet.
         bool process_ethernet(const packet& pcappkt, net::ip::packet* ippkt);
 
@@ -129,18 +239,26 @@ namespace pcap {
         // Process Linux SLL packet.
         bool process_linux_sll(const packet& pcappkt, net::ip::packet* ippkt);
 
+        // Process packet based on its link-layer header type (pcapng and
+        // merged files).
+        bool process_linktype(const packet& pcappkt, net::ip::packet* ippkt);
+
         // Get first packet based on iterator.
         bool begin_iterator(const_iterator& it);
 
         // Get next packet based on iterator.
         bool next_iterator(const_iterator& it);
 
-        // Get last packet based on iterator (not supported).
+        // Get last packet based on iterator (requires the index).
         bool end_iterator(const_iterator& it);
 
-        // Get previous packet based on iterator (not supported).
+        // Get previous packet based on iterator (requires the index).
         bool prev_iterator(const_iterator& it);
 
+        // Get the last IP packet at or before the packet number 'idx'
+        // (requires the index).
+        bool search_backward(uint64_t idx, const_iterator& it);
+
         // Get first packet based on index.
         bool begin_index(const_iterator& it);
 
@@ -153,24 +271,58 @@ namespace pcap {
         // Get previous packet based on index.
         bool prev_index(const_iterator& it);
 
+        // Get first packet based on the compact packets.
+        bool begin_compact(const_iterator& it);
+
+        // Get next packet based on the compact packets.
+        bool next_compact(const_iterator& it);
+
+        // Get last packet based on the compact packets.
+        bool end_compact(const_iterator& it);
+
+        // Get previous packet based on the compact packets.
+        bool prev_compact(const_iterator& it);
+
         // Disable copy constructor and assignment operator.
         analyzer(const analyzer&) = delete;
         analyzer& operator=(const analyzer&) = delete;
     };
 
+    inline void analyzer::asynchronous(size_t queue_depth,
+                                       size_t buffer_size)
+    {
+      _M_reader.asynchronous(queue_depth, buffer_size);
+    }
+
     inline void analyzer::close()
     {
       _M_reader.close();
+      _M_index.close();
+    }
+
+    inline void analyzer::compact()
+    {
+      _M_compact = true;
+    }
+
+    inline void analyzer::flow_hashes(bool enable)
+    {
+      _M_parser.flow_hashes(enable);
     }
 
     inline size_t analyzer::count() const
     {
-      return _M_packets.count();
+      return _M_compact ? _M_compact_packets.count() : _M_packets.count();
     }
 
     inline const net::ip::packet* analyzer::get(size_t idx) const
     {
-      return _M_packets.get(idx);
+      return _M_compact ? nullptr : _M_packets.get(idx);
+    }
+
+    inline bool analyzer::get(size_t idx, net::ip::packet& pkt) const
+    {
+      return _M_compact_packets.get(idx, pkt);
     }
 
     inline analyzer::const_iterator::const_iterator(const const_iterator& it)
@@ -252,18 +404,158 @@ namespace pcap {
                                           ippkt)));
     }
 
-    inline bool analyzer::end_iterator(const_iterator& it)
+    inline const index& analyzer::get_index() const
+    {
+      return _M_index;
+    }
+
+    template<typename Function>
+    inline bool analyzer::for_each_packet(Function fn)
     {
-      // Not supported.
+      // If all the packets have been read as compact records...
+      if (_M_begin == &analyzer::begin_compact) {
+        net::ip::packet ippkt;
+
+        const size_t count = _M_compact_packets.count();
+        for (size_t i = 0; i < count; i++) {
+          if ((_M_compact_packets.get(i, ippkt)) && (!fn(ippkt))) {
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      // If all the packets have been read...
+      if (_M_begin == &analyzer::begin_index) {
+        const size_t count = _M_packets.count();
+        for (size_t i = 0; i < count; i++) {
+          if (!fn(*_M_packets.get(i))) {
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      // pcapng file or merged files?
+      if (_M_reader.file_format() != reader::format::pcap) {
+        return for_each_packet<&analyzer::process_linktype>(fn);
+      }
+
+      // Check link-layer header type.
+      switch (static_cast<linklayer_header>(_M_reader.linktype())) {
+        case linklayer_header::ethernet:
+          return for_each_packet<&analyzer::process_ethernet>(fn);
+        case linklayer_header::raw:
+          return for_each_packet<&analyzer::process_raw>(fn);
+        case linklayer_header::linux_sll:
+          return for_each_packet<&analyzer::process_linux_sll>(fn);
+      }
+
+      return true;
+    }
+
+    template<analyzer::fnprocess process, typename Function>
+    inline bool analyzer::for_each_packet(Function& fn)
+    {
+      net::ip::packet ippkt;
+
+      visitor<process, Function> v;
+      v.a = this;
+      v.fn = &fn;
+      v.ippkt = &ippkt;
+
+      return _M_reader.for_each(v);
+    }
+
+    template<analyzer::fnprocess process, typename Function>
+    inline bool
+    analyzer::visitor<process, Function>::operator()(const packet& pcappkt)
+    const
+    {
+      // If the packet can't be processed, skip it.
+      return ((!(a->*process)(pcappkt, ippkt)) || ((*fn)(*ippkt)));
+    }
+
+    inline bool analyzer::process_raw(const packet& pcappkt,
+                                      net::ip::packet* ippkt)
+    {
+      // If the packet is not too big...
+      if (pcappkt.length() <= net::ip::packet_max_len) {
+        // Check IP version.
+        switch (*static_cast<const uint8_t*>(pcappkt.data()) & 0xf0) {
+          case 0x40: // IPv4.
+            // Process IPv4 packet.
+            return _M_parser.process_ipv4(pcappkt.data(),
+                                          pcappkt.length(),
+                                          pcappkt.timestamp(),
+                                          ippkt);
+          case 0x60: // IPv6.
+            // Process IPv6 packet.
+            return _M_parser.process_ipv6(pcappkt.data(),
+                                          pcappkt.length(),
+                                          pcappkt.timestamp(),
+                                          ippkt);
+        }
+      }
+
       return false;
     }
 
-    inline bool analyzer::prev_iterator(const_iterator& it)
+    inline bool analyzer::process_linux_sll(const packet& pcappkt,
+                                            net::ip::packet* ippkt)
     {
-      // Not supported.
+      // If the packet is neither too small nor too big...
+      if ((pcappkt.length() > 16) &&
+          (pcappkt.length() <= net::ip::packet_max_len)) {
+        const uint8_t* const b = static_cast<const uint8_t*>(pcappkt.data());
+
+        if ((((static_cast<uint16_t>(b[2]) << 8) | b[3]) == ARPHRD_ETHER) &&
+            (((static_cast<uint16_t>(b[4]) << 8) | b[5]) == ETH_ALEN)) {
+          // The Linux SLL header is two bytes longer than the ethernet header.
+
+          // Process ethernet frame.
+          return _M_parser.process_ethernet(b + 2,
+                                            pcappkt.length() - 2,
+                                            pcappkt.timestamp(),
+                                            ippkt);
+        }
+      }
+
       return false;
     }
 
+    inline bool analyzer::process_linktype(const packet& pcappkt,
+                                           net::ip::packet* ippkt)
+    {
+      // Check link-layer header type of the packet.
+      switch (static_cast<linklayer_header>(pcappkt.linktype())) {
+        case linklayer_header::ethernet:
+          return process_ethernet(pcappkt, ippkt);
+        case linklayer_header::raw:
+          return process_raw(pcappkt, ippkt);
+        case linklayer_header::linux_sll:
+          return process_linux_sll(pcappkt, ippkt);
+        default:
+          return false;
+      }
+    }
+
+    inline bool analyzer::end_iterator(const_iterator& it)
+    {
+      return ((_M_index.open()) &&
+              (_M_index.packets() > 0) &&
+              (search_backward(_M_index.packets() - 1, it)));
+    }
+
+    inline bool analyzer::prev_iterator(const_iterator& it)
+    {
+      return ((_M_index.open()) &&
+              (it._M_pktidx > 0) &&
+              (search_backward(it._M_pktidx - 1, it)));
+    }
+
     inline bool analyzer::begin_index(const_iterator& it)
     {
       return ((it._M_ippkt = _M_packets.get(it._M_pktidx = 0)) != nullptr);
@@ -288,6 +580,35 @@ namespace pcap {
                ((it._M_ippkt = _M_packets.get(--it._M_pktidx)) != nullptr) :
                false;
     }
+
+    inline bool analyzer::begin_compact(const_iterator& it)
+    {
+      it._M_ippkt = &it._M_ip_packet;
+      return _M_compact_packets.get(it._M_pktidx = 0, it._M_ip_packet);
+    }
+
+    inline bool analyzer::next_compact(const_iterator& it)
+    {
+      it._M_ippkt = &it._M_ip_packet;
+      return _M_compact_packets.get(++it._M_pktidx, it._M_ip_packet);
+    }
+
+    inline bool analyzer::end_compact(const_iterator& it)
+    {
+      it._M_ippkt = &it._M_ip_packet;
+      return (count() > 0) ?
+               _M_compact_packets.get(it._M_pktidx = count() - 1,
+                                      it._M_ip_packet) :
+               false;
+    }
+
+    inline bool analyzer::prev_compact(const_iterator& it)
+    {
+      it._M_ippkt = &it._M_ip_packet;
+      return (it._M_pktidx > 0) ?
+               _M_compact_packets.get(--it._M_pktidx, it._M_ip_packet) :
+               false;
+    }
   }
 }
 
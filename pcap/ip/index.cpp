@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pcap/ip/index.h"
+#include "pcap/ip/analyzer.h"
+#include "net/ip/flow.h"
+#include "fs/file.h"
+
+bool pcap::ip::index::open(const char* filename)
+{
+  close();
+
+  // Build the name of the index file.
+  char idxfilename[PATH_MAX];
+  if (index_filename(filename, idxfilename, sizeof(idxfilename))) {
+    // Get PCAP file and index file status.
+    struct stat pcapbuf;
+    struct stat idxbuf;
+    if ((stat(filename, &pcapbuf) == 0) &&
+        (stat(idxfilename, &idxbuf) == 0) &&
+        (S_ISREG(idxbuf.st_mode)) &&
+        (idxbuf.st_size >= static_cast<off_t>(sizeof(header)))) {
+      // Open index file for reading.
+      const int fd = ::open(idxfilename, O_RDONLY);
+      if (fd != -1) {
+        // Map index file into memory.
+        _M_base = mmap(nullptr,
+                       idxbuf.st_size,
+                       PROT_READ,
+                       MAP_SHARED,
+                       fd,
+                       0);
+
+        ::close(fd);
+
+        if (_M_base != MAP_FAILED) {
+          _M_filesize = idxbuf.st_size;
+
+          _M_header = static_cast<const header*>(_M_base);
+
+          const uint64_t mtime = (pcapbuf.st_mtim.tv_sec * 1000000000ull) +
+                                 pcapbuf.st_mtim.tv_nsec;
+
+          // Check header and make sure the index is not stale.
+          if ((_M_header->magic == magic) &&
+              (_M_header->version == version) &&
+              (_M_header->filesize == static_cast<uint64_t>(
+                                        pcapbuf.st_size
+                                      )) &&
+              (_M_header->mtime == mtime) &&
+              (_M_header->interval > 0) &&
+              (_M_header->interval <= max_interval) &&
+              (_M_header->nentries ==
+               (_M_header->npackets + _M_header->interval - 1) /
+               _M_header->interval) &&
+              (sizeof(header) +
+               (_M_header->nentries * sizeof(entry)) +
+               (_M_header->nflows * sizeof(flow)) == _M_filesize)) {
+            _M_entries = reinterpret_cast<const entry*>(_M_header + 1);
+
+            _M_flows = reinterpret_cast<const flow*>(
+                         _M_entries + _M_header->nentries
+                       );
+
+            return true;
+          }
+
+          close();
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+bool pcap::ip::index::build(const char* filename, uint32_t interval)
+{
+  close();
+
+  // Sanity check.
+  if ((interval == 0) || (interval > max_interval)) {
+    return false;
+  }
+
+  // Build the name of the index file.
+  char idxfilename[PATH_MAX];
+  char tmpfilename[PATH_MAX];
+  if ((!index_filename(filename, idxfilename, sizeof(idxfilename))) ||
+      (snprintf(tmpfilename,
+                sizeof(tmpfilename),
+                "%s.tmp",
+                idxfilename) >= static_cast<int>(sizeof(tmpfilename)))) {
+    return false;
+  }
+
+  // Get status of the PCAP file.
+  struct stat sbuf;
+  if (stat(filename, &sbuf) < 0) {
+    return false;
+  }
+
+  // Open PCAP file.
+  analyzer a;
+  if ((!a.open(filename)) ||
+      (a._M_reader.file_format() != reader::format::pcap)) {
+    return false;
+  }
+
+  header hdr;
+  hdr.magic = magic;
+  hdr.version = version;
+  hdr.filesize = sbuf.st_size;
+  hdr.mtime = (sbuf.st_mtim.tv_sec * 1000000000ull) + sbuf.st_mtim.tv_nsec;
+  hdr.interval = interval;
+  hdr.reserved = 0;
+  hdr.npackets = 0;
+  hdr.nentries = 0;
+  hdr.nflows = 0;
+
+  // Entries.
+  entry* entries = nullptr;
+  size_t nentries = 0;
+
+  // Hash table of flows.
+  flow* flows = nullptr;
+  size_t size = 0;
+  size_t used = 0;
+
+  bool ret = true;
+
+  packet pcappkt;
+  if (a._M_reader.begin(pcappkt)) {
+    net::ip::packet ippkt;
+    flow key;
+
+    // Offset of the current packet.
+    uint64_t offset = sizeof(pcap::file_header);
+
+    // Maximum timestamp.
+    uint64_t timestamp = 0;
+
+    do {
+      if (pcappkt.timestamp() > timestamp) {
+        timestamp = pcappkt.timestamp();
+      }
+
+      // If the packet has to be indexed...
+      if ((hdr.npackets % interval) == 0) {
+        // If the array of entries is full...
+        if ((nentries & (nentries - 1)) == 0) {
+          entry* e = static_cast<entry*>(
+                       realloc(entries,
+                               ((nentries > 0) ? nentries * 2 : 1) *
+                               sizeof(entry))
+                     );
+
+          if (!e) {
+            ret = false;
+            break;
+          }
+
+          entries = e;
+        }
+
+        entries[nentries].offset = offset;
+        entries[nentries].timestamp = timestamp;
+
+        nentries++;
+      }
+
+      // If the packet is an IP packet...
+      if ((a.*a._M_process)(pcappkt, &ippkt)) {
+        flow_key(ippkt, key);
+
+        if (!add_flow(flows, size, used, key, offset)) {
+          ret = false;
+          break;
+        }
+      }
+
+      hdr.npackets++;
+
+      offset = a._M_reader.offset(pcappkt);
+    } while (a._M_reader.next(pcappkt));
+  }
+
+  if (ret) {
+    // Remove the empty slots of the hash table and sort the flows.
+    size_t nflows = 0;
+    for (size_t i = 0; i < size; i++) {
+      if (flows[i].packets > 0) {
+        flows[nflows++] = flows[i];
+      }
+    }
+
+    qsort(flows, nflows, sizeof(flow), compare_flows);
+
+    hdr.nentries = nentries;
+    hdr.nflows = nflows;
+
+    // Write index to a temporary file and rename it.
+    fs::file f;
+    ret = ((f.open(tmpfilename)) &&
+           (f.write(&hdr, sizeof(header))) &&
+           (f.write(entries, nentries * sizeof(entry))) &&
+           (f.write(flows, nflows * sizeof(flow))));
+
+    f.close();
+
+    if ((ret) && (rename(tmpfilename, idxfilename) < 0)) {
+      ret = false;
+    }
+
+    if (!ret) {
+      unlink(tmpfilename);
+    }
+  }
+
+  if (entries) {
+    free(entries);
+  }
+
+  if (flows) {
+    free(flows);
+  }
+
+  return ((ret) && (open(filename)));
+}
+
+bool pcap::ip::index::locate(uint64_t idx,
+                             uint64_t& offset,
+                             uint64_t& skip) const
+{
+  if (idx < _M_header->npackets) {
+    offset = _M_entries[idx / _M_header->interval].offset;
+    skip = idx % _M_header->interval;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool pcap::ip::index::find(uint64_t timestamp,
+                           uint64_t& idx,
+                           uint64_t& offset) const
+{
+  // Search the first entry whose timestamp is equal or greater than
+  // 'timestamp' (the timestamps of the entries are monotonic).
+  size_t i = 0;
+  size_t j = _M_header->nentries;
+
+  while (i < j) {
+    const size_t mid = i + ((j - i) / 2);
+
+    if (_M_entries[mid].timestamp < timestamp) {
+      i = mid + 1;
+    } else {
+      j = mid;
+    }
+  }
+
+  // If there is no such entry, the timestamp might be in the packets
+  // following the last entry.
+  if (i > 0) {
+    i--;
+  } else if (_M_header->nentries == 0) {
+    return false;
+  }
+
+  idx = static_cast<uint64_t>(i) * _M_header->interval;
+  offset = _M_entries[i].offset;
+
+  return true;
+}
+
+const pcap::ip::index::flow* pcap::ip::index::find_flow(uint32_t hash) const
+{
+  // Search the first flow whose hash is equal or greater than 'hash'.
+  size_t i = 0;
+  size_t j = _M_header->nflows;
+
+  while (i < j) {
+    const size_t mid = i + ((j - i) / 2);
+
+    if (_M_flows[mid].hash < hash) {
+      i = mid + 1;
+    } else {
+      j = mid;
+    }
+  }
+
+  return ((i < _M_header->nflows) && (_M_flows[i].hash == hash)) ?
+           &_M_flows[i] :
+           nullptr;
+}
+
+const pcap::ip::index::flow*
+pcap::ip::index::find_flow(const net::ip::packet& pkt) const
+{
+  flow key;
+  flow_key(pkt, key);
+
+  const flow* f = find_flow(key.hash);
+  if (f) {
+    // Search the flow among the flows with the same hash.
+    const flow* const end = _M_flows + _M_header->nflows;
+
+    do {
+      if (same_flow(*f, key)) {
+        return f;
+      }
+    } while ((++f < end) && (f->hash == key.hash));
+  }
+
+  return nullptr;
+}
+
+bool pcap::ip::index::index_filename(const char* filename,
+                                     char* idxfilename,
+                                     size_t size)
+{
+  return (snprintf(idxfilename, size, "%s.idx", filename) <
+          static_cast<int>(size));
+}
+
+void pcap::ip::index::flow_key(const net::ip::packet& pkt, flow& f)
+{
+  memset(&f, 0, sizeof(flow));
+
+  f.hash = net::ip::flow_hash(pkt);
+  f.protocol = pkt.protocol();
+
+  const void* saddr;
+  const void* daddr;
+  size_t len;
+
+  if (pkt.version() == net::ip::version::v4) {
+    f.version = 4;
+
+    saddr = &pkt.ipv4()->saddr;
+    daddr = &pkt.ipv4()->daddr;
+    len = 4;
+  } else {
+    f.version = 6;
+
+    saddr = &pkt.ipv6()->ip6_src;
+    daddr = &pkt.ipv6()->ip6_dst;
+    len = 16;
+  }
+
+  uint16_t sport = 0;
+  uint16_t dport = 0;
+
+  if (pkt.is_tcp()) {
+    sport = pkt.tcp()->source;
+    dport = pkt.tcp()->dest;
+  } else if (pkt.is_udp()) {
+    sport = pkt.udp()->source;
+    dport = pkt.udp()->dest;
+  }
+
+  // Order the endpoints (both directions of the flow have the same key).
+  const int cmp = memcmp(saddr, daddr, len);
+  if ((cmp < 0) || ((cmp == 0) && (sport <= dport))) {
+    memcpy(f.addresses[0], saddr, len);
+    memcpy(f.addresses[1], daddr, len);
+
+    f.ports[0] = sport;
+    f.ports[1] = dport;
+  } else {
+    memcpy(f.addresses[0], daddr, len);
+    memcpy(f.addresses[1], saddr, len);
+
+    f.ports[0] = dport;
+    f.ports[1] = sport;
+  }
+}
+
+bool pcap::ip::index::same_flow(const flow& f1, const flow& f2)
+{
+  return ((f1.hash == f2.hash) &&
+          (f1.version == f2.version) &&
+          (f1.protocol == f2.protocol) &&
+          (f1.ports[0] == f2.ports[0]) &&
+          (f1.ports[1] == f2.ports[1]) &&
+          (memcmp(f1.addresses, f2.addresses, sizeof(f1.addresses)) == 0));
+}
+
+bool pcap::ip::index::add_flow(flow*& flows,
+                               size_t& size,
+                               size_t& used,
+                               const flow& key,
+                               uint64_t offset)
+{
+  // If the hash table is half full...
+  if (used >= size / 2) {
+    const size_t newsize = (size > 0) ? size * 2 : 1024;
+
+    flow* f = static_cast<flow*>(calloc(newsize, sizeof(flow)));
+    if (!f) {
+      return false;
+    }
+
+    // Rehash flows.
+    for (size_t i = 0; i < size; i++) {
+      if (flows[i].packets > 0) {
+        size_t pos = flows[i].hash & (newsize - 1);
+        while (f[pos].packets > 0) {
+          pos = (pos + 1) & (newsize - 1);
+        }
+
+        f[pos] = flows[i];
+      }
+    }
+
+    if (flows) {
+      free(flows);
+    }
+
+    flows = f;
+    size = newsize;
+  }
+
+  // Search flow.
+  size_t pos = key.hash & (size - 1);
+  while (flows[pos].packets > 0) {
+    if (same_flow(flows[pos], key)) {
+      flows[pos].packets++;
+      flows[pos].last = offset;
+
+      return true;
+    }
+
+    pos = (pos + 1) & (size - 1);
+  }
+
+  // New flow.
+  flows[pos] = key;
+  flows[pos].packets = 1;
+  flows[pos].first = offset;
+  flows[pos].last = offset;
+
+  used++;
+
+  return true;
+}
+
+int pcap::ip::index::compare_flows(const void* a, const void* b)
+{
+  const flow* const f1 = static_cast<const flow*>(a);
+  const flow* const f2 = static_cast<const flow*>(b);
+
+  if (f1->hash != f2->hash) {
+    return (f1->hash < f2->hash) ? -1 : 1;
+  }
+
+  // The first packets of two flows are at different offsets.
+  return (f1->first < f2->first) ? -1 : ((f1->first > f2->first) ? 1 : 0);
+}
@@ -0,0 +1,234 @@
+#ifndef PCAP_IP_INDEX_H
+#define PCAP_IP_INDEX_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "net/ip/packet.h"
+
+namespace pcap {
+  namespace ip {
+    // Packet index of a PCAP file.
+    // It is stored next to the PCAP file (<filename>.idx) and mapped into
+    // memory. It contains the offset of every 'interval'th packet and, for
+    // each flow (identified by the IP version, the protocol, the addresses
+    // and the ports), the number of packets and the offsets of the first and
+    // the last packet.
+    // The index is stale when the size or the modification time of the PCAP
+    // file change.
+    class index {
+      public:
+        // Default interval (index every 32nd packet).
+        static constexpr const uint32_t default_interval = 32;
+
+        // Maximum interval.
+        static constexpr const uint32_t max_interval = 1024 * 1024;
+
+        // Index file header.
+        struct header {
+          // Magic ("PIDX").
+          uint32_t magic;
+
+          // Version.
+          uint32_t version;
+
+          // Size of the PCAP file.
+          uint64_t filesize;
+
+          // Modification time of the PCAP file (nanoseconds since the Epoch).
+          uint64_t mtime;
+
+          // Interval.
+          uint32_t interval;
+
+          uint32_t reserved;
+
+          // Number of packets.
+          uint64_t npackets;
+
+          // Number of entries.
+          uint64_t nentries;
+
+          // Number of flows.
+          uint64_t nflows;
+        };
+
+        // Entry (one per 'interval' packets).
+        struct entry {
+          // Offset of the packet in the PCAP file.
+          uint64_t offset;
+
+          // Maximum timestamp of the packets up to this one (microseconds).
+          uint64_t timestamp;
+        };
+
+        // Flow (sorted by hash, see net::ip::flow_hash(), and by offset of
+        // the first packet). Different flows can have the same hash.
+        struct flow {
+          // Flow hash.
+          uint32_t hash;
+
+          // IP version (4 or 6).
+          uint8_t version;
+
+          // Layer 3 protocol.
+          uint8_t protocol;
+
+          // Ports (network byte order, 0 for protocols without ports) of
+          // the lower and the higher endpoint.
+          uint16_t ports[2];
+
+          uint16_t reserved1;
+          uint32_t reserved2;
+
+          // Addresses of the lower and the higher endpoint (IPv4 addresses
+          // use the first 4 bytes, the rest are 0).
+          uint8_t addresses[2][16];
+
+          // Number of packets.
+          uint64_t packets;
+
+          // Offsets of the first and the last packet in the PCAP file.
+          uint64_t first;
+          uint64_t last;
+        };
+
+        // Constructor.
+        index() = default;
+
+        // Destructor.
+        ~index();
+
+        // Open the index of a PCAP file.
+        // Fails if the index doesn't exist or is stale.
+        bool open(const char* filename);
+
+        // Build the index of a PCAP file (PCAP files only) and open it.
+        bool build(const char* filename, uint32_t interval = default_interval);
+
+        // Is the index open?
+        bool open() const;
+
+        // Close index.
+        void close();
+
+        // Get number of packets.
+        uint64_t packets() const;
+
+        // Get interval.
+        uint32_t interval() const;
+
+        // Locate packet.
+        // 'offset' receives the offset of the closest indexed packet at or
+        // before the packet 'idx' and 'skip' the number of packets which
+        // have to be skipped from there.
+        bool locate(uint64_t idx, uint64_t& offset, uint64_t& skip) const;
+
+        // Find the indexed packet from which the first packet with a
+        // timestamp equal or greater than 'timestamp' has to be searched.
+        // 'idx' receives the number of the packet and 'offset' its offset.
+        bool find(uint64_t timestamp, uint64_t& idx, uint64_t& offset) const;
+
+        // Get number of flows.
+        uint64_t flows() const;
+
+        // Get flow.
+        const flow* get_flow(uint64_t idx) const;
+
+        // Find the first flow with the hash (the flows with the same hash
+        // are consecutive).
+        const flow* find_flow(uint32_t hash) const;
+
+        // Find the flow of the packet.
+        const flow* find_flow(const net::ip::packet& pkt) const;
+
+      private:
+        // Magic ("PIDX").
+        static constexpr const uint32_t magic = 0x58444950;
+
+        // Version.
+        static constexpr const uint32_t version = 2;
+
+        // Pointer to the mapped area.
+        void* _M_base = MAP_FAILED;
+
+        // Size of the index file.
+        size_t _M_filesize;
+
+        // Header.
+        const header* _M_header;
+
+        // Entries.
+        const entry* _M_entries;
+
+        // Flows.
+        const flow* _M_flows;
+
+        // Build the name of the index file.
+        static bool index_filename(const char* filename,
+                                   char* idxfilename,
+                                   size_t size);
+
+        // Fill the key of the flow (hash, version, protocol, addresses and
+        // ports) from the packet.
+        static void flow_key(const net::ip::packet& pkt, flow& f);
+
+        // Do the flows have the same key?
+        static bool same_flow(const flow& f1, const flow& f2);
+
+        // Add flow to the hash table of flows.
+        static bool add_flow(flow*& flows,
+                             size_t& size,
+                             size_t& used,
+                             const flow& key,
+                             uint64_t offset);
+
+        // Compare flows (for sorting).
+        static int compare_flows(const void* a, const void* b);
+
+        // Disable copy constructor and assignment operator.
+        index(const index&) = delete;
+        index& operator=(const index&) = delete;
+    };
+
+    inline index::~index()
+    {
+      close();
+    }
+
+    inline bool index::open() const
+    {
+      return (_M_base != MAP_FAILED);
+    }
+
+    inline void index::close()
+    {
+      if (_M_base != MAP_FAILED) {
+        munmap(_M_base, _M_filesize);
+        _M_base = MAP_FAILED;
+      }
+    }
+
+    inline uint64_t index::packets() const
+    {
+      return _M_header->npackets;
+    }
+
+    inline uint32_t index::interval() const
+    {
+      return _M_header->interval;
+    }
+
+    inline uint64_t index::flows() const
+    {
+      return _M_header->nflows;
+    }
+
+    inline const index::flow* index::get_flow(uint64_t idx) const
+    {
+      return (idx < _M_header->nflows) ? &_M_flows[idx] : nullptr;
+    }
+  }
+}
+
+#endif // PCAP_IP_INDEX_H
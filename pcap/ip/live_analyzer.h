@@ -15,8 +15,14 @@ namespace pcap {
         // Destructor.
         ~live_analyzer() = default;
 
+        // Enable mapped mode (see pcap::live_reader, must be called before
+        // open()).
+        void mapped(size_t window = live_reader::default_window);
+
         // Open PCAP file.
-        bool open(const char* filename);
+        // If 'follow' is true, the rotation of the file is followed (see
+        // pcap::live_reader).
+        bool open(const char* filename, bool follow = false);
 
         // Close PCAP file.
         void close();
@@ -36,6 +42,13 @@ namespace pcap {
         // Get file descriptor.
         int fileno() const;
 
+        // Wait until the file is modified or rotated, up to 'timeout'
+        // milliseconds (see pcap::live_reader::wait()).
+        bool wait(int timeout = -1);
+
+        // Get file descriptor to be polled for notifications.
+        int notification_fd() const;
+
       private:
         // PCAP live reader.
         live_reader _M_reader;
@@ -66,10 +79,15 @@ namespace pcap {
         live_analyzer& operator=(const live_analyzer&) = delete;
     };
 
-    inline bool live_analyzer::open(const char* filename)
+    inline void live_analyzer::mapped(size_t window)
+    {
+      _M_reader.mapped(window);
+    }
+
+    inline bool live_analyzer::open(const char* filename, bool follow)
     {
       // Open PCAP file.
-      if (_M_reader.open(filename)) {
+      if (_M_reader.open(filename, follow)) {
         _M_error = false;
         return true;
       }
@@ -103,6 +121,16 @@ namespace pcap {
       return _M_reader.fileno();
     }
 
+    inline bool live_analyzer::wait(int timeout)
+    {
+      return _M_reader.wait(timeout);
+    }
+
+    inline int live_analyzer::notification_fd() const
+    {
+      return _M_reader.notification_fd();
+    }
+
     inline bool live_analyzer::process_ethernet(const packet& pcappkt,
                                                 net::ip::packet* ippkt)
     {
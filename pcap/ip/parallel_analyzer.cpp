@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <new>
+#include "pcap/ip/parallel_analyzer.h"
+#include "net/ip/flow.h"
+
+bool pcap::ip::parallel_analyzer::open(const char* filename, size_t nworkers)
+{
+  close();
+
+  // If the number of workers has not been specified...
+  if (nworkers == 0) {
+    // Get number of online CPUs.
+    const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nworkers = (ncpus > 0) ? static_cast<size_t>(ncpus) : 1;
+  }
+
+  if (nworkers > max_workers) {
+    nworkers = max_workers;
+  }
+
+  // Open PCAP file (for splitting it).
+  reader r;
+  if (r.open(filename)) {
+    // Don't create chunks smaller than 'min_chunk_size'.
+    size_t nchunks = r.filesize() / min_chunk_size;
+    if (nchunks > nworkers) {
+      nchunks = nworkers;
+    }
+
+    // Split file.
+    size_t offsets[max_workers + 1];
+    if ((nchunks <= 1) || ((nchunks = r.split(nchunks, offsets)) == 0)) {
+      // Single chunk.
+      nchunks = 1;
+    }
+
+    r.close();
+
+    // Create workers.
+    if ((_M_workers = new (std::nothrow) worker[nchunks]) != nullptr) {
+      for (size_t i = 0; i < nchunks; i++) {
+        worker& w = _M_workers[i];
+
+        w.pa = this;
+
+        if (nchunks > 1) {
+          w.begin = offsets[i];
+
+          // The last chunk ends at the end of the file (which might be
+          // truncated).
+          w.end = (i + 1 < nchunks) ? offsets[i + 1] : SIZE_MAX;
+        }
+
+        for (size_t j = 0; j < nchunks; j++) {
+          w.partitions[j].idx = nullptr;
+          w.partitions[j].size = 0;
+          w.partitions[j].used = 0;
+        }
+
+        w.running = false;
+
+        _M_nworkers++;
+
+        // Open PCAP file.
+        if (!w.a.open(filename)) {
+          close();
+          return false;
+        }
+
+        // The packets are partitioned by flow hash: compute it once, while
+        // parsing them.
+        w.a.flow_hashes(true);
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void pcap::ip::parallel_analyzer::close()
+{
+  if (_M_workers) {
+    for (size_t i = 0; i < _M_nworkers; i++) {
+      worker& w = _M_workers[i];
+
+      for (size_t j = 0; j < _M_nworkers; j++) {
+        if (w.partitions[j].idx) {
+          free(w.partitions[j].idx);
+        }
+      }
+    }
+
+    delete [] _M_workers;
+    _M_workers = nullptr;
+  }
+
+  _M_nworkers = 0;
+}
+
+bool pcap::ip::parallel_analyzer::read_all()
+{
+  return run(read_chunk);
+}
+
+size_t pcap::ip::parallel_analyzer::count() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < _M_nworkers; i++) {
+    n += _M_workers[i].a.count();
+  }
+
+  return n;
+}
+
+const net::ip::packet* pcap::ip::parallel_analyzer::get(size_t idx) const
+{
+  for (size_t i = 0; i < _M_nworkers; i++) {
+    const analyzer& a = _M_workers[i].a;
+
+    // If the packet belongs to this chunk...
+    if (idx < a.count()) {
+      return a.get(idx);
+    }
+
+    idx -= a.count();
+  }
+
+  return nullptr;
+}
+
+bool pcap::ip::parallel_analyzer::for_each_flow(packetfn_t fn,
+                                                void* const* users)
+{
+  for (size_t i = 0; i < _M_nworkers; i++) {
+    worker& w = _M_workers[i];
+
+    w.partition = i;
+    w.fn = fn;
+    w.user = users[i];
+  }
+
+  return run(process_flows);
+}
+
+bool pcap::ip::parallel_analyzer::run(void* (*fn)(void*))
+{
+  if (_M_nworkers > 0) {
+    bool ret = true;
+
+    for (size_t i = 0; i < _M_nworkers; i++) {
+      worker& w = _M_workers[i];
+
+      w.result = false;
+
+      // Start thread.
+      if (pthread_create(&w.thread, nullptr, fn, &w) == 0) {
+        w.running = true;
+      } else {
+        ret = false;
+        break;
+      }
+    }
+
+    // Wait for the threads.
+    for (size_t i = 0; i < _M_nworkers; i++) {
+      worker& w = _M_workers[i];
+
+      if (w.running) {
+        pthread_join(w.thread, nullptr);
+        w.running = false;
+
+        if (!w.result) {
+          ret = false;
+        }
+      }
+    }
+
+    return ret;
+  }
+
+  return false;
+}
+
+void* pcap::ip::parallel_analyzer::read_chunk(void* arg)
+{
+  worker* w = static_cast<worker*>(arg);
+
+  // Parse the packets of the chunk and build the partitions.
+  w->result = (((w->pa->_M_nworkers == 1) ?
+                  w->a.read_all() :
+                  w->a.read_all(w->begin, w->end)) &&
+               (w->pa->partition(*w)));
+
+  return nullptr;
+}
+
+void* pcap::ip::parallel_analyzer::process_flows(void* arg)
+{
+  worker* w = static_cast<worker*>(arg);
+  const parallel_analyzer* pa = w->pa;
+
+  // Single worker?
+  if (pa->_M_nworkers == 1) {
+    for (size_t i = 0; i < w->a.count(); i++) {
+      if (!w->fn(*w->a.get(i), w->user)) {
+        break;
+      }
+    }
+  } else {
+    // Process the packets of the partition, chunk by chunk.
+    for (size_t i = 0; i < pa->_M_nworkers; i++) {
+      const worker& src = pa->_M_workers[i];
+      const indices& list = src.partitions[w->partition];
+
+      for (size_t j = 0; j < list.used; j++) {
+        if (!w->fn(*src.a.get(list.idx[j]), w->user)) {
+          w->result = true;
+          return nullptr;
+        }
+      }
+    }
+  }
+
+  w->result = true;
+
+  return nullptr;
+}
+
+bool pcap::ip::parallel_analyzer::partition(worker& w)
+{
+  // Single worker?
+  if (_M_nworkers == 1) {
+    return true;
+  }
+
+  const size_t count = w.a.count();
+
+  for (size_t i = 0; i < count; i++) {
+    if (!add(w.partitions[net::ip::flow_hash(*w.a.get(i)) % _M_nworkers],
+             i)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool pcap::ip::parallel_analyzer::add(indices& list, uint32_t idx)
+{
+  // If the list is full...
+  if (list.used == list.size) {
+    const size_t size = (list.size > 0) ? list.size * 2 : 1024;
+
+    uint32_t* l = static_cast<uint32_t*>(
+                    realloc(list.idx, size * sizeof(uint32_t))
+                  );
+
+    if (!l) {
+      return false;
+    }
+
+    list.idx = l;
+    list.size = size;
+  }
+
+  list.idx[list.used++] = idx;
+
+  return true;
+}
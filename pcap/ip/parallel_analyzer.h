@@ -0,0 +1,141 @@
+#ifndef PCAP_IP_PARALLEL_ANALYZER_H
+#define PCAP_IP_PARALLEL_ANALYZER_H
+
+#include <pthread.h>
+#include "pcap/ip/analyzer.h"
+
+namespace pcap {
+  namespace ip {
+    // Parallel IP analyzer.
+    // The PCAP file is split in chunks (see pcap::reader::split()) which are
+    // parsed by worker threads, each one with its own IP parser. The packets
+    // can be retrieved in the order of the file or partitioned by flow.
+    // The fragments of an IP packet which are spread across chunks are not
+    // reassembled.
+    // pcapng files are parsed by a single worker.
+    class parallel_analyzer {
+      public:
+        // Maximum number of workers.
+        static constexpr const size_t max_workers = 64;
+
+        // Minimum chunk size (1 MiB).
+        static constexpr const size_t
+               min_chunk_size = static_cast<size_t>(1) << 20;
+
+        // Packet callback (see for_each_flow()).
+        // If the callback returns false, the thread stops.
+        typedef bool (*packetfn_t)(const net::ip::packet& pkt, void* user);
+
+        // Constructor.
+        parallel_analyzer() = default;
+
+        // Destructor.
+        ~parallel_analyzer();
+
+        // Open PCAP file.
+        // The file is split in up to 'nworkers' chunks (0: one chunk per
+        // online CPU).
+        bool open(const char* filename, size_t nworkers = 0);
+
+        // Close PCAP file.
+        void close();
+
+        // Read all packets.
+        // Parses the chunks in parallel.
+        bool read_all();
+
+        // Get number of workers.
+        size_t workers() const;
+
+        // Get number of packets.
+        size_t count() const;
+
+        // Get packet at position (in the order of the PCAP file).
+        const net::ip::packet* get(size_t idx) const;
+
+        // Process the packets partitioned by flow.
+        // The callback is called from one thread per worker: the thread 'i'
+        // receives the packets of the flows whose hash modulo the number of
+        // workers is 'i', in the order of the PCAP file, with the user
+        // pointer 'users[i]'.
+        bool for_each_flow(packetfn_t fn, void* const* users);
+
+      private:
+        // Packet indices.
+        struct indices {
+          uint32_t* idx;
+          size_t size;
+          size_t used;
+        };
+
+        // Worker.
+        struct worker {
+          // Parallel analyzer.
+          parallel_analyzer* pa;
+
+          // IP analyzer.
+          analyzer a;
+
+          // Chunk.
+          size_t begin;
+          size_t end;
+
+          // Indices of the packets of each partition.
+          indices partitions[max_workers];
+
+          // Partition (see for_each_flow()).
+          size_t partition;
+
+          // Packet callback and user pointer (see for_each_flow()).
+          packetfn_t fn;
+          void* user;
+
+          // Thread.
+          pthread_t thread;
+
+          // Has the thread been started?
+          bool running;
+
+          // Result.
+          bool result;
+        };
+
+        // Workers.
+        worker* _M_workers = nullptr;
+
+        // Number of workers.
+        size_t _M_nworkers = 0;
+
+        // Run 'fn' in one thread per worker.
+        bool run(void* (*fn)(void*));
+
+        // Thread function for reading the chunks.
+        static void* read_chunk(void* arg);
+
+        // Thread function for processing the flows.
+        static void* process_flows(void* arg);
+
+        // Build the partitions of a worker.
+        bool partition(worker& w);
+
+        // Add index to list.
+        static bool add(indices& list, uint32_t idx);
+
+        // Disable copy constructor and assignment operator.
+        parallel_analyzer(const parallel_analyzer&) = delete;
+        parallel_analyzer& operator=(const parallel_analyzer&) = delete;
+    };
+
+    inline parallel_analyzer::~parallel_analyzer()
+    {
+      close();
+    }
+
+    inline size_t parallel_analyzer::workers() const
+    {
+      return _M_nworkers;
+    }
+  }
+}
+
+#endif // PCAP_IP_PARALLEL_ANALYZER_H
@@ -1,15 +1,145 @@
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "pcap/live_reader.h"
 
-bool pcap::live_reader::open(const char* filename)
+void pcap::live_reader::mapped(size_t window)
+{
+  close();
+
+  // Free buffer (if any).
+  if ((_M_buf) && (_M_window == 0)) {
+    free(_M_buf);
+    _M_buf = nullptr;
+  }
+
+  _M_window = (window > min_window) ? window : min_window;
+}
+
+bool pcap::live_reader::open(const char* filename, bool follow)
+{
+  close();
+
+  // Save file name.
+  const size_t len = strlen(filename);
+  if (len >= sizeof(_M_filename)) {
+    return false;
+  }
+
+  memcpy(_M_filename, filename, len + 1);
+
+  // Follow the rotation of the file?
+  if (follow) {
+    // Build the name of the next file.
+    if (!next_filename(_M_filename,
+                       _M_next_filename,
+                       sizeof(_M_next_filename))) {
+      return false;
+    }
+  }
+
+  _M_follow = follow;
+  _M_rotated = false;
+
+  // Set up the notifications before opening the file, so that no
+  // modification is missed.
+  watch();
+
+  return open_file(_M_filename);
+}
+
+void pcap::live_reader::close()
+{
+  // Mapped mode?
+  if (_M_window > 0) {
+    unmap();
+  }
+
+  if (_M_fd != -1) {
+    ::close(_M_fd);
+    _M_fd = -1;
+  }
+
+  if (_M_inotify_fd != -1) {
+    ::close(_M_inotify_fd);
+    _M_inotify_fd = -1;
+  }
+}
+
+bool pcap::live_reader::read(packet& pkt)
+{
+  do {
+    // Read record.
+    if (read_record(pkt)) {
+      return true;
+    }
+
+    // If we have reached the end of the file and the next file has been
+    // created (the writer has finished writing the current file)...
+    if ((!_M_eof) || (_M_error) || (!_M_rotated) || (!next_file())) {
+      return false;
+    }
+  } while (true);
+}
+
+bool pcap::live_reader::wait(int timeout)
+{
+  // If the notifications are not available...
+  if (_M_inotify_fd == -1) {
+    // Sleep (at most 'max_sleep' milliseconds).
+    if ((timeout < 0) || (timeout > max_sleep)) {
+      timeout = max_sleep;
+    }
+
+    usleep(timeout * 1000);
+
+    // Check whether the next file has been created.
+    if (_M_follow) {
+      _M_rotated = (access(_M_next_filename, F_OK) == 0);
+    }
+
+    return true;
+  }
+
+  // If the next file has already been created...
+  if (_M_rotated) {
+    return true;
+  }
+
+  pollfd fd;
+  fd.fd = _M_inotify_fd;
+  fd.events = POLLIN;
+
+  switch (poll(&fd, 1, timeout)) {
+    case 1:
+      // Process notifications.
+      process_notifications();
+      return true;
+    default:
+      // Timeout or signal.
+      return false;
+  }
+}
+
+bool pcap::live_reader::open_file(const char* filename)
 {
   // Open file for reading.
   if ((_M_fd = ::open(filename, O_RDONLY)) != -1) {
-    // If the buffer has not been allocated yet...
-    if (!_M_buf) {
-      // Allocate buffer.
+    // Mapped mode?
+    if (_M_window > 0) {
+      // Map the beginning of the file.
+      if (!map(0)) {
+        ::close(_M_fd);
+        _M_fd = -1;
+
+        return false;
+      }
+    } else if (!_M_buf) {
+      // Allocate buffer (if it has not been allocated yet).
       if ((_M_buf = static_cast<uint8_t*>(malloc(buffer_size))) != nullptr) {
         // Make '_M_bufend' point to the end of the buffer.
         _M_bufend = _M_buf + buffer_size;
@@ -33,7 +163,7 @@ bool pcap::live_reader::open(const char* filename)
   return false;
 }
 
-bool pcap::live_reader::read(packet& pkt)
+bool pcap::live_reader::read_record(packet& pkt)
 {
   do {
     switch (_M_state) {
@@ -52,6 +182,8 @@ bool pcap::live_reader::read(packet& pkt)
                                (hdr->ts.tv_usec / 1000);
           }
 
+          pkt._M_linktype = _M_link_type;
+
           // Make '_M_begin' point to the next record.
           _M_begin += _M_record_length;
 
@@ -86,6 +218,179 @@ bool pcap::live_reader::read(packet& pkt)
   } while (true);
 }
 
+bool pcap::live_reader::next_file()
+{
+  // Close current file.
+  ::close(_M_fd);
+  _M_fd = -1;
+
+  // Remove the watch of the current file.
+  if ((_M_inotify_fd != -1) && (_M_file_wd != -1)) {
+    inotify_rm_watch(_M_inotify_fd, _M_file_wd);
+  }
+
+  memcpy(_M_filename, _M_next_filename, sizeof(_M_filename));
+
+  // Build the name of the next file.
+  if (!next_filename(_M_filename,
+                     _M_next_filename,
+                     sizeof(_M_next_filename))) {
+    _M_error = true;
+    return false;
+  }
+
+  _M_rotated = false;
+
+  // Watch the new file.
+  if (_M_inotify_fd != -1) {
+    _M_file_wd = inotify_add_watch(_M_inotify_fd,
+                                   _M_filename,
+                                   IN_MODIFY | IN_CLOSE_WRITE);
+
+    // Check whether the next file has already been created.
+    _M_rotated = (access(_M_next_filename, F_OK) == 0);
+  }
+
+  if (open_file(_M_filename)) {
+    return true;
+  }
+
+  _M_error = true;
+
+  return false;
+}
+
+bool pcap::live_reader::next_filename(const char* filename,
+                                      char* next,
+                                      size_t size)
+{
+  // Find the last sequence of digits in the base name.
+  const char* basename = strrchr(filename, '/');
+  basename = basename ? basename + 1 : filename;
+
+  const char* end = nullptr;
+  for (const char* ptr = basename; *ptr; ptr++) {
+    if ((*ptr >= '0') && (*ptr <= '9')) {
+      end = ptr + 1;
+    }
+  }
+
+  // If there is no sequence number...
+  if (!end) {
+    return false;
+  }
+
+  const char* begin = end - 1;
+  while ((begin > basename) && (begin[-1] >= '0') && (begin[-1] <= '9')) {
+    begin--;
+  }
+
+  // Increment sequence number (keeping the width, the number grows by one
+  // digit if all the digits are '9').
+  const size_t len = strlen(filename);
+  if (len + 2 > size) {
+    return false;
+  }
+
+  const size_t pos = begin - filename;
+  size_t i = end - filename;
+
+  memcpy(next, filename, len + 1);
+
+  while (i > pos) {
+    if (next[--i] != '9') {
+      next[i]++;
+      return true;
+    }
+
+    next[i] = '0';
+  }
+
+  // Insert a '1' at the beginning of the sequence number.
+  memmove(next + pos + 1, next + pos, len - pos + 1);
+  next[pos] = '1';
+
+  return true;
+}
+
+void pcap::live_reader::watch()
+{
+  if ((_M_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) != -1) {
+    // Watch the file.
+    _M_file_wd = inotify_add_watch(_M_inotify_fd,
+                                   _M_filename,
+                                   IN_MODIFY | IN_CLOSE_WRITE);
+
+    // Follow the rotation of the file?
+    if (_M_follow) {
+      char dirname[PATH_MAX];
+      const char* const slash = strrchr(_M_filename, '/');
+      if (slash) {
+        const size_t len = (slash > _M_filename) ? slash - _M_filename : 1;
+        memcpy(dirname, _M_filename, len);
+        dirname[len] = 0;
+      } else {
+        dirname[0] = '.';
+        dirname[1] = 0;
+      }
+
+      // Watch the directory (creation of the next file).
+      if ((_M_dir_wd = inotify_add_watch(_M_inotify_fd,
+                                         dirname,
+                                         IN_CREATE | IN_MOVED_TO)) == -1) {
+        ::close(_M_inotify_fd);
+        _M_inotify_fd = -1;
+
+        return;
+      }
+
+      // Check whether the next file has already been created.
+      _M_rotated = (access(_M_next_filename, F_OK) == 0);
+    } else {
+      _M_dir_wd = -1;
+    }
+  }
+}
+
+void pcap::live_reader::process_notifications()
+{
+  // Buffer suitably aligned for inotify_event.
+  char buf[4096] __attribute__((aligned(__alignof__(inotify_event))));
+
+  // Get base name of the next file.
+  const char* basename = strrchr(_M_next_filename, '/');
+  basename = basename ? basename + 1 : _M_next_filename;
+
+  do {
+    const ssize_t ret = ::read(_M_inotify_fd, buf, sizeof(buf));
+    if (ret <= 0) {
+      if ((ret == -1) && (errno == EINTR)) {
+        continue;
+      }
+
+      return;
+    }
+
+    // Process events.
+    for (const char* ptr = buf; ptr < buf + ret; ) {
+      const inotify_event* const
+        ev = reinterpret_cast<const inotify_event*>(ptr);
+
+      // Has the next file been created?
+      if ((ev->wd == _M_dir_wd) &&
+          (ev->len > 0) &&
+          (strcmp(ev->name, basename) == 0)) {
+        _M_rotated = true;
+      } else if ((ev->mask & IN_Q_OVERFLOW) && (_M_follow)) {
+        // Events have been lost.
+        _M_rotated = (access(_M_next_filename, F_OK) == 0);
+      }
+
+      ptr += sizeof(inotify_event) + ev->len;
+    }
+  } while (true);
+}
+
 bool pcap::live_reader::read_file_header()
 {
   // Read from file.
@@ -163,6 +468,11 @@ bool pcap::live_reader::read_packet_data()
 
 bool pcap::live_reader::read()
 {
+  // Mapped mode?
+  if (_M_window > 0) {
+    return extend();
+  }
+
   // Make 'end' point to the end of the data.
   const uint8_t* const end = _M_end;
 
@@ -191,6 +501,12 @@ bool pcap::live_reader::read()
 
 void pcap::live_reader::shift_data_left()
 {
+  // Mapped mode?
+  if (_M_window > 0) {
+    move_window();
+    return;
+  }
+
   // Compute number of bytes in the buffer.
   const size_t len = _M_end - _M_begin;
 
@@ -204,6 +520,89 @@ void pcap::live_reader::shift_data_left()
   _M_end = _M_buf + len;
 }
 
+bool pcap::live_reader::map(off_t offset)
+{
+  void* const
+    base = mmap(nullptr, _M_window, PROT_READ, MAP_SHARED, _M_fd, offset);
+
+  if (base != MAP_FAILED) {
+    madvise(base, _M_window, MADV_SEQUENTIAL);
+
+    // Unmap previous window.
+    unmap();
+
+    _M_buf = static_cast<uint8_t*>(base);
+    _M_bufend = _M_buf + _M_window;
+
+    _M_window_offset = offset;
+
+    return true;
+  }
+
+  return false;
+}
+
+void pcap::live_reader::unmap()
+{
+  if (_M_buf) {
+    munmap(_M_buf, _M_window);
+    _M_buf = nullptr;
+  }
+}
+
+bool pcap::live_reader::extend()
+{
+  // If the window could not be moved...
+  if (_M_error) {
+    return false;
+  }
+
+  struct stat sbuf;
+  if (fstat(_M_fd, &sbuf) == 0) {
+    // Compute offset of the end of the data.
+    const off_t end = _M_window_offset + (_M_end - _M_buf);
+
+    // If the file has not been truncated...
+    if (sbuf.st_size >= end) {
+      // Extend the data up to the end of the file (or of the window).
+      const uint8_t* const old_end = _M_end;
+
+      if (static_cast<size_t>(sbuf.st_size - _M_window_offset) < _M_window) {
+        _M_end = _M_buf + (sbuf.st_size - _M_window_offset);
+
+        // The end of the file is inside the window.
+        _M_eof = true;
+      } else {
+        _M_end = _M_buf + _M_window;
+      }
+
+      return (_M_end > old_end);
+    }
+  }
+
+  _M_error = true;
+
+  return false;
+}
+
+void pcap::live_reader::move_window()
+{
+  // Compute offsets of the current record and of the end of the data.
+  const off_t begin = _M_window_offset + (_M_begin - _M_buf);
+  const off_t end = _M_window_offset + (_M_end - _M_buf);
+
+  // Round down to the page size.
+  const off_t offset = begin & ~static_cast<off_t>(sysconf(_SC_PAGESIZE) - 1);
+
+  if (map(offset)) {
+    _M_begin = _M_buf + (begin - offset);
+    _M_end = _M_buf + (end - offset);
+  } else {
+    // Keep the current window.
+    _M_error = true;
+  }
+}
+
 bool pcap::live_reader::is_pcap()
 {
   const file_header* const
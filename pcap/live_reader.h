@@ -3,21 +3,46 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
 #include "pcap/packet.h"
 #include "net/ip/limits.h"
 
 namespace pcap {
   // PCAP file live reader.
+  // wait() blocks until the file is modified (inotify), so that a tailing
+  // reader neither sleeps nor spins.
+  // When following the rotation of the file, the name of the file has to
+  // end with a sequence number (as the files created by
+  // net::capture::writer: <prefix>-<sequence-number>.pcap); when the next
+  // file is created, the current file is read up to its end and the reader
+  // continues with the next file.
+  // In mapped mode, the file is mapped into memory in windows which are
+  // extended as the file grows and moved forward as it is read, and the
+  // packets point into the mapping (no copy). The file must not be
+  // truncated while it is mapped (SIGBUS).
   class live_reader {
     public:
+      // Default window size in mapped mode (16 MiB).
+      static constexpr const size_t
+             default_window = static_cast<size_t>(16) << 20;
+
+      // Minimum window size in mapped mode (1 MiB).
+      static constexpr const size_t
+             min_window = static_cast<size_t>(1) << 20;
+
       // Constructor.
       live_reader() = default;
 
       // Destructor.
       ~live_reader();
 
+      // Enable mapped mode (must be called before open()).
+      void mapped(size_t window = default_window);
+
       // Open PCAP file.
-      bool open(const char* filename);
+      // If 'follow' is true, the rotation of the file is followed.
+      bool open(const char* filename, bool follow = false);
 
       // Close PCAP file.
       void close();
@@ -40,7 +65,25 @@ namespace pcap {
       // Get file descriptor.
       int fileno() const;
 
+      // Wait until the file is modified or rotated, up to 'timeout'
+      // milliseconds (-1: no timeout).
+      // Returns true if there might be more packets to read, false on
+      // timeout or if interrupted by a signal.
+      bool wait(int timeout = -1);
+
+      // Get file descriptor to be polled for notifications (readable when
+      // the file has been modified or rotated, see wait()), -1 if not
+      // available.
+      int notification_fd() const;
+
+      // Get name of the current file.
+      const char* filename() const;
+
     private:
+      // Maximum time to sleep in wait() when the notifications are not
+      // available (milliseconds).
+      static constexpr const int max_sleep = 100;
+
       // Buffer size.
       static constexpr const size_t buffer_size = sizeof(pkthdr) +
                                                   net::ip::packet_max_len;
@@ -54,9 +97,16 @@ namespace pcap {
       // Error?
       bool _M_error;
 
-      // Buffer where to read from the file.
+      // Buffer where to read from the file (mapped mode: mapping of the
+      // window).
       uint8_t* _M_buf = nullptr;
 
+      // Window size (0: not mapped mode).
+      size_t _M_window = 0;
+
+      // Offset of the window in the file (mapped mode).
+      off_t _M_window_offset;
+
       // Buffer end.
       const uint8_t* _M_bufend;
 
@@ -84,6 +134,42 @@ namespace pcap {
       // Total length of the record.
       uint32_t _M_record_length;
 
+      // inotify file descriptor and watches of the file and of its directory
+      // (rotation).
+      int _M_inotify_fd = -1;
+      int _M_file_wd;
+      int _M_dir_wd;
+
+      // Follow the rotation of the file?
+      bool _M_follow;
+
+      // Has the next file been created?
+      bool _M_rotated;
+
+      // Name of the current file and of the next one.
+      char _M_filename[PATH_MAX];
+      char _M_next_filename[PATH_MAX];
+
+      // Read record.
+      bool read_record(packet& pkt);
+
+      // Open file.
+      bool open_file(const char* filename);
+
+      // Switch to the next file.
+      bool next_file();
+
+      // Build the name of the next file.
+      static bool next_filename(const char* filename,
+                                char* next,
+                                size_t size);
+
+      // Set up the notifications.
+      void watch();
+
+      // Process the pending notifications.
+      void process_notifications();
+
       // Read file header.
       bool read_file_header();
 
@@ -99,6 +185,19 @@ namespace pcap {
       // Shift data to the left.
       void shift_data_left();
 
+      // Map window starting at 'offset' (page aligned).
+      bool map(off_t offset);
+
+      // Unmap window.
+      void unmap();
+
+      // Extend the window up to the end of the file (mapped mode).
+      bool extend();
+
+      // Move the window forward, so that it starts at the page of the
+      // current record (mapped mode).
+      void move_window();
+
       // Is a PCAP file?
       bool is_pcap();
 
@@ -112,19 +211,11 @@ namespace pcap {
     // Close file.
     close();
 
-    if (_M_buf) {
+    if ((_M_buf) && (_M_window == 0)) {
       free(_M_buf);
     }
   }
 
-  inline void live_reader::close()
-  {
-    if (_M_fd != -1) {
-      ::close(_M_fd);
-      _M_fd = -1;
-    }
-  }
-
   inline uint32_t live_reader::linktype() const
   {
     return _M_link_type;
@@ -150,6 +241,16 @@ namespace pcap {
   {
     return _M_fd;
   }
+
+  inline int live_reader::notification_fd() const
+  {
+    return _M_inotify_fd;
+  }
+
+  inline const char* live_reader::filename() const
+  {
+    return _M_filename;
+  }
 }
 
 #endif // PCAP_LIVE_READER_H
@@ -0,0 +1,179 @@
+#include <new>
+#include "pcap/merged_reader.h"
+#include "pcap/reader.h"
+
+struct pcap::merged_reader::source {
+  // PCAP reader.
+  reader r;
+
+  // Next packet.
+  packet pkt;
+};
+
+bool pcap::merged_reader::open(const char* const* filenames, size_t nfiles)
+{
+  close();
+
+  if (nfiles > 0) {
+    // Allocate sources and heap.
+    if (((_M_sources = new (std::nothrow) source[nfiles]) != nullptr) &&
+        ((_M_heap = static_cast<size_t*>(
+                      malloc(nfiles * sizeof(size_t))
+                    )) != nullptr)) {
+      _M_nsources = nfiles;
+
+      // Open PCAP files.
+      for (size_t i = 0; i < nfiles; i++) {
+        reader& r = _M_sources[i].r;
+
+        // Streaming mode?
+        if (_M_window > 0) {
+          r.streaming(_M_window, _M_readahead_thread);
+        }
+
+        // Asynchronous mode?
+        if (_M_queue_depth > 0) {
+          r.asynchronous(_M_queue_depth, _M_buffer_size);
+        }
+
+        if (!r.open(filenames[i])) {
+          close();
+          return false;
+        }
+
+        _M_filesize += r.filesize();
+      }
+
+      return true;
+    }
+
+    close();
+  }
+
+  return false;
+}
+
+void pcap::merged_reader::close()
+{
+  if (_M_sources) {
+    delete [] _M_sources;
+    _M_sources = nullptr;
+  }
+
+  _M_nsources = 0;
+
+  if (_M_heap) {
+    free(_M_heap);
+    _M_heap = nullptr;
+  }
+
+  _M_heapsize = 0;
+
+  _M_filesize = 0;
+}
+
+bool pcap::merged_reader::mapped() const
+{
+  for (size_t i = 0; i < _M_nsources; i++) {
+    if (!_M_sources[i].r.mapped()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+const pcap::file_header* pcap::merged_reader::file_header() const
+{
+  return _M_sources[0].r.file_header();
+}
+
+uint32_t pcap::merged_reader::linktype() const
+{
+  return _M_sources[0].r.linktype();
+}
+
+bool pcap::merged_reader::begin(packet& pkt)
+{
+  // Get the first packet of each file.
+  _M_heapsize = 0;
+  for (size_t i = 0; i < _M_nsources; i++) {
+    source& s = _M_sources[i];
+    if (s.r.begin(s.pkt)) {
+      _M_heap[_M_heapsize++] = i;
+    }
+  }
+
+  if (_M_heapsize > 0) {
+    // Build heap.
+    for (size_t i = _M_heapsize / 2; i > 0; i--) {
+      sift_down(i - 1);
+    }
+
+    pkt = _M_sources[_M_heap[0]].pkt;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool pcap::merged_reader::next(packet& pkt)
+{
+  if (_M_heapsize > 0) {
+    // Get the next packet of the file of the last packet (the last packet
+    // stays valid until now).
+    source& s = _M_sources[_M_heap[0]];
+    if (!s.r.next(s.pkt)) {
+      // No more packets in this file.
+      if (--_M_heapsize == 0) {
+        return false;
+      }
+
+      _M_heap[0] = _M_heap[_M_heapsize];
+    }
+
+    sift_down(0);
+
+    pkt = _M_sources[_M_heap[0]].pkt;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool pcap::merged_reader::less(size_t i, size_t j) const
+{
+  const uint64_t t1 = _M_sources[i].pkt.timestamp();
+  const uint64_t t2 = _M_sources[j].pkt.timestamp();
+
+  return ((t1 < t2) || ((t1 == t2) && (i < j)));
+}
+
+void pcap::merged_reader::sift_down(size_t pos)
+{
+  const size_t idx = _M_heap[pos];
+
+  do {
+    size_t child = (2 * pos) + 1;
+    if (child >= _M_heapsize) {
+      break;
+    }
+
+    // Choose the smallest child.
+    if ((child + 1 < _M_heapsize) &&
+        (less(_M_heap[child + 1], _M_heap[child]))) {
+      child++;
+    }
+
+    if (!less(_M_heap[child], idx)) {
+      break;
+    }
+
+    _M_heap[pos] = _M_heap[child];
+    pos = child;
+  } while (true);
+
+  _M_heap[pos] = idx;
+}
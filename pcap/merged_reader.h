@@ -0,0 +1,132 @@
+#ifndef PCAP_MERGED_READER_H
+#define PCAP_MERGED_READER_H
+
+#include <stdlib.h>
+#include "pcap/packet.h"
+
+namespace pcap {
+  class reader;
+
+  // Merged reader.
+  // Opens several PCAP files (through pcap::reader) and returns their
+  // packets ordered by timestamp, using a min-heap with the next packet of
+  // each file. Packets with the same timestamp are returned in the order of
+  // the files.
+  class merged_reader {
+    public:
+      // Constructor.
+      merged_reader() = default;
+
+      // Destructor.
+      ~merged_reader();
+
+      // Enable streaming mode for the files (see pcap::reader::streaming(),
+      // must be called before open()).
+      void streaming(size_t window, bool readahead_thread = false);
+
+      // Enable asynchronous mode for the files (see
+      // pcap::reader::asynchronous(), must be called before open()).
+      void asynchronous(size_t queue_depth, size_t buffer_size);
+
+      // Open PCAP files.
+      bool open(const char* const* filenames, size_t nfiles);
+
+      // Close PCAP files.
+      void close();
+
+      // Get number of files.
+      size_t files() const;
+
+      // Get total size of the files.
+      size_t filesize() const;
+
+      // Are the packets of all the files mapped (see
+      // pcap::reader::mapped())?
+      bool mapped() const;
+
+      // Get PCAP file header (of the first file).
+      const pcap::file_header* file_header() const;
+
+      // Get link-layer header type (of the first file).
+      uint32_t linktype() const;
+
+      // Get first packet.
+      bool begin(packet& pkt);
+
+      // Get next packet.
+      bool next(packet& pkt);
+
+      // Get index of the file of the last packet returned by begin() or
+      // next().
+      size_t file() const;
+
+    private:
+      // Source (one per file).
+      struct source;
+
+      // Sources.
+      source* _M_sources = nullptr;
+      size_t _M_nsources = 0;
+
+      // Min-heap of indices of sources (ordered by the timestamp of their
+      // next packet).
+      size_t* _M_heap = nullptr;
+      size_t _M_heapsize = 0;
+
+      // Total size of the files.
+      size_t _M_filesize = 0;
+
+      // Streaming mode.
+      size_t _M_window = 0;
+      bool _M_readahead_thread = false;
+
+      // Asynchronous mode.
+      size_t _M_queue_depth = 0;
+      size_t _M_buffer_size;
+
+      // Compare sources.
+      bool less(size_t i, size_t j) const;
+
+      // Move down the element at position 'pos' of the heap.
+      void sift_down(size_t pos);
+
+      // Disable copy constructor and assignment operator.
+      merged_reader(const merged_reader&) = delete;
+      merged_reader& operator=(const merged_reader&) = delete;
+  };
+
+  inline merged_reader::~merged_reader()
+  {
+    close();
+  }
+
+  inline void merged_reader::streaming(size_t window, bool readahead_thread)
+  {
+    _M_window = window;
+    _M_readahead_thread = readahead_thread;
+  }
+
+  inline void merged_reader::asynchronous(size_t queue_depth,
+                                          size_t buffer_size)
+  {
+    _M_queue_depth = queue_depth;
+    _M_buffer_size = buffer_size;
+  }
+
+  inline size_t merged_reader::files() const
+  {
+    return _M_nsources;
+  }
+
+  inline size_t merged_reader::filesize() const
+  {
+    return _M_filesize;
+  }
+
+  inline size_t merged_reader::file() const
+  {
+    return _M_heap[0];
+  }
+}
+
+#endif // PCAP_MERGED_READER_H
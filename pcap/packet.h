@@ -16,7 +16,7 @@ namespace pcap {
       // Destructor.
       ~packet() = default;
 
-      // Get packet header.
+      // Get packet header (PCAP files only, not available for pcapng files).
       const pkthdr* header() const;
 
       // Get packet data.
@@ -28,6 +28,10 @@ namespace pcap {
       // Get packet timestamp.
       uint64_t timestamp() const;
 
+      // Get link-layer header type (pcapng files might contain packets of
+      // interfaces with different link-layer header types).
+      uint32_t linktype() const;
+
     private:
       // Pointer to the next packet in the PCAP file.
       const uint8_t* _M_next;
@@ -41,6 +45,9 @@ namespace pcap {
       // Packet timestamp, as the number of microseconds since the Epoch,
       // 1970-01-01 00:00:00 +0000 (UTC).
       uint64_t _M_timestamp;
+
+      // Link-layer header type.
+      uint32_t _M_linktype;
   };
 
   inline const pkthdr* packet::header() const
@@ -64,6 +71,11 @@ namespace pcap {
   {
     return _M_timestamp;
   }
+
+  inline uint32_t packet::linktype() const
+  {
+    return _M_linktype;
+  }
 }
 
 #endif // PCAP_PACKET_H
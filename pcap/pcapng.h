@@ -0,0 +1,85 @@
+#ifndef PCAP_PCAPNG_H
+#define PCAP_PCAPNG_H
+
+#include <stdint.h>
+
+namespace pcap {
+  namespace ng {
+    enum class block_type : uint32_t {
+      interface_description = 0x00000001,
+      packet = 0x00000002, // Obsolete.
+      simple_packet = 0x00000003,
+      enhanced_packet = 0x00000006,
+      section_header = 0x0a0d0d0a
+    };
+
+    static constexpr const uint32_t byte_order_magic = 0x1a2b3c4d;
+
+    static constexpr const uint16_t version_major = 1;
+
+    // Minimum block length (block type + 2 * block total length).
+    static constexpr const uint32_t min_block_length = 12;
+
+    enum class option_code : uint16_t {
+      end_of_options = 0,
+      if_tsresol = 9,
+      if_tsoffset = 14
+    };
+
+    // Default timestamp resolution (10^-6).
+    static constexpr const uint8_t default_tsresol = 6;
+
+    // Block header.
+    struct block_header {
+      uint32_t type;
+      uint32_t total_length;
+    };
+
+    // Section Header Block (after the block header).
+    struct section_header {
+      uint32_t byte_order_magic;
+      uint16_t version_major;
+      uint16_t version_minor;
+      int64_t section_length;
+    } __attribute__((packed));
+
+    // Interface Description Block (after the block header).
+    struct interface_description {
+      uint16_t linktype;
+      uint16_t reserved;
+      uint32_t snaplen;
+    };
+
+    // Enhanced Packet Block (after the block header).
+    struct enhanced_packet {
+      uint32_t interface_id;
+      uint32_t timestamp_high;
+      uint32_t timestamp_low;
+      uint32_t caplen;
+      uint32_t len;
+    };
+
+    // Obsolete Packet Block (after the block header).
+    struct packet {
+      uint16_t interface_id;
+      uint16_t drops_count;
+      uint32_t timestamp_high;
+      uint32_t timestamp_low;
+      uint32_t caplen;
+      uint32_t len;
+    };
+
+    // Simple Packet Block (after the block header).
+    struct simple_packet {
+      uint32_t len;
+    };
+
+    // Option header.
+    struct option_header {
+      uint16_t code;
+      uint16_t length;
+    };
+  }
+}
+
+#endif // PCAP_PCAPNG_H
@@ -4,6 +4,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include "pcap/reader.h"
+#include "pcap/pcapng.h"
 
 bool pcap::reader::open(const char* filename)
 {
@@ -17,10 +18,13 @@ bool pcap::reader::open(const char* filename)
       _M_begin = &reader::stream_begin;
       _M_next = &reader::stream_next;
 
+      _M_format = format::pcap;
+
       return true;
     }
   } else {
-    if (_M_file.open(filename)) {
+    // In asynchronous mode, PCAP files are read as streams.
+    if ((!_M_stream.asynchronous()) && (_M_file.open(filename))) {
       _M_close = &reader::file_close;
       _M_filesize = &reader::file_filesize;
       _M_file_header = &reader::file_file_header;
@@ -28,13 +32,74 @@ bool pcap::reader::open(const char* filename)
       _M_begin = &reader::file_begin;
       _M_next = &reader::file_next;
 
+      _M_format = format::pcap;
+
       return true;
     }
+
+    _M_file.close();
+
+    // pcapng file?
+    if (_M_ngfile.open(filename)) {
+      _M_close = &reader::ngfile_close;
+      _M_filesize = &reader::ngfile_filesize;
+      _M_file_header = &reader::ngfile_file_header;
+      _M_linktype = &reader::ngfile_linktype;
+      _M_begin = &reader::ngfile_begin;
+      _M_next = &reader::ngfile_next;
+
+      _M_format = format::pcapng;
+
+      return true;
+    }
+
+    _M_ngfile.close();
+
+    // Compressed PCAP file, FIFO or PCAP file in asynchronous mode?
+    if (_M_stream.open(filename)) {
+      _M_close = &reader::stream_close;
+      _M_filesize = &reader::stream_filesize;
+      _M_file_header = &reader::stream_file_header;
+      _M_linktype = &reader::stream_linktype;
+      _M_begin = &reader::stream_begin;
+      _M_next = &reader::stream_next;
+
+      _M_format = format::pcap;
+
+      return true;
+    }
+
+    _M_stream.close();
   }
 
   return false;
 }
 
+bool pcap::reader::open(const char* const* filenames, size_t nfiles)
+{
+  // Single file?
+  if (nfiles == 1) {
+    return open(filenames[0]);
+  }
+
+  if (_M_merged.open(filenames, nfiles)) {
+    _M_close = &reader::merged_close;
+    _M_filesize = &reader::merged_filesize;
+    _M_file_header = &reader::merged_file_header;
+    _M_linktype = &reader::merged_linktype;
+    _M_begin = &reader::merged_begin;
+    _M_next = &reader::merged_next;
+
+    _M_format = format::merged;
+
+    return true;
+  }
+
+  _M_merged.close();
+
+  return false;
+}
+
 bool pcap::reader::file::open(const char* filename)
 {
   // If the file exists and is big enough to contain the PCAP file header...
@@ -76,7 +141,8 @@ bool pcap::reader::file::open(const char* filename)
           // Make '_M_end' point to the end.
           _M_end = static_cast<const uint8_t*>(_M_base) + _M_filesize;
 
-          return true;
+          // Start read-ahead (streaming mode).
+          return _M_readahead.start(_M_fd, _M_base, _M_filesize);
         }
       }
     }
@@ -87,6 +153,8 @@ bool pcap::reader::file::open(const char* filename)
 
 void pcap::reader::file::close()
 {
+  _M_readahead.stop();
+
   if (_M_base != MAP_FAILED) {
     munmap(_M_base, _M_filesize);
     _M_base = MAP_FAILED;
@@ -98,31 +166,350 @@ void pcap::reader::file::close()
   }
 }
 
-bool pcap::reader::file::next(packet& pkt)
+size_t pcap::reader::file::split(size_t n, size_t* offsets) const
 {
-  // Make 'data' point to the packet data.
-  const uint8_t* const data = pkt._M_next + sizeof(pkthdr);
+  // Offset of the first packet.
+  offsets[0] = _M_begin - static_cast<const uint8_t*>(_M_base);
 
-  // If the packet data is not beyond the end of the file...
-  if (data <= _M_end) {
-    const pkthdr* const hdr = reinterpret_cast<const pkthdr*>(pkt._M_next);
+  // Size of the packets.
+  const size_t size = _M_filesize - offsets[0];
 
-    // Make 'next' point to the next packet.
-    const uint8_t* const next = data + hdr->caplen;
+  size_t nchunks = 1;
 
-    // If the next packet is not beyond the end of the file...
-    if (next <= _M_end) {
-      pkt._M_data = data;
-      pkt._M_length = hdr->caplen;
+  for (size_t i = 1; i < n; i++) {
+    // Start searching at the split point, after the start of the previous
+    // chunk.
+    const uint8_t* ptr = _M_begin + ((size * i) / n);
+    const uint8_t* const
+      prev = static_cast<const uint8_t*>(_M_base) + offsets[nchunks - 1];
 
-      if (_M_resolution == resolution::microseconds) {
-        pkt._M_timestamp = (hdr->ts.tv_sec * 1000000ull) + hdr->ts.tv_usec;
-      } else {
-        pkt._M_timestamp = (hdr->ts.tv_sec * 1000000ull) +
-                           (hdr->ts.tv_usec / 1000);
+    if (ptr <= prev) {
+      continue;
+    }
+
+    // Search packet boundary.
+    while ((ptr + sizeof(pkthdr) <= _M_end) && (!is_packet(ptr))) {
+      ptr++;
+    }
+
+    // If no packet boundary has been found...
+    if (ptr + sizeof(pkthdr) > _M_end) {
+      break;
+    }
+
+    offsets[nchunks++] = ptr - static_cast<const uint8_t*>(_M_base);
+  }
+
+  offsets[nchunks] = _M_filesize;
+
+  return nchunks;
+}
+
+bool pcap::reader::file::is_packet(const uint8_t* ptr) const
+{
+  const uint32_t max_usec = (_M_resolution == resolution::microseconds) ?
+                              1000000 :
+                              1000000000;
+
+  const pkthdr* prev = nullptr;
+
+  for (unsigned i = 0; i < resync_packets; i++) {
+    // If the packet header is beyond the end of the file...
+    if (ptr + sizeof(pkthdr) > _M_end) {
+      return false;
+    }
+
+    const pkthdr* const hdr = reinterpret_cast<const pkthdr*>(ptr);
+
+    // Check packet header.
+    if ((hdr->ts.tv_usec >= max_usec) ||
+        (hdr->caplen == 0) ||
+        (hdr->caplen > hdr->len) ||
+        (hdr->len > max_packet_length) ||
+        ((prev) &&
+         (((hdr->ts.tv_sec > prev->ts.tv_sec) &&
+           (hdr->ts.tv_sec - prev->ts.tv_sec > max_time_gap)) ||
+          ((hdr->ts.tv_sec < prev->ts.tv_sec) &&
+           (prev->ts.tv_sec - hdr->ts.tv_sec > max_time_gap))))) {
+      return false;
+    }
+
+    // Make 'ptr' point to the next packet.
+    ptr += sizeof(pkthdr) + hdr->caplen;
+
+    // If the packet ends exactly at the end of the file...
+    if (ptr == _M_end) {
+      return true;
+    } else if (ptr > _M_end) {
+      return false;
+    }
+
+    prev = hdr;
+  }
+
+  return true;
+}
+
+bool pcap::reader::ngfile::open(const char* filename)
+{
+  // If the file exists and is big enough to contain a Section Header
+  // Block...
+  struct stat sbuf;
+  if ((stat(filename, &sbuf) == 0) &&
+      (S_ISREG(sbuf.st_mode)) &&
+      (sbuf.st_size >= static_cast<off_t>(ng::min_block_length +
+                                          sizeof(ng::section_header)))) {
+    // Open file for reading.
+    if ((_M_fd = ::open(filename, O_RDONLY)) != -1) {
+      // Map file into memory.
+      if ((_M_base = mmap(nullptr,
+                          sbuf.st_size,
+                          PROT_READ,
+                          MAP_SHARED,
+                          _M_fd,
+                          0)) != MAP_FAILED) {
+        // Save file size.
+        _M_filesize = sbuf.st_size;
+
+        // Make '_M_end' point to the end.
+        _M_end = static_cast<const uint8_t*>(_M_base) + _M_filesize;
+
+        const uint8_t* const base = static_cast<const uint8_t*>(_M_base);
+
+        // The file must start with a Section Header Block.
+        if ((*reinterpret_cast<const uint32_t*>(base) ==
+             static_cast<uint32_t>(ng::block_type::section_header)) &&
+            (process_section_header(base, _M_filesize)) &&
+            (_M_readahead.start(_M_fd, _M_base, _M_filesize))) {
+          // Build PCAP file header (the timestamps are converted to
+          // microseconds).
+          _M_file_header.magic = static_cast<uint32_t>(magic::microseconds);
+          _M_file_header.version_major = version_major;
+          _M_file_header.version_minor = version_minor;
+          _M_file_header.thiszone = 0;
+          _M_file_header.sigfigs = 0;
+          _M_file_header.snaplen = 0;
+          _M_file_header.linktype = 0;
+
+          // Read the blocks up to the first packet, to get the first
+          // interface.
+          packet pkt;
+          begin(pkt);
+
+          if (_M_used > 0) {
+            _M_file_header.snaplen = _M_interfaces[0].snaplen;
+            _M_file_header.linktype = _M_interfaces[0].linktype;
+          }
+
+          return true;
+        }
       }
+    }
+  }
+
+  return false;
+}
+
+void pcap::reader::ngfile::close()
+{
+  _M_readahead.stop();
+
+  if (_M_base != MAP_FAILED) {
+    munmap(_M_base, _M_filesize);
+    _M_base = MAP_FAILED;
+  }
+
+  if (_M_fd != -1) {
+    ::close(_M_fd);
+    _M_fd = -1;
+  }
+
+  if (_M_interfaces) {
+    free(_M_interfaces);
+    _M_interfaces = nullptr;
+  }
+
+  _M_size = 0;
+  _M_used = 0;
+}
+
+bool pcap::reader::ngfile::begin(packet& pkt)
+{
+  // The interfaces are defined again while reading the file.
+  _M_used = 0;
+  _M_timestamp = 0;
+
+  pkt._M_next = static_cast<const uint8_t*>(_M_base);
+
+  _M_readahead.reset(pkt._M_next);
+
+  return next(pkt);
+}
+
+bool pcap::reader::ngfile::next(packet& pkt)
+{
+  const uint8_t* block = pkt._M_next;
+
+  // While there are blocks...
+  while (static_cast<size_t>(_M_end - block) >= ng::min_block_length) {
+    // Section Header Block? (the block type is a palindrome, so it can be
+    // checked before knowing the byte order of the section)
+    if ((*reinterpret_cast<const uint32_t*>(block) ==
+         static_cast<uint32_t>(ng::block_type::section_header)) &&
+        (!process_section_header(block, _M_end - block))) {
+      return false;
+    }
+
+    // Get block total length.
+    const uint32_t len = get32(block + 4);
+
+    // Sanity check.
+    if ((len < ng::min_block_length) ||
+        ((len & 0x03) != 0) ||
+        (len > static_cast<size_t>(_M_end - block))) {
+      return false;
+    }
+
+    // Make 'body' point to the block body.
+    const uint8_t* const body = block + sizeof(ng::block_header);
+
+    // Length of the block body.
+    const uint32_t bodylen = len - ng::min_block_length;
+
+    switch (static_cast<ng::block_type>(get32(block))) {
+      case ng::block_type::interface_description:
+        if (!process_interface_description(block, len)) {
+          return false;
+        }
+
+        break;
+      case ng::block_type::enhanced_packet:
+        if (bodylen >= sizeof(ng::enhanced_packet)) {
+          const ng::enhanced_packet* const
+            epb = reinterpret_cast<const ng::enhanced_packet*>(body);
+
+          const uint32_t id = get32(&epb->interface_id);
+          const uint32_t caplen = get32(&epb->caplen);
+
+          if ((id < _M_used) &&
+              (caplen <= bodylen - sizeof(ng::enhanced_packet))) {
+            const interface& iface = _M_interfaces[id];
+
+            fill(pkt,
+                 body + sizeof(ng::enhanced_packet),
+                 caplen,
+                 iface,
+                 timestamp(iface,
+                           get32(&epb->timestamp_high),
+                           get32(&epb->timestamp_low)));
+
+            pkt._M_next = block + len;
+
+            _M_readahead.advance(pkt._M_next);
+
+            return true;
+          }
+        }
+
+        return false;
+      case ng::block_type::packet:
+        if (bodylen >= sizeof(ng::packet)) {
+          const ng::packet* const
+            pb = reinterpret_cast<const ng::packet*>(body);
+
+          const uint16_t id = get16(&pb->interface_id);
+          const uint32_t caplen = get32(&pb->caplen);
+
+          if ((id < _M_used) && (caplen <= bodylen - sizeof(ng::packet))) {
+            const interface& iface = _M_interfaces[id];
+
+            fill(pkt,
+                 body + sizeof(ng::packet),
+                 caplen,
+                 iface,
+                 timestamp(iface,
+                           get32(&pb->timestamp_high),
+                           get32(&pb->timestamp_low)));
+
+            pkt._M_next = block + len;
+
+            _M_readahead.advance(pkt._M_next);
+
+            return true;
+          }
+        }
+
+        return false;
+      case ng::block_type::simple_packet:
+        // The Simple Packet Blocks belong to the first interface.
+        if ((_M_used > 0) && (bodylen >= sizeof(ng::simple_packet))) {
+          const interface& iface = _M_interfaces[0];
+
+          // The captured length is the original length, limited by the
+          // snapshot length and by the block length.
+          uint32_t caplen = get32(body);
+
+          if ((iface.snaplen > 0) && (caplen > iface.snaplen)) {
+            caplen = iface.snaplen;
+          }
+
+          if (caplen > bodylen - sizeof(ng::simple_packet)) {
+            caplen = bodylen - sizeof(ng::simple_packet);
+          }
+
+          // The block has no timestamp: use the timestamp of the last
+          // packet.
+          fill(pkt,
+               body + sizeof(ng::simple_packet),
+               caplen,
+               iface,
+               _M_timestamp);
+
+          pkt._M_next = block + len;
+
+          _M_readahead.advance(pkt._M_next);
+
+          return true;
+        }
+
+        return false;
+      default:
+        // Skip block.
+        ;
+    }
+
+    // Make 'block' point to the next block.
+    block += len;
+  }
+
+  return false;
+}
 
-      pkt._M_next = next;
+bool pcap::reader::ngfile::process_section_header(const uint8_t* block,
+                                                  size_t len)
+{
+  // If the block is big enough...
+  if (len >= ng::min_block_length + sizeof(ng::section_header)) {
+    const ng::section_header* const
+      shb = reinterpret_cast<const ng::section_header*>(
+              block + sizeof(ng::block_header)
+            );
+
+    // Check byte order.
+    if (shb->byte_order_magic == ng::byte_order_magic) {
+      _M_swap = false;
+    } else if (shb->byte_order_magic ==
+               __builtin_bswap32(ng::byte_order_magic)) {
+      _M_swap = true;
+    } else {
+      return false;
+    }
+
+    // Version 1.x?
+    if (get16(&shb->version_major) == ng::version_major) {
+      // The interfaces of the previous section (if any) don't apply to the
+      // new section.
+      _M_used = 0;
 
       return true;
     }
@@ -131,21 +518,388 @@ bool pcap::reader::file::next(packet& pkt)
   return false;
 }
 
+bool pcap::reader::ngfile::process_interface_description(
+  const uint8_t* block,
+  uint32_t len
+)
+{
+  // If the block is big enough...
+  if (len >= ng::min_block_length + sizeof(ng::interface_description)) {
+    // If the array of interfaces is full...
+    if (_M_used == _M_size) {
+      const size_t size = (_M_size > 0) ? _M_size * 2 : 8;
+
+      interface* interfaces = static_cast<interface*>(
+                                realloc(_M_interfaces,
+                                        size * sizeof(interface))
+                              );
+
+      if (!interfaces) {
+        return false;
+      }
+
+      _M_interfaces = interfaces;
+      _M_size = size;
+    }
+
+    const ng::interface_description* const
+      idb = reinterpret_cast<const ng::interface_description*>(
+              block + sizeof(ng::block_header)
+            );
+
+    interface& iface = _M_interfaces[_M_used];
+
+    iface.linktype = get16(&idb->linktype);
+    iface.snaplen = get32(&idb->snaplen);
+    iface.binary = false;
+    iface.exponent = ng::default_tsresol;
+    iface.offset = 0;
+
+    // Process options.
+    const uint8_t* opt = block +
+                         sizeof(ng::block_header) +
+                         sizeof(ng::interface_description);
+
+    const uint8_t* const end = block + len - sizeof(uint32_t);
+
+    while (opt + sizeof(ng::option_header) <= end) {
+      const uint16_t code = get16(opt);
+      const uint16_t optlen = get16(opt + 2);
+
+      const uint8_t* const value = opt + sizeof(ng::option_header);
+
+      if ((code == static_cast<uint16_t>(ng::option_code::end_of_options)) ||
+          (value + optlen > end)) {
+        break;
+      }
+
+      switch (static_cast<ng::option_code>(code)) {
+        case ng::option_code::if_tsresol:
+          if (optlen >= 1) {
+            iface.binary = ((*value & 0x80) != 0);
+            iface.exponent = *value & 0x7f;
+
+            // Sanity check.
+            if (iface.exponent > (iface.binary ? 63 : 19)) {
+              return false;
+            }
+          }
+
+          break;
+        case ng::option_code::if_tsoffset:
+          if (optlen >= sizeof(int64_t)) {
+            uint64_t offset;
+            memcpy(&offset, value, sizeof(uint64_t));
+
+            if (_M_swap) {
+              offset = __builtin_bswap64(offset);
+            }
+
+            iface.offset = static_cast<int64_t>(offset) * 1000000ll;
+          }
+
+          break;
+        default:
+          ;
+      }
+
+      // Options are padded to 32 bits.
+      opt = value + ((optlen + 3) & ~3);
+    }
+
+    _M_used++;
+
+    return true;
+  }
+
+  return false;
+}
+
+uint64_t pcap::reader::ngfile::timestamp(const interface& iface,
+                                         uint32_t high,
+                                         uint32_t low) const
+{
+  static constexpr const uint64_t powers_of_ten[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull
+  };
+
+  const uint64_t ts = (static_cast<uint64_t>(high) << 32) | low;
+
+  uint64_t t;
+
+  if (!iface.binary) {
+    if (iface.exponent == 6) {
+      // Microseconds.
+      t = ts;
+    } else if (iface.exponent < 6) {
+      t = ts * powers_of_ten[6 - iface.exponent];
+    } else if (iface.exponent - 6 < 14) {
+      t = ts / powers_of_ten[iface.exponent - 6];
+    } else {
+      t = 0;
+    }
+  } else {
+    // Units of 2^-exponent seconds.
+    unsigned exponent = iface.exponent;
+    uint64_t fraction = ts & ((static_cast<uint64_t>(1) << exponent) - 1);
+
+    // Avoid overflows when converting the fraction.
+    if (exponent > 44) {
+      fraction >>= (exponent - 44);
+      exponent = 44;
+    }
+
+    t = ((ts >> iface.exponent) * 1000000ull) +
+        ((fraction * 1000000ull) >> exponent);
+  }
+
+  return t + iface.offset;
+}
+
+bool pcap::reader::readahead::start(int fd, const void* base, size_t size)
+{
+  // If the streaming mode is not enabled...
+  if (_M_window == 0) {
+    return true;
+  }
+
+  _M_fd = fd;
+  _M_base = static_cast<const uint8_t*>(base);
+  _M_size = size;
+
+  _M_step = _M_window / 4;
+
+  _M_released = 0;
+  _M_prefetched = 0;
+
+  // The file is read sequentially.
+  madvise(const_cast<void*>(base), size, MADV_SEQUENTIAL);
+
+  // Start helper thread (if needed).
+  if (_M_use_thread) {
+    _M_cursor = 0;
+    _M_stop = false;
+
+    pthread_mutex_init(&_M_mutex, nullptr);
+    pthread_cond_init(&_M_cond, nullptr);
+
+    if (pthread_create(&_M_thread, nullptr, run, this) != 0) {
+      pthread_cond_destroy(&_M_cond);
+      pthread_mutex_destroy(&_M_mutex);
+
+      _M_base = nullptr;
+
+      return false;
+    }
+
+    _M_running = true;
+  }
+
+  move(0);
+
+  return true;
+}
+
+void pcap::reader::readahead::stop()
+{
+  // Stop helper thread.
+  if (_M_running) {
+    pthread_mutex_lock(&_M_mutex);
+    _M_stop = true;
+    pthread_cond_signal(&_M_cond);
+    pthread_mutex_unlock(&_M_mutex);
+
+    pthread_join(_M_thread, nullptr);
+
+    pthread_cond_destroy(&_M_cond);
+    pthread_mutex_destroy(&_M_mutex);
+
+    _M_running = false;
+  }
+
+  _M_base = nullptr;
+  _M_mark = UINTPTR_MAX;
+}
+
+void pcap::reader::readahead::reset(const uint8_t* ptr)
+{
+  if (_M_base) {
+    const size_t offset = ptr - _M_base;
+
+    // The pages from the new position have to be read ahead again.
+    if (offset < _M_released) {
+      _M_released = offset & ~(static_cast<size_t>(getpagesize()) - 1);
+    }
+
+    _M_prefetched = offset;
+
+    move(offset);
+  }
+}
+
+void pcap::reader::readahead::move(size_t offset)
+{
+  const size_t pagemask = static_cast<size_t>(getpagesize()) - 1;
+
+  // Release the pages behind the cursor (the pages of the last step are
+  // kept, the last packets might still be in use).
+  if (offset > _M_step) {
+    const size_t end = (offset - _M_step) & ~pagemask;
+
+    if (end > _M_released) {
+      madvise(const_cast<uint8_t*>(_M_base) + _M_released,
+              end - _M_released,
+              MADV_DONTNEED);
+
+      // Drop the pages from the page cache too.
+      posix_fadvise(_M_fd, _M_released, end - _M_released, POSIX_FADV_DONTNEED);
+
+      _M_released = end;
+    }
+  }
+
+  // Read ahead.
+  if (_M_use_thread) {
+    pthread_mutex_lock(&_M_mutex);
+    _M_cursor = offset;
+    pthread_cond_signal(&_M_cond);
+    pthread_mutex_unlock(&_M_mutex);
+  } else {
+    const size_t end = (offset + _M_window < _M_size) ?
+                         offset + _M_window :
+                         _M_size;
+
+    if (end > _M_prefetched) {
+      const size_t begin = ((_M_prefetched > offset) ?
+                              _M_prefetched :
+                              offset) & ~pagemask;
+
+      madvise(const_cast<uint8_t*>(_M_base) + begin,
+              end - begin,
+              MADV_WILLNEED);
+
+      _M_prefetched = end;
+    }
+  }
+
+  _M_mark = reinterpret_cast<uintptr_t>(_M_base + offset + _M_step);
+}
+
+void* pcap::reader::readahead::run(void* arg)
+{
+  readahead* r = static_cast<readahead*>(arg);
+
+  // Offset up to which the pages have been read ahead.
+  size_t prefetched = 0;
+
+  pthread_mutex_lock(&r->_M_mutex);
+
+  while (!r->_M_stop) {
+    const size_t end = (r->_M_cursor + r->_M_window < r->_M_size) ?
+                         r->_M_cursor + r->_M_window :
+                         r->_M_size;
+
+    // If the cursor has jumped...
+    if ((prefetched < r->_M_cursor) || (prefetched > end)) {
+      prefetched = r->_M_cursor;
+    }
+
+    if (prefetched < end) {
+      // Read ahead (one step at a time).
+      const size_t len = (end - prefetched < r->_M_step) ?
+                           end - prefetched :
+                           r->_M_step;
+
+      pthread_mutex_unlock(&r->_M_mutex);
+
+      ::readahead(r->_M_fd, prefetched, len);
+
+      pthread_mutex_lock(&r->_M_mutex);
+
+      prefetched += len;
+    } else {
+      pthread_cond_wait(&r->_M_cond, &r->_M_mutex);
+    }
+  }
+
+  pthread_mutex_unlock(&r->_M_mutex);
+
+  return nullptr;
+}
+
 bool pcap::reader::stream::open(int fd)
+{
+  _M_fd = fd;
+
+  // Asynchronous mode? (if io_uring is not available, blocking reads are
+  // used)
+  if (_M_queue_depth > 0) {
+    _M_async.open(fd, _M_queue_depth, _M_async_buffer_size);
+  }
+
+  return init();
+}
+
+bool pcap::reader::stream::open(const char* filename)
+{
+  struct stat sbuf;
+  if (stat(filename, &sbuf) == 0) {
+    if (S_ISREG(sbuf.st_mode)) {
+      _M_filesize = sbuf.st_size;
+
+      // Compressed file?
+      if (_M_decompressor.open(filename)) {
+        return init();
+      }
+
+      // Uncompressed files are only read as streams in asynchronous mode.
+      if (_M_queue_depth == 0) {
+        return false;
+      }
+    } else if (!S_ISFIFO(sbuf.st_mode)) {
+      return false;
+    }
+
+    // Open file for reading.
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd != -1) {
+      _M_close_fd = true;
+
+      return open(fd);
+    }
+  }
+
+  return false;
+}
+
+bool pcap::reader::stream::init()
 {
   uint8_t* buf = reinterpret_cast<uint8_t*>(&_M_file_header);
   size_t left = sizeof(pcap::file_header);
 
   // Read PCAP file header.
   do {
-    const ssize_t ret = ::read(fd, buf, left);
+    const ssize_t ret = input(buf, left);
     if (ret > 0) {
       if ((left -= ret) == 0) {
         break;
       } else {
         buf += ret;
       }
-    } else if ((ret == 0) || (errno != EINTR)) {
+    } else {
       return false;
     }
   } while (true);
@@ -170,8 +924,6 @@ bool pcap::reader::stream::open(int fd)
       _M_bufend = _M_buf + buffer_size;
       _M_dataend = _M_buf;
 
-      _M_fd = fd;
-
       return true;
     }
   }
@@ -214,6 +966,8 @@ bool pcap::reader::stream::next(packet& pkt)
                              (hdr->ts.tv_usec / 1000);
         }
 
+        pkt._M_linktype = _M_file_header.linktype;
+
         // Make '_M_pkt' point to the next packet.
         _M_pkt += len;
 
@@ -245,13 +999,31 @@ bool pcap::reader::stream::read()
     _M_pkt = _M_buf;
   }
 
+  const ssize_t ret = input(_M_dataend, _M_bufend - _M_dataend);
+  if (ret > 0) {
+    _M_dataend += ret;
+    return true;
+  }
+
+  return false;
+}
+
+ssize_t pcap::reader::stream::input(void* buf, size_t count)
+{
+  // Compressed file?
+  if (_M_decompressor.open()) {
+    return _M_decompressor.read(buf, count);
+  }
+
+  // Asynchronous mode?
+  if (_M_async.open()) {
+    return _M_async.read(buf, count);
+  }
+
   do {
-    const ssize_t ret = ::read(_M_fd, _M_dataend, _M_bufend - _M_dataend);
-    if (ret > 0) {
-      _M_dataend += ret;
-      return true;
-    } else if ((ret == 0) || (errno != EINTR)) {
-      return false;
+    const ssize_t ret = ::read(_M_fd, buf, count);
+    if ((ret >= 0) || (errno != EINTR)) {
+      return ret;
     }
   } while (true);
 }
@@ -2,32 +2,97 @@
 #define PCAP_READER_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include "pcap/packet.h"
+#include "pcap/merged_reader.h"
+#include "fs/decompressor.h"
+#include "fs/async_reader.h"
 
 namespace pcap {
-  // PCAP reader.
+  // PCAP reader (PCAP and pcapng files).
+  // PCAP files compressed with gzip, zstd or lz4 are decompressed on the fly
+  // by a background thread (see fs::decompressor).
+  // The standard input and FIFOs are read as PCAP streams, with blocking
+  // reads or, in asynchronous mode, with io_uring (see fs::async_reader).
   class reader {
     public:
+      // File format.
+      enum class format {
+        pcap,
+        pcapng,
+        merged
+      };
+
+      // Default read-ahead window (64 MiB).
+      static constexpr const size_t
+             default_window = static_cast<size_t>(64) << 20;
+
+      // Minimum read-ahead window (1 MiB).
+      static constexpr const size_t
+             min_window = static_cast<size_t>(1) << 20;
+
       // Constructor.
       reader() = default;
 
       // Destructor.
       ~reader() = default;
 
+      // Enable streaming mode (mapped files, must be called before open()).
+      // The kernel is advised that the file is read sequentially, the next
+      // 'window' bytes are read ahead (from a helper thread if
+      // 'readahead_thread' is true) and the pages behind the cursor are
+      // released, so the resident memory stays around twice the window
+      // instead of growing up to the file size. The packets behind the
+      // cursor are still valid (they are read again from the file when
+      // accessed).
+      void streaming(size_t window = default_window,
+                     bool readahead_thread = false);
+
+      // Enable asynchronous mode (must be called before open()).
+      // The PCAP streams are read with io_uring, with up to 'queue_depth'
+      // reads of 'buffer_size' bytes in flight, so that the reads overlap
+      // with the parsing. Uncompressed PCAP files are also read as streams
+      // instead of being mapped (useful on FUSE and network file systems,
+      // where page faults stall the parsing), so split() is not available
+      // for them. If io_uring is not available, blocking reads are used.
+      void asynchronous(size_t queue_depth = fs::async_reader::
+                                             default_queue_depth,
+                        size_t buffer_size = fs::async_reader::
+                                             default_buffer_size);
+
       // Open PCAP file.
       bool open(const char* filename);
 
+      // Open several PCAP files whose packets are merged by timestamp (see
+      // pcap::merged_reader).
+      bool open(const char* const* filenames, size_t nfiles);
+
       // Close PCAP file.
       void close();
 
       // Get file size.
       size_t filesize() const;
 
-      // Get PCAP file header.
+      // Get file format.
+      format file_format() const;
+
+      // Are the packets mapped (valid until the file is closed)?
+      // The packets of the PCAP streams (compressed PCAP files, standard
+      // input, FIFOs and, in asynchronous mode, PCAP files) are read into a
+      // buffer which is reused: they are only valid until the next packet
+      // is read.
+      bool mapped() const;
+
+      // Get PCAP file header (for pcapng files, built from the first section
+      // header and the first interface; for merged files, of the first
+      // file).
       const pcap::file_header* file_header() const;
 
-      // Get link-layer header type.
+      // Get link-layer header type (for pcapng files, link-layer header type
+      // of the first interface).
       uint32_t linktype() const;
 
       // Get first packet.
@@ -36,7 +101,110 @@ namespace pcap {
       // Get next packet.
       bool next(packet& pkt);
 
+      // Split the packets in up to 'n' chunks (PCAP files only).
+      // 'offsets' (n + 1 entries) receives the offset of the first packet of
+      // each chunk followed by the file size. Each chunk starts at a packet
+      // boundary, found by validating the packet headers following the
+      // split point.
+      // Returns the number of chunks (0: not supported).
+      size_t split(size_t n, size_t* offsets) const;
+
+      // Get first packet at offset (PCAP files only, 'offset' must be a
+      // packet boundary, see split()).
+      bool begin(packet& pkt, size_t offset);
+
+      // Get offset of the packet following 'pkt' (PCAP files only).
+      size_t offset(const packet& pkt) const;
+
+      // Call 'fn' for every packet (bool fn(const packet& pkt), returns
+      // false to stop).
+      // The backend is selected once, so the loop calls it directly (the
+      // one of the mapped PCAP files is inlined) instead of through the
+      // member function pointers used by begin() and next().
+      // Returns false if 'fn' has stopped the iteration.
+      template<typename Function>
+      bool for_each(Function fn);
+
     private:
+      // Read-ahead and release of the pages of a mapped file.
+      class readahead {
+        public:
+          // Constructor.
+          readahead() = default;
+
+          // Destructor.
+          ~readahead();
+
+          // Set window (0: disabled).
+          void window(size_t window, bool thread);
+
+          // Start (the file 'fd' of size 'size' is mapped at 'base').
+          bool start(int fd, const void* base, size_t size);
+
+          // Stop.
+          void stop();
+
+          // The cursor has moved to 'ptr'.
+          void advance(const uint8_t* ptr);
+
+          // The cursor has been moved to 'ptr' (it might have moved
+          // backwards).
+          void reset(const uint8_t* ptr);
+
+        private:
+          // File descriptor.
+          int _M_fd;
+
+          // Pointer to the mapped area (nullptr: not started).
+          const uint8_t* _M_base = nullptr;
+
+          // Size of the file.
+          size_t _M_size;
+
+          // Window (0: disabled).
+          size_t _M_window = 0;
+
+          // The window is advanced every '_M_step' bytes.
+          size_t _M_step;
+
+          // Next position at which the window has to be advanced.
+          uintptr_t _M_mark = UINTPTR_MAX;
+
+          // Offset up to which the pages have been released.
+          size_t _M_released;
+
+          // Offset up to which the pages have been read ahead.
+          size_t _M_prefetched;
+
+          // Read ahead from a helper thread?
+          bool _M_use_thread = false;
+
+          // Helper thread.
+          pthread_t _M_thread;
+          bool _M_running = false;
+
+          // Mutex and condition variable protecting '_M_cursor' and
+          // '_M_stop'.
+          pthread_mutex_t _M_mutex;
+          pthread_cond_t _M_cond;
+
+          // Offset of the cursor (read by the helper thread).
+          size_t _M_cursor;
+
+          // Has the helper thread to stop?
+          bool _M_stop;
+
+          // Move window.
+          void move(size_t offset);
+
+          // Helper thread.
+          static void* run(void* arg);
+
+          // Disable copy constructor and assignment operator.
+          readahead(const readahead&) = delete;
+          readahead& operator=(const readahead&) = delete;
+      };
+
       // PCAP file.
       class file {
         public:
@@ -67,7 +235,30 @@ namespace pcap {
           // Get next packet.
           bool next(packet& pkt);
 
+          // Split the packets in up to 'n' chunks.
+          size_t split(size_t n, size_t* offsets) const;
+
+          // Get first packet at offset.
+          bool begin(packet& pkt, size_t offset);
+
+          // Get offset of the packet following 'pkt'.
+          size_t offset(const packet& pkt) const;
+
+          // Set read-ahead window (0: disabled).
+          void streaming(size_t window, bool thread);
+
         private:
+          // Number of consecutive packet headers which have to be valid to
+          // accept a split point.
+          static constexpr const unsigned resync_packets = 8;
+
+          // Maximum packet length accepted when searching for a split point.
+          static constexpr const uint32_t max_packet_length = 256 * 1024;
+
+          // Maximum difference between the timestamps (in seconds) of two
+          // consecutive packets when searching for a split point.
+          static constexpr const uint32_t max_time_gap = 3600;
+
           // File descriptor.
           int _M_fd = -1;
 
@@ -86,11 +277,130 @@ namespace pcap {
           // Resolution.
           resolution _M_resolution;
 
+          // Read-ahead.
+          readahead _M_readahead;
+
+          // Is there a valid packet header at 'ptr'? (the following packet
+          // headers are also checked)
+          bool is_packet(const uint8_t* ptr) const;
+
           // Disable copy constructor and assignment operator.
           file(const file&) = delete;
           file& operator=(const file&) = delete;
       };
 
+      // pcapng file.
+      // The packets point to the mapped file (Enhanced, Simple and obsolete
+      // Packet Blocks); the timestamps are converted to microseconds using
+      // the resolution and the offset of their interface.
+      class ngfile {
+        public:
+          // Constructor.
+          ngfile() = default;
+
+          // Destructor.
+          ~ngfile();
+
+          // Open pcapng file.
+          bool open(const char* filename);
+
+          // Close pcapng file.
+          void close();
+
+          // Get file size.
+          size_t filesize() const;
+
+          // Get PCAP file header.
+          const pcap::file_header* file_header() const;
+
+          // Get link-layer header type.
+          uint32_t linktype() const;
+
+          // Get first packet.
+          bool begin(packet& pkt);
+
+          // Get next packet.
+          bool next(packet& pkt);
+
+          // Set read-ahead window (0: disabled).
+          void streaming(size_t window, bool thread);
+
+        private:
+          // Interface.
+          struct interface {
+            // Link-layer header type.
+            uint32_t linktype;
+
+            // Snapshot length (0: no limit).
+            uint32_t snaplen;
+
+            // Timestamp resolution (if_tsresol): 10^-exponent or
+            // 2^-exponent.
+            bool binary;
+            uint8_t exponent;
+
+            // Timestamp offset (if_tsoffset, microseconds).
+            int64_t offset;
+          };
+
+          // File descriptor.
+          int _M_fd = -1;
+
+          // Pointer to the mapped area.
+          void* _M_base = MAP_FAILED;
+
+          // Size of the file.
+          size_t _M_filesize;
+
+          // Pointer to the end.
+          const uint8_t* _M_end;
+
+          // PCAP file header.
+          pcap::file_header _M_file_header;
+
+          // Byte order of the current section differs from the host's?
+          bool _M_swap;
+
+          // Interfaces of the current section.
+          interface* _M_interfaces = nullptr;
+          size_t _M_size = 0;
+          size_t _M_used = 0;
+
+          // Timestamp of the last packet (the Simple Packet Blocks have no
+          // timestamp).
+          uint64_t _M_timestamp;
+
+          // Read-ahead.
+          readahead _M_readahead;
+
+          // Read 16-bit and 32-bit values in the byte order of the section.
+          uint16_t get16(const void* p) const;
+          uint32_t get32(const void* p) const;
+
+          // Process Section Header Block.
+          bool process_section_header(const uint8_t* block, size_t len);
+
+          // Process Interface Description Block.
+          bool process_interface_description(const uint8_t* block,
+                                             uint32_t len);
+
+          // Convert timestamp to microseconds.
+          uint64_t timestamp(const interface& iface,
+                             uint32_t high,
+                             uint32_t low) const;
+
+          // Fill packet.
+          void fill(packet& pkt,
+                    const uint8_t* data,
+                    uint32_t caplen,
+                    const interface& iface,
+                    uint64_t timestamp);
+
+          // Disable copy constructor and assignment operator.
+          ngfile(const ngfile&) = delete;
+          ngfile& operator=(const ngfile&) = delete;
+      };
+
       // PCAP stream.
       class stream {
         public:
@@ -103,6 +413,10 @@ namespace pcap {
           // Open PCAP stream.
           bool open(int fd);
 
+          // Open compressed PCAP file, FIFO or, in asynchronous mode, PCAP
+          // file.
+          bool open(const char* filename);
+
           // Close PCAP stream.
           void close();
 
@@ -121,6 +435,12 @@ namespace pcap {
           // Get next packet.
           bool next(packet& pkt);
 
+          // Set asynchronous mode (queue depth 0: disabled).
+          void asynchronous(size_t queue_depth, size_t buffer_size);
+
+          // Is the asynchronous mode enabled?
+          bool asynchronous() const;
+
         private:
           // Buffer size.
           static constexpr const size_t buffer_size = 256 * 1024;
@@ -128,6 +448,22 @@ namespace pcap {
           // File descriptor.
           int _M_fd = -1;
 
+          // Has the file descriptor to be closed?
+          bool _M_close_fd = false;
+
+          // Size of the file (0 for the standard input and FIFOs).
+          size_t _M_filesize = 0;
+
+          // Asynchronous reader.
+          fs::async_reader _M_async;
+
+          // Asynchronous mode.
+          size_t _M_queue_depth = 0;
+          size_t _M_async_buffer_size;
+
+          // Decompressor (compressed PCAP files).
+          fs::decompressor _M_decompressor;
+
           // PCAP file header.
           pcap::file_header _M_file_header;
 
@@ -146,9 +482,15 @@ namespace pcap {
           // Resolution.
           resolution _M_resolution;
 
+          // Read PCAP file header and create buffer.
+          bool init();
+
           // Read from the stream.
           bool read();
 
+          // Read from the file descriptor or the decompressor.
+          ssize_t input(void* buf, size_t count);
+
           // Disable copy constructor and assignment operator.
           stream(const stream&) = delete;
           stream& operator=(const stream&) = delete;
@@ -157,56 +499,101 @@ namespace pcap {
       // PCAP file.
       file _M_file;
 
+      // pcapng file.
+      ngfile _M_ngfile;
+
       // PCAP stream.
       stream _M_stream;
 
+      // Merged PCAP files.
+      merged_reader _M_merged;
+
+      // File format.
+      format _M_format;
+
       // Close PCAP file.
       typedef void (reader::*fnclose)();
       fnclose _M_close;
 
       void file_close();
+      void ngfile_close();
       void stream_close();
+      void merged_close();
 
       // Get file size.
       typedef size_t (reader::*fnfilesize)() const;
       fnfilesize _M_filesize;
 
       size_t file_filesize() const;
+      size_t ngfile_filesize() const;
       size_t stream_filesize() const;
+      size_t merged_filesize() const;
 
       // Get PCAP file header.
       typedef const pcap::file_header* (reader::*fnfile_header)() const;
       fnfile_header _M_file_header;
 
       const pcap::file_header* file_file_header() const;
+      const pcap::file_header* ngfile_file_header() const;
       const pcap::file_header* stream_file_header() const;
+      const pcap::file_header* merged_file_header() const;
 
       // Get link-layer header type.
       typedef uint32_t (reader::*fnlinktype)() const;
       fnlinktype _M_linktype;
 
       uint32_t file_linktype() const;
+      uint32_t ngfile_linktype() const;
       uint32_t stream_linktype() const;
+      uint32_t merged_linktype() const;
 
       // Get first packet.
       typedef bool (reader::*fnbegin)(packet&);
       fnbegin _M_begin;
 
       bool file_begin(packet& pkt);
+      bool ngfile_begin(packet& pkt);
       bool stream_begin(packet& pkt);
+      bool merged_begin(packet& pkt);
 
       // Get next packet.
       typedef bool (reader::*fnnext)(packet&);
       fnnext _M_next;
 
       bool file_next(packet& pkt);
+      bool ngfile_next(packet& pkt);
       bool stream_next(packet& pkt);
+      bool merged_next(packet& pkt);
+
+      // Is it a (mapped) PCAP file?
+      bool is_file() const;
+
+      // Call 'fn' for every packet of 'source'.
+      template<typename Source, typename Function>
+      static bool for_each(Source& source, Function& fn);
 
       // Disable copy constructor and assignment operator.
       reader(const reader&) = delete;
       reader& operator=(const reader&) = delete;
   };
 
+  inline void reader::streaming(size_t window, bool readahead_thread)
+  {
+    if ((window > 0) && (window < min_window)) {
+      window = min_window;
+    }
+
+    _M_file.streaming(window, readahead_thread);
+    _M_ngfile.streaming(window, readahead_thread);
+    _M_merged.streaming(window, readahead_thread);
+  }
+
+  inline void reader::asynchronous(size_t queue_depth, size_t buffer_size)
+  {
+    _M_stream.asynchronous(queue_depth, buffer_size);
+    _M_merged.asynchronous(queue_depth, buffer_size);
+  }
+
   inline void reader::close()
   {
     (this->*_M_close)();
@@ -217,6 +604,18 @@ namespace pcap {
     return (this->*_M_filesize)();
   }
 
+  inline reader::format reader::file_format() const
+  {
+    return _M_format;
+  }
+
+  inline bool reader::mapped() const
+  {
+    return (_M_format == format::merged) ?
+             _M_merged.mapped() :
+             (_M_next != &reader::stream_next);
+  }
+
   inline const pcap::file_header* reader::file_header() const
   {
     return (this->*_M_file_header)();
@@ -237,6 +636,39 @@ namespace pcap {
     return (this->*_M_next)(pkt);
   }
 
+  inline size_t reader::split(size_t n, size_t* offsets) const
+  {
+    return is_file() ? _M_file.split(n, offsets) : 0;
+  }
+
+  inline bool reader::begin(packet& pkt, size_t offset)
+  {
+    return (is_file()) && (_M_file.begin(pkt, offset));
+  }
+
+  inline size_t reader::offset(const packet& pkt) const
+  {
+    return _M_file.offset(pkt);
+  }
+
+  inline reader::readahead::~readahead()
+  {
+    stop();
+  }
+
+  inline void reader::readahead::window(size_t window, bool thread)
+  {
+    _M_window = window;
+    _M_use_thread = thread;
+  }
+
+  inline void reader::readahead::advance(const uint8_t* ptr)
+  {
+    if (reinterpret_cast<uintptr_t>(ptr) >= _M_mark) {
+      move(ptr - _M_base);
+    }
+  }
+
   inline reader::file::~file()
   {
     close();
@@ -261,9 +693,123 @@ namespace pcap {
   {
     pkt._M_next = _M_begin;
 
+    _M_readahead.reset(_M_begin);
+
     return next(pkt);
   }
 
+  inline bool reader::file::next(packet& pkt)
+  {
+    // Make 'data' point to the packet data.
+    const uint8_t* const data = pkt._M_next + sizeof(pkthdr);
+
+    // If the packet data is not beyond the end of the file...
+    if (data <= _M_end) {
+      const pkthdr* const hdr = reinterpret_cast<const pkthdr*>(pkt._M_next);
+
+      // Make 'next' point to the next packet.
+      const uint8_t* const next = data + hdr->caplen;
+
+      // If the next packet is not beyond the end of the file...
+      if (next <= _M_end) {
+        pkt._M_data = data;
+        pkt._M_length = hdr->caplen;
+
+        if (_M_resolution == resolution::microseconds) {
+          pkt._M_timestamp = (hdr->ts.tv_sec * 1000000ull) + hdr->ts.tv_usec;
+        } else {
+          pkt._M_timestamp = (hdr->ts.tv_sec * 1000000ull) +
+                             (hdr->ts.tv_usec / 1000);
+        }
+
+        pkt._M_linktype = file_header()->linktype;
+
+        pkt._M_next = next;
+
+        _M_readahead.advance(next);
+
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  inline bool reader::file::begin(packet& pkt, size_t offset)
+  {
+    // If the offset is inside the file...
+    if ((offset >= sizeof(pcap::file_header)) && (offset < _M_filesize)) {
+      pkt._M_next = static_cast<const uint8_t*>(_M_base) + offset;
+
+      _M_readahead.reset(pkt._M_next);
+
+      return next(pkt);
+    }
+
+    return false;
+  }
+
+  inline size_t reader::file::offset(const packet& pkt) const
+  {
+    return pkt._M_next - static_cast<const uint8_t*>(_M_base);
+  }
+
+  inline void reader::file::streaming(size_t window, bool thread)
+  {
+    _M_readahead.window(window, thread);
+  }
+
+  inline reader::ngfile::~ngfile()
+  {
+    close();
+  }
+
+  inline size_t reader::ngfile::filesize() const
+  {
+    return _M_filesize;
+  }
+
+  inline const pcap::file_header* reader::ngfile::file_header() const
+  {
+    return &_M_file_header;
+  }
+
+  inline uint32_t reader::ngfile::linktype() const
+  {
+    return _M_file_header.linktype;
+  }
+
+  inline void reader::ngfile::streaming(size_t window, bool thread)
+  {
+    _M_readahead.window(window, thread);
+  }
+
+  inline uint16_t reader::ngfile::get16(const void* p) const
+  {
+    const uint16_t n = *static_cast<const uint16_t*>(p);
+    return _M_swap ? __builtin_bswap16(n) : n;
+  }
+
+  inline uint32_t reader::ngfile::get32(const void* p) const
+  {
+    const uint32_t n = *static_cast<const uint32_t*>(p);
+    return _M_swap ? __builtin_bswap32(n) : n;
+  }
+
+  inline void reader::ngfile::fill(packet& pkt,
+                                   const uint8_t* data,
+                                   uint32_t caplen,
+                                   const interface& iface,
+                                   uint64_t timestamp)
+  {
+    pkt._M_data = data;
+    pkt._M_length = caplen;
+    pkt._M_timestamp = timestamp;
+    pkt._M_linktype = iface.linktype;
+
+    _M_timestamp = timestamp;
+  }
+
   inline reader::stream::~stream()
   {
     close();
@@ -271,8 +817,19 @@ namespace pcap {
 
   inline void reader::stream::close()
   {
+    _M_async.close();
+
+    if (_M_close_fd) {
+      ::close(_M_fd);
+      _M_close_fd = false;
+    }
+
     _M_fd = -1;
 
+    _M_filesize = 0;
+
+    _M_decompressor.close();
+
     if (_M_buf) {
       free(_M_buf);
       _M_buf = nullptr;
@@ -283,7 +840,7 @@ namespace pcap {
 
   inline size_t reader::stream::filesize() const
   {
-    return 0;
+    return _M_filesize;
   }
 
   inline const pcap::file_header* reader::stream::file_header() const
@@ -296,6 +853,18 @@ namespace pcap {
     return _M_file_header.linktype;
   }
 
+  inline void reader::stream::asynchronous(size_t queue_depth,
+                                           size_t buffer_size)
+  {
+    _M_queue_depth = queue_depth;
+    _M_async_buffer_size = buffer_size;
+  }
+
+  inline bool reader::stream::asynchronous() const
+  {
+    return (_M_queue_depth > 0);
+  }
+
   inline bool reader::stream::begin(packet& pkt)
   {
     if (!_M_pkt) {
@@ -311,60 +880,155 @@ namespace pcap {
     _M_file.close();
   }
 
+  inline void reader::ngfile_close()
+  {
+    _M_ngfile.close();
+  }
+
   inline void reader::stream_close()
   {
     _M_stream.close();
   }
 
+  inline void reader::merged_close()
+  {
+    _M_merged.close();
+  }
+
   inline size_t reader::file_filesize() const
   {
     return _M_file.filesize();
   }
 
+  inline size_t reader::ngfile_filesize() const
+  {
+    return _M_ngfile.filesize();
+  }
+
   inline size_t reader::stream_filesize() const
   {
     return _M_stream.filesize();
   }
 
+  inline size_t reader::merged_filesize() const
+  {
+    return _M_merged.filesize();
+  }
+
   inline const pcap::file_header* reader::file_file_header() const
   {
     return _M_file.file_header();
   }
 
+  inline const pcap::file_header* reader::ngfile_file_header() const
+  {
+    return _M_ngfile.file_header();
+  }
+
   inline const pcap::file_header* reader::stream_file_header() const
   {
     return _M_stream.file_header();
   }
 
+  inline const pcap::file_header* reader::merged_file_header() const
+  {
+    return _M_merged.file_header();
+  }
+
   inline uint32_t reader::file_linktype() const
   {
     return _M_file.linktype();
   }
 
+  inline uint32_t reader::ngfile_linktype() const
+  {
+    return _M_ngfile.linktype();
+  }
+
   inline uint32_t reader::stream_linktype() const
   {
     return _M_stream.linktype();
   }
 
+  inline uint32_t reader::merged_linktype() const
+  {
+    return _M_merged.linktype();
+  }
+
   inline bool reader::file_begin(packet& pkt)
   {
     return _M_file.begin(pkt);
   }
 
+  inline bool reader::ngfile_begin(packet& pkt)
+  {
+    return _M_ngfile.begin(pkt);
+  }
+
   inline bool reader::stream_begin(packet& pkt)
   {
     return _M_stream.begin(pkt);
   }
 
+  inline bool reader::merged_begin(packet& pkt)
+  {
+    return _M_merged.begin(pkt);
+  }
+
   inline bool reader::file_next(packet& pkt)
   {
     return _M_file.next(pkt);
   }
 
+  inline bool reader::ngfile_next(packet& pkt)
+  {
+    return _M_ngfile.next(pkt);
+  }
+
   inline bool reader::stream_next(packet& pkt)
   {
     return _M_stream.next(pkt);
   }
+
+  inline bool reader::merged_next(packet& pkt)
+  {
+    return _M_merged.next(pkt);
+  }
+
+  inline bool reader::is_file() const
+  {
+    return (_M_next == &reader::file_next);
+  }
+
+  template<typename Function>
+  inline bool reader::for_each(Function fn)
+  {
+    switch (_M_format) {
+      case format::pcap:
+        return is_file() ? for_each(_M_file, fn) : for_each(_M_stream, fn);
+      case format::pcapng:
+        return for_each(_M_ngfile, fn);
+      case format::merged:
+        return for_each(_M_merged, fn);
+    }
+
+    return true;
+  }
+
+  template<typename Source, typename Function>
+  inline bool reader::for_each(Source& source, Function& fn)
+  {
+    packet pkt;
+    if (source.begin(pkt)) {
+      do {
+        if (!fn(pkt)) {
+          return false;
+        }
+      } while (source.next(pkt));
+    }
+
+    return true;
+  }
 }
 
 #endif // PCAP_READER_H
@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "pcap/ip/analyzer.h"
+
+// Options.
+struct options {
+  // PCAP file.
+  const char* filename;
+
+  // Interval.
+  uint32_t interval;
+
+  // Rebuild the index?
+  bool rebuild;
+
+  // Timestamp to seek to (microseconds, 0: don't seek).
+  uint64_t seek;
+
+  // Show the last packets?
+  bool last;
+
+  // Number of packets to show.
+  uint64_t count;
+};
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static bool parse_timestamp(const char* s, uint64_t& timestamp);
+static void usage(const char* program);
+static void show_packet(const net::ip::packet& pkt);
+static uint64_t now();
+
+int main(int argc, const char** argv)
+{
+  // Parse arguments.
+  options opts;
+  if (!parse_arguments(argc, argv, opts)) {
+    return -1;
+  }
+
+  // Build the index if it has to be rebuilt.
+  if (opts.rebuild) {
+    pcap::ip::index idx;
+    if (!idx.build(opts.filename, opts.interval)) {
+      fprintf(stderr,
+              "Error building index of the PCAP file '%s'.\n",
+              opts.filename);
+
+      return -1;
+    }
+  }
+
+  // Open PCAP file and its index.
+  uint64_t start = now();
+
+  pcap::ip::analyzer analyzer;
+  if (!analyzer.open(opts.filename, true, opts.interval)) {
+    fprintf(stderr,
+            "Error opening PCAP file '%s' or its index.\n",
+            opts.filename);
+
+    return -1;
+  }
+
+  const pcap::ip::index& idx = analyzer.get_index();
+
+  printf("Index opened in %.3f ms: %" PRIu64 " packets, one entry every %u "
+         "packets, %" PRIu64 " flows.\n",
+         (now() - start) / 1000000.0,
+         idx.packets(),
+         idx.interval(),
+         idx.flows());
+
+  pcap::ip::analyzer::const_iterator it;
+
+  // Seek?
+  if (opts.seek > 0) {
+    start = now();
+
+    if (!analyzer.seek(opts.seek, it)) {
+      printf("No packets at or after the timestamp.\n");
+      return 0;
+    }
+
+    printf("Seek: %.3f ms.\n", (now() - start) / 1000000.0);
+
+    for (uint64_t i = 0; i < opts.count; i++) {
+      show_packet(*it);
+
+      if (!analyzer.next(it)) {
+        break;
+      }
+    }
+  } else if (opts.last) {
+    start = now();
+
+    if (!analyzer.end(it)) {
+      printf("No packets.\n");
+      return 0;
+    }
+
+    printf("Last packet: %.3f ms.\n", (now() - start) / 1000000.0);
+
+    for (uint64_t i = 0; i < opts.count; i++) {
+      show_packet(*it);
+
+      if (!analyzer.prev(it)) {
+        break;
+      }
+    }
+  }
+
+  return 0;
+}
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return false;
+  }
+
+  opts.filename = argv[1];
+  opts.interval = pcap::ip::index::default_interval;
+  opts.rebuild = false;
+  opts.seek = 0;
+  opts.last = false;
+  opts.count = 10;
+
+  int i = 2;
+  while (i < argc) {
+    if (strcasecmp(argv[i], "--interval") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        errno = 0;
+        const unsigned long n = strtoul(argv[i + 1], &end, 10);
+
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (errno == 0) &&
+            (n > 0) &&
+            (n <= pcap::ip::index::max_interval)) {
+          opts.interval = n;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid interval '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected interval after \"--interval\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--rebuild") == 0) {
+      opts.rebuild = true;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--seek") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if ((parse_timestamp(argv[i + 1], opts.seek)) && (opts.seek > 0)) {
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid timestamp '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected timestamp after \"--seek\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--last") == 0) {
+      opts.last = true;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--count") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        errno = 0;
+        opts.count = strtoull(argv[i + 1], &end, 10);
+
+        if ((end != argv[i + 1]) && (*end == 0) && (errno == 0)) {
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid number of packets '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected number of packets after \"--count\".\n");
+        return false;
+      }
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool parse_timestamp(const char* s, uint64_t& timestamp)
+{
+  // Parse seconds.
+  char* end;
+  errno = 0;
+  const unsigned long long sec = strtoull(s, &end, 10);
+
+  if ((end == s) || (errno != 0) || (sec > UINT64_MAX / 1000000ull)) {
+    return false;
+  }
+
+  timestamp = sec * 1000000ull;
+
+  // Parse microseconds.
+  if (*end == '.') {
+    uint64_t usec = 0;
+    unsigned ndigits = 0;
+
+    for (s = end + 1; (*s >= '0') && (*s <= '9'); s++) {
+      if (ndigits < 6) {
+        usec = (usec * 10) + (*s - '0');
+        ndigits++;
+      }
+    }
+
+    if ((ndigits == 0) || (*s)) {
+      return false;
+    }
+
+    for (; ndigits < 6; ndigits++) {
+      usec *= 10;
+    }
+
+    timestamp += usec;
+
+    return true;
+  }
+
+  return (*end == 0);
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <filename> [--interval <number-of-packets>] "
+          "[--rebuild] [--seek <seconds>[.<microseconds>] | --last] "
+          "[--count <number-of-packets>]\n",
+          program);
+}
+
+void show_packet(const net::ip::packet& pkt)
+{
+  printf("%" PRIu64 ".%06u IPv%c, protocol %u, %u bytes.\n",
+         static_cast<uint64_t>(pkt.timestamp() / 1000000ull),
+         static_cast<unsigned>(pkt.timestamp() % 1000000ull),
+         (pkt.version() == net::ip::version::v4) ? '4' : '6',
+         pkt.protocol(),
+         pkt.length());
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 #include <signal.h>
@@ -17,10 +18,31 @@ static bool running = false;
 
 int main(int argc, const char** argv)
 {
-  if (argc == 2) {
-    // Open PCAP file.
+  // Follow the rotation of the file? Mapped mode?
+  bool follow = false;
+  bool mapped = false;
+
+  int i;
+  for (i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--follow") == 0) {
+      follow = true;
+    } else if (strcmp(argv[i], "--mmap") == 0) {
+      mapped = true;
+    } else {
+      break;
+    }
+  }
+
+  if ((argc >= 2) && (i == argc)) {
     pcap::live_reader reader;
-    if (reader.open(argv[1])) {
+
+    // Mapped mode?
+    if (mapped) {
+      reader.mapped();
+    }
+
+    // Open PCAP file.
+    if (reader.open(argv[1], follow)) {
       // Install signal handler.
       struct sigaction act;
       sigemptyset(&act.sa_mask);
@@ -61,10 +83,10 @@ int main(int argc, const char** argv)
         if (reader.feof()) {
           printf("==================== End of file ====================\n");
 
-          // Sleep interval.
-          static constexpr const useconds_t sleep_interval = 500 * 1000;
+          // Wait for the file to be modified (or rotated).
+          static constexpr const int timeout = 500;
 
-          usleep(sleep_interval);
+          reader.wait(timeout);
         } else {
           fprintf(stderr, "Error reading from file.\n");
           break;
@@ -78,7 +100,7 @@ int main(int argc, const char** argv)
       fprintf(stderr, "Error opening PCAP file '%s'.\n", argv[1]);
     }
   } else {
-    fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <filename> [--follow] [--mmap]\n", argv[0]);
   }
 
   return -1;
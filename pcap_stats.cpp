@@ -1,14 +1,54 @@
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/resource.h>
 #include "pcap/reader.h"
 
+// Options.
+struct options {
+  // PCAP file.
+  const char* filename;
+
+  // Read-ahead window (0: streaming mode disabled).
+  size_t window;
+
+  // Read ahead from a helper thread?
+  bool readahead_thread;
+
+  // Queue depth of the asynchronous mode (0: asynchronous mode disabled).
+  size_t queue_depth;
+
+  // Buffer size of the asynchronous mode.
+  size_t buffer_size;
+};
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static void usage(const char* program);
+static uint64_t now();
+
 int main(int argc, const char** argv)
 {
-  if (argc == 2) {
+  // Parse arguments.
+  options opts;
+  if (parse_arguments(argc, argv, opts)) {
     pcap::reader reader;
 
+    // Streaming mode?
+    if (opts.window > 0) {
+      reader.streaming(opts.window, opts.readahead_thread);
+    }
+
+    // Asynchronous mode?
+    if (opts.queue_depth > 0) {
+      reader.asynchronous(opts.queue_depth, opts.buffer_size);
+    }
+
     // Open PCAP file.
-    if (reader.open(argv[1])) {
+    if (reader.open(opts.filename)) {
+      const uint64_t start = now();
+
       pcap::packet pkt;
 
       if (reader.begin(pkt)) {
@@ -20,20 +60,165 @@ int main(int argc, const char** argv)
           total += pkt.length();
         } while (reader.next(pkt));
 
+        const double elapsed = (now() - start) / 1000000000.0;
+
         printf("# packets: %zu\n", count);
         printf("%zu bytes\n", total);
         printf("%zu bytes per packet (average)\n", total / count);
+
+        if ((elapsed > 0) && (reader.filesize() > 0)) {
+          printf("Throughput: %.3f seconds, %.0f packets per second, "
+                 "%.2f MB/s (file)\n",
+                 elapsed,
+                 count / elapsed,
+                 (reader.filesize() / elapsed) / (1024.0 * 1024.0));
+        }
       } else {
         printf("No packets.\n");
       }
 
+      // Show peak resident memory.
+      struct rusage usage;
+      if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        printf("Peak resident memory: %.2f MB\n", usage.ru_maxrss / 1024.0);
+      }
+
       return 0;
     } else {
-      fprintf(stderr, "Error opening PCAP file '%s'.\n", argv[1]);
+      fprintf(stderr, "Error opening PCAP file '%s'.\n", opts.filename);
     }
-  } else {
-    fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
   }
 
   return -1;
 }
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return false;
+  }
+
+  opts.filename = argv[1];
+  opts.window = 0;
+  opts.readahead_thread = false;
+  opts.queue_depth = 0;
+  opts.buffer_size = fs::async_reader::default_buffer_size;
+
+  int i = 2;
+  while (i < argc) {
+    if (strcasecmp(argv[i], "--stream") == 0) {
+      opts.window = pcap::reader::default_window;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--window") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        errno = 0;
+        const unsigned long long n = strtoull(argv[i + 1], &end, 10);
+
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (errno == 0) &&
+            (n > 0) &&
+            (n <= 1024 * 1024)) {
+          // Window in MiB.
+          opts.window = static_cast<size_t>(n) << 20;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid window '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected window after \"--window\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--readahead-thread") == 0) {
+      opts.readahead_thread = true;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--async") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        errno = 0;
+        const unsigned long n = strtoul(argv[i + 1], &end, 10);
+
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (errno == 0) &&
+            (n > 0) &&
+            (n <= fs::async_reader::max_queue_depth)) {
+          opts.queue_depth = n;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid queue depth '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected queue depth after \"--async\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--async-buffer") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        char* end;
+        errno = 0;
+        const unsigned long n = strtoul(argv[i + 1], &end, 10);
+
+        if ((end != argv[i + 1]) &&
+            (*end == 0) &&
+            (errno == 0) &&
+            (n >= fs::async_reader::min_buffer_size / 1024) &&
+            (n <= 64 * 1024)) {
+          // Buffer size in KiB.
+          opts.buffer_size = static_cast<size_t>(n) * 1024;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid buffer size '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected buffer size after \"--async-buffer\".\n");
+        return false;
+      }
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+  }
+
+  // The read-ahead thread requires the streaming mode.
+  if ((opts.readahead_thread) && (opts.window == 0)) {
+    opts.window = pcap::reader::default_window;
+  }
+
+  // The buffer size is only used in asynchronous mode.
+  if ((opts.buffer_size != fs::async_reader::default_buffer_size) &&
+      (opts.queue_depth == 0)) {
+    opts.queue_depth = fs::async_reader::default_queue_depth;
+  }
+
+  return true;
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <filename> [--stream] [--window <MiB>] "
+          "[--readahead-thread] [--async <queue-depth>] "
+          "[--async-buffer <KiB>]\n",
+          program);
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "pcap/reader.h"
+#include "pcap/pcap.h"
+#include "net/capture/tx_ring.h"
+
+// Replay mode.
+enum class mode {
+  original, // Original timing.
+  pps,      // Packets per second.
+  bps,      // Bits per second.
+  max       // As fast as possible.
+};
+
+// Options.
+struct options {
+  // Interface name.
+  const char* interface;
+
+  // PCAP file.
+  const char* filename;
+
+  // Replay mode.
+  mode m;
+
+  // Rate (packets or bits per second).
+  uint64_t rate;
+
+  // Number of times the file is replayed (0: forever).
+  uint64_t loops;
+
+  // Bypass the traffic control layer?
+  bool qdisc_bypass;
+};
+
+static bool parse_arguments(int argc, const char** argv, options& opts);
+static bool parse_number(const char* s,
+                         uint64_t min,
+                         uint64_t max,
+                         uint64_t& n);
+
+static void usage(const char* program);
+
+static int replay(pcap::reader& reader,
+                  net::capture::tx_ring& ring,
+                  const options& opts);
+
+static uint64_t schedule(uint64_t start, uint64_t n, uint64_t rate);
+
+static void signal_handler(int nsig);
+
+static uint64_t now();
+static void sleep_until(uint64_t t);
+
+static bool running = false;
+
+int main(int argc, const char** argv)
+{
+  // Parse arguments.
+  options opts;
+  if (parse_arguments(argc, argv, opts)) {
+    // Open PCAP file.
+    pcap::reader reader;
+    if (reader.open(opts.filename)) {
+      if (reader.linktype() ==
+          static_cast<uint32_t>(pcap::linklayer_header::ethernet)) {
+        // Create transmission ring.
+        net::capture::tx_ring ring;
+        if (ring.create(opts.interface,
+                        net::capture::tx_ring::default_frame_size,
+                        net::capture::tx_ring::default_frames,
+                        opts.qdisc_bypass)) {
+          return replay(reader, ring, opts);
+        } else {
+          fprintf(stderr,
+                  "Error creating transmission ring for interface '%s'.\n",
+                  opts.interface);
+        }
+      } else {
+        fprintf(stderr,
+                "Unsupported link-layer header type %u (only ethernet "
+                "is supported).\n",
+                reader.linktype());
+      }
+    } else {
+      fprintf(stderr, "Error opening PCAP file '%s'.\n", opts.filename);
+    }
+  }
+
+  return -1;
+}
+
+int replay(pcap::reader& reader,
+           net::capture::tx_ring& ring,
+           const options& opts)
+{
+  // Install signal handler.
+  struct sigaction act;
+  sigemptyset(&act.sa_mask);
+  act.sa_flags = 0;
+  act.sa_handler = signal_handler;
+  sigaction(SIGTERM, &act, nullptr);
+  sigaction(SIGINT, &act, nullptr);
+
+  running = true;
+
+  uint64_t npackets = 0;
+  uint64_t nbytes = 0;
+  uint64_t nskipped = 0;
+  uint64_t nloops = 0;
+
+  const uint64_t start = now();
+
+  do {
+    pcap::packet pkt;
+    if (!reader.begin(pkt)) {
+      fprintf(stderr, "The PCAP file has no packets.\n");
+      return -1;
+    }
+
+    // Timestamp of the first packet and start of the current loop.
+    const uint64_t first = pkt.timestamp();
+    const uint64_t loop_start = now();
+
+    do {
+      // Compute when the packet has to be sent.
+      uint64_t t;
+      switch (opts.m) {
+        case mode::original:
+          t = loop_start +
+              ((pkt.timestamp() > first) ?
+                 (pkt.timestamp() - first) * 1000ull :
+                 0);
+
+          break;
+        case mode::pps:
+          t = schedule(start, npackets, opts.rate);
+          break;
+        case mode::bps:
+          t = schedule(start, nbytes * 8, opts.rate);
+          break;
+        default:
+          t = 0;
+      }
+
+      // If the packet has to be delayed...
+      if (t > now()) {
+        // Send the queued frames before sleeping.
+        if (!ring.flush()) {
+          fprintf(stderr, "Error sending frames.\n");
+          return -1;
+        }
+
+        sleep_until(t);
+      }
+
+      // If the packet doesn't fit in a frame...
+      if (pkt.length() > ring.mtu()) {
+        nskipped++;
+        continue;
+      }
+
+      // Queue frame.
+      int ret;
+      while (((ret = ring.write(pkt.data(), pkt.length())) == 0) &&
+             (running));
+
+      if (ret < 0) {
+        if (errno != EINTR) {
+          fprintf(stderr, "Error sending frame.\n");
+          return -1;
+        }
+
+        break;
+      } else if (ret == 0) {
+        // Interrupted.
+        break;
+      }
+
+      npackets++;
+      nbytes += pkt.length();
+    } while ((running) && (reader.next(pkt)));
+  } while ((running) && ((opts.loops == 0) || (++nloops < opts.loops)));
+
+  // Wait until all the frames have been sent.
+  ring.flush(true);
+
+  const double elapsed = (now() - start) / 1000000000.0;
+
+  printf("%" PRIu64 " packets (%" PRIu64 " bytes) sent in %.3f seconds.\n",
+         npackets,
+         nbytes,
+         elapsed);
+
+  if (elapsed > 0) {
+    printf("%.0f packets per second, %.3f Mbps.\n",
+           npackets / elapsed,
+           (nbytes * 8) / (elapsed * 1000000.0));
+  }
+
+  if (nskipped > 0) {
+    printf("%" PRIu64 " packets skipped (longer than %zu bytes).\n",
+           nskipped,
+           ring.mtu());
+  }
+
+  return 0;
+}
+
+bool parse_arguments(int argc, const char** argv, options& opts)
+{
+  if (argc < 3) {
+    usage(argv[0]);
+    return false;
+  }
+
+  opts.interface = argv[1];
+  opts.filename = argv[2];
+  opts.m = mode::original;
+  opts.rate = 0;
+  opts.loops = 1;
+  opts.qdisc_bypass = false;
+
+  int i = 3;
+  while (i < argc) {
+    if (strcasecmp(argv[i], "--original") == 0) {
+      opts.m = mode::original;
+
+      i++;
+    } else if (strcasecmp(argv[i], "--max") == 0) {
+      opts.m = mode::max;
+
+      i++;
+    } else if ((strcasecmp(argv[i], "--pps") == 0) ||
+               (strcasecmp(argv[i], "--bps") == 0)) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse_number(argv[i + 1], 1, UINT64_MAX / 8, opts.rate)) {
+          opts.m = (strcasecmp(argv[i], "--pps") == 0) ?
+                     mode::pps :
+                     mode::bps;
+
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid rate '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected rate after \"%s\".\n", argv[i]);
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--loop") == 0) {
+      // If not the last argument...
+      if (i + 1 < argc) {
+        if (parse_number(argv[i + 1], 0, UINT64_MAX, opts.loops)) {
+          i += 2;
+        } else {
+          fprintf(stderr, "Invalid number of loops '%s'.\n", argv[i + 1]);
+          return false;
+        }
+      } else {
+        fprintf(stderr, "Expected number of loops after \"--loop\".\n");
+        return false;
+      }
+    } else if (strcasecmp(argv[i], "--qdisc-bypass") == 0) {
+      opts.qdisc_bypass = true;
+
+      i++;
+    } else {
+      usage(argv[0]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool parse_number(const char* s, uint64_t min, uint64_t max, uint64_t& n)
+{
+  char* end;
+  errno = 0;
+  n = strtoull(s, &end, 10);
+
+  return ((end != s) &&
+          (*end == 0) &&
+          (errno == 0) &&
+          (n >= min) &&
+          (n <= max));
+}
+
+void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <interface-name> <pcap-file> "
+          "[--original | --pps <packets-per-second> | "
+          "--bps <bits-per-second> | --max] "
+          "[--loop <count> (0: forever)] [--qdisc-bypass]\n",
+          program);
+}
+
+uint64_t schedule(uint64_t start, uint64_t n, uint64_t rate)
+{
+  // start + (n / rate) seconds (avoiding overflows).
+  return start +
+         ((n / rate) * 1000000000ull) +
+         static_cast<uint64_t>((static_cast<long double>(n % rate) * 1e9) /
+                               rate);
+}
+
+void signal_handler(int nsig)
+{
+  printf("Received signal %d.\n", nsig);
+
+  running = false;
+}
+
+uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+void sleep_until(uint64_t t)
+{
+  struct timespec ts;
+  ts.tv_sec = t / 1000000000ull;
+  ts.tv_nsec = t % 1000000000ull;
+
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
@@ -75,10 +75,10 @@ int main(int argc, const char** argv)
             if (analyzer.feof()) {
               printf("==================== End of file ====================\n");
 
-              // Sleep interval.
-              static constexpr const useconds_t sleep_interval = 500 * 1000;
+              // Wait for the file to be modified.
+              static constexpr const int timeout = 500;
 
-              usleep(sleep_interval);
+              analyzer.wait(timeout);
             } else if (analyzer.ferror()) {
               fprintf(stderr, "Error reading from file.\n");
               break;
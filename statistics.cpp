@@ -6,10 +6,14 @@
 #include "net/ip/statistics.h"
 #include "pcap/ip/analyzer.h"
 
+// Maximum number of PCAP files (their packets are merged by timestamp).
+static constexpr const size_t max_pcap_files = 256;
+
 static bool parse_arguments(int argc,
                             const char** argv,
                             const char*& svcdirname,
-                            const char*& pcapfilename,
+                            const char** pcapfilenames,
+                            size_t& npcapfiles,
                             const char*& csvdirname,
                             const char*& pcapdirname);
 
@@ -19,13 +23,15 @@ int main(int argc, const char** argv)
 {
   // Parse arguments.
   const char* svcdirname;
-  const char* pcapfilename;
+  const char* pcapfilenames[max_pcap_files];
+  size_t npcapfiles;
   const char* csvdirname;
   const char* pcapdirname;
   if (parse_arguments(argc,
                       argv,
                       svcdirname,
-                      pcapfilename,
+                      pcapfilenames,
+                      npcapfiles,
                       csvdirname,
                       pcapdirname)) {
     // Load services.
@@ -47,9 +53,9 @@ int main(int argc, const char** argv)
         }
       }
 
-      // Open PCAP file.
+      // Open PCAP file(s).
       pcap::ip::analyzer analyzer;
-      if (analyzer.open(pcapfilename)) {
+      if (analyzer.open(pcapfilenames, npcapfiles)) {
         pcap::ip::analyzer::const_iterator it;
         if (analyzer.begin(it)) {
           uint64_t npkt = 0;
@@ -121,7 +127,13 @@ int main(int argc, const char** argv)
 
         return 0;
       } else {
-        fprintf(stderr, "Error opening PCAP file '%s'.\n", pcapfilename);
+        if (npcapfiles == 1) {
+          fprintf(stderr,
+                  "Error opening PCAP file '%s'.\n",
+                  pcapfilenames[0]);
+        } else {
+          fprintf(stderr, "Error opening PCAP files.\n");
+        }
       }
     }
   }
@@ -132,13 +144,14 @@ int main(int argc, const char** argv)
 bool parse_arguments(int argc,
                      const char** argv,
                      const char*& svcdirname,
-                     const char*& pcapfilename,
+                     const char** pcapfilenames,
+                     size_t& npcapfiles,
                      const char*& csvdirname,
                      const char*& pcapdirname)
 {
   // Set default values.
   svcdirname = nullptr;
-  pcapfilename = nullptr;
+  npcapfiles = 0;
   csvdirname = nullptr;
   pcapdirname = nullptr;
 
@@ -169,7 +182,15 @@ bool parse_arguments(int argc,
         struct stat sbuf;
         if ((strcmp(argv[i + 1], "-") == 0) ||
             ((stat(argv[i + 1], &sbuf) == 0) && (S_ISREG(sbuf.st_mode)))) {
-          pcapfilename = argv[i + 1];
+          if (npcapfiles == max_pcap_files) {
+            fprintf(stderr,
+                    "Too many PCAP files (maximum: %zu).\n",
+                    max_pcap_files);
+
+            return false;
+          }
+
+          pcapfilenames[npcapfiles++] = argv[i + 1];
 
           i += 2;
         } else {
@@ -228,13 +249,13 @@ bool parse_arguments(int argc,
   }
 
   if (svcdirname) {
-    if (pcapfilename) {
+    if (npcapfiles > 0) {
       return true;
     } else {
       fprintf(stderr, "Parameter \"--pcap\" is mandatory.\n");
       return false;
     }
-  } else if (pcapfilename) {
+  } else if (npcapfiles > 0) {
     fprintf(stderr, "Parameter \"--services-directory\" is mandatory.\n");
     return false;
   }
@@ -254,6 +275,7 @@ void usage(const char* program)
 {
   fprintf(stderr,
           "Usage: %s --services-directory <directory> --pcap <filename> "
-          "[--csv-directory <directory>] [--pcap-directory <directory>]\n",
+          "[--pcap <filename> ...] [--csv-directory <directory>] "
+          "[--pcap-directory <directory>]\n",
           program);
 }
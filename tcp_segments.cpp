@@ -10,6 +10,9 @@ int main(int argc, const char** argv)
     // Open PCAP file.
     pcap::ip::analyzer analyzer;
     if (analyzer.open(argv[1])) {
+      // Compute the flow hashes while reading the packets.
+      analyzer.flow_hashes(true);
+
       // Read all packets.
       if (!analyzer.read_all()) {
         fprintf(stderr, "Error reading packets.\n");
@@ -30,10 +33,16 @@ int main(int argc, const char** argv)
             const net::ip::tcp::connection* conn;
             if (it->version() == net::ip::version::v4) {
               // Process TCP segment.
-              conn = conns.process(it->ipv4(), it->tcp(), it->timestamp());
+              conn = conns.process(it->hash(),
+                                   it->ipv4(),
+                                   it->tcp(),
+                                   it->timestamp());
             } else {
               // Process TCP segment.
-              conn = conns.process(it->ipv6(), it->tcp(), it->timestamp());
+              conn = conns.process(it->hash(),
+                                   it->ipv6(),
+                                   it->tcp(),
+                                   it->timestamp());
             }
 
             if (conn) {
@@ -0,0 +1,508 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "net/capture/filter.h"
+
+// Frame.
+struct frame {
+  // Frame data.
+  uint8_t data[128];
+
+  // Frame length.
+  size_t len;
+
+  // VLAN tag stripped by the kernel (if any).
+  bool tag_present;
+  uint16_t tag;
+};
+
+// IP layer of a sample frame.
+struct layer {
+  // IP version (4 or 6).
+  unsigned version;
+
+  // Source and destination address.
+  const char* src;
+  const char* dst;
+
+  // Layer 3 protocol.
+  uint8_t protocol;
+
+  // Source and destination port.
+  uint16_t sport;
+  uint16_t dport;
+
+  // Fragment offset (IPv4).
+  uint16_t fragoff;
+};
+
+static void put16(uint8_t* p, uint16_t n)
+{
+  p[0] = static_cast<uint8_t>(n >> 8);
+  p[1] = static_cast<uint8_t>(n);
+}
+
+static uint32_t get16(const uint8_t* p)
+{
+  return (static_cast<uint32_t>(p[0]) << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+  return (get16(p) << 16) | get16(p + 2);
+}
+
+// Build ethernet frame with up to two VLAN tags in the packet.
+static void build(const layer& l,
+                  const uint16_t* vlans,
+                  size_t nvlans,
+                  frame& f)
+{
+  memset(&f, 0, sizeof(frame));
+
+  // Destination and source MAC address.
+  uint8_t* p = f.data + 12;
+
+  for (size_t i = 0; i < nvlans; i++) {
+    put16(p, (i + 1 < nvlans) ? 0x88a8 : 0x8100);
+    put16(p + 2, vlans[i]);
+    p += 4;
+  }
+
+  if (l.version == 4) {
+    put16(p, 0x0800);
+    p += 2;
+
+    p[0] = 0x45;
+    put16(p + 2, 20 + 8);
+    put16(p + 6, l.fragoff);
+    p[8] = 64;
+    p[9] = l.protocol;
+    inet_pton(AF_INET, l.src, p + 12);
+    inet_pton(AF_INET, l.dst, p + 16);
+    p += 20;
+  } else {
+    put16(p, 0x86dd);
+    p += 2;
+
+    p[0] = 0x60;
+    put16(p + 4, 8);
+    p[6] = l.protocol;
+    p[7] = 64;
+    inet_pton(AF_INET6, l.src, p + 8);
+    inet_pton(AF_INET6, l.dst, p + 24);
+    p += 40;
+  }
+
+  // Ports (TCP / UDP) or type and code (ICMP).
+  put16(p, l.sport);
+  put16(p + 2, l.dport);
+  p += 8;
+
+  f.len = p - f.data;
+}
+
+// Strip the VLAN tag of the frame (as the kernel does).
+static void strip(frame& f)
+{
+  f.tag_present = true;
+  f.tag = static_cast<uint16_t>(get16(f.data + 14));
+
+  memmove(f.data + 12, f.data + 16, f.len - 16);
+  f.len -= 4;
+}
+
+// Run classic BPF program (returns the number of bytes to keep, 0 if the
+// frame is dropped or the program is invalid).
+static uint32_t run(const struct sock_fprog* prog, const frame& f)
+{
+  uint32_t a = 0;
+  uint32_t x = 0;
+  uint32_t mem[BPF_MEMWORDS];
+
+  memset(mem, 0, sizeof(mem));
+
+  for (size_t pc = 0; pc < prog->len; pc++) {
+    const struct sock_filter& insn = prog->filter[pc];
+
+    switch (insn.code) {
+      case BPF_LD | BPF_W | BPF_ABS:
+      case BPF_LD | BPF_H | BPF_ABS:
+      case BPF_LD | BPF_B | BPF_ABS:
+      case BPF_LD | BPF_W | BPF_IND:
+      case BPF_LD | BPF_H | BPF_IND:
+      case BPF_LD | BPF_B | BPF_IND:
+        {
+          uint32_t off = insn.k;
+
+          // Ancillary data?
+          if (BPF_MODE(insn.code) == BPF_ABS) {
+            if (off == static_cast<uint32_t>(SKF_AD_OFF +
+                                             SKF_AD_VLAN_TAG_PRESENT)) {
+              a = f.tag_present ? 1 : 0;
+              break;
+            } else if (off == static_cast<uint32_t>(SKF_AD_OFF +
+                                                    SKF_AD_VLAN_TAG)) {
+              a = f.tag;
+              break;
+            }
+          } else {
+            off += x;
+          }
+
+          size_t size;
+          switch (BPF_SIZE(insn.code)) {
+            case BPF_W:
+              size = 4;
+              break;
+            case BPF_H:
+              size = 2;
+              break;
+            default:
+              size = 1;
+          }
+
+          // Out of bounds?
+          if ((off >= f.len) || (size > f.len - off)) {
+            return 0;
+          }
+
+          switch (size) {
+            case 4:
+              a = get32(f.data + off);
+              break;
+            case 2:
+              a = get16(f.data + off);
+              break;
+            default:
+              a = f.data[off];
+          }
+        }
+
+        break;
+      case BPF_LD | BPF_IMM:
+        a = insn.k;
+        break;
+      case BPF_LD | BPF_MEM:
+        a = mem[insn.k % BPF_MEMWORDS];
+        break;
+      case BPF_LDX | BPF_MEM:
+        x = mem[insn.k % BPF_MEMWORDS];
+        break;
+      case BPF_ST:
+        mem[insn.k % BPF_MEMWORDS] = a;
+        break;
+      case BPF_ALU | BPF_AND | BPF_K:
+        a &= insn.k;
+        break;
+      case BPF_ALU | BPF_LSH | BPF_K:
+        a <<= insn.k;
+        break;
+      case BPF_ALU | BPF_ADD | BPF_K:
+        a += insn.k;
+        break;
+      case BPF_ALU | BPF_ADD | BPF_X:
+        a += x;
+        break;
+      case BPF_MISC | BPF_TAX:
+        x = a;
+        break;
+      case BPF_JMP | BPF_JA:
+        pc += insn.k;
+        break;
+      case BPF_JMP | BPF_JEQ | BPF_K:
+        pc += (a == insn.k) ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JGT | BPF_K:
+        pc += (a > insn.k) ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JGE | BPF_K:
+        pc += (a >= insn.k) ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JSET | BPF_K:
+        pc += (a & insn.k) ? insn.jt : insn.jf;
+        break;
+      case BPF_RET | BPF_K:
+        return insn.k;
+      default:
+        fprintf(stderr,
+                "Unknown instruction 0x%04x at position %zu.\n",
+                insn.code,
+                pc);
+
+        return 0;
+    }
+  }
+
+  // The program didn't return.
+  return 0;
+}
+
+// Check whether the filter expression accepts the frame.
+static bool check(const char* expression,
+                  const char* description,
+                  const frame& f,
+                  bool accept)
+{
+  net::capture::filter filter;
+  if (!filter.compile(expression)) {
+    printf("[FAIL] '%s': error compiling filter expression.\n", expression);
+    return false;
+  }
+
+  const bool accepted = (run(filter.program(), f) != 0);
+
+  // Shorten long expressions.
+  const int len = static_cast<int>(strlen(expression));
+
+  printf("[%s] '%.*s%s' %s %s.\n",
+         (accepted == accept) ? "OK" : "FAIL",
+         (len > 40) ? 36 : len,
+         expression,
+         (len > 40) ? "..." : "",
+         accept ? "accepts" : "rejects",
+         description);
+
+  return (accepted == accept);
+}
+
+// Check whether the filter expression compiles.
+static bool check(const char* expression, bool compiles)
+{
+  net::capture::filter filter;
+  const bool compiled = filter.compile(expression);
+
+  // A failed compilation must leave no program.
+  const bool ok = compiled ? (compiles && (filter.program() != nullptr)) :
+                             ((!compiles) && (filter.program() == nullptr));
+
+  printf("[%s] Expression of %zu bytes %s.\n",
+         ok ? "OK" : "FAIL",
+         strlen(expression),
+         compiles ? "compiles" : "doesn't compile");
+
+  return ok;
+}
+
+// Build the expression "port <port>,<port+2>,...,<port+2*(n-1)>" in 'buf'.
+static const char* port_list(size_t n, char* buf, size_t size)
+{
+  size_t len = snprintf(buf, size, "port ");
+  for (size_t i = 0; i < n; i++) {
+    len += snprintf(buf + len,
+                    size - len,
+                    "%s%zu",
+                    (i > 0) ? "," : "",
+                    1000 + (2 * i));
+  }
+
+  return buf;
+}
+
+// Build the expression "port <port> or port <port+2> or ... or
+// port <port+2*(n-1)>" in 'buf'.
+static const char* port_clauses(size_t n, char* buf, size_t size)
+{
+  size_t len = 0;
+  for (size_t i = 0; i < n; i++) {
+    len += snprintf(buf + len,
+                    size - len,
+                    "%sport %zu",
+                    (i > 0) ? " or " : "",
+                    1000 + (2 * i));
+  }
+
+  return buf;
+}
+
+// Check the accepted ports of an expression built by port_list() or
+// port_clauses() with 'n' ports.
+static bool check_ports(const char* expression, size_t n)
+{
+  layer l = {4, "10.1.2.3", "192.168.0.1", 17, 40000, 1000, 0};
+  frame f;
+  bool ok = true;
+
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "a frame to the first port", f, true);
+
+  l.dport = static_cast<uint16_t>(1000 + (2 * (n - 1)));
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "a frame to the last port", f, true);
+
+  l.dport++;
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "a frame to the port after the last", f, false);
+
+  l.dport = 1001;
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "a frame to a port between the ports", f, false);
+
+  l.protocol = 6;
+  l.sport = static_cast<uint16_t>(1000 + (2 * (n / 2)));
+  l.dport = 40000;
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "a TCP frame from a port in the middle", f, true);
+
+  l.version = 6;
+  l.src = "2001:db8::1";
+  l.dst = "2001:db8::2";
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "an IPv6 frame from a port in the middle", f, true);
+
+  l.sport = 40000;
+  build(l, nullptr, 0, f);
+  ok &= check(expression, "an IPv6 frame between other ports", f, false);
+
+  return ok;
+}
+
+static int run_checks()
+{
+  static const layer tcp4 = {4, "10.1.2.3", "192.168.0.1", 6, 40000, 80, 0};
+  static const layer udp4 = {4, "10.1.2.3", "192.168.0.1", 17, 8040, 53, 0};
+  static const layer frag4 = {4, "10.1.2.3", "192.168.0.1", 6, 40000, 80, 185};
+  static const layer icmp4 = {4, "10.1.2.3", "192.168.0.1", 1, 0x0800, 0, 0};
+
+  static const layer tcp6 = {
+    6, "2001:db8::1", "2001:db8:1::2", 6, 40000, 8080, 0
+  };
+
+  static const layer udp6 = {
+    6, "fe80::1", "2001:db8::1", 17, 7999, 8081, 0
+  };
+
+  static const uint16_t vlan100 = 100;
+  static const uint16_t vlan200 = 200;
+  static const uint16_t qinq[] = {300, 100};
+
+  frame f;
+  bool ok = true;
+
+  // VLAN.
+  build(tcp4, nullptr, 0, f);
+  ok &= check("vlan", "an untagged frame", f, false);
+  ok &= check("vlan 100", "an untagged frame", f, false);
+  ok &= check("tcp and port 80", "an untagged frame", f, true);
+
+  build(tcp4, &vlan100, 1, f);
+  ok &= check("vlan", "a frame of VLAN 100", f, true);
+  ok &= check("vlan 100", "a frame of VLAN 100", f, true);
+  ok &= check("vlan 200", "a frame of VLAN 100", f, false);
+  ok &= check("tcp and port 80", "a frame of VLAN 100", f, true);
+  ok &= check("udp", "a frame of VLAN 100", f, false);
+
+  build(udp4, &vlan200, 1, f);
+  strip(f);
+  ok &= check("vlan", "a stripped frame of VLAN 200", f, true);
+  ok &= check("vlan 200", "a stripped frame of VLAN 200", f, true);
+  ok &= check("vlan 100", "a stripped frame of VLAN 200", f, false);
+  ok &= check("udp and dst port 53", "a stripped frame of VLAN 200", f, true);
+
+  build(tcp4, qinq, 2, f);
+  ok &= check("vlan 300", "a QinQ frame (300, 100)", f, true);
+  ok &= check("tcp and port 80", "a QinQ frame (300, 100)", f, true);
+  ok &= check("host 192.168.0.1", "a QinQ frame (300, 100)", f, true);
+
+  build(tcp6, &vlan100, 1, f);
+  ok &= check("ip6 and tcp and port 8080",
+              "an IPv6 frame of VLAN 100",
+              f,
+              true);
+
+  // IPv6.
+  build(tcp6, nullptr, 0, f);
+  ok &= check("ip6", "an IPv6 TCP frame", f, true);
+  ok &= check("ip", "an IPv6 TCP frame", f, false);
+  ok &= check("ip6 and tcp", "an IPv6 TCP frame", f, true);
+  ok &= check("ip6 and udp", "an IPv6 TCP frame", f, false);
+  ok &= check("host 2001:db8::1", "an IPv6 TCP frame", f, true);
+  ok &= check("src host 2001:db8::1", "an IPv6 TCP frame", f, true);
+  ok &= check("dst host 2001:db8::1", "an IPv6 TCP frame", f, false);
+  ok &= check("net 2001:db8::/32", "an IPv6 TCP frame", f, true);
+  ok &= check("dst net 2001:db8:1::/48", "an IPv6 TCP frame", f, true);
+  ok &= check("src net 2001:db8:1::/48", "an IPv6 TCP frame", f, false);
+  ok &= check("host 10.1.2.3", "an IPv6 TCP frame", f, false);
+
+  build(tcp4, nullptr, 0, f);
+  ok &= check("ip6", "an IPv4 TCP frame", f, false);
+  ok &= check("host 2001:db8::1", "an IPv4 TCP frame", f, false);
+  ok &= check("net 10.0.0.0/8", "an IPv4 TCP frame", f, true);
+
+  build(icmp4, nullptr, 0, f);
+  ok &= check("icmp", "an ICMP frame", f, true);
+  ok &= check("port 2048", "an ICMP frame", f, false);
+
+  // Port ranges.
+  build(tcp6, nullptr, 0, f);
+  ok &= check("portrange 8000-8080", "an IPv6 frame to port 8080", f, true);
+  ok &= check("portrange 8081-9000", "an IPv6 frame to port 8080", f, false);
+  ok &= check("dst portrange 8080-8080", "an IPv6 frame to port 8080", f, true);
+  ok &= check("src portrange 8000-8080",
+              "an IPv6 frame to port 8080",
+              f,
+              false);
+
+  build(udp6, nullptr, 0, f);
+  ok &= check("portrange 8000-8080", "a frame 7999 -> 8081", f, false);
+  ok &= check("portrange 8000-8080,8081", "a frame 7999 -> 8081", f, true);
+  ok &= check("port 80,443,7999", "a frame 7999 -> 8081", f, true);
+  ok &= check("portrange 0-7999", "a frame 7999 -> 8081", f, true);
+  ok &= check("portrange 8082-65535", "a frame 7999 -> 8081", f, false);
+
+  build(udp4, nullptr, 0, f);
+  ok &= check("portrange 8000-8080", "a frame 8040 -> 53", f, true);
+  ok &= check("dst portrange 1-1023", "a frame 8040 -> 53", f, true);
+  ok &= check("src portrange 1-1023", "a frame 8040 -> 53", f, false);
+
+  build(frag4, nullptr, 0, f);
+  ok &= check("port 80", "a non-first fragment", f, false);
+  ok &= check("tcp", "a non-first fragment", f, true);
+
+  // Long expressions: the conditional jumps further than 255 instructions
+  // go through unconditional jumps.
+  char buf[4096];
+
+  ok &= check_ports(port_clauses(10, buf, sizeof(buf)), 10);
+  ok &= check_ports(port_clauses(100, buf, sizeof(buf)), 100);
+  ok &= check_ports(port_list(256, buf, sizeof(buf)), 256);
+
+  build(tcp4, nullptr, 0, f);
+  ok &= check(port_list(256, buf, sizeof(buf)), "a frame to port 80", f, false);
+
+  char expr[4200];
+  snprintf(expr, sizeof(expr), "not (%s) and tcp", buf);
+  ok &= check(expr, "a TCP frame to port 80", f, true);
+
+  // More than 256 port ranges.
+  ok &= check(port_list(257, buf, sizeof(buf)), false);
+
+  if (ok) {
+    printf("All the checks passed.\n");
+    return 0;
+  }
+
+  printf("Some checks failed.\n");
+  return -1;
+}
+
+int main(int argc, const char** argv)
+{
+  if (argc == 1) {
+    return run_checks();
+  } else if (argc == 2) {
+    net::capture::filter filter;
+    if (filter.compile(argv[1])) {
+      filter.print();
+
+      return 0;
+    } else {
+      fprintf(stderr, "Error compiling filter expression.\n");
+    }
+  } else {
+    fprintf(stderr, "Usage: %s [<expression>]\n", argv[0]);
+  }
+
+  return -1;
+}
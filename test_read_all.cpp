@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "pcap/ip/analyzer.h"
+
+static bool compare(const pcap::ip::analyzer& reference,
+                    const char* filename,
+                    bool async);
+
+int main(int argc, const char** argv)
+{
+  if ((argc == 2) || (argc == 3)) {
+    // Read all the packets of the (mapped) PCAP file.
+    pcap::ip::analyzer reference;
+    if (reference.open(argv[1])) {
+      if (reference.read_all()) {
+        printf("%s (mapped): %zu packets.\n", argv[1], reference.count());
+
+        // Compare with the PCAP file read in asynchronous mode and with the
+        // compressed PCAP file.
+        if ((compare(reference, argv[1], true)) &&
+            ((argc == 2) || (compare(reference, argv[2], false)))) {
+          return 0;
+        }
+      } else {
+        fprintf(stderr, "Error reading packets.\n");
+      }
+    } else {
+      fprintf(stderr, "Error opening PCAP file '%s'.\n", argv[1]);
+    }
+  } else {
+    fprintf(stderr,
+            "Usage: %s <pcap-file> [<compressed-pcap-file>]\n",
+            argv[0]);
+  }
+
+  return -1;
+}
+
+bool compare(const pcap::ip::analyzer& reference,
+             const char* filename,
+             bool async)
+{
+  const char* const mode = async ? "asynchronous" : "compressed";
+
+  pcap::ip::analyzer analyzer;
+
+  // Asynchronous mode?
+  if (async) {
+    analyzer.asynchronous();
+  }
+
+  // Open PCAP file.
+  if (!analyzer.open(filename)) {
+    fprintf(stderr, "Error opening PCAP file '%s'.\n", filename);
+    return false;
+  }
+
+  // Read all packets (the packets are compared once all of them have been
+  // read, when the buffer of the stream has been reused).
+  if (!analyzer.read_all()) {
+    fprintf(stderr, "Error reading packets (%s).\n", mode);
+    return false;
+  }
+
+  if (analyzer.count() != reference.count()) {
+    fprintf(stderr,
+            "%s (%s): %zu packets, expected %zu.\n",
+            filename,
+            mode,
+            analyzer.count(),
+            reference.count());
+
+    return false;
+  }
+
+  for (size_t i = 0; i < reference.count(); i++) {
+    const net::ip::packet* const expected = reference.get(i);
+    const net::ip::packet* const pkt = analyzer.get(i);
+
+    if ((pkt->timestamp() != expected->timestamp()) ||
+        (pkt->length() != expected->length()) ||
+        (pkt->protocol() != expected->protocol()) ||
+        (pkt->l4length() != expected->l4length()) ||
+        (memcmp(pkt->l2(), expected->l2(), expected->length()) != 0)) {
+      fprintf(stderr, "%s (%s): packet %zu differs.\n", filename, mode, i);
+      return false;
+    }
+  }
+
+  printf("%s (%s): OK.\n", filename, mode);
+
+  return true;
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "util/numa.h"
+
+unsigned util::numa::nodes()
+{
+  unsigned count = 1;
+
+  // Format: list of ranges (e.g.: "0-1").
+  FILE* file = fopen("/sys/devices/system/node/possible", "r");
+  if (file) {
+    char buf[256];
+    if (fgets(buf, sizeof(buf), file)) {
+      // The last number is the highest node.
+      const char* p = buf + strlen(buf);
+      while ((p > buf) && ((p[-1] < '0') || (p[-1] > '9'))) {
+        p--;
+      }
+
+      while ((p > buf) && (p[-1] >= '0') && (p[-1] <= '9')) {
+        p--;
+      }
+
+      unsigned node;
+      if ((sscanf(p, "%u", &node) == 1) && (node < max_nodes)) {
+        count = node + 1;
+      }
+    }
+
+    fclose(file);
+  }
+
+  return count;
+}
+
+int util::numa::node_of_cpu(unsigned cpu)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+
+  // The directory of the CPU contains a link 'node<number>'.
+  DIR* dir = opendir(path);
+  if (dir) {
+    int node = -1;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      unsigned n;
+      if ((strncmp(entry->d_name, "node", 4) == 0) &&
+          (sscanf(entry->d_name + 4, "%u", &n) == 1)) {
+        node = static_cast<int>(n);
+        break;
+      }
+    }
+
+    closedir(dir);
+
+    return node;
+  }
+
+  return -1;
+}
+
+bool util::numa::pin(unsigned cpu)
+{
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+
+  return (pthread_setaffinity_np(pthread_self(),
+                                 sizeof(cpu_set_t),
+                                 &cpuset) == 0);
+}
+
+bool util::numa::bind_thread(unsigned node, policy& old)
+{
+  if (node < max_nodes) {
+    // Save current policy.
+    if (syscall(SYS_get_mempolicy,
+                &old.mode,
+                old.nodemask,
+                max_nodes,
+                nullptr,
+                0) == 0) {
+      unsigned long nodemask[max_nodes / (8 * sizeof(unsigned long))] = {0};
+      nodemask[node / (8 * sizeof(unsigned long))] =
+        1ul << (node % (8 * sizeof(unsigned long)));
+
+      return (syscall(SYS_set_mempolicy,
+                      MPOL_BIND,
+                      nodemask,
+                      max_nodes) == 0);
+    }
+  }
+
+  return false;
+}
+
+bool util::numa::restore(const policy& old)
+{
+  return (syscall(SYS_set_mempolicy,
+                  old.mode,
+                  (old.mode != MPOL_DEFAULT) ? old.nodemask : nullptr,
+                  (old.mode != MPOL_DEFAULT) ? max_nodes : 0) == 0);
+}
+
+void* util::numa::alloc(size_t size, int node, bool hugepages)
+{
+  if (size > 0) {
+    size = round_size(size);
+
+    void* ptr = MAP_FAILED;
+
+    // If the allocation spans at least a huge page...
+    if ((hugepages) && (size >= huge_page_size)) {
+      // Try with explicit huge pages first (they might not be reserved).
+      ptr = mmap(nullptr,
+                 size,
+                 PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                 -1,
+                 0);
+    }
+
+    if (ptr == MAP_FAILED) {
+      if ((ptr = mmap(nullptr,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0)) == MAP_FAILED) {
+        return nullptr;
+      }
+
+      // Fall back to transparent huge pages.
+      if ((hugepages) && (size >= huge_page_size)) {
+        madvise(ptr, size, MADV_HUGEPAGE);
+      }
+    }
+
+    if ((node >= 0) && (static_cast<size_t>(node) < max_nodes)) {
+      unsigned long nodemask[max_nodes / (8 * sizeof(unsigned long))] = {0};
+      nodemask[node / (8 * sizeof(unsigned long))] =
+        1ul << (node % (8 * sizeof(unsigned long)));
+
+      // Bind the memory to the node (the pages are allocated when they are
+      // first touched).
+      if (syscall(SYS_mbind,
+                  ptr,
+                  size,
+                  MPOL_BIND,
+                  nodemask,
+                  max_nodes,
+                  0) < 0) {
+        munmap(ptr, size);
+        return nullptr;
+      }
+    }
+
+    return ptr;
+  }
+
+  return nullptr;
+}
+
+void util::numa::free(void* ptr, size_t size)
+{
+  if (ptr) {
+    munmap(ptr, round_size(size));
+  }
+}
+
+size_t util::numa::round_size(size_t size)
+{
+  const size_t align = (size >= huge_page_size) ?
+                         huge_page_size :
+                         static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+  return (size + align - 1) & ~(align - 1);
+}
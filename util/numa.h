@@ -0,0 +1,55 @@
+#ifndef UTIL_NUMA_H
+#define UTIL_NUMA_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace util {
+  // NUMA helpers (raw system calls, libnuma is not required).
+  class numa {
+    public:
+      // Maximum number of NUMA nodes.
+      static constexpr const size_t max_nodes = 1024;
+
+      // Memory policy of a thread.
+      struct policy {
+        int mode;
+        unsigned long nodemask[max_nodes / (8 * sizeof(unsigned long))];
+      };
+
+      // Get number of configured NUMA nodes (1 if NUMA is not available).
+      static unsigned nodes();
+
+      // Get NUMA node of a CPU (-1: unknown).
+      static int node_of_cpu(unsigned cpu);
+
+      // Pin the calling thread to a CPU.
+      static bool pin(unsigned cpu);
+
+      // Bind the memory allocations of the calling thread to a NUMA node
+      // (the previous policy is saved in 'old').
+      static bool bind_thread(unsigned node, policy& old);
+
+      // Restore the memory policy of the calling thread.
+      static bool restore(const policy& old);
+
+      // Allocate memory (page-aligned, zeroed).
+      // 'node': NUMA node (-1: default placement).
+      // 'hugepages': prefer huge pages where the kernel allows it.
+      static void* alloc(size_t size, int node = -1, bool hugepages = false);
+
+      // Free memory allocated with alloc() ('size' must be the same size
+      // passed to alloc()).
+      static void free(void* ptr, size_t size);
+
+    private:
+      // Huge page size (2 MiB).
+      static constexpr const size_t
+             huge_page_size = static_cast<size_t>(1) << 21;
+
+      // Round size to the size actually mapped.
+      static size_t round_size(size_t size);
+  };
+}
+
+#endif // UTIL_NUMA_H